@@ -0,0 +1,22 @@
+#include "allocator.h"
+
+#include <stdlib.h>
+
+void* allocator_allocate(const allocator_t* allocator,
+                         size_t alignment,
+                         size_t size)
+{
+    if (allocator)
+        return allocator->allocate(allocator->context, alignment, size);
+
+    // aligned_alloc needs a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void allocator_free(const allocator_t* allocator, void* pointer, size_t size)
+{
+    if (allocator)
+        allocator->free(allocator->context, pointer, size);
+    else
+        free(pointer);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+/** Allocator of large buffers supplied by a user of the library. */
+typedef struct allocator
+{
+    // Returns 'size' bytes aligned to 'alignment' or NULL
+    void* (*allocate)(void* context, size_t alignment, size_t size);
+
+    // Frees 'pointer' of 'size' returned by 'allocate'
+    void (*free)(void* context, void* pointer, size_t size);
+
+    void* context;
+} allocator_t;
+
+/** Allocates 'size' bytes aligned to 'alignment', a power of two, by
+ * 'allocator' or by aligned_alloc if it is NULL.
+ * @return NULL if out of memory.
+ */
+void* allocator_allocate(const allocator_t* allocator,
+                         size_t alignment,
+                         size_t size);
+
+/** Frees 'pointer' of 'size' allocated by allocator_allocate with
+ * 'allocator'.
+ */
+void allocator_free(const allocator_t* allocator, void* pointer, size_t size);
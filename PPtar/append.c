@@ -0,0 +1,258 @@
+#include "append.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "archive_index.h"
+#include "creator.h"
+#include "pptar.h"
+
+/** Adds the free arguments to 'creator' and writes the archive of the -f
+ * option. Writes its index of the members in 'builder' and the new ones if an
+ * index was given. Lists the members to 'output'. Closes 'creator' and frees
+ * 'builder'.
+ * @return The exit code.
+ */
+static int write_archive(const options_t* options,
+                         creator_t* creator,
+                         output_t* output,
+                         archive_index_builder_t* builder)
+{
+    for (const char** i = options->free_arguments; *i != NULL; ++i)
+        if (!creator_add(creator, *i))
+        {
+            fprintf(stderr, "PPtar: Out of memory\n");
+            creator_close(creator);
+            archive_index_builder_destroy(builder);
+            return 2;
+        }
+
+    int return_code =
+        creator_write(creator,
+                      options->threads ? options->threads : CREATOR_DEFAULT_THREADS,
+                      options->dedup,
+                      options->verify,
+                      options->v ? output : NULL,
+                      options->index ? builder : NULL);
+
+    struct stat archive_stat;
+    bool indexable = return_code != 9 && options->index &&
+                     fstat(creator->fd, &archive_stat) == 0;
+
+    if (!creator_close(creator) && return_code != 9)
+    {
+        fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+        return_code = 9;
+        indexable = false;
+    }
+
+    if (indexable &&
+        !archive_index_builder_write(builder, options->index, &archive_stat))
+        fprintf(stderr,
+                "PPtar: Couldn't write index %s\n",
+                options->index); // not fatal
+
+    archive_index_builder_destroy(builder);
+    return return_code;
+}
+
+int append_create(const options_t* options, output_t* output, stats_t* stats)
+{
+    creator_t creator;
+
+    if (!compressor_is_supported(options->compression))
+    {
+        fprintf(stderr,
+                "PPtar: %s compression is not supported by this build\n",
+                options->compression == COMPRESSION_GZIP ? "gzip" : "zstd");
+        return 2;
+    }
+
+    if (!creator_open(&creator,
+                      options->f_argument,
+                      options->buffer_size,
+                      options->compression,
+                      stats))
+    {
+        fprintf(stderr, "PPtar: Couldn't create file %s\n", options->f_argument);
+        return 9;
+    }
+
+    archive_index_builder_t builder;
+    archive_index_builder_init(&builder);
+
+    return write_archive(options, &creator, output, &builder);
+}
+
+/** Finds the end of the archive 'source' from its current member, skipping
+ * the data. Adds the members to 'builder' unless it is NULL.
+ * @return The exit code.
+ */
+static int find_end(pptar_t* source, archive_index_builder_t* builder)
+{
+    while (true)
+    {
+        entry_t entry;
+        pptar_status_t status = pptar_next_entry(source, &entry);
+
+        if (status == PPTAR_END)
+            return 0;
+
+        switch (status)
+        {
+            case PPTAR_OK:
+                break;
+            case PPTAR_BAD_HEADER:
+                return pptar_check_header(source->header_status, source->typeflag);
+            case PPTAR_MALFORMED:
+                fprintf(stderr,
+                        "PPtar: Malformed extended header\n"
+                        "PPtar: Exiting with failure status due to previous "
+                        "errors\n");
+                return 2;
+            case PPTAR_NO_MEMORY:
+                fprintf(stderr, "PPtar: Out of memory\n");
+                return 2;
+            default:
+                pptar_check_read_error(&source->reader);
+                fprintf(stderr,
+                        "PPtar: Unexpected EOF in archive\n"
+                        "PPtar: Error is not recoverable: exiting now\n");
+                return 2;
+        }
+
+        if (builder)
+        {
+            archive_index_entry_t index_entry;
+
+            index_entry.name = entry.name;
+            index_entry.name_length = entry.name_length;
+            index_entry.header_offset = (uint64_t)source->entry_offset;
+            index_entry.size = entry.size;
+            index_entry.mtime = entry.mtime;
+
+            archive_index_builder_add(builder, &index_entry);
+        }
+    }
+}
+
+/** Reads the members of the archive 'source' into 'members' and finds its
+ * end. Starts from the last member of the index of the -f option if it is
+ * valid, otherwise from the start of the archive, adding the members only if
+ * they are needed.
+ * @return The exit code.
+ */
+static int read_members(const options_t* options,
+                        pptar_t* source,
+                        archive_index_builder_t* members)
+{
+    struct stat archive_stat;
+    archive_index_t index;
+
+    if (!options->index || fstat(source->reader.fd, &archive_stat) != 0 ||
+        !archive_index_open(&index, options->index, &archive_stat))
+        return find_end(source, options->u || options->index ? members : NULL);
+
+    uint64_t last_offset = 0;
+
+    for (size_t i = 0; i != index.entry_count; ++i)
+    {
+        archive_index_entry_t entry = archive_index_get(&index, i);
+
+        archive_index_builder_add(members, &entry);
+
+        if (entry.header_offset > last_offset)
+            last_offset = entry.header_offset;
+    }
+
+    archive_index_close(&index);
+
+    if (!reader_seek(&source->reader, (off_t)last_offset))
+    {
+        fprintf(stderr, "PPtar: Seek error: %s\n", strerror(errno));
+        return 2;
+    }
+
+    return find_end(source, NULL);
+}
+
+int append_archive(const options_t* options, output_t* output, stats_t* stats)
+{
+    pptar_t source;
+    pptar_options_t source_options = pptar_options_default();
+
+    source_options.buffer_size = options->buffer_size;
+
+    if (!pptar_open(&source, options->f_argument, &source_options))
+    {
+        if (errno == ENOENT)
+            return append_create(options, output, stats);
+
+        if (errno == ENOTSUP)
+            fprintf(stderr, "PPtar: Cannot update compressed archives\n");
+        else
+            fprintf(stderr,
+                    "PPtar: could not open file %s\n",
+                    options->f_argument);
+
+        return 2;
+    }
+
+    if (source.reader.decompressor || options->compression != COMPRESSION_NONE)
+    {
+        fprintf(stderr, "PPtar: Cannot update compressed archives\n");
+        pptar_close(&source);
+        return 2;
+    }
+
+    archive_index_builder_t members;
+    archive_index_builder_init(&members);
+
+    int return_code = read_members(options, &source, &members);
+    off_t end_offset = source.end_offset;
+
+    pptar_close(&source);
+
+    if (return_code == 0 && members.failed)
+    {
+        fprintf(stderr, "PPtar: Out of memory\n");
+        return_code = 2;
+    }
+
+    if (return_code != 0)
+    {
+        archive_index_builder_destroy(&members);
+        return return_code;
+    }
+
+    archive_index_builder_sort(&members);
+
+    // The new index has the old members and the appended ones
+    archive_index_builder_t builder;
+    archive_index_builder_init(&builder);
+
+    for (size_t i = 0; options->index && i != members.entry_count; ++i)
+        archive_index_builder_add(&builder, &members.entries[i].entry);
+
+    creator_t creator;
+
+    if (!creator_open_append(&creator,
+                             options->f_argument,
+                             (uint64_t)end_offset,
+                             options->buffer_size,
+                             options->u ? &members : NULL,
+                             stats))
+    {
+        fprintf(stderr, "PPtar: Couldn't open file %s\n", options->f_argument);
+        archive_index_builder_destroy(&builder);
+        archive_index_builder_destroy(&members);
+        return 9;
+    }
+
+    return_code = write_archive(options, &creator, output, &builder);
+
+    archive_index_builder_destroy(&members);
+    return return_code;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "options.h"
+#include "output.h"
+#include "stats.h"
+
+/** Creates the archive of the -f option from the free arguments.
+ * Writes its index if one was given. Lists the members to 'output' and
+ * collects statistics into 'stats' unless it is NULL.
+ * @return The exit code.
+ */
+int append_create(const options_t* options, output_t* output, stats_t* stats);
+
+/** Appends the free arguments to the archive of the -f option, with -u only
+ * the files newer than their members. Creates the archive if it does not
+ * exist. Updates its index if one was given. Lists the members to 'output'
+ * and collects statistics into 'stats' unless it is NULL.
+ * @return The exit code.
+ */
+int append_archive(const options_t* options, output_t* output, stats_t* stats);
@@ -0,0 +1,376 @@
+#include "archive_index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** Magic value at the start of an index. */
+#define ARCHIVE_INDEX_MAGIC "PPtarIdx"
+
+/** Version of the index format. */
+#define ARCHIVE_INDEX_VERSION ((uint64_t)1)
+
+/** Size of the index header. */
+#define ARCHIVE_INDEX_HEADER_SIZE ((size_t)56)
+
+/** Size of one entry in the index. */
+#define ARCHIVE_INDEX_ENTRY_SIZE ((size_t)40)
+
+/** Decodes a little endian 64-bit number. */
+static uint64_t load_u64(const unsigned char* data)
+{
+    uint64_t value = 0;
+
+    for (size_t i = 8; i-- != 0;)
+        value = value << 8 | data[i];
+
+    return value;
+}
+
+/** Encodes a little endian 64-bit number. */
+static void store_u64(unsigned char* data, uint64_t value)
+{
+    for (size_t i = 0; i != 8; ++i, value >>= 8)
+        data[i] = (unsigned char)value;
+}
+
+/** Encodes the identity of the archive with 'archive_stat' into
+ * 'identity'.
+ */
+static void store_identity(unsigned char* identity,
+                           const struct stat* archive_stat)
+{
+    store_u64(identity, (uint64_t)archive_stat->st_size);
+    store_u64(identity + 8, (uint64_t)archive_stat->st_mtim.tv_sec);
+    store_u64(identity + 16, (uint64_t)archive_stat->st_mtim.tv_nsec);
+}
+
+bool archive_index_open(archive_index_t* index,
+                        const char* path,
+                        const struct stat* archive_stat)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat index_stat;
+    if (fstat(fd, &index_stat) != 0 ||
+        (size_t)index_stat.st_size < ARCHIVE_INDEX_HEADER_SIZE)
+    {
+        close(fd);
+        return false;
+    }
+
+    index->map_size = (size_t)index_stat.st_size;
+    void* map = mmap(NULL, index->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    index->map = map;
+
+    unsigned char identity[24];
+    store_identity(identity, archive_stat);
+
+    index->entry_count = (size_t)load_u64(index->map + 40);
+    index->names_size = (size_t)load_u64(index->map + 48);
+    index->entries = index->map + ARCHIVE_INDEX_HEADER_SIZE;
+    index->names = (const char*)index->entries +
+                   index->entry_count * ARCHIVE_INDEX_ENTRY_SIZE;
+
+    if (memcmp(index->map, ARCHIVE_INDEX_MAGIC, 8) != 0 ||
+        load_u64(index->map + 8) != ARCHIVE_INDEX_VERSION ||
+        memcmp(index->map + 16, identity, sizeof(identity)) != 0 ||
+        index->entry_count >
+            (index->map_size - ARCHIVE_INDEX_HEADER_SIZE) /
+                ARCHIVE_INDEX_ENTRY_SIZE ||
+        ARCHIVE_INDEX_HEADER_SIZE +
+                index->entry_count * ARCHIVE_INDEX_ENTRY_SIZE +
+                index->names_size !=
+            index->map_size)
+    {
+        archive_index_close(index);
+        return false;
+    }
+
+    madvise(map, index->map_size, MADV_RANDOM);
+
+    return true;
+}
+
+void archive_index_close(archive_index_t* index)
+{
+    munmap((void*)index->map, index->map_size);
+}
+
+archive_index_entry_t archive_index_get(const archive_index_t* index,
+                                        size_t position)
+{
+    const unsigned char* data =
+        index->entries + position * ARCHIVE_INDEX_ENTRY_SIZE;
+    archive_index_entry_t entry;
+
+    entry.header_offset = load_u64(data);
+    entry.size = load_u64(data + 8);
+    entry.mtime = load_u64(data + 16);
+
+    uint64_t name_offset = load_u64(data + 24);
+    uint64_t name_length = load_u64(data + 32);
+
+    // A corrupted name is treated as empty
+    if (name_offset > index->names_size ||
+        name_length > index->names_size - name_offset)
+        name_offset = name_length = 0;
+
+    entry.name = index->names + name_offset;
+    entry.name_length = (size_t)name_length;
+
+    return entry;
+}
+
+/** Compares names 'a' of 'a_length' and 'b' of 'b_length'. */
+static int compare_names(const char* a,
+                         size_t a_length,
+                         const char* b,
+                         size_t b_length)
+{
+    int result = memcmp(a, b, a_length < b_length ? a_length : b_length);
+
+    if (result != 0)
+        return result;
+
+    return a_length < b_length ? -1 : a_length > b_length ? 1 : 0;
+}
+
+size_t archive_index_find(const archive_index_t* index,
+                          const char* name,
+                          size_t length)
+{
+    size_t low = 0;
+    size_t high = index->entry_count;
+
+    while (low != high)
+    {
+        size_t middle = low + (high - low) / 2;
+        archive_index_entry_t entry = archive_index_get(index, middle);
+
+        if (compare_names(entry.name, entry.name_length, name, length) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low != index->entry_count)
+    {
+        archive_index_entry_t entry = archive_index_get(index, low);
+
+        if (compare_names(entry.name, entry.name_length, name, length) == 0)
+            return low;
+    }
+
+    return index->entry_count;
+}
+
+void archive_index_builder_init(archive_index_builder_t* builder)
+{
+    builder->entries = NULL;
+    builder->entry_count = 0;
+    builder->entry_capacity = 0;
+
+    builder->names = NULL;
+    builder->names_size = 0;
+    builder->names_capacity = 0;
+
+    builder->failed = false;
+}
+
+void archive_index_builder_destroy(archive_index_builder_t* builder)
+{
+    free(builder->entries);
+    free(builder->names);
+}
+
+/** Grows the array at '*data' of '*capacity' elements of 'element_size' to
+ * fit 'size' elements.
+ */
+static bool grow(void** data, size_t* capacity, size_t size, size_t element_size)
+{
+    if (size <= *capacity)
+        return true;
+
+    size_t new_capacity = *capacity != 0 ? *capacity : 64;
+    while (new_capacity < size)
+        new_capacity *= 2;
+
+    void* new_data = realloc(*data, new_capacity * element_size);
+    if (!new_data)
+        return false;
+
+    *data = new_data;
+    *capacity = new_capacity;
+    return true;
+}
+
+void archive_index_builder_add(archive_index_builder_t* builder,
+                               const archive_index_entry_t* entry)
+{
+    if (builder->failed ||
+        !grow((void**)&builder->entries,
+              &builder->entry_capacity,
+              builder->entry_count + 1,
+              sizeof(archive_index_builder_entry_t)) ||
+        !grow((void**)&builder->names,
+              &builder->names_capacity,
+              builder->names_size + entry->name_length,
+              sizeof(char)))
+    {
+        builder->failed = true;
+        return;
+    }
+
+    archive_index_builder_entry_t* builder_entry =
+        builder->entries + builder->entry_count++;
+
+    builder_entry->entry = *entry;
+    builder_entry->name_offset = builder->names_size;
+
+    memcpy(builder->names + builder->names_size,
+           entry->name,
+           entry->name_length);
+    builder->names_size += entry->name_length;
+}
+
+/** Orders builder entries by name and then by header offset. */
+static int compare_builder_entries(const void* a_void, const void* b_void)
+{
+    const archive_index_entry_t* a =
+        &((const archive_index_builder_entry_t*)a_void)->entry;
+    const archive_index_entry_t* b =
+        &((const archive_index_builder_entry_t*)b_void)->entry;
+
+    int result = compare_names(a->name, a->name_length, b->name, b->name_length);
+
+    if (result != 0)
+        return result;
+
+    return a->header_offset < b->header_offset   ? -1
+           : a->header_offset > b->header_offset ? 1
+                                                 : 0;
+}
+
+void archive_index_builder_sort(archive_index_builder_t* builder)
+{
+    for (archive_index_builder_entry_t* i = builder->entries;
+         i != builder->entries + builder->entry_count;
+         ++i)
+        i->entry.name = builder->names + i->name_offset;
+
+    if (builder->entry_count != 0)
+        qsort(builder->entries,
+              builder->entry_count,
+              sizeof(archive_index_builder_entry_t),
+              compare_builder_entries);
+}
+
+bool archive_index_builder_find_mtime(const archive_index_builder_t* builder,
+                                      const char* name,
+                                      size_t length,
+                                      uint64_t* mtime)
+{
+    // The first entry ordered after all of the name
+    size_t low = 0;
+    size_t high = builder->entry_count;
+
+    while (low != high)
+    {
+        size_t middle = low + (high - low) / 2;
+        const archive_index_entry_t* entry = &builder->entries[middle].entry;
+
+        if (compare_names(entry->name, entry->name_length, name, length) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low == 0)
+        return false;
+
+    const archive_index_entry_t* entry = &builder->entries[low - 1].entry;
+
+    if (compare_names(entry->name, entry->name_length, name, length) != 0)
+        return false;
+
+    *mtime = entry->mtime;
+    return true;
+}
+
+bool archive_index_builder_write(archive_index_builder_t* builder,
+                                 const char* path,
+                                 const struct stat* archive_stat)
+{
+    if (builder->failed)
+        return false;
+
+    archive_index_builder_sort(builder);
+
+    size_t path_length = strlen(path);
+    char* temporary_path = malloc(path_length + sizeof(".XXXXXX"));
+    if (!temporary_path)
+        return false;
+
+    memcpy(temporary_path, path, path_length);
+    memcpy(temporary_path + path_length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int fd = mkstemp(temporary_path);
+    FILE* file = fd != -1 && fchmod(fd, 0644) == 0 ? fdopen(fd, "wb") : NULL;
+
+    if (!file)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+            unlink(temporary_path);
+        }
+        free(temporary_path);
+        return false;
+    }
+
+    unsigned char header[ARCHIVE_INDEX_HEADER_SIZE];
+    memcpy(header, ARCHIVE_INDEX_MAGIC, 8);
+    store_u64(header + 8, ARCHIVE_INDEX_VERSION);
+    store_identity(header + 16, archive_stat);
+    store_u64(header + 40, builder->entry_count);
+    store_u64(header + 48, builder->names_size);
+
+    bool success = fwrite(header, sizeof(header), 1, file) == 1;
+
+    for (const archive_index_builder_entry_t* i = builder->entries;
+         success && i != builder->entries + builder->entry_count;
+         ++i)
+    {
+        unsigned char data[ARCHIVE_INDEX_ENTRY_SIZE];
+
+        store_u64(data, i->entry.header_offset);
+        store_u64(data + 8, i->entry.size);
+        store_u64(data + 16, i->entry.mtime);
+        store_u64(data + 24, i->name_offset);
+        store_u64(data + 32, i->entry.name_length);
+
+        success = fwrite(data, sizeof(data), 1, file) == 1;
+    }
+
+    success = success && (builder->names_size == 0 ||
+                          fwrite(builder->names, builder->names_size, 1, file) == 1);
+    success = fclose(file) == 0 && success;
+    success = success && rename(temporary_path, path) == 0;
+
+    if (!success)
+        unlink(temporary_path);
+
+    free(temporary_path);
+    return success;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/** One member of an archive index. */
+typedef struct archive_index_entry
+{
+    const char* name;
+    size_t name_length;
+
+    // Offset of the header of the member in the archive
+    uint64_t header_offset;
+
+    uint64_t size;
+    uint64_t mtime;
+} archive_index_entry_t;
+
+/** Sidecar index of an archive mapping member names to their headers.
+ * The file consists of a header, entries sorted by name and then by offset,
+ * and a blob of the names. All numbers are 64-bit little endian.
+ * The index is mapped and searched in place.
+ */
+typedef struct archive_index
+{
+    const unsigned char* map;
+    size_t map_size;
+
+    const unsigned char* entries;
+    size_t entry_count;
+
+    const char* names;
+    size_t names_size;
+} archive_index_t;
+
+/** Entry of an archive index builder. */
+typedef struct archive_index_builder_entry
+{
+    archive_index_entry_t entry;
+
+    // Offset of the name in the names of the builder
+    size_t name_offset;
+} archive_index_builder_entry_t;
+
+/** Builder of an archive index, collects entries during a pass over the
+ * archive.
+ */
+typedef struct archive_index_builder
+{
+    archive_index_builder_entry_t* entries;
+    size_t entry_count;
+    size_t entry_capacity;
+
+    char* names;
+    size_t names_size;
+    size_t names_capacity;
+
+    // An allocation failed, the index is not written
+    bool failed;
+} archive_index_builder_t;
+
+/** Opens the index at 'path' if it exists and belongs to the archive with
+ * 'archive_stat'.
+ * @return false if the index does not exist, is invalid or stale.
+ */
+bool archive_index_open(archive_index_t* index,
+                        const char* path,
+                        const struct stat* archive_stat);
+
+/** Closes 'index'. */
+void archive_index_close(archive_index_t* index);
+
+/** Returns the position of the first entry of 'name' of 'length' in 'index'
+ * or the entry count if there is none. Entries of the same name follow it.
+ */
+size_t archive_index_find(const archive_index_t* index,
+                          const char* name,
+                          size_t length);
+
+/** Reads the entry at 'position' of 'index'. */
+archive_index_entry_t archive_index_get(const archive_index_t* index,
+                                        size_t position);
+
+/** Initializes an empty 'builder'. */
+void archive_index_builder_init(archive_index_builder_t* builder);
+
+/** Frees the memory of 'builder'. */
+void archive_index_builder_destroy(archive_index_builder_t* builder);
+
+/** Adds an entry to 'builder', copying its name. */
+void archive_index_builder_add(archive_index_builder_t* builder,
+                               const archive_index_entry_t* entry);
+
+/** Sorts the entries of 'builder' by name and then by header offset, so
+ * they can be found.
+ */
+void archive_index_builder_sort(archive_index_builder_t* builder);
+
+/** Finds the last member named 'name' of 'length' in the sorted 'builder' and
+ * writes its modification time to '*mtime'.
+ * @return false if there is no such member.
+ */
+bool archive_index_builder_find_mtime(const archive_index_builder_t* builder,
+                                      const char* name,
+                                      size_t length,
+                                      uint64_t* mtime);
+
+/** Writes the index of the archive with 'archive_stat' to 'path'.
+ * The index is written to a temporary file which is then renamed.
+ * @return false on failure.
+ */
+bool archive_index_builder_write(archive_index_builder_t* builder,
+                                 const char* path,
+                                 const struct stat* archive_stat);
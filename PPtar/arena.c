@@ -0,0 +1,85 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void arena_init(arena_t* arena)
+{
+    arena->blocks = NULL;
+    arena->current = NULL;
+}
+
+void arena_destroy(arena_t* arena)
+{
+    while (arena->blocks)
+    {
+        arena_block_t* block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+
+    arena->current = NULL;
+}
+
+void* arena_alloc(arena_t* arena, size_t size)
+{
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) *
+           sizeof(max_align_t);
+
+    // Blocks after the current one are free since the last reset
+    for (arena_block_t* block = arena->current; block; block = block->next)
+    {
+        if (block->size - block->used >= size)
+        {
+            arena->current = block;
+
+            void* allocation = (char*)block->data + block->used;
+            block->used += size;
+            return allocation;
+        }
+    }
+
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    arena_block_t* block = malloc(sizeof(arena_block_t) + block_size);
+    if (!block)
+        return NULL;
+
+    block->size = block_size;
+    block->used = size;
+
+    // Full blocks stay before the current one
+    if (arena->current)
+    {
+        block->next = arena->current->next;
+        arena->current->next = block;
+    }
+    else
+    {
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    arena->current = block;
+    return block->data;
+}
+
+char* arena_strndup(arena_t* arena, const char* string, size_t length)
+{
+    char* copy = arena_alloc(arena, length + 1);
+
+    if (copy)
+    {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+
+    return copy;
+}
+
+void arena_reset(arena_t* arena)
+{
+    for (arena_block_t* block = arena->blocks; block; block = block->next)
+        block->used = 0;
+
+    arena->current = arena->blocks;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Default size of a block of an arena. */
+#define ARENA_BLOCK_SIZE ((size_t)64 << 10)
+
+/** Block of memory of an arena. */
+typedef struct arena_block
+{
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} arena_block_t;
+
+/** Bump allocator of memory which is freed all at once.
+ * Allocations never move, the blocks are kept for reuse after a reset.
+ */
+typedef struct arena
+{
+    arena_block_t* blocks;
+
+    // The block allocations are taken from
+    arena_block_t* current;
+} arena_t;
+
+/** Initializes an empty 'arena'. */
+void arena_init(arena_t* arena);
+
+/** Frees the memory of 'arena'. */
+void arena_destroy(arena_t* arena);
+
+/** Allocates 'size' bytes aligned for any type from 'arena'.
+ * @return NULL if out of memory.
+ */
+void* arena_alloc(arena_t* arena, size_t size);
+
+/** Copies 'length' bytes of 'string' into 'arena' and terminates them by a
+ * NUL.
+ * @return NULL if out of memory.
+ */
+char* arena_strndup(arena_t* arena, const char* string, size_t length);
+
+/** Frees all allocations of 'arena' at once. */
+void arena_reset(arena_t* arena);
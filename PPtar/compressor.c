@@ -0,0 +1,472 @@
+#include "compressor.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PPTAR_HAVE_ZLIB
+    #include <zlib.h>
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+#include "writer.h"
+
+/** Alignment of the chunks. */
+#define COMPRESSOR_ALIGNMENT ((size_t)4096)
+
+bool compressor_is_supported(compression_t compression)
+{
+    switch (compression)
+    {
+        case COMPRESSION_NONE:
+            return true;
+#ifdef PPTAR_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+            return true;
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/** Creates the state of the compressor library for 'compression' or returns
+ * NULL on failure.
+ */
+static void* compressor_context_create(compression_t compression)
+{
+#ifdef PPTAR_HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP)
+    {
+        z_stream* stream = calloc(1, sizeof(z_stream));
+
+        // Window bits over 15 select the gzip wrapper
+        if (stream && deflateInit2(stream,
+                                   Z_DEFAULT_COMPRESSION,
+                                   Z_DEFLATED,
+                                   15 + 16,
+                                   8,
+                                   Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            free(stream);
+            stream = NULL;
+        }
+
+        return stream;
+    }
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+    {
+        ZSTD_CCtx* context = ZSTD_createCCtx();
+
+        if (context &&
+            ZSTD_isError(ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1)))
+        {
+            ZSTD_freeCCtx(context);
+            context = NULL;
+        }
+
+        return context;
+    }
+#endif
+
+    (void)compression;
+    return NULL;
+}
+
+/** Frees 'context' created for 'compression'. */
+static void compressor_context_destroy(compression_t compression, void* context)
+{
+#ifdef PPTAR_HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP && context)
+    {
+        deflateEnd(context);
+        free(context);
+    }
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+        ZSTD_freeCCtx(context);
+#endif
+
+    (void)compression;
+    (void)context;
+}
+
+/** Compresses the input of 'job' into a new output with 'context'.
+ * @return false on failure.
+ */
+static bool compressor_compress(compression_t compression,
+                                void* context,
+                                compressor_job_t* job)
+{
+    if (!context)
+        return false;
+
+#ifdef PPTAR_HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP)
+    {
+        z_stream* stream = context;
+
+        if (deflateReset(stream) != Z_OK)
+            return false;
+
+        uLong bound = deflateBound(stream, (uLong)job->input_size);
+        if (!(job->output = malloc(bound)))
+            return false;
+
+        stream->next_in = (Bytef*)job->input;
+        stream->avail_in = (uInt)job->input_size;
+        stream->next_out = (Bytef*)job->output;
+        stream->avail_out = (uInt)bound;
+
+        if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+            return false;
+
+        job->output_size = bound - stream->avail_out;
+        return true;
+    }
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+    {
+        size_t bound = ZSTD_compressBound(job->input_size);
+        if (!(job->output = malloc(bound)))
+            return false;
+
+        size_t size =
+            ZSTD_compress2(context, job->output, bound, job->input, job->input_size);
+        if (ZSTD_isError(size))
+            return false;
+
+        job->output_size = size;
+        return true;
+    }
+#endif
+
+    (void)compression;
+    (void)job;
+    return false;
+}
+
+/** Returns the compressed input of 'job' to the free chunks.
+ * The mutex of 'compressor' has to be locked.
+ */
+static void compressor_recycle_input(compressor_t* compressor,
+                                     compressor_job_t* job)
+{
+    if (compressor->free_chunk_count != compressor->max_job_count + 2)
+        compressor->free_chunks[compressor->free_chunk_count++] = job->input;
+    else
+        free(job->input);
+
+    job->input = NULL;
+}
+
+/** Main function of a compressor thread. */
+static void* compressor_run(void* compressor_void)
+{
+    compressor_t* compressor = compressor_void;
+    void* context = compressor_context_create(compressor->compression);
+
+    pthread_mutex_lock(&compressor->mutex);
+
+    while (true)
+    {
+        while (!compressor->next_job && !compressor->stopping)
+            pthread_cond_wait(&compressor->not_empty, &compressor->mutex);
+
+        compressor_job_t* job = compressor->next_job;
+        if (!job)
+            break;
+
+        compressor->next_job = job->next;
+
+        pthread_mutex_unlock(&compressor->mutex);
+
+        bool success = compressor_compress(compressor->compression, context, job);
+
+        pthread_mutex_lock(&compressor->mutex);
+
+        compressor_recycle_input(compressor, job);
+        job->failed = !success;
+        job->done = true;
+        pthread_cond_signal(&compressor->done);
+    }
+
+    pthread_mutex_unlock(&compressor->mutex);
+
+    compressor_context_destroy(compressor->compression, context);
+    return NULL;
+}
+
+bool compressor_init(compressor_t* compressor,
+                     int fd,
+                     compression_t compression,
+                     size_t chunk_size,
+                     size_t thread_count,
+                     stats_t* stats)
+{
+    compressor->compression = compression;
+    compressor->fd = fd;
+    compressor->chunk_size = chunk_size;
+    compressor->head = NULL;
+    compressor->tail = NULL;
+    compressor->next_job = NULL;
+    compressor->job_count = 0;
+    compressor->max_job_count = 2 * thread_count;
+    compressor->free_chunk_count = 0;
+    compressor->stopping = false;
+    compressor->frame_sizes = NULL;
+    compressor->frame_count = 0;
+    compressor->frame_capacity = 0;
+    compressor->stats = stats;
+    compressor->thread_count = 0;
+
+    compressor->threads = malloc(sizeof(pthread_t) * thread_count);
+    compressor->free_chunks =
+        malloc(sizeof(char*) * (compressor->max_job_count + 2));
+
+    if (!compressor->threads || !compressor->free_chunks)
+    {
+        free(compressor->threads);
+        free(compressor->free_chunks);
+        return false;
+    }
+
+    pthread_mutex_init(&compressor->mutex, NULL);
+    pthread_cond_init(&compressor->not_empty, NULL);
+    pthread_cond_init(&compressor->done, NULL);
+
+    for (; compressor->thread_count != thread_count; ++compressor->thread_count)
+        if (pthread_create(compressor->threads + compressor->thread_count,
+                           NULL,
+                           compressor_run,
+                           compressor) != 0)
+            break;
+
+    if (compressor->thread_count == 0)
+    {
+        compressor_destroy(compressor);
+        return false;
+    }
+
+    return true;
+}
+
+char* compressor_get_chunk(compressor_t* compressor)
+{
+    char* chunk = NULL;
+
+    pthread_mutex_lock(&compressor->mutex);
+
+    if (compressor->free_chunk_count != 0)
+        chunk = compressor->free_chunks[--compressor->free_chunk_count];
+
+    pthread_mutex_unlock(&compressor->mutex);
+
+    return chunk ? chunk
+                 : aligned_alloc(COMPRESSOR_ALIGNMENT, compressor->chunk_size);
+}
+
+/** Stores 'value' as 4 little-endian bytes at 'data'. */
+static void store_u32(unsigned char* data, uint32_t value)
+{
+    for (size_t i = 0; i != 4; ++i)
+        data[i] = (unsigned char)(value >> (8 * i));
+}
+
+/** Writes the compressed output of 'job' and records its frame.
+ * @return false on failure, errno is set.
+ */
+static bool compressor_write_job(compressor_t* compressor,
+                                 const compressor_job_t* job)
+{
+    if (job->failed)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    if (compressor->compression == COMPRESSION_ZSTD)
+    {
+        if (compressor->frame_count == compressor->frame_capacity)
+        {
+            size_t capacity =
+                compressor->frame_capacity ? 2 * compressor->frame_capacity : 64;
+            uint32_t* frame_sizes = realloc(compressor->frame_sizes,
+                                            2 * sizeof(uint32_t) * capacity);
+            if (!frame_sizes)
+                return false;
+
+            compressor->frame_sizes = frame_sizes;
+            compressor->frame_capacity = capacity;
+        }
+
+        uint32_t* frame = compressor->frame_sizes + 2 * compressor->frame_count++;
+        frame[0] = (uint32_t)job->output_size;
+        frame[1] = (uint32_t)job->input_size;
+    }
+
+    uint64_t start = compressor->stats ? stats_now() : 0;
+
+    if (!write_all(compressor->fd, job->output, job->output_size))
+        return false;
+
+    if (compressor->stats)
+    {
+        compressor->stats->output_time += stats_now() - start;
+        compressor->stats->bytes_written += job->output_size;
+    }
+
+    return true;
+}
+
+/** Writes the compressed jobs at the head of 'compressor', waiting for them
+ * while more than 'max_job_count' jobs are not written.
+ * @return false on failure, errno is set.
+ */
+static bool compressor_write_jobs(compressor_t* compressor, size_t max_job_count)
+{
+    pthread_mutex_lock(&compressor->mutex);
+
+    while (compressor->head &&
+           (compressor->head->done || compressor->job_count > max_job_count))
+    {
+        while (!compressor->head->done)
+            pthread_cond_wait(&compressor->done, &compressor->mutex);
+
+        compressor_job_t* job = compressor->head;
+
+        compressor->head = job->next;
+        if (!compressor->head)
+            compressor->tail = NULL;
+        --compressor->job_count;
+
+        pthread_mutex_unlock(&compressor->mutex);
+
+        bool success = compressor_write_job(compressor, job);
+
+        free(job->output);
+        free(job);
+
+        if (!success)
+            return false;
+
+        pthread_mutex_lock(&compressor->mutex);
+    }
+
+    pthread_mutex_unlock(&compressor->mutex);
+
+    return true;
+}
+
+bool compressor_submit(compressor_t* compressor, char* data, size_t size)
+{
+    compressor_job_t* job = malloc(sizeof(compressor_job_t));
+    if (!job)
+    {
+        free(data);
+        return false;
+    }
+
+    job->next = NULL;
+    job->input = data;
+    job->input_size = size;
+    job->output = NULL;
+    job->output_size = 0;
+    job->done = false;
+    job->failed = false;
+
+    pthread_mutex_lock(&compressor->mutex);
+
+    if (compressor->tail)
+        compressor->tail->next = job;
+    else
+        compressor->head = job;
+    compressor->tail = job;
+
+    if (!compressor->next_job)
+        compressor->next_job = job;
+    ++compressor->job_count;
+
+    pthread_cond_signal(&compressor->not_empty);
+
+    pthread_mutex_unlock(&compressor->mutex);
+
+    return compressor_write_jobs(compressor, compressor->max_job_count);
+}
+
+bool compressor_finish(compressor_t* compressor)
+{
+    if (!compressor_write_jobs(compressor, 0))
+        return false;
+
+    if (compressor->compression != COMPRESSION_ZSTD)
+        return true;
+
+    // Skippable frame with the frame sizes and the seekable footer
+    size_t table_size =
+        8 + 8 * compressor->frame_count + ZSTD_SEEKABLE_FOOTER_SIZE;
+    unsigned char* table = malloc(table_size);
+    if (!table)
+        return false;
+
+    store_u32(table, ZSTD_SKIPPABLE_SEEK_TABLE_MAGIC);
+    store_u32(table + 4, (uint32_t)(table_size - 8));
+
+    for (size_t i = 0; i != 2 * compressor->frame_count; ++i)
+        store_u32(table + 8 + 4 * i, compressor->frame_sizes[i]);
+
+    unsigned char* footer = table + table_size - ZSTD_SEEKABLE_FOOTER_SIZE;
+    store_u32(footer, (uint32_t)compressor->frame_count);
+    footer[4] = 0;
+    store_u32(footer + 5, ZSTD_SEEKABLE_MAGIC);
+
+    bool success = write_all(compressor->fd, (const char*)table, table_size);
+
+    if (success && compressor->stats)
+        compressor->stats->bytes_written += table_size;
+
+    free(table);
+    return success;
+}
+
+void compressor_destroy(compressor_t* compressor)
+{
+    pthread_mutex_lock(&compressor->mutex);
+    compressor->stopping = true;
+    compressor->next_job = NULL;
+    pthread_cond_broadcast(&compressor->not_empty);
+    pthread_mutex_unlock(&compressor->mutex);
+
+    for (size_t i = 0; i != compressor->thread_count; ++i)
+        pthread_join(compressor->threads[i], NULL);
+
+    while (compressor->head)
+    {
+        compressor_job_t* job = compressor->head;
+        compressor->head = job->next;
+
+        free(job->input);
+        free(job->output);
+        free(job);
+    }
+
+    for (size_t i = 0; i != compressor->free_chunk_count; ++i)
+        free(compressor->free_chunks[i]);
+
+    pthread_cond_destroy(&compressor->done);
+    pthread_cond_destroy(&compressor->not_empty);
+    pthread_mutex_destroy(&compressor->mutex);
+
+    free(compressor->free_chunks);
+    free(compressor->frame_sizes);
+    free(compressor->threads);
+}
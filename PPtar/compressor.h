@@ -0,0 +1,103 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decompressor.h"
+#include "stats.h"
+
+/** Piece of work for a compressor thread: one chunk of the archive. */
+typedef struct compressor_job
+{
+    struct compressor_job* next;
+
+    char* input;
+    size_t input_size;
+
+    char* output;
+    size_t output_size;
+
+    bool done;
+    bool failed;
+} compressor_job_t;
+
+/** Parallel compression stage between a creator and the archive.
+ * The archive is cut into chunks, which the threads compress independently
+ * into gzip members or zstd frames. The chunks are written in order and a
+ * zstd archive ends with a seek table of its frames. The number of chunks in
+ * flight is bounded, a full stage blocks the writer.
+ */
+typedef struct compressor
+{
+    compression_t compression;
+    int fd;
+
+    // Capacity of the chunks
+    size_t chunk_size;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t done;
+
+    pthread_t* threads;
+    size_t thread_count;
+
+    // Jobs not written yet, the first of them not taken by a thread
+    compressor_job_t* head;
+    compressor_job_t* tail;
+    compressor_job_t* next_job;
+    size_t job_count;
+    size_t max_job_count;
+
+    // Chunks which were compressed already, to be filled again
+    char** free_chunks;
+    size_t free_chunk_count;
+
+    bool stopping;
+
+    // Compressed and decompressed sizes of the written frames
+    uint32_t* frame_sizes;
+    size_t frame_count;
+    size_t frame_capacity;
+
+    // Statistics to collect or NULL
+    stats_t* stats;
+} compressor_t;
+
+/** Checks if creating archives with 'compression' is supported by this
+ * build.
+ */
+bool compressor_is_supported(compression_t compression);
+
+/** Starts 'compressor' with 'thread_count' threads writing the archive
+ * compressed with 'compression' to 'fd' in chunks of 'chunk_size' bytes.
+ * Collects output statistics into 'stats' unless it is NULL.
+ * @return false on failure.
+ */
+bool compressor_init(compressor_t* compressor,
+                     int fd,
+                     compression_t compression,
+                     size_t chunk_size,
+                     size_t thread_count,
+                     stats_t* stats);
+
+/** Returns an aligned chunk to be filled and passed to compressor_submit or
+ * NULL if out of memory.
+ */
+char* compressor_get_chunk(compressor_t* compressor);
+
+/** Compresses the chunk 'data' of 'size' bytes filled and takes its
+ * ownership. Writes the chunks which are compressed already.
+ * @return false on failure, errno is set.
+ */
+bool compressor_submit(compressor_t* compressor, char* data, size_t size);
+
+/** Writes all chunks and the seek table of a zstd archive.
+ * @return false on failure, errno is set.
+ */
+bool compressor_finish(compressor_t* compressor);
+
+/** Stops the threads and frees the memory of 'compressor'. */
+void compressor_destroy(compressor_t* compressor);
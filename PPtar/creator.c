@@ -0,0 +1,1315 @@
+#include "creator.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "header.h"
+#include "reader.h"
+#include "sha256.h"
+#include "writer.h"
+
+/** Alignment of the output buffer. */
+#define CREATOR_ALIGNMENT ((size_t)4096)
+
+/** Initializes 'creator' writing the archive 'fd' from its current offset.
+ * Closes 'fd' on failure.
+ * @return false on failure, errno is set.
+ */
+static bool creator_init(creator_t* creator,
+                         int fd,
+                         size_t buffer_size,
+                         compression_t compression,
+                         stats_t* stats)
+{
+    creator->fd = fd;
+
+    size_t capacity =
+        (buffer_size + CREATOR_ALIGNMENT - 1) / CREATOR_ALIGNMENT *
+        CREATOR_ALIGNMENT;
+
+    long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    creator->compressed = compression != COMPRESSION_NONE;
+
+    if (fstat(creator->fd, &creator->archive_stat) != 0 ||
+        (creator->compressed &&
+         !compressor_init(&creator->compressor,
+                          creator->fd,
+                          compression,
+                          capacity,
+                          processor_count > 0 ? (size_t)processor_count : 1,
+                          stats)))
+    {
+        int error = errno;
+        close(creator->fd);
+        errno = error;
+        return false;
+    }
+
+    creator->buffer = creator->compressed
+                          ? compressor_get_chunk(&creator->compressor)
+                          : aligned_alloc(CREATOR_ALIGNMENT, capacity);
+    if (!creator->buffer)
+    {
+        if (creator->compressed)
+            compressor_destroy(&creator->compressor);
+        close(creator->fd);
+        errno = ENOMEM;
+        return false;
+    }
+
+    creator->capacity = capacity;
+    creator->fill = 0;
+    creator->offset = 0;
+    creator->paths = NULL;
+    creator->paths_size = 0;
+    creator->paths_capacity = 0;
+    creator->files = NULL;
+    creator->file_count = 0;
+    creator->file_capacity = 0;
+    creator->threads = NULL;
+    creator->thread_count = 0;
+    creator->next_file = 0;
+    creator->write_index = 0;
+    creator->bytes_in_flight = 0;
+    creator->max_bytes_in_flight = CREATOR_DEFAULT_MAX_BYTES_IN_FLIGHT;
+    creator->stopping = false;
+    creator->error_code = 0;
+    creator->existing = NULL;
+    creator->deduplicating = false;
+    creator->digesting = false;
+    creator->removed_slash = false;
+    creator->has_owner = false;
+    creator->stats = stats;
+
+    dedup_init(&creator->dedup);
+
+    pthread_mutex_init(&creator->mutex, NULL);
+    pthread_cond_init(&creator->ready, NULL);
+    pthread_cond_init(&creator->not_full, NULL);
+
+    return true;
+}
+
+bool creator_open(creator_t* creator,
+                  const char* path,
+                  size_t buffer_size,
+                  compression_t compression,
+                  stats_t* stats)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    return fd != -1 && creator_init(creator, fd, buffer_size, compression, stats);
+}
+
+bool creator_open_append(creator_t* creator,
+                         const char* path,
+                         uint64_t offset,
+                         size_t buffer_size,
+                         const archive_index_builder_t* existing,
+                         stats_t* stats)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd == -1)
+        return false;
+
+    // The old end and anything after it is dropped
+    if (ftruncate(fd, (off_t)offset) != 0 ||
+        lseek(fd, (off_t)offset, SEEK_SET) == -1)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+
+    if (!creator_init(creator, fd, buffer_size, COMPRESSION_NONE, stats))
+        return false;
+
+    creator->offset = offset;
+    creator->existing = existing;
+
+    return true;
+}
+
+bool creator_close(creator_t* creator)
+{
+    for (creator_file_t* i = creator->files;
+         i != creator->files + creator->file_count;
+         ++i)
+    {
+        if (i->fd != -1)
+            close(i->fd);
+        free(i->data);
+    }
+
+    if (creator->compressed)
+        compressor_destroy(&creator->compressor);
+
+    pthread_cond_destroy(&creator->not_full);
+    pthread_cond_destroy(&creator->ready);
+    pthread_mutex_destroy(&creator->mutex);
+
+    dedup_destroy(&creator->dedup);
+    free(creator->files);
+    free(creator->paths);
+    free(creator->buffer);
+
+    return close(creator->fd) == 0;
+}
+
+/** Returns the member name of 'path', without leading slashes. */
+static const char* creator_member_name(const char* path)
+{
+    while (*path == '/')
+        ++path;
+
+    return path;
+}
+
+/** Adds the input at 'path' of 'length' with 'typeflag' to the files of
+ * 'creator'.
+ * @return false if out of memory.
+ */
+static bool creator_add_file(creator_t* creator,
+                             const char* path,
+                             size_t length,
+                             char typeflag)
+{
+    // The member name of a directory ends in a slash
+    bool slash = typeflag == DIRTYPE && path[length - 1] != '/';
+
+    if (creator->file_count == creator->file_capacity)
+    {
+        size_t capacity = creator->file_capacity ? 2 * creator->file_capacity : 64;
+        creator_file_t* files =
+            realloc(creator->files, sizeof(creator_file_t) * capacity);
+        if (!files)
+            return false;
+
+        creator->files = files;
+        creator->file_capacity = capacity;
+    }
+
+    if (creator->paths_capacity - creator->paths_size < length + slash + 1)
+    {
+        size_t capacity = creator->paths_capacity ? creator->paths_capacity : 4096;
+        while (capacity - creator->paths_size < length + slash + 1)
+            capacity *= 2;
+
+        char* paths = realloc(creator->paths, capacity);
+        if (!paths)
+            return false;
+
+        creator->paths = paths;
+        creator->paths_capacity = capacity;
+    }
+
+    creator_file_t* file = creator->files + creator->file_count++;
+
+    file->path_offset = creator->paths_size;
+    file->typeflag = typeflag;
+    file->fd = -1;
+    file->error = 0;
+    file->unchanged = false;
+    file->keyed = false;
+    file->data = NULL;
+    file->data_size = 0;
+    file->reserved = 0;
+    file->ready = false;
+
+    memcpy(creator->paths + creator->paths_size, path, length);
+    if (slash)
+        creator->paths[creator->paths_size + length] = '/';
+    creator->paths[creator->paths_size + length + slash] = '\0';
+    creator->paths_size += length + slash + 1;
+
+    return true;
+}
+
+/** Entry of a directory being added. */
+typedef struct creator_entry
+{
+    char* name;
+    unsigned char type;
+} creator_entry_t;
+
+/** Orders directory entries by name. */
+static int compare_entries(const void* a_void, const void* b_void)
+{
+    const creator_entry_t* a = a_void;
+    const creator_entry_t* b = b_void;
+
+    return strcmp(a->name, b->name);
+}
+
+static bool creator_add_path(creator_t* creator,
+                             char** path,
+                             size_t* path_capacity,
+                             size_t length,
+                             unsigned char type);
+
+/** Adds the entries of the directory at '*path' of 'length' in name order.
+ * @return false if out of memory.
+ */
+static bool creator_add_directory(creator_t* creator,
+                                  char** path,
+                                  size_t* path_capacity,
+                                  size_t length)
+{
+    DIR* directory = opendir(*path);
+    if (!directory)
+    {
+        fprintf(stderr, "PPtar: %s: Cannot open: %s\n", *path, strerror(errno));
+        creator->error_code = 2;
+        return true;
+    }
+
+    creator_entry_t* entries = NULL;
+    size_t entry_count = 0;
+    size_t entry_capacity = 0;
+    bool success = true;
+
+    struct dirent* entry;
+    while ((errno = 0, entry = readdir(directory)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        if (entry_count == entry_capacity)
+        {
+            size_t capacity = entry_capacity ? 2 * entry_capacity : 16;
+            creator_entry_t* grown =
+                realloc(entries, sizeof(creator_entry_t) * capacity);
+            if (!grown)
+                break;
+
+            entries = grown;
+            entry_capacity = capacity;
+        }
+
+        if (!(entries[entry_count].name = strdup(entry->d_name)))
+            break;
+
+        entries[entry_count++].type = entry->d_type;
+    }
+
+    if (entry)
+        success = false;
+    else if (errno != 0)
+    {
+        fprintf(stderr, "PPtar: %s: Cannot read: %s\n", *path, strerror(errno));
+        creator->error_code = 2;
+    }
+
+    closedir(directory);
+
+    if (entry_count != 0)
+        qsort(entries, entry_count, sizeof(creator_entry_t), compare_entries);
+
+    for (size_t i = 0; i != entry_count; ++i)
+    {
+        size_t name_length = strlen(entries[i].name);
+        bool separator = (*path)[length - 1] != '/';
+        size_t entry_length = length + separator + name_length;
+
+        if (success && entry_length + 1 > *path_capacity)
+        {
+            size_t capacity = 2 * *path_capacity;
+            while (capacity < entry_length + 1)
+                capacity *= 2;
+
+            char* grown = realloc(*path, capacity);
+            if (grown)
+            {
+                *path = grown;
+                *path_capacity = capacity;
+            }
+            else
+                success = false;
+        }
+
+        if (success)
+        {
+            if (separator)
+                (*path)[length] = '/';
+            memcpy(*path + length + separator, entries[i].name, name_length + 1);
+
+            success = creator_add_path(
+                creator, path, path_capacity, entry_length, entries[i].type);
+        }
+
+        free(entries[i].name);
+    }
+
+    free(entries);
+
+    (*path)[length] = '\0';
+    return success;
+}
+
+/** Adds the file at '*path' of 'length' with the directory entry 'type'.
+ * @return false if out of memory.
+ */
+static bool creator_add_path(creator_t* creator,
+                             char** path,
+                             size_t* path_capacity,
+                             size_t length,
+                             unsigned char type)
+{
+    if (type == DT_UNKNOWN)
+    {
+        struct stat path_stat;
+
+        if (lstat(*path, &path_stat) != 0)
+        {
+            fprintf(stderr,
+                    "PPtar: %s: Cannot stat: %s\n",
+                    *path,
+                    strerror(errno));
+            creator->error_code = 2;
+            return true;
+        }
+
+        type = S_ISREG(path_stat.st_mode)   ? DT_REG
+               : S_ISDIR(path_stat.st_mode) ? DT_DIR
+               : S_ISLNK(path_stat.st_mode) ? DT_LNK
+                                            : DT_UNKNOWN;
+    }
+
+    if (type == DT_REG)
+        return creator_add_file(creator, *path, length, REGTYPE);
+    else if (type == DT_LNK)
+        return creator_add_file(creator, *path, length, SYMTYPE);
+    else if (type == DT_DIR)
+        return creator_add_file(creator, *path, length, DIRTYPE) &&
+               creator_add_directory(creator, path, path_capacity, length);
+
+    fprintf(stderr, "PPtar: %s: Unsupported file type, not dumped\n", *path);
+    creator->error_code = 2;
+    return true;
+}
+
+bool creator_add(creator_t* creator, const char* path)
+{
+    size_t length = strlen(path);
+    size_t capacity = length + 1 > 256 ? length + 1 : 256;
+
+    char* buffer = malloc(capacity);
+    if (!buffer)
+        return false;
+
+    memcpy(buffer, path, length + 1);
+
+    bool success = creator_add_path(creator, &buffer, &capacity, length, DT_UNKNOWN);
+
+    free(buffer);
+    return success;
+}
+
+/** Hashes all of 'file', whose start was read ahead, into its digest. The
+ * rest is read past the position of the descriptor.
+ */
+static void creator_hash_file(creator_file_t* file)
+{
+    sha256_t hash;
+
+    sha256_init(&hash);
+    if (file->data_size != 0)
+        sha256_update(&hash, file->data, file->data_size);
+
+    uint64_t size = (uint64_t)file->stat.st_size;
+    uint64_t offset = file->data_size;
+
+    if (offset != size)
+    {
+        char* buffer = malloc(CREATOR_PREFETCH_SIZE);
+        if (!buffer)
+            return;
+
+        while (offset != size)
+        {
+            size_t chunk = size - offset < CREATOR_PREFETCH_SIZE
+                               ? (size_t)(size - offset)
+                               : CREATOR_PREFETCH_SIZE;
+
+            ssize_t read_size = pread(file->fd, buffer, chunk, (off_t)offset);
+
+            if (read_size == -1 && errno == EINTR)
+                continue;
+
+            if (read_size <= 0)
+                break;
+
+            sha256_update(&hash, buffer, (size_t)read_size);
+            offset += (size_t)read_size;
+        }
+
+        free(buffer);
+
+        // The writer finds out the file shrank or failed
+        if (offset != size)
+            return;
+    }
+
+    sha256_final(&hash, file->digest);
+    file->keyed = true;
+}
+
+/** Checks if the input at 'path' of 'stat' is not newer than its member in
+ * the archive updated by 'creator'.
+ */
+static bool creator_unchanged(const creator_t* creator,
+                              const char* path,
+                              const struct stat* stat)
+{
+    uint64_t mtime;
+    const char* name = creator_member_name(path);
+
+    return creator->existing &&
+           archive_index_builder_find_mtime(
+               creator->existing, name, strlen(name), &mtime) &&
+           stat->st_mtime <= (time_t)mtime;
+}
+
+/** Reads the attributes of the directory or symlink 'file' at 'path' and the
+ * target of a symlink.
+ */
+static void creator_prefetch_special(creator_t* creator,
+                                     creator_file_t* file,
+                                     const char* path)
+{
+    if (lstat(path, &file->stat) != 0)
+    {
+        file->error = errno;
+        return;
+    }
+
+    if (file->typeflag == DIRTYPE ? !S_ISDIR(file->stat.st_mode)
+                                  : !S_ISLNK(file->stat.st_mode))
+    {
+        file->error = -1;
+        return;
+    }
+
+    if (creator_unchanged(creator, path, &file->stat))
+    {
+        file->unchanged = true;
+        return;
+    }
+
+    if (file->typeflag != SYMTYPE)
+        return;
+
+    // The size of a symlink is only a hint on some filesystems
+    size_t capacity = file->stat.st_size > 0 ? (size_t)file->stat.st_size + 1 : 256;
+
+    while (true)
+    {
+        char* data = realloc(file->data, capacity);
+        if (!data)
+        {
+            file->error = ENOMEM;
+            return;
+        }
+
+        file->data = data;
+
+        ssize_t length = readlink(path, file->data, capacity);
+
+        if (length == -1)
+        {
+            file->error = errno;
+            return;
+        }
+
+        if ((size_t)length < capacity)
+        {
+            file->data[length] = '\0';
+            file->data_size = (size_t)length;
+            return;
+        }
+
+        capacity *= 2;
+    }
+}
+
+/** Opens the file 'index' of 'creator' and reads its start.
+ * Waits while too many bytes are read ahead, unless the writer waits for it.
+ */
+static void creator_prefetch(creator_t* creator, size_t index)
+{
+    creator_file_t* file = creator->files + index;
+    const char* path = creator->paths + file->path_offset;
+
+    if (file->typeflag != REGTYPE)
+    {
+        creator_prefetch_special(creator, file, path);
+        return;
+    }
+
+    // Does not block on a file replaced by a FIFO
+    file->fd = open(path, O_RDONLY | O_NONBLOCK);
+
+    if (file->fd == -1 || fstat(file->fd, &file->stat) != 0)
+    {
+        file->error = errno;
+        return;
+    }
+
+    if (!S_ISREG(file->stat.st_mode) ||
+        (file->stat.st_dev == creator->archive_stat.st_dev &&
+         file->stat.st_ino == creator->archive_stat.st_ino))
+    {
+        file->error = -1;
+        return;
+    }
+
+    // Nothing is read of a file which is not updated
+    if (creator_unchanged(creator, path, &file->stat))
+    {
+        file->unchanged = true;
+        return;
+    }
+
+    size_t size = (uint64_t)file->stat.st_size < CREATOR_PREFETCH_SIZE
+                      ? (size_t)file->stat.st_size
+                      : CREATOR_PREFETCH_SIZE;
+
+    pthread_mutex_lock(&creator->mutex);
+
+    while (creator->bytes_in_flight + size > creator->max_bytes_in_flight &&
+           creator->write_index != index && !creator->stopping)
+        pthread_cond_wait(&creator->not_full, &creator->mutex);
+
+    creator->bytes_in_flight += size;
+    file->reserved = size;
+
+    pthread_mutex_unlock(&creator->mutex);
+
+    if (size != 0 && !(file->data = malloc(size)))
+        return;
+
+    while (file->data_size != size)
+    {
+        ssize_t read_size =
+            read(file->fd, file->data + file->data_size, size - file->data_size);
+
+        if (read_size == -1 && errno == EINTR)
+            continue;
+
+        // The writer finds out the file shrank or failed when reading the rest
+        if (read_size <= 0)
+            return;
+
+        file->data_size += (size_t)read_size;
+    }
+
+    if ((creator->deduplicating && size != 0) || creator->digesting)
+        creator_hash_file(file);
+
+    if ((uint64_t)file->stat.st_size == size)
+    {
+        close(file->fd);
+        file->fd = -1;
+    }
+    else
+        posix_fadvise(file->fd, (off_t)size, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+/** Main function of a thread reading files ahead. */
+static void* creator_prefetch_run(void* creator_void)
+{
+    creator_t* creator = creator_void;
+
+    pthread_mutex_lock(&creator->mutex);
+
+    while (creator->next_file != creator->file_count && !creator->stopping)
+    {
+        size_t index = creator->next_file++;
+
+        pthread_mutex_unlock(&creator->mutex);
+
+        creator_prefetch(creator, index);
+
+        pthread_mutex_lock(&creator->mutex);
+
+        creator->files[index].ready = true;
+        pthread_cond_signal(&creator->ready);
+    }
+
+    pthread_mutex_unlock(&creator->mutex);
+
+    return NULL;
+}
+
+/** Writes the filled buffer of 'creator' to the archive or passes it to the
+ * compressor.
+ * @return false if writing failed, errno is set.
+ */
+static bool creator_flush(creator_t* creator)
+{
+    if (creator->compressed)
+    {
+        char* buffer = creator->buffer;
+        creator->buffer = NULL;
+
+        if (!compressor_submit(&creator->compressor, buffer, creator->fill))
+            return false;
+
+        if (!(creator->buffer = compressor_get_chunk(&creator->compressor)))
+        {
+            errno = ENOMEM;
+            return false;
+        }
+    }
+    else
+    {
+        uint64_t start = creator->stats ? stats_now() : 0;
+
+        if (!write_all(creator->fd, creator->buffer, creator->fill))
+            return false;
+
+        if (creator->stats)
+        {
+            creator->stats->output_time += stats_now() - start;
+            creator->stats->bytes_written += creator->fill;
+        }
+    }
+
+    creator->offset += creator->fill;
+    creator->fill = 0;
+
+    return true;
+}
+
+/** Returns 'size' bytes of space in the buffer, flushing it if needed.
+ * @return NULL if writing failed, errno is set.
+ */
+static char* creator_reserve(creator_t* creator, size_t size)
+{
+    if (creator->capacity - creator->fill < size && !creator_flush(creator))
+        return NULL;
+
+    char* space = creator->buffer + creator->fill;
+    creator->fill += size;
+
+    return space;
+}
+
+/** Appends 'size' bytes of 'data' to the archive, zeros if 'data' is NULL.
+ * @return false if writing failed, errno is set.
+ */
+static bool creator_append(creator_t* creator, const char* data, size_t size)
+{
+    while (size != 0)
+    {
+        if (creator->fill == creator->capacity && !creator_flush(creator))
+            return false;
+
+        size_t chunk = creator->capacity - creator->fill;
+        if (chunk > size)
+            chunk = size;
+
+        if (data)
+        {
+            memcpy(creator->buffer + creator->fill, data, chunk);
+            data += chunk;
+        }
+        else
+            memset(creator->buffer + creator->fill, 0, chunk);
+
+        creator->fill += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+/** Copies a name of the owner or group into the 32 byte 'field'. */
+static void creator_set_owner_name(char* field, const char* name)
+{
+    size_t length = name ? strnlen(name, 31) : 0;
+
+    memcpy(field, name ? name : "", length);
+    memset(field + length, 0, 32 - length);
+}
+
+/** Writes the checksum of the filled 'header' into it. */
+static void creator_set_checksum(header_t* header)
+{
+    // Six octal digits, a NUL and a space
+    header_set_number(header->chksum,
+                      sizeof(header->chksum) - 1,
+                      header_compute_checksum(header));
+    header->chksum[sizeof(header->chksum) - 1] = ' ';
+}
+
+/** Splits 'name' of 'length' into the name and prefix fields of a header like
+ * GNU tar, at the last slash fitting the prefix. Writes the length of the
+ * prefix, 0 for a name fitting alone, to '*prefix_length'.
+ * @return false if the name does not fit the fields.
+ */
+static bool creator_split_name(const char* name, size_t length, size_t* prefix_length)
+{
+    *prefix_length = 0;
+
+    if (length <= sizeof(((header_t*)NULL)->name))
+        return true;
+
+    size_t slash = length > sizeof(((header_t*)NULL)->prefix) + 1
+                       ? sizeof(((header_t*)NULL)->prefix) + 1
+                       : length - 1;
+
+    while (slash != 0 && name[slash] != '/')
+        --slash;
+
+    if (slash == 0 || slash > sizeof(((header_t*)NULL)->prefix) ||
+        length - slash - 1 > sizeof(((header_t*)NULL)->name) ||
+        length - slash - 1 == 0)
+        return false;
+
+    *prefix_length = slash;
+    return true;
+}
+
+/** Returns the length of the PAX record of 'key' of 'key_length', which
+ * starts with a space and ends with an equals sign, with a value of 'length'.
+ */
+static size_t creator_record_length(size_t key_length, size_t length)
+{
+    // The length of the record "<length> <key>=<value>\n" counts its own
+    // digits
+    size_t base = key_length + length + 1;
+    size_t record_length = base + 1;
+
+    for (size_t bound = 10; record_length >= bound; bound *= 10)
+        ++record_length;
+
+    return record_length;
+}
+
+/** Appends the PAX record of 'key' of 'key_length' with 'value' of 'length'.
+ * @return false if writing failed, errno is set.
+ */
+static bool creator_append_record(creator_t* creator,
+                                  const char* key,
+                                  size_t key_length,
+                                  const char* value,
+                                  size_t length)
+{
+    char digits[24];
+    int digit_count = snprintf(
+        digits, sizeof(digits), "%zu", creator_record_length(key_length, length));
+
+    return creator_append(creator, digits, (size_t)digit_count) &&
+           creator_append(creator, key, key_length) &&
+           creator_append(creator, value, length) &&
+           creator_append(creator, "\n", 1);
+}
+
+/** Writes a PAX extended header with the path 'name' of 'length', the link
+ * target 'linkname' of 'link_length' and the SHA-256 'digest' of the data for
+ * the member of 'stat'. Each is left out if it is NULL.
+ * @return false if writing failed, errno is set.
+ */
+static bool creator_write_extended(creator_t* creator,
+                                   const char* name,
+                                   size_t length,
+                                   const char* linkname,
+                                   size_t link_length,
+                                   const unsigned char* digest,
+                                   const struct stat* stat)
+{
+    static const char path_key[] = " path=";
+    static const char linkpath_key[] = " linkpath=";
+    static const char digest_key[] = " PPTAR.sha256=";
+
+    char hex[SHA256_DIGEST_SIZE * 2];
+    if (digest)
+        for (size_t i = 0; i != SHA256_DIGEST_SIZE; ++i)
+        {
+            hex[i * 2] = "0123456789abcdef"[digest[i] >> 4];
+            hex[i * 2 + 1] = "0123456789abcdef"[digest[i] & 0xf];
+        }
+
+    size_t size =
+        (name ? creator_record_length(sizeof(path_key) - 1, length) : 0) +
+        (linkname ? creator_record_length(sizeof(linkpath_key) - 1, link_length)
+                  : 0) +
+        (digest ? creator_record_length(sizeof(digest_key) - 1, sizeof(hex)) : 0);
+
+    header_t* header = (header_t*)creator_reserve(creator, sizeof(header_t));
+    if (!header)
+        return false;
+
+    memset(header, 0, sizeof(header_t));
+
+    memcpy(header->name, "././@PaxHeader", sizeof("././@PaxHeader") - 1);
+    header_set_number(header->mode, sizeof(header->mode), 0644);
+    header_set_number(header->uid, sizeof(header->uid), 0);
+    header_set_number(header->gid, sizeof(header->gid), 0);
+    header_set_number(header->size, sizeof(header->size), size);
+    header_set_number(header->mtime,
+                      sizeof(header->mtime),
+                      stat->st_mtime < 0 ? 0 : (uint64_t)stat->st_mtime);
+    header->typeflag = XHDTYPE;
+    memcpy(header->magic, TMAGIC, sizeof(header->magic));
+    memcpy(header->version, TVERSION, sizeof(header->version));
+    header_set_number(header->devmajor, sizeof(header->devmajor), 0);
+    header_set_number(header->devminor, sizeof(header->devminor), 0);
+    creator_set_checksum(header);
+
+    return (!name || creator_append_record(
+                         creator, path_key, sizeof(path_key) - 1, name, length)) &&
+           (!linkname || creator_append_record(creator,
+                                               linkpath_key,
+                                               sizeof(linkpath_key) - 1,
+                                               linkname,
+                                               link_length)) &&
+           (!digest || creator_append_record(creator,
+                                             digest_key,
+                                             sizeof(digest_key) - 1,
+                                             hex,
+                                             sizeof(hex))) &&
+           creator_append(
+               creator, NULL, (RECORD_SIZE - size % RECORD_SIZE) % RECORD_SIZE);
+}
+
+/** Fills 'header' of the member 'name' with 'typeflag' and 'stat'. The first
+ * 'prefix_length' bytes of the name and a slash go to the prefix field. The
+ * link target 'linkname' of a link is cut to fit the header.
+ */
+static void creator_fill_header(creator_t* creator,
+                                header_t* header,
+                                const char* name,
+                                size_t prefix_length,
+                                char typeflag,
+                                const char* linkname,
+                                const struct stat* stat)
+{
+    memset(header, 0, sizeof(header_t));
+
+    if (prefix_length != 0)
+    {
+        memcpy(header->prefix, name, prefix_length);
+        name += prefix_length + 1;
+    }
+
+    memcpy(header->name, name, strnlen(name, sizeof(header->name)));
+    header_set_number(header->mode, sizeof(header->mode), stat->st_mode & 07777);
+    header_set_number(header->uid, sizeof(header->uid), stat->st_uid);
+    header_set_number(header->gid, sizeof(header->gid), stat->st_gid);
+    header_set_number(header->size,
+                      sizeof(header->size),
+                      typeflag == REGTYPE ? (uint64_t)stat->st_size : 0);
+    header_set_number(header->mtime,
+                      sizeof(header->mtime),
+                      stat->st_mtime < 0 ? 0 : (uint64_t)stat->st_mtime);
+    header->typeflag = typeflag;
+
+    if (linkname)
+        memcpy(header->linkname,
+               linkname,
+               strnlen(linkname, sizeof(header->linkname)));
+
+    memcpy(header->magic, TMAGIC, sizeof(header->magic));
+    memcpy(header->version, TVERSION, sizeof(header->version));
+
+    if (!creator->has_owner || creator->owner_uid != stat->st_uid ||
+        creator->owner_gid != stat->st_gid)
+    {
+        const struct passwd* user = getpwuid(stat->st_uid);
+        const struct group* group = getgrgid(stat->st_gid);
+
+        creator_set_owner_name(creator->uname, user ? user->pw_name : NULL);
+        creator_set_owner_name(creator->gname, group ? group->gr_name : NULL);
+
+        creator->has_owner = true;
+        creator->owner_uid = stat->st_uid;
+        creator->owner_gid = stat->st_gid;
+    }
+
+    memcpy(header->uname, creator->uname, sizeof(header->uname));
+    memcpy(header->gname, creator->gname, sizeof(header->gname));
+    header_set_number(header->devmajor, sizeof(header->devmajor), 0);
+    header_set_number(header->devminor, sizeof(header->devminor), 0);
+    creator_set_checksum(header);
+}
+
+/** Waits until the file 'index' of 'creator' is read ahead, reading it
+ * itself if no thread took it yet.
+ */
+static void creator_wait_file(creator_t* creator, size_t index)
+{
+    pthread_mutex_lock(&creator->mutex);
+
+    creator->write_index = index;
+    pthread_cond_broadcast(&creator->not_full);
+
+    while (!creator->files[index].ready)
+    {
+        if (creator->next_file == index)
+        {
+            ++creator->next_file;
+            pthread_mutex_unlock(&creator->mutex);
+
+            creator_prefetch(creator, index);
+
+            pthread_mutex_lock(&creator->mutex);
+            creator->files[index].ready = true;
+        }
+        else
+            pthread_cond_wait(&creator->ready, &creator->mutex);
+    }
+
+    pthread_mutex_unlock(&creator->mutex);
+}
+
+/** Releases the data read ahead of 'file'. */
+static void creator_release_file(creator_t* creator, creator_file_t* file)
+{
+    pthread_mutex_lock(&creator->mutex);
+
+    creator->bytes_in_flight -= file->reserved;
+    file->reserved = 0;
+    pthread_cond_broadcast(&creator->not_full);
+
+    pthread_mutex_unlock(&creator->mutex);
+
+    if (file->fd != -1)
+        close(file->fd);
+    file->fd = -1;
+
+    free(file->data);
+    file->data = NULL;
+}
+
+/** Writes the header of the directory or symlink 'file' of 'creator' called
+ * 'name' of 'name_length'.
+ * @return false if writing the archive failed, errno is set.
+ */
+static bool creator_write_special(creator_t* creator,
+                                  const creator_file_t* file,
+                                  const char* name,
+                                  size_t name_length)
+{
+    // Names and targets which do not fit the header go to an extended header
+    size_t prefix_length;
+    bool long_name = !creator_split_name(name, name_length, &prefix_length);
+    bool long_link = file->typeflag == SYMTYPE &&
+                     file->data_size > sizeof(((header_t*)NULL)->linkname);
+
+    if ((long_name || long_link) &&
+        !creator_write_extended(creator,
+                                long_name ? name : NULL,
+                                name_length,
+                                long_link ? file->data : NULL,
+                                long_link ? file->data_size : 0,
+                                NULL,
+                                &file->stat))
+        return false;
+
+    header_t* header = (header_t*)creator_reserve(creator, sizeof(header_t));
+    if (!header)
+        return false;
+
+    creator_fill_header(creator,
+                        header,
+                        name,
+                        prefix_length,
+                        file->typeflag,
+                        file->typeflag == SYMTYPE ? file->data : NULL,
+                        &file->stat);
+
+    return true;
+}
+
+/** Writes the header and the data of the file 'index' of 'creator'.
+ * Writes its name to 'output' and adds the member to 'builder' unless they
+ * are NULL.
+ * @return false if writing the archive failed, errno is set.
+ */
+static bool creator_write_file(creator_t* creator,
+                               size_t index,
+                               output_t* output,
+                               archive_index_builder_t* builder)
+{
+    creator_file_t* file = creator->files + index;
+    const char* path = creator->paths + file->path_offset;
+    const char* name = creator_member_name(path);
+
+    if (file->unchanged)
+        return true;
+
+    if (name != path && !creator->removed_slash)
+    {
+        fprintf(stderr, "PPtar: Removing leading '/' from member names\n");
+        creator->removed_slash = true;
+    }
+
+    if (file->error == -1)
+    {
+        if (file->typeflag == REGTYPE && S_ISREG(file->stat.st_mode))
+            fprintf(stderr, "PPtar: %s: file is the archive; not dumped\n", path);
+        else
+        {
+            fprintf(stderr, "PPtar: %s: Unsupported file type, not dumped\n", path);
+            creator->error_code = 2;
+        }
+
+        return true;
+    }
+    else if (file->error != 0)
+    {
+        fprintf(stderr, "PPtar: %s: Cannot open: %s\n", path, strerror(file->error));
+        creator->error_code = 2;
+        return true;
+    }
+
+    uint64_t size = (uint64_t)file->stat.st_size;
+    size_t name_length = strlen(name);
+
+    // The root directory has no name
+    if (name_length == 0)
+        return true;
+
+
+    // A file with the content and the attributes of an earlier one is a hard
+    // link to it
+    const dedup_file_t* original = NULL;
+    dedup_key_t key;
+
+    if (creator->deduplicating)
+    {
+        dedup_forget(&creator->dedup, name, name_length);
+
+        if (file->keyed)
+        {
+            memcpy(key.digest, file->digest, sizeof(key.digest));
+            key.size = size;
+            key.mode = file->stat.st_mode & 07777;
+            key.uid = file->stat.st_uid;
+            key.gid = file->stat.st_gid;
+            key.mtime = file->stat.st_mtime < 0 ? 0 : (uint64_t)file->stat.st_mtime;
+
+            original = dedup_find(&creator->dedup, &key);
+        }
+    }
+
+    if (output)
+        output_name(output, name, name_length);
+
+    if (builder)
+    {
+        archive_index_entry_t entry;
+
+        entry.name = name;
+        entry.name_length = name_length;
+        entry.header_offset = creator->offset + creator->fill;
+        entry.size = original || file->typeflag != REGTYPE ? 0 : size;
+        entry.mtime = file->stat.st_mtime < 0 ? 0 : (uint64_t)file->stat.st_mtime;
+
+        archive_index_builder_add(builder, &entry);
+    }
+
+    if (file->typeflag != REGTYPE)
+        return creator_write_special(creator, file, name, name_length);
+
+    // Names which do not fit the header and the digest go to an extended
+    // header before it, a file which could not be hashed gets no digest
+    size_t prefix_length;
+    bool long_name = !creator_split_name(name, name_length, &prefix_length);
+    bool long_link =
+        original && original->path_length > sizeof(((header_t*)NULL)->linkname);
+    bool digest = creator->digesting && file->keyed && !original;
+
+    if ((long_name || long_link || digest) &&
+        !creator_write_extended(creator,
+                                long_name ? name : NULL,
+                                name_length,
+                                long_link ? original->path : NULL,
+                                long_link ? original->path_length : 0,
+                                digest ? file->digest : NULL,
+                                &file->stat))
+        return false;
+
+    header_t* header = (header_t*)creator_reserve(creator, sizeof(header_t));
+    if (!header)
+        return false;
+
+    creator_fill_header(creator,
+                        header,
+                        name,
+                        prefix_length,
+                        original ? LNKTYPE : REGTYPE,
+                        original ? original->path : NULL,
+                        &file->stat);
+
+    if (original)
+    {
+        if (creator->stats)
+            ++creator->stats->files_linked;
+
+        return true;
+    }
+
+    if (!creator_append(creator, file->data, file->data_size))
+        return false;
+
+    uint64_t remaining = size - file->data_size;
+    uint64_t start = creator->stats ? stats_now() : 0;
+
+    // The rest is read straight into the buffer
+    while (remaining != 0 && file->fd != -1)
+    {
+        if (creator->fill == creator->capacity && !creator_flush(creator))
+            return false;
+
+        size_t chunk = creator->capacity - creator->fill;
+        if (chunk > remaining)
+            chunk = (size_t)remaining;
+
+        ssize_t read_size = read(file->fd, creator->buffer + creator->fill, chunk);
+
+        if (read_size == -1 && errno == EINTR)
+            continue;
+
+        if (read_size == -1)
+        {
+            fprintf(stderr, "PPtar: %s: Read error: %s\n", path, strerror(errno));
+            break;
+        }
+
+        if (read_size == 0)
+            break;
+
+        creator->fill += (size_t)read_size;
+        remaining -= (size_t)read_size;
+    }
+
+    if (creator->stats)
+    {
+        creator->stats->input_time += stats_now() - start;
+        creator->stats->bytes_read += size - remaining;
+        ++creator->stats->files_created;
+    }
+
+    // The header promised 'size' bytes
+    if (remaining != 0)
+    {
+        fprintf(stderr,
+                "PPtar: %s: File shrank by %llu bytes; padding with zeros\n",
+                path,
+                (unsigned long long)remaining);
+        creator->error_code = 2;
+
+        while (remaining != 0)
+        {
+            size_t chunk = remaining < creator->capacity ? (size_t)remaining
+                                                         : creator->capacity;
+            if (!creator_append(creator, NULL, chunk))
+                return false;
+
+            remaining -= chunk;
+        }
+    }
+
+    // The table keeps the name if there is memory for it, else the file is
+    // just not deduplicated against
+    if (creator->deduplicating && file->keyed && remaining == 0)
+        dedup_add(&creator->dedup, name, name_length, &key);
+
+    return creator_append(creator, NULL, (RECORD_SIZE - size % RECORD_SIZE) % RECORD_SIZE);
+}
+
+/** Stops the threads of 'creator' and waits for them. */
+static void creator_stop_threads(creator_t* creator)
+{
+    pthread_mutex_lock(&creator->mutex);
+    creator->stopping = true;
+    pthread_cond_broadcast(&creator->not_full);
+    pthread_mutex_unlock(&creator->mutex);
+
+    for (size_t i = 0; i != creator->thread_count; ++i)
+        pthread_join(creator->threads[i], NULL);
+
+    free(creator->threads);
+    creator->threads = NULL;
+    creator->thread_count = 0;
+}
+
+int creator_write(creator_t* creator,
+                  size_t thread_count,
+                  bool dedup,
+                  bool digest,
+                  output_t* output,
+                  archive_index_builder_t* builder)
+{
+    creator->deduplicating = dedup;
+    creator->digesting = digest;
+
+    // Without threads the writer reads every file itself
+    creator->threads = malloc(sizeof(pthread_t) * thread_count);
+
+    for (; creator->threads && creator->thread_count != thread_count;
+         ++creator->thread_count)
+        if (pthread_create(creator->threads + creator->thread_count,
+                           NULL,
+                           creator_prefetch_run,
+                           creator) != 0)
+            break;
+
+    bool success = true;
+
+    for (size_t i = 0; success && i != creator->file_count; ++i)
+    {
+        uint64_t start = creator->stats ? stats_now() : 0;
+
+        creator_wait_file(creator, i);
+
+        success = creator_write_file(creator, i, output, builder);
+
+        creator_release_file(creator, creator->files + i);
+
+        if (creator->stats)
+            stats_add_member(creator->stats, stats_now() - start);
+    }
+
+    creator_stop_threads(creator);
+
+    // Two null records end the archive, which is padded to whole blocks
+    if (success)
+    {
+        uint64_t size = creator->offset + creator->fill + 2 * RECORD_SIZE;
+        uint64_t block_size = CREATOR_BLOCKING_FACTOR * RECORD_SIZE;
+
+        success = creator_append(creator,
+                                 NULL,
+                                 (size_t)((size + block_size - 1) / block_size *
+                                          block_size - creator->offset -
+                                          creator->fill)) &&
+                  creator_flush(creator) &&
+                  (!creator->compressed ||
+                   compressor_finish(&creator->compressor));
+    }
+
+    if (!success)
+    {
+        fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+        return 9;
+    }
+
+    if (creator->error_code != 0)
+        fprintf(stderr,
+                "PPtar: Exiting with failure status due to previous errors\n");
+
+    return creator->error_code;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "archive_index.h"
+#include "compressor.h"
+#include "dedup.h"
+#include "output.h"
+#include "stats.h"
+
+/** Default number of threads reading input files ahead. */
+#define CREATOR_DEFAULT_THREADS ((size_t)4)
+
+/** Maximum number of bytes of one file read ahead of the writer. */
+#define CREATOR_PREFETCH_SIZE ((size_t)1 << 20)
+
+/** Default maximum of bytes read ahead and not yet written. */
+#define CREATOR_DEFAULT_MAX_BYTES_IN_FLIGHT ((size_t)64 << 20)
+
+/** Number of records the archive size is rounded up to. */
+#define CREATOR_BLOCKING_FACTOR ((size_t)20)
+
+/** Input file of a created archive. */
+typedef struct creator_file
+{
+    // Offset of the path in the paths of the creator, a directory ends in a
+    // slash
+    size_t path_offset;
+
+    // REGTYPE, DIRTYPE or SYMTYPE
+    char typeflag;
+
+    // Open descriptor while some data is not read yet or -1
+    int fd;
+
+    // errno of a failed open, -1 for an input which is not dumped or 0
+    int error;
+
+    // The file is not newer than its member in the updated archive
+    bool unchanged;
+
+    // The whole file was hashed when it was read ahead
+    bool keyed;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+
+    struct stat stat;
+
+    // Start of the file read ahead or the target of a symlink, which is
+    // terminated by a NUL
+    char* data;
+    size_t data_size;
+
+    // Bytes counted as read ahead for the file
+    size_t reserved;
+
+    bool ready;
+} creator_file_t;
+
+/** Writer of a new archive.
+ * The input files are collected first. Threads then open them and read their
+ * starts ahead in archive order, so small files do not wait for each other.
+ * The writer fills an aligned buffer with headers and data and writes it
+ * whole, or passes it to the compressor of a compressed archive. The number of
+ * bytes read ahead is bounded.
+ * Directories go before their entries and symlinks are stored as such.
+ * Duplicates and the digests of the files are found by hashing the files
+ * when they are read ahead, all of a large file is read twice then.
+ */
+typedef struct creator
+{
+    int fd;
+    struct stat archive_stat;
+
+    // Compresses the buffers of a compressed archive
+    bool compressed;
+    compressor_t compressor;
+
+    // The buffer being filled, 'offset' bytes were written before it
+    char* buffer;
+    size_t capacity;
+    size_t fill;
+    uint64_t offset;
+
+    // Paths of the input files, each terminated by a NUL
+    char* paths;
+    size_t paths_size;
+    size_t paths_capacity;
+
+    creator_file_t* files;
+    size_t file_count;
+    size_t file_capacity;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    pthread_cond_t not_full;
+
+    pthread_t* threads;
+    size_t thread_count;
+
+    // Next file to read ahead and the file being written
+    size_t next_file;
+    size_t write_index;
+
+    size_t bytes_in_flight;
+    size_t max_bytes_in_flight;
+
+    bool stopping;
+
+    // Exit code of problems with the input files
+    int error_code;
+
+    // Members of an updated archive, sorted, or NULL
+    const archive_index_builder_t* existing;
+
+    // Files with the content and the attributes of an earlier member are hard
+    // links to it
+    bool deduplicating;
+    dedup_t dedup;
+
+    // Files get a PAX record of their SHA-256
+    bool digesting;
+
+    // Leading slashes were removed from a member name and the user was told
+    bool removed_slash;
+
+    // Names of the last looked up owner and group
+    bool has_owner;
+    uid_t owner_uid;
+    gid_t owner_gid;
+    char uname[32];
+    char gname[32];
+
+    // Statistics to collect or NULL
+    stats_t* stats;
+} creator_t;
+
+/** Creates the archive at 'path' written in chunks of 'buffer_size' bytes,
+ * which has to be a non-zero multiple of RECORD_SIZE.
+ * The archive is compressed with 'compression' on all processors, each chunk
+ * on its own.
+ * Collects statistics into 'stats' unless it is NULL.
+ * @return false on failure, errno is set.
+ */
+bool creator_open(creator_t* creator,
+                  const char* path,
+                  size_t buffer_size,
+                  compression_t compression,
+                  stats_t* stats);
+
+/** Opens the uncompressed archive at 'path' like creator_open to append to
+ * it. Its end at 'offset' is overwritten by the new members. Files which are
+ * not newer than their last member in 'existing', sorted, are skipped unless
+ * it is NULL, 'existing' has to stay valid until the creator is closed.
+ * @return false on failure, errno is set.
+ */
+bool creator_open_append(creator_t* creator,
+                         const char* path,
+                         uint64_t offset,
+                         size_t buffer_size,
+                         const archive_index_builder_t* existing,
+                         stats_t* stats);
+
+/** Adds the file, directory or symlink at 'path' to the archive, directories
+ * recursively. Prints errors about inputs which cannot be added.
+ * @return false if out of memory.
+ */
+bool creator_add(creator_t* creator, const char* path);
+
+/** Writes all added files and the end of the archive, reading ahead with
+ * 'thread_count' threads. Writes the files with the content and the
+ * attributes of an earlier member as hard links to it if 'dedup' is true.
+ * Records the SHA-256 of each file in a PPTAR.sha256 PAX record if 'digest'
+ * is true. Writes the member names to 'output' and adds the members to 'builder'
+ * unless they are NULL.
+ * @return The exit code.
+ */
+int creator_write(creator_t* creator,
+                  size_t thread_count,
+                  bool dedup,
+                  bool digest,
+                  output_t* output,
+                  archive_index_builder_t* builder);
+
+/** Closes the archive and frees the memory of 'creator'.
+ * @return false if closing the archive failed.
+ */
+bool creator_close(creator_t* creator);
@@ -0,0 +1,546 @@
+#include "decompressor.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef PPTAR_HAVE_ZLIB
+    #include <zlib.h>
+#endif
+#ifdef PPTAR_HAVE_LZMA
+    #include <lzma.h>
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+/** Size of the buffer of compressed input. */
+#define DECOMPRESSOR_INPUT_SIZE ((size_t)256 << 10)
+
+compression_t compression_detect(const unsigned char* data, size_t size)
+{
+    if (size >= 2 && data[0] == 0x1F && data[1] == 0x8B)
+        return COMPRESSION_GZIP;
+
+    if (size >= 6 && memcmp(data, "\xFD" "7zXZ\0", 6) == 0)
+        return COMPRESSION_XZ;
+
+    // Frames and skippable frames
+    if (size >= 4 && ((data[0] == 0x28 && data[1] == 0xB5 && data[2] == 0x2F &&
+                       data[3] == 0xFD) ||
+                      ((data[0] & 0xF0) == 0x50 && data[1] == 0x2A &&
+                       data[2] == 0x4D && data[3] == 0x18)))
+        return COMPRESSION_ZSTD;
+
+    return COMPRESSION_NONE;
+}
+
+bool compression_is_supported(compression_t compression)
+{
+    switch (compression)
+    {
+        case COMPRESSION_NONE:
+            return true;
+#ifdef PPTAR_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+            return true;
+#endif
+#ifdef PPTAR_HAVE_LZMA
+        case COMPRESSION_XZ:
+            return true;
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+#ifdef PPTAR_HAVE_ZSTD
+/** Decodes a little endian 32-bit number. */
+static uint32_t load_u32(const unsigned char* data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 |
+           (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+/** Reads exactly 'size' bytes at 'offset' of 'fd'. */
+static bool pread_all(int fd, unsigned char* data, size_t size, off_t offset)
+{
+    while (size != 0)
+    {
+        ssize_t read_count = pread(fd, data, size, offset);
+
+        if (read_count == -1 && errno == EINTR)
+            continue;
+
+        if (read_count <= 0)
+            return false;
+
+        data += read_count;
+        size -= (size_t)read_count;
+        offset += read_count;
+    }
+
+    return true;
+}
+
+/** Loads the seek table of a seekable zstd archive if there is one. */
+static void decompressor_load_seek_table(decompressor_t* decompressor)
+{
+    struct stat file_stat;
+    if (fstat(decompressor->fd, &file_stat) != 0 ||
+        !S_ISREG(file_stat.st_mode) ||
+        (size_t)file_stat.st_size < 8 + ZSTD_SEEKABLE_FOOTER_SIZE)
+        return;
+
+    unsigned char footer[ZSTD_SEEKABLE_FOOTER_SIZE];
+    if (!pread_all(decompressor->fd,
+                   footer,
+                   sizeof(footer),
+                   file_stat.st_size - (off_t)sizeof(footer)) ||
+        load_u32(footer + 5) != ZSTD_SEEKABLE_MAGIC || (footer[4] & 0x7C) != 0)
+        return;
+
+    size_t frame_count = load_u32(footer);
+    size_t entry_size = footer[4] & 0x80 ? 12 : 8;
+    uint64_t table_size =
+        8 + (uint64_t)frame_count * entry_size + ZSTD_SEEKABLE_FOOTER_SIZE;
+
+    if (table_size > (uint64_t)file_stat.st_size)
+        return;
+
+    off_t table_offset = file_stat.st_size - (off_t)table_size;
+    unsigned char* table = malloc((size_t)table_size);
+    decompressor->frame_compressed_offsets =
+        malloc(sizeof(uint64_t) * (frame_count + 1));
+    decompressor->frame_offsets = malloc(sizeof(uint64_t) * (frame_count + 1));
+
+    bool valid =
+        table && decompressor->frame_compressed_offsets &&
+        decompressor->frame_offsets &&
+        pread_all(decompressor->fd, table, (size_t)table_size, table_offset) &&
+        load_u32(table) == ZSTD_SKIPPABLE_SEEK_TABLE_MAGIC &&
+        load_u32(table + 4) == table_size - 8;
+
+    uint64_t compressed_offset = 0;
+    uint64_t offset = 0;
+
+    for (size_t i = 0; valid && i != frame_count; ++i)
+    {
+        const unsigned char* entry = table + 8 + i * entry_size;
+
+        decompressor->frame_compressed_offsets[i] = compressed_offset;
+        decompressor->frame_offsets[i] = offset;
+
+        compressed_offset += load_u32(entry);
+        offset += load_u32(entry + 4);
+    }
+
+    // The frames have to cover everything before the seek table
+    if (valid && compressed_offset == (uint64_t)table_offset)
+    {
+        decompressor->frame_compressed_offsets[frame_count] = compressed_offset;
+        decompressor->frame_offsets[frame_count] = offset;
+        decompressor->frame_count = frame_count;
+    }
+    else
+    {
+        free(decompressor->frame_compressed_offsets);
+        free(decompressor->frame_offsets);
+        decompressor->frame_compressed_offsets = NULL;
+        decompressor->frame_offsets = NULL;
+    }
+
+    free(table);
+}
+#endif
+
+bool decompressor_init(decompressor_t* decompressor,
+                       compression_t compression,
+                       int fd,
+                       const char* initial,
+                       size_t initial_size)
+{
+    decompressor->compression = compression;
+    decompressor->fd = fd;
+    decompressor->input = malloc(DECOMPRESSOR_INPUT_SIZE);
+    decompressor->input_begin = 0;
+    decompressor->input_end = initial_size;
+    decompressor->input_eof = false;
+    decompressor->stream = NULL;
+    decompressor->stream_end = false;
+    decompressor->frame_complete = true;
+    decompressor->frame_compressed_offsets = NULL;
+    decompressor->frame_offsets = NULL;
+    decompressor->frame_count = 0;
+    decompressor->discard = 0;
+    decompressor->position = 0;
+
+    if (!decompressor->input || initial_size > DECOMPRESSOR_INPUT_SIZE)
+    {
+        free(decompressor->input);
+        errno = ENOMEM;
+        return false;
+    }
+
+    if (initial_size != 0)
+        memcpy(decompressor->input, initial, initial_size);
+
+    switch (compression)
+    {
+#ifdef PPTAR_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+        {
+            z_stream* stream = calloc(1, sizeof(z_stream));
+
+            // Gzip header only
+            if (stream && inflateInit2(stream, 16 + MAX_WBITS) != Z_OK)
+            {
+                free(stream);
+                stream = NULL;
+            }
+
+            decompressor->stream = stream;
+            break;
+        }
+#endif
+#ifdef PPTAR_HAVE_LZMA
+        case COMPRESSION_XZ:
+        {
+            lzma_stream* stream = malloc(sizeof(lzma_stream));
+
+            if (stream)
+            {
+                *stream = (lzma_stream)LZMA_STREAM_INIT;
+
+                if (lzma_stream_decoder(stream, UINT64_MAX, LZMA_CONCATENATED) !=
+                    LZMA_OK)
+                {
+                    free(stream);
+                    stream = NULL;
+                }
+            }
+
+            decompressor->stream = stream;
+            break;
+        }
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            decompressor->stream = ZSTD_createDStream();
+            decompressor_load_seek_table(decompressor);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if (!decompressor->stream)
+    {
+        decompressor_destroy(decompressor);
+        errno = compression_is_supported(compression) ? ENOMEM : ENOTSUP;
+        return false;
+    }
+
+    return true;
+}
+
+void decompressor_destroy(decompressor_t* decompressor)
+{
+    if (decompressor->stream)
+    {
+        switch (decompressor->compression)
+        {
+#ifdef PPTAR_HAVE_ZLIB
+            case COMPRESSION_GZIP:
+                inflateEnd(decompressor->stream);
+                break;
+#endif
+#ifdef PPTAR_HAVE_LZMA
+            case COMPRESSION_XZ:
+                lzma_end(decompressor->stream);
+                break;
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+            case COMPRESSION_ZSTD:
+                ZSTD_freeDStream(decompressor->stream);
+                decompressor->stream = NULL;
+                break;
+#endif
+            default:
+                break;
+        }
+
+        free(decompressor->stream);
+    }
+
+    free(decompressor->input);
+    free(decompressor->frame_compressed_offsets);
+    free(decompressor->frame_offsets);
+}
+
+/** Reads more compressed input if all of it was consumed.
+ * @return false on a read failure.
+ */
+static bool decompressor_refill(decompressor_t* decompressor)
+{
+    if (decompressor->input_begin != decompressor->input_end ||
+        decompressor->input_eof)
+        return true;
+
+    while (true)
+    {
+        ssize_t read_count =
+            read(decompressor->fd, decompressor->input, DECOMPRESSOR_INPUT_SIZE);
+
+        if (read_count == -1 && errno == EINTR)
+            continue;
+
+        if (read_count == -1)
+            return false;
+
+        decompressor->input_begin = 0;
+        decompressor->input_end = (size_t)read_count;
+        decompressor->input_eof = read_count == 0;
+
+        return true;
+    }
+}
+
+/** Decompresses some of the input into 'output' of 'size'.
+ * @return The number of bytes decompressed or -1 on corrupted data.
+ */
+static ssize_t decompressor_step(decompressor_t* decompressor,
+                                 char* output,
+                                 size_t size)
+{
+    const unsigned char* input =
+        decompressor->input + decompressor->input_begin;
+    size_t input_size = decompressor->input_end - decompressor->input_begin;
+
+    // Without any decoder library
+    (void)input;
+    (void)input_size;
+    (void)output;
+    (void)size;
+
+    switch (decompressor->compression)
+    {
+#ifdef PPTAR_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+        {
+            z_stream* stream = decompressor->stream;
+
+            stream->next_in = (unsigned char*)input;
+            stream->avail_in = (uInt)input_size;
+            stream->next_out = (unsigned char*)output;
+            stream->avail_out = (uInt)size;
+
+            int result = inflate(stream, Z_NO_FLUSH);
+
+            decompressor->input_begin += input_size - stream->avail_in;
+            size -= stream->avail_out;
+
+            if (result == Z_STREAM_END)
+            {
+                // Another member may follow, anything else is ignored
+                if (!decompressor_refill(decompressor))
+                    return -1;
+
+                const unsigned char* next =
+                    decompressor->input + decompressor->input_begin;
+
+                if (decompressor->input_end - decompressor->input_begin >= 2 &&
+                    next[0] == 0x1F && next[1] == 0x8B)
+                    inflateReset(stream);
+                else
+                    decompressor->stream_end = true;
+            }
+            else if (result != Z_OK && result != Z_BUF_ERROR)
+                return -1;
+
+            return (ssize_t)size;
+        }
+#endif
+#ifdef PPTAR_HAVE_LZMA
+        case COMPRESSION_XZ:
+        {
+            lzma_stream* stream = decompressor->stream;
+
+            stream->next_in = input;
+            stream->avail_in = input_size;
+            stream->next_out = (uint8_t*)output;
+            stream->avail_out = size;
+
+            lzma_ret result = lzma_code(stream,
+                                        decompressor->input_eof ? LZMA_FINISH
+                                                                : LZMA_RUN);
+
+            decompressor->input_begin += input_size - stream->avail_in;
+            size -= stream->avail_out;
+
+            if (result == LZMA_STREAM_END)
+                decompressor->stream_end = true;
+            else if (result != LZMA_OK && result != LZMA_BUF_ERROR)
+                return -1;
+
+            return (ssize_t)size;
+        }
+#endif
+#ifdef PPTAR_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+        {
+            ZSTD_inBuffer in = {input, input_size, 0};
+            ZSTD_outBuffer out = {output, size, 0};
+
+            size_t result = ZSTD_decompressStream(decompressor->stream, &out, &in);
+
+            decompressor->input_begin += in.pos;
+
+            if (ZSTD_isError(result))
+                return -1;
+
+            if (result == 0)
+                decompressor->frame_complete = true;
+            else if (in.pos != 0 || out.pos != 0)
+                decompressor->frame_complete = false;
+
+            // Frames end at the end of the input
+            if (decompressor->frame_complete && decompressor->input_eof &&
+                decompressor->input_begin == decompressor->input_end)
+                decompressor->stream_end = true;
+
+            return (ssize_t)out.pos;
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+
+ssize_t decompressor_read(decompressor_t* decompressor,
+                          char* output,
+                          size_t size)
+{
+    while (!decompressor->stream_end)
+    {
+        if (!decompressor_refill(decompressor))
+            return -1;
+
+        bool input_was_empty =
+            decompressor->input_begin == decompressor->input_end;
+
+        ssize_t decompressed = decompressor_step(decompressor, output, size);
+
+        if (decompressed == -1)
+        {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        if (decompressor->discard != 0)
+        {
+            size_t discarded = (uint64_t)decompressed < decompressor->discard
+                                   ? (size_t)decompressed
+                                   : (size_t)decompressor->discard;
+
+            decompressor->discard -= discarded;
+            memmove(output, output + discarded, (size_t)decompressed - discarded);
+            decompressed -= (ssize_t)discarded;
+        }
+
+        if (decompressed != 0)
+        {
+            decompressor->position += (uint64_t)decompressed;
+            return decompressed;
+        }
+
+        // No progress at the end of the input, the stream is truncated
+        if (input_was_empty && decompressor->input_eof &&
+            !decompressor->stream_end)
+        {
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+off_t decompressor_get_seekable_size(const decompressor_t* decompressor)
+{
+    if (!decompressor->frame_offsets)
+        return -1;
+
+    return (off_t)decompressor->frame_offsets[decompressor->frame_count];
+}
+
+#ifdef PPTAR_HAVE_ZSTD
+/** Returns the last frame of a seekable archive starting at or before
+ * 'offset'.
+ */
+static size_t decompressor_find_frame(const decompressor_t* decompressor,
+                                      uint64_t offset)
+{
+    size_t low = 0;
+    size_t high = decompressor->frame_count;
+
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (decompressor->frame_offsets[middle] <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+#endif
+
+bool decompressor_seek(decompressor_t* decompressor, off_t offset)
+{
+#ifdef PPTAR_HAVE_ZSTD
+    if (!decompressor->frame_offsets || offset < 0 ||
+        (uint64_t)offset > decompressor->frame_offsets[decompressor->frame_count])
+        return false;
+
+    size_t frame = decompressor_find_frame(decompressor, (uint64_t)offset);
+
+    // Within the current frame it is cheaper to decompress up to 'offset'
+    if ((uint64_t)offset >= decompressor->position &&
+        frame == decompressor_find_frame(decompressor, decompressor->position))
+    {
+        decompressor->discard += (uint64_t)offset - decompressor->position;
+        decompressor->position = (uint64_t)offset;
+        return true;
+    }
+
+    if (lseek(decompressor->fd,
+              (off_t)decompressor->frame_compressed_offsets[frame],
+              SEEK_SET) == -1)
+        return false;
+
+    ZSTD_DCtx_reset(decompressor->stream, ZSTD_reset_session_only);
+
+    decompressor->input_begin = 0;
+    decompressor->input_end = 0;
+    decompressor->input_eof = false;
+    decompressor->stream_end = false;
+    decompressor->frame_complete = true;
+    decompressor->discard = (uint64_t)offset - decompressor->frame_offsets[frame];
+    decompressor->position = (uint64_t)offset;
+
+    return true;
+#else
+    (void)decompressor;
+    (void)offset;
+    return false;
+#endif
+}
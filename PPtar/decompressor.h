@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Number of bytes needed to detect the compression of an archive. */
+#define COMPRESSION_MAGIC_SIZE ((size_t)6)
+
+/** Magic values of the seek table of a seekable zstd archive. */
+#define ZSTD_SKIPPABLE_SEEK_TABLE_MAGIC ((uint32_t)0x184D2A5E)
+#define ZSTD_SEEKABLE_MAGIC ((uint32_t)0x8F92EAB1)
+
+/** Size of the footer of the seek table. */
+#define ZSTD_SEEKABLE_FOOTER_SIZE ((size_t)9)
+
+/** Compression formats of an archive. */
+typedef enum compression
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_XZ,
+    COMPRESSION_ZSTD
+} compression_t;
+
+/** Stage decompressing the archive between its descriptor and the reader. */
+typedef struct decompressor
+{
+    compression_t compression;
+    int fd;
+
+    unsigned char* input;
+    size_t input_begin;
+    size_t input_end;
+    bool input_eof;
+
+    // State of the decoder library
+    void* stream;
+
+    // The compressed stream ended
+    bool stream_end;
+
+    // The last zstd frame was decoded completely
+    bool frame_complete;
+
+    // Seek table of a seekable zstd archive, offsets of the frame starts and
+    // of the end, or NULL
+    uint64_t* frame_compressed_offsets;
+    uint64_t* frame_offsets;
+    size_t frame_count;
+
+    // Number of decompressed bytes to discard after seeking
+    uint64_t discard;
+
+    // Decompressed offset of the next byte returned
+    uint64_t position;
+} decompressor_t;
+
+/** Detects the compression of an archive starting with 'data' of 'size'. */
+compression_t compression_detect(const unsigned char* data, size_t size);
+
+/** Checks if decompressing 'compression' is supported by this build. */
+bool compression_is_supported(compression_t compression);
+
+/** Initializes 'decompressor' decompressing 'compression' from 'fd'.
+ * The first 'initial_size' bytes of the compressed archive were already read
+ * from 'fd' into 'initial', the rest are read from 'fd'.
+ * @return false on failure, errno is set.
+ */
+bool decompressor_init(decompressor_t* decompressor,
+                       compression_t compression,
+                       int fd,
+                       const char* initial,
+                       size_t initial_size);
+
+/** Frees the memory of 'decompressor'. */
+void decompressor_destroy(decompressor_t* decompressor);
+
+/** Decompresses at most 'size' bytes into 'output'.
+ * @return The number of bytes decompressed, 0 at the end of the archive or -1
+ * on failure with errno set.
+ */
+ssize_t decompressor_read(decompressor_t* decompressor,
+                          char* output,
+                          size_t size);
+
+/** Returns the decompressed size of a seekable archive or -1. */
+off_t decompressor_get_seekable_size(const decompressor_t* decompressor);
+
+/** Moves to the decompressed 'offset' of a seekable archive.
+ * @return false on failure.
+ */
+bool decompressor_seek(decompressor_t* decompressor, off_t offset);
@@ -0,0 +1,170 @@
+#include "dedup.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+void dedup_init(dedup_t* dedup)
+{
+    arena_init(&dedup->paths);
+
+    dedup->files = NULL;
+    dedup->file_count = 0;
+    dedup->file_capacity = 0;
+    dedup->contents = NULL;
+    dedup->names = NULL;
+    dedup->table_size = 0;
+}
+
+void dedup_destroy(dedup_t* dedup)
+{
+    arena_destroy(&dedup->paths);
+    free(dedup->files);
+    free(dedup->contents);
+    free(dedup->names);
+}
+
+/** Checks if 'a' and 'b' are the same key. */
+static bool dedup_key_equal(const dedup_key_t* a, const dedup_key_t* b)
+{
+    return memcmp(a->digest, b->digest, sizeof(a->digest)) == 0 &&
+           a->size == b->size && a->mode == b->mode && a->uid == b->uid &&
+           a->gid == b->gid && a->mtime == b->mtime;
+}
+
+/** Returns the slot of 'key' in the table of the contents of 'dedup', which
+ * is either its slot or the empty slot where it belongs.
+ */
+static size_t* dedup_content_slot(const dedup_t* dedup, const dedup_key_t* key)
+{
+    size_t mask = dedup->table_size - 1;
+
+    // The digest is uniform already
+    uint64_t hash;
+    memcpy(&hash, key->digest, sizeof(hash));
+
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+    {
+        size_t* slot = dedup->contents + i;
+
+        if (*slot == 0 || dedup_key_equal(&dedup->files[*slot - 1].key, key))
+            return slot;
+    }
+}
+
+/** Returns the slot of 'path' of 'length' in the table of the names of
+ * 'dedup', which is either its slot or the empty slot where it belongs.
+ */
+static size_t* dedup_name_slot(const dedup_t* dedup, const char* path, size_t length)
+{
+    size_t mask = dedup->table_size - 1;
+
+    for (size_t i = (size_t)hash_name(path, length) & mask;; i = (i + 1) & mask)
+    {
+        size_t* slot = dedup->names + i;
+
+        if (*slot == 0)
+            return slot;
+
+        const dedup_file_t* file = dedup->files + *slot - 1;
+
+        if (file->path_length == length && memcmp(file->path, path, length) == 0)
+            return slot;
+    }
+}
+
+/** Doubles the tables of 'dedup' and the room for its files.
+ * @return false if out of memory.
+ */
+static bool dedup_grow(dedup_t* dedup)
+{
+    size_t capacity = dedup->file_capacity ? dedup->file_capacity * 2 : 1024;
+
+    dedup_file_t* files = realloc(dedup->files, sizeof(dedup_file_t) * capacity);
+    if (!files)
+        return false;
+
+    dedup->files = files;
+    dedup->file_capacity = capacity;
+
+    // At most half full
+    size_t* contents = calloc(capacity * 2, sizeof(size_t));
+    size_t* names = calloc(capacity * 2, sizeof(size_t));
+    if (!contents || !names)
+    {
+        free(contents);
+        free(names);
+        return false;
+    }
+
+    free(dedup->contents);
+    free(dedup->names);
+    dedup->contents = contents;
+    dedup->names = names;
+    dedup->table_size = capacity * 2;
+
+    // The last file at a path is the one there
+    for (size_t i = 0; i != dedup->file_count; ++i)
+    {
+        const dedup_file_t* file = dedup->files + i;
+
+        if (file->original)
+            *dedup_content_slot(dedup, &file->key) = i + 1;
+
+        *dedup_name_slot(dedup, file->path, file->path_length) = i + 1;
+    }
+
+    return true;
+}
+
+const dedup_file_t* dedup_find(const dedup_t* dedup, const dedup_key_t* key)
+{
+    if (dedup->table_size == 0)
+        return NULL;
+
+    size_t index = *dedup_content_slot(dedup, key);
+
+    if (index == 0 || !dedup->files[index - 1].original)
+        return NULL;
+
+    return dedup->files + index - 1;
+}
+
+bool dedup_add(dedup_t* dedup,
+               const char* path,
+               size_t length,
+               const dedup_key_t* key)
+{
+    if (dedup->file_count == dedup->file_capacity && !dedup_grow(dedup))
+        return false;
+
+    dedup_forget(dedup, path, length);
+
+    char* copy = arena_strndup(&dedup->paths, path, length);
+    if (!copy)
+        return false;
+
+    dedup_file_t* file = dedup->files + dedup->file_count;
+
+    file->key = *key;
+    file->path = copy;
+    file->path_length = length;
+    file->original = true;
+
+    *dedup_content_slot(dedup, key) = dedup->file_count + 1;
+    *dedup_name_slot(dedup, path, length) = ++dedup->file_count;
+
+    return true;
+}
+
+void dedup_forget(dedup_t* dedup, const char* path, size_t length)
+{
+    if (dedup->table_size == 0)
+        return;
+
+    size_t index = *dedup_name_slot(dedup, path, length);
+
+    if (index != 0)
+        dedup->files[index - 1].original = false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "sha256.h"
+
+/** Content of a file and the attributes its hard links share with it. */
+typedef struct dedup_key
+{
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    uint64_t size;
+
+    uint32_t mode;
+    uint64_t uid;
+    uint64_t gid;
+    uint64_t mtime;
+} dedup_key_t;
+
+/** File known to a dedup table. */
+typedef struct dedup_file
+{
+    dedup_key_t key;
+
+    const char* path;
+    size_t path_length;
+
+    // The path still holds the file
+    bool original;
+} dedup_file_t;
+
+/** Originals of files by their content and attributes, duplicates of them
+ * are made links to them.
+ * The files are found by their keys and by their paths in two open addressing
+ * hash tables of their indices. A path which is reused stops being the
+ * original of its content, the next file with the content becomes it then.
+ */
+typedef struct dedup
+{
+    arena_t paths;
+
+    dedup_file_t* files;
+    size_t file_count;
+    size_t file_capacity;
+
+    // Indices into 'files' plus one, 0 for an empty slot, of the originals by
+    // their keys and of the last files by their paths
+    size_t* contents;
+    size_t* names;
+
+    // Power of two
+    size_t table_size;
+} dedup_t;
+
+/** Initializes empty 'dedup'. */
+void dedup_init(dedup_t* dedup);
+
+/** Frees the memory of 'dedup' and its paths. */
+void dedup_destroy(dedup_t* dedup);
+
+/** Returns the original with 'key' of 'dedup' or NULL. */
+const dedup_file_t* dedup_find(const dedup_t* dedup, const dedup_key_t* key);
+
+/** Adds the file at 'path' of 'length' to 'dedup' as the original with
+ * 'key'. A previous file at the path is forgotten.
+ * @return false if out of memory.
+ */
+bool dedup_add(dedup_t* dedup,
+               const char* path,
+               size_t length,
+               const dedup_key_t* key);
+
+/** Forgets the file at 'path' of 'length' of 'dedup' if there is one, it is
+ * replaced.
+ */
+void dedup_forget(dedup_t* dedup, const char* path, size_t length);
@@ -0,0 +1,482 @@
+#include "extended.h"
+
+#include <errno.h>
+#include <string.h>
+
+/** Initializes empty 'attributes'. */
+static void extended_attributes_init(extended_attributes_t* attributes)
+{
+    attributes->path = NULL;
+    attributes->path_length = 0;
+    attributes->linkpath = NULL;
+    attributes->linkpath_length = 0;
+    attributes->has_size = false;
+    attributes->size = 0;
+    attributes->has_mtime = false;
+    attributes->mtime = 0;
+    attributes->sparse_name = NULL;
+    attributes->sparse_name_length = 0;
+    attributes->has_real_size = false;
+    attributes->real_size = 0;
+    sparse_map_init(&attributes->sparse_map);
+    attributes->sparse_map_in_data = false;
+    attributes->has_sparse_offset = false;
+    attributes->sparse_offset = 0;
+    attributes->has_digest = false;
+}
+
+void extended_init(extended_t* extended)
+{
+    arena_init(&extended->arena);
+    extended_attributes_init(&extended->local);
+
+    arena_init(&extended->global_arena);
+    extended_attributes_init(&extended->global);
+
+    extended->pending = false;
+}
+
+void extended_destroy(extended_t* extended)
+{
+    arena_destroy(&extended->arena);
+    arena_destroy(&extended->global_arena);
+}
+
+char* extended_begin(extended_t* extended, char typeflag, size_t size)
+{
+    if (size > EXTENDED_MAX_SIZE)
+        return NULL;
+
+    // The values of a global header are kept for all following members
+    return arena_alloc(typeflag == XGLTYPE ? &extended->global_arena
+                                           : &extended->arena,
+                       size + 1);
+}
+
+/** Parses the 'length' decimal digits of 'value' into '*number'. */
+static bool extended_get_decimal(const char* value, size_t length, uint64_t* number)
+{
+    uint64_t result = 0;
+
+    if (length == 0)
+        return false;
+
+    for (size_t i = 0; i != length; ++i)
+    {
+        if (value[i] < '0' || value[i] > '9')
+            return false;
+
+        uint64_t digit = (uint64_t)(value[i] - '0');
+        if (result > (UINT64_MAX - digit) / 10)
+            return false;
+
+        result = result * 10 + digit;
+    }
+
+    *number = result;
+    return true;
+}
+
+/** Parses the 'length' hexadecimal digits of 'value' into the
+ * 'length' / 2 bytes of 'bytes'.
+ */
+static bool extended_get_hex(const char* value, size_t length, unsigned char* bytes)
+{
+    for (size_t i = 0; i != length; ++i)
+    {
+        char digit = value[i];
+        unsigned nibble;
+
+        if (digit >= '0' && digit <= '9')
+            nibble = (unsigned)(digit - '0');
+        else if (digit >= 'a' && digit <= 'f')
+            nibble = (unsigned)(digit - 'a' + 10);
+        else if (digit >= 'A' && digit <= 'F')
+            nibble = (unsigned)(digit - 'A' + 10);
+        else
+            return false;
+
+        bytes[i / 2] = (unsigned char)(i % 2 ? bytes[i / 2] | nibble : nibble << 4);
+    }
+
+    return true;
+}
+
+/** Checks if the key 'key' of 'key_length' is 'name'. */
+static bool extended_key_is(const char* key, size_t key_length, const char* name)
+{
+    return key_length == strlen(name) && memcmp(key, name, key_length) == 0;
+}
+
+/** Sets the GNU sparse attribute 'key' of 'key_length' in 'attributes' to
+ * 'value' of 'value_length'. The map is allocated from 'arena'.
+ * @return false if the value is malformed or out of memory.
+ */
+static bool extended_set_sparse(extended_attributes_t* attributes,
+                                arena_t* arena,
+                                const char* key,
+                                size_t key_length,
+                                const char* value,
+                                size_t value_length)
+{
+    uint64_t number;
+
+    if (extended_key_is(key, key_length, "GNU.sparse.name"))
+    {
+        attributes->sparse_name = value_length ? value : NULL;
+        attributes->sparse_name_length = value_length;
+        return true;
+    }
+    else if (extended_key_is(key, key_length, "GNU.sparse.map"))
+        return sparse_parse_list(
+            &attributes->sparse_map, arena, value, value_length);
+
+    // The other values are numbers
+    if (!extended_get_decimal(value, value_length, &number))
+        return extended_key_is(key, key_length, "GNU.sparse.minor") ||
+               extended_key_is(key, key_length, "GNU.sparse.numblocks");
+
+    if (extended_key_is(key, key_length, "GNU.sparse.size") ||
+        extended_key_is(key, key_length, "GNU.sparse.realsize"))
+    {
+        attributes->has_real_size = true;
+        attributes->real_size = number;
+    }
+    else if (extended_key_is(key, key_length, "GNU.sparse.major"))
+        attributes->sparse_map_in_data = number == 1;
+    else if (extended_key_is(key, key_length, "GNU.sparse.offset"))
+    {
+        attributes->has_sparse_offset = true;
+        attributes->sparse_offset = number;
+    }
+    else if (extended_key_is(key, key_length, "GNU.sparse.numbytes"))
+    {
+        if (!attributes->has_sparse_offset)
+            return false;
+
+        attributes->has_sparse_offset = false;
+        return sparse_map_add(
+            &attributes->sparse_map, arena, attributes->sparse_offset, number);
+    }
+
+    return true;
+}
+
+/** Sets the attribute 'key' of 'key_length' in 'attributes' to 'value' of
+ * 'value_length', which is terminated by a NUL. An empty value unsets it.
+ * Unknown keys are ignored. Allocates from 'arena'.
+ * @return false if the value is malformed or out of memory.
+ */
+static bool extended_set(extended_attributes_t* attributes,
+                         arena_t* arena,
+                         const char* key,
+                         size_t key_length,
+                         const char* value,
+                         size_t value_length)
+{
+    if (key_length > 11 && memcmp(key, "GNU.sparse.", 11) == 0)
+        return extended_set_sparse(
+            attributes, arena, key, key_length, value, value_length);
+    else if (key_length == 4 && memcmp(key, "path", 4) == 0)
+    {
+        attributes->path = value_length ? value : NULL;
+        attributes->path_length = value_length;
+    }
+    else if (key_length == 8 && memcmp(key, "linkpath", 8) == 0)
+    {
+        attributes->linkpath = value_length ? value : NULL;
+        attributes->linkpath_length = value_length;
+    }
+    else if (key_length == 4 && memcmp(key, "size", 4) == 0)
+    {
+        attributes->has_size = value_length != 0;
+
+        if (value_length != 0 &&
+            !extended_get_decimal(value, value_length, &attributes->size))
+            return false;
+    }
+    else if (key_length == 5 && memcmp(key, "mtime", 5) == 0)
+    {
+        // The fraction of a second is dropped, times before 1970 are ignored
+        const char* point = memchr(value, '.', value_length);
+        size_t seconds_length = point ? (size_t)(point - value) : value_length;
+
+        attributes->has_mtime =
+            extended_get_decimal(value, seconds_length, &attributes->mtime);
+    }
+    else if (extended_key_is(key, key_length, "PPTAR.sha256"))
+    {
+        attributes->has_digest = value_length != 0;
+
+        if (value_length != 0 &&
+            (value_length != 2 * SHA256_DIGEST_SIZE ||
+             !extended_get_hex(value, value_length, attributes->digest)))
+            return false;
+    }
+
+    return true;
+}
+
+/** Parses the PAX records "<length> <key>=<value>\n" of the 'size' bytes of
+ * 'data' into 'attributes'. The newlines are replaced by NULs. Allocates from
+ * 'arena'.
+ * @return false if the records are malformed or out of memory.
+ */
+static bool extended_parse_records(extended_attributes_t* attributes,
+                                   arena_t* arena,
+                                   char* data,
+                                   size_t size)
+{
+    size_t offset = 0;
+
+    // Some archivers pad the records with NULs
+    while (offset != size && data[offset] != '\0')
+    {
+        char* record = data + offset;
+        size_t available = size - offset;
+
+        size_t length = 0;
+        size_t digits = 0;
+
+        for (; digits != available && record[digits] >= '0' &&
+               record[digits] <= '9';
+             ++digits)
+        {
+            length = length * 10 + (size_t)(record[digits] - '0');
+
+            if (length > available)
+                return false;
+        }
+
+        if (digits == 0 || digits == available || record[digits] != ' ' ||
+            length < digits + 3 || record[length - 1] != '\n')
+            return false;
+
+        char* key = record + digits + 1;
+        char* end = record + length - 1;
+        char* equals = memchr(key, '=', (size_t)(end - key));
+
+        if (!equals || equals == key)
+            return false;
+
+        *end = '\0';
+
+        if (!extended_set(attributes,
+                          arena,
+                          key,
+                          (size_t)(equals - key),
+                          equals + 1,
+                          (size_t)(end - equals - 1)))
+            return false;
+
+        offset += length;
+    }
+
+    return true;
+}
+
+bool extended_parse(extended_t* extended, char typeflag, char* data, size_t size)
+{
+    data[size] = '\0';
+
+    if (typeflag == XGLTYPE)
+        return extended_parse_records(
+            &extended->global, &extended->global_arena, data, size);
+
+    extended->pending = true;
+
+    if (typeflag == XHDTYPE)
+        return extended_parse_records(
+            &extended->local, &extended->arena, data, size);
+
+    // The data of a GNU header is the name terminated by a NUL
+    size_t length = strnlen(data, size);
+
+    if (typeflag == GNUTYPE_LONGNAME)
+    {
+        extended->local.path = length ? data : NULL;
+        extended->local.path_length = length;
+    }
+    else
+    {
+        extended->local.linkpath = length ? data : NULL;
+        extended->local.linkpath_length = length;
+    }
+
+    return true;
+}
+
+/** Writes the NUL terminated contents of the 'size' bytes of 'field' of a
+ * header to '*string' and '*length', copying them to 'arena' if the field is
+ * not terminated.
+ * @return false if out of memory.
+ */
+static bool extended_get_field(arena_t* arena,
+                               const char* field,
+                               size_t size,
+                               const char** string,
+                               size_t* length)
+{
+    *length = strnlen(field, size);
+
+    if (*length != size)
+    {
+        *string = field;
+        return true;
+    }
+
+    *string = arena_strndup(arena, field, size);
+    return *string != NULL;
+}
+
+/** Writes the name of 'header', joined with its prefix, to '*name' and
+ * '*length'.
+ * @return false if out of memory.
+ */
+static bool extended_get_name(arena_t* arena,
+                              const header_t* header,
+                              const char** name,
+                              size_t* length)
+{
+    // GNU archives keep other fields in the place of the prefix
+    size_t prefix_length = header->magic[5] == '\0'
+                               ? strnlen(header->prefix, sizeof(header->prefix))
+                               : 0;
+
+    if (prefix_length == 0)
+        return extended_get_field(
+            arena, header->name, sizeof(header->name), name, length);
+
+    size_t name_length = header_get_name_length(header);
+    char* joined = arena_alloc(arena, prefix_length + 1 + name_length + 1);
+    if (!joined)
+        return false;
+
+    memcpy(joined, header->prefix, prefix_length);
+    joined[prefix_length] = '/';
+    memcpy(joined + prefix_length + 1, header->name, name_length);
+    joined[prefix_length + 1 + name_length] = '\0';
+
+    *name = joined;
+    *length = prefix_length + 1 + name_length;
+    return true;
+}
+
+bool extended_make_entry(extended_t* extended,
+                         const header_t* header,
+                         entry_t* entry)
+{
+    const extended_attributes_t* local = &extended->local;
+    const extended_attributes_t* global = &extended->global;
+
+    entry->header = header;
+
+    if (local->sparse_name)
+    {
+        entry->name = local->sparse_name;
+        entry->name_length = local->sparse_name_length;
+    }
+    else if (local->path || global->path)
+    {
+        entry->name = local->path ? local->path : global->path;
+        entry->name_length = local->path ? local->path_length : global->path_length;
+    }
+    else if (!extended_get_name(
+                 &extended->arena, header, &entry->name, &entry->name_length))
+        return false;
+
+    if (local->linkpath || global->linkpath)
+    {
+        entry->linkname = local->linkpath ? local->linkpath : global->linkpath;
+        entry->linkname_length =
+            local->linkpath ? local->linkpath_length : global->linkpath_length;
+    }
+    else if (!extended_get_field(&extended->arena,
+                                 header->linkname,
+                                 sizeof(header->linkname),
+                                 &entry->linkname,
+                                 &entry->linkname_length))
+        return false;
+
+    entry->size = local->has_size    ? local->size
+                  : global->has_size ? global->size
+                                     : header_get_size(header);
+    entry->mtime = local->has_mtime    ? local->mtime
+                   : global->has_mtime ? global->mtime
+                                       : header_get_mtime(header);
+
+    // Sparse attributes make no sense for all members
+    entry->sparse = header->typeflag == GNUTYPE_SPARSE || local->has_real_size ||
+                    local->sparse_map.count != 0 || local->sparse_map_in_data;
+    entry->real_size = local->has_real_size ? local->real_size : entry->size;
+    entry->sparse_extended = false;
+    entry->sparse_map_in_data = local->sparse_map_in_data;
+
+    if (header->typeflag == GNUTYPE_SPARSE)
+    {
+        const char* block = (const char*)header;
+
+        if (!sparse_parse_gnu(&extended->local.sparse_map,
+                              &extended->arena,
+                              block + SPARSE_GNU_MAP_OFFSET,
+                              SPARSE_GNU_MAP_COUNT))
+            return false;
+
+        if (!header_get_number(
+                block + SPARSE_GNU_REAL_SIZE_OFFSET, 12, &entry->real_size))
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        entry->sparse_extended = block[SPARSE_GNU_EXTENDED_OFFSET] != '\0';
+    }
+
+    entry->segments = local->sparse_map.segments;
+    entry->segment_count = local->sparse_map.count;
+
+    // A digest makes no sense for all members either
+    entry->digest = local->has_digest ? local->digest : NULL;
+
+    return true;
+}
+
+bool extended_add_sparse_record(extended_t* extended,
+                                entry_t* entry,
+                                const char* record)
+{
+    sparse_map_t* map = &extended->local.sparse_map;
+
+    if (!sparse_parse_gnu(map, &extended->arena, record, SPARSE_GNU_EXTENSION_COUNT))
+        return false;
+
+    entry->segments = map->segments;
+    entry->segment_count = map->count;
+    entry->sparse_extended = record[SPARSE_GNU_EXTENSION_EXTENDED_OFFSET] != '\0';
+
+    return true;
+}
+
+bool extended_parse_sparse_map(extended_t* extended,
+                               entry_t* entry,
+                               const char* data,
+                               size_t size,
+                               size_t* map_size)
+{
+    sparse_map_t* map = &extended->local.sparse_map;
+
+    if (!sparse_parse_data(map, &extended->arena, data, size, map_size))
+        return false;
+
+    entry->segments = map->segments;
+    entry->segment_count = map->count;
+
+    return true;
+}
+
+void extended_reset(extended_t* extended)
+{
+    arena_reset(&extended->arena);
+    extended_attributes_init(&extended->local);
+    extended->pending = false;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "header.h"
+#include "sha256.h"
+#include "sparse.h"
+
+/** Maximum size of the data of an extended header. */
+#define EXTENDED_MAX_SIZE ((size_t)16 << 20)
+
+/** Member of an archive, its header with the preceding extended headers
+ * applied.
+ */
+typedef struct entry
+{
+    const header_t* header;
+
+    // Terminated by a NUL
+    const char* name;
+    size_t name_length;
+    const char* linkname;
+    size_t linkname_length;
+
+    uint64_t size;
+    uint64_t mtime;
+
+    // A sparse file of 'real_size' bytes, its data are the segments
+    bool sparse;
+    uint64_t real_size;
+    const sparse_segment_t* segments;
+    size_t segment_count;
+
+    // More segments follow in GNU extension records or start the data
+    bool sparse_extended;
+    bool sparse_map_in_data;
+
+    // SHA-256 of the data recorded by PPtar or NULL
+    const unsigned char* digest;
+} entry_t;
+
+/** Values of extended headers overriding header fields. */
+typedef struct extended_attributes
+{
+    // Terminated by a NUL or NULL if not given
+    const char* path;
+    size_t path_length;
+    const char* linkpath;
+    size_t linkpath_length;
+
+    bool has_size;
+    uint64_t size;
+    bool has_mtime;
+    uint64_t mtime;
+
+    // GNU sparse files, the name replaces the path
+    const char* sparse_name;
+    size_t sparse_name_length;
+    bool has_real_size;
+    uint64_t real_size;
+    sparse_map_t sparse_map;
+    bool sparse_map_in_data;
+
+    // Offset of a PAX 0.0 segment waiting for its size
+    bool has_sparse_offset;
+    uint64_t sparse_offset;
+
+    // The PPTAR.sha256 record of the data
+    bool has_digest;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+} extended_attributes_t;
+
+/** Parser of PAX extended headers, GNU long names and long links and the maps
+ * of GNU sparse files.
+ * The data of an extended header is read into an arena once and its records
+ * are parsed in place, the values point into the data. The attributes of
+ * local headers apply to the next member only, those of global headers to all
+ * following members.
+ */
+typedef struct extended
+{
+    // Data of the local headers and names of the current entry
+    arena_t arena;
+    extended_attributes_t local;
+
+    arena_t global_arena;
+    extended_attributes_t global;
+
+    // Some local headers were read since the last member
+    bool pending;
+} extended_t;
+
+/** Initializes 'extended' with no attributes. */
+void extended_init(extended_t* extended);
+
+/** Frees the memory of 'extended'. */
+void extended_destroy(extended_t* extended);
+
+/** Returns the memory to read the 'size' bytes of data of the extended header
+ * with 'typeflag' into or NULL if out of memory.
+ */
+char* extended_begin(extended_t* extended, char typeflag, size_t size);
+
+/** Parses the 'size' bytes of 'data' returned by extended_begin for the
+ * extended header with 'typeflag'.
+ * @return false if the data is malformed.
+ */
+bool extended_parse(extended_t* extended, char typeflag, char* data, size_t size);
+
+/** Makes '*entry' of 'header' with the attributes applied.
+ * The entry is valid until the next extended_reset and while 'header' is.
+ * @return false if the sparse map of the header is malformed or out of
+ * memory, errno is set.
+ */
+bool extended_make_entry(extended_t* extended,
+                         const header_t* header,
+                         entry_t* entry);
+
+/** Appends the map entries of the GNU extension record 'record' following
+ * the header of 'entry' to it.
+ * @return false if the record is malformed or out of memory, errno is set.
+ */
+bool extended_add_sparse_record(extended_t* extended,
+                                entry_t* entry,
+                                const char* record);
+
+/** Parses the map at the start of the 'size' bytes of 'data' of the PAX 1.0
+ * sparse 'entry' into it. Writes the size of the map padded to whole records
+ * to '*map_size', 0 if the data ends before the map.
+ * @return false if the map is malformed or out of memory, errno is set.
+ */
+bool extended_parse_sparse_map(extended_t* extended,
+                               entry_t* entry,
+                               const char* data,
+                               size_t size,
+                               size_t* map_size);
+
+/** Discards the local attributes and the last entry. */
+void extended_reset(extended_t* extended);
@@ -0,0 +1,1697 @@
+#include "extract.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_index.h"
+#include "dedup.h"
+#include "extractor.h"
+#include "filter.h"
+#include "header.h"
+#include "pptar.h"
+#include "reader.h"
+#include "scanner.h"
+#include "sha256.h"
+#include "tree.h"
+#include "uring_writer.h"
+#include "verifier.h"
+#include "writer.h"
+
+/** Returns the number of records a file of size 'x' occupies. */
+static size_t size_to_record_count(size_t x)
+{
+    return (x + RECORD_SIZE - 1) / RECORD_SIZE;
+}
+
+/** Prints errors about files from free arguments, unless they are excluded,
+ * after the listing in 'output'.
+ */
+static int check_files(const options_t* options,
+                       filter_t* filter,
+                       output_t* output)
+{
+    bool some_was_not_found = false;
+
+    // A failure is reported when the output is finished
+    output_flush(output);
+
+    for (const char** i = options->free_arguments; *i != NULL; ++i)
+    {
+        size_t index = (size_t)(i - options->free_arguments);
+        filter_entry_t* entry =
+            options->wildcards ? NULL : filter_find(filter, *i, strlen(*i));
+
+        // Earlier occurrences of a name are the found ones
+        if (options->wildcards ? filter->pattern_found[index] : entry->found != 0)
+        {
+            if (entry)
+                --entry->found;
+        }
+        else if (!filter_excludes(filter, *i, strlen(*i)))
+        {
+            fprintf(stderr, "PPtar: %s: Not found in archive\n", *i);
+            some_was_not_found = true;
+        }
+    }
+
+    if (some_was_not_found)
+    {
+        fprintf(stderr,
+                "PPtar: Exiting with failure status due to previous errors\n");
+
+        return 2;
+    }
+
+    return 0;
+}
+
+/** Checks if the member 'name' of 'name_length' is to be considered.
+ * Marks the name in 'filter' as found. Lists the name to 'output'.
+ */
+static bool check_file_filter(const options_t* options,
+                              output_t* output,
+                              const char* name,
+                              size_t name_length,
+                              filter_t* filter)
+{
+    if (filter_match(filter, name, name_length))
+    {
+        if (options->t || (options->x && options->v))
+            output_name(output, name, name_length);
+        return true;
+    }
+
+    return false;
+}
+
+/** Tries to open the file from the argument of the -f option into 'source'.
+ * The reader collects statistics into 'stats' unless it is NULL.
+ */
+static bool try_open_tarball(const options_t* options,
+                             pptar_t* source,
+                             stats_t* stats)
+{
+    pptar_options_t source_options = pptar_options_default();
+
+    source_options.buffer_size = options->buffer_size;
+    source_options.map = options->mmap;
+    source_options.stats = stats;
+
+    if (!pptar_open(source, options->f_argument, &source_options))
+    {
+        if (errno == ENOTSUP)
+            fprintf(stderr,
+                    "PPtar: compression of %s is not supported by this build\n",
+                    options->f_argument);
+        else
+            fprintf(stderr,
+                    "PPtar: could not open file %s\n",
+                    options->f_argument);
+
+        return false;
+    }
+
+    return true;
+}
+
+/** State of a pass over an archive. */
+typedef struct archive
+{
+    const options_t* options;
+    output_t* output;
+    filter_t filter;
+
+    // The archive read, its reader and the attributes of its extended headers
+    pptar_t source;
+
+    // Descriptor of the current file being extracted or -1 and its node
+    int file_output;
+    tree_node_t file_node;
+
+    // The file is written to 'data_output', its bytes written so far
+    bool file_stdout;
+    uint64_t stdout_offset;
+
+    // Buffered standard output of the data of files extracted with -O
+    output_t* data_output;
+
+    // The file is written past the page cache through 'direct_writer'
+    bool file_direct;
+    direct_writer_t direct_writer;
+
+    // Extracted files, directories and links
+    tree_t tree;
+    tree_cache_t tree_cache;
+
+    // Extracting by the workers of 'extractor'
+    bool parallel;
+    extractor_t extractor;
+
+    // Writing small files through 'uring_writer'
+    bool uring;
+    uring_writer_t uring_writer;
+
+    // Extracted files with the key of an earlier one are links to it
+    bool deduplicating;
+    dedup_t dedup;
+
+    // The filesystem may clone files
+    bool clones;
+
+    // The key of the file being written is known or its data is hashed while
+    // it is written
+    bool file_keyed;
+    bool file_hashing;
+    dedup_key_t file_key;
+    sha256_t file_hash;
+
+    // Listed files with a digest are checked by the workers of 'verifier'
+    bool verifying;
+    verifier_t verifier;
+
+    // Leading slashes were removed from names or link targets already, the
+    // warning is printed once
+    bool stripped_name;
+    bool stripped_link;
+
+    // Exit code of skipped members, the extraction goes on
+    int error_code;
+
+    // Statistics to collect or NULL
+    stats_t* stats;
+} archive_t;
+
+/** Returns the current time if 'archive' collects statistics. */
+static uint64_t archive_clock(const archive_t* archive)
+{
+    return archive->stats ? stats_now() : 0;
+}
+
+/** Adds the time since 'start' to the output time of 'archive'. */
+static void archive_add_output_time(archive_t* archive, uint64_t start)
+{
+    if (archive->stats)
+        archive->stats->output_time += stats_now() - start;
+}
+
+/** Waits for the workers of a parallel 'archive' or for its io_uring writer
+ * and stops them.
+ * A failure of theirs happened before any failure of the reader.
+ * @return The exit code of the workers.
+ */
+static int archive_stop_workers(archive_t* archive)
+{
+    if (archive->uring)
+    {
+        archive->uring = false;
+        return uring_writer_finish(&archive->uring_writer);
+    }
+
+    if (!archive->parallel)
+        return 0;
+
+    archive->parallel = false;
+    return extractor_finish(&archive->extractor, archive->stats);
+}
+
+/** Prints the error message of a truncated archive.
+ * @return The exit code.
+ */
+static int unexpected_eof(archive_t* archive)
+{
+    int return_code = archive_stop_workers(archive);
+    if (return_code != 0)
+        return return_code;
+
+    // The members listed before come first, a failure is reported later
+    output_flush(archive->output);
+
+    pptar_check_read_error(&archive->source.reader);
+    fprintf(stderr,
+            "PPtar: Unexpected EOF in archive\n"
+            "PPtar: Error is not recoverable: exiting now\n");
+    return 2;
+}
+
+/** Prints the error message of a malformed extended header.
+ * @return The exit code.
+ */
+static int malformed_extended(archive_t* archive)
+{
+    int return_code = archive_stop_workers(archive);
+    if (return_code != 0)
+        return return_code;
+
+    fprintf(stderr,
+            "PPtar: Malformed extended header\n"
+            "PPtar: Exiting with failure status due to previous errors\n");
+    return 2;
+}
+
+/** Prints the error message of a failed read of 'status' from 'archive'.
+ * @return The exit code.
+ */
+static int read_failed(archive_t* archive, pptar_status_t status)
+{
+    int return_code;
+
+    switch (status)
+    {
+        case PPTAR_TRUNCATED:
+            return unexpected_eof(archive);
+        case PPTAR_MALFORMED:
+            return malformed_extended(archive);
+        case PPTAR_BAD_HEADER:
+            if ((return_code = archive_stop_workers(archive)) != 0)
+                return return_code;
+
+            return pptar_check_header(archive->source.header_status,
+                                      archive->source.typeflag);
+        case PPTAR_NO_MEMORY:
+            fprintf(stderr, "PPtar: Out of memory\n");
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/** Returns the node of the member 'entry'. */
+static tree_node_t entry_node(const entry_t* entry)
+{
+    tree_node_t node;
+
+    node.typeflag = entry->header->typeflag;
+    node.linkname = entry->linkname;
+    node.mode = header_get_mode(entry->header);
+    node.uid = header_get_uid(entry->header);
+    node.gid = header_get_gid(entry->header);
+    node.mtime = entry->mtime;
+    node.sparse = entry->sparse;
+    node.size = entry->real_size;
+
+    // Old archivers marked directories by a trailing slash only
+    if (node.typeflag == AREGTYPE && entry->name_length != 0 &&
+        entry->name[entry->name_length - 1] == '/')
+        node.typeflag = DIRTYPE;
+    else if (node.typeflag == AREGTYPE || node.typeflag == GNUTYPE_SPARSE)
+        node.typeflag = REGTYPE;
+
+    return node;
+}
+
+/** Passes the regular file 'entry' of 'node' to the workers of 'archive'.
+ * @return The exit code.
+ */
+static int extract_parallel(archive_t* archive,
+                            const entry_t* entry,
+                            const tree_node_t* node)
+{
+    reader_t* reader = &archive->source.reader;
+
+    size_t size = (size_t)entry->size;
+    size_t record_count = size_to_record_count(size);
+
+    if (!extractor_begin(
+            &archive->extractor, entry->name, entry->name_length, node, size))
+        return archive_stop_workers(archive);
+
+    while (record_count != 0)
+    {
+        size_t read;
+        const char* data = reader_next(reader, record_count * RECORD_SIZE, &read);
+
+        if (data)
+            extractor_write(&archive->extractor, data, read < size ? read : size);
+
+        size -= read < size ? read : size;
+
+        if (read % RECORD_SIZE != 0 || read == 0)
+        {
+            extractor_end(&archive->extractor);
+            return unexpected_eof(archive);
+        }
+
+        record_count -= read / RECORD_SIZE;
+        archive->source.block_index += read / RECORD_SIZE;
+    }
+
+    extractor_end(&archive->extractor);
+    return 0;
+}
+
+/** Writes 'size' bytes of 'data' to the file extracted by 'archive'.
+ * @return false on failure, errno is set.
+ */
+static bool write_output(archive_t* archive, const char* data, size_t size)
+{
+    if (archive->file_stdout)
+        return output_data(archive->data_output, data, size);
+
+    if (archive->file_direct)
+        return direct_writer_write(&archive->direct_writer, data, size);
+
+    return write_all(archive->file_output, data, size);
+}
+
+/** Writes 'size' bytes of 'data' at 'offset' of the file which 'archive'
+ * extracts to the standard output. The bytes from the end of the last write
+ * are a hole, zeros are written for them.
+ * @return false on failure, errno is set.
+ */
+static bool write_stdout_at(archive_t* archive,
+                            uint64_t offset,
+                            const char* data,
+                            size_t size)
+{
+    static const char zeros[RECORD_SIZE * 8];
+
+    while (archive->stdout_offset < offset)
+    {
+        size_t chunk = offset - archive->stdout_offset < sizeof(zeros)
+                           ? (size_t)(offset - archive->stdout_offset)
+                           : sizeof(zeros);
+
+        if (!output_data(archive->data_output, zeros, chunk))
+            return false;
+
+        archive->stdout_offset += chunk;
+    }
+
+    archive->stdout_offset += size;
+
+    return size == 0 || output_data(archive->data_output, data, size);
+}
+
+/** Passes the small regular file 'entry' of 'node' to the io_uring writer of
+ * 'archive'.
+ * @return The exit code.
+ */
+static int extract_uring(archive_t* archive,
+                         const entry_t* entry,
+                         const tree_node_t* node)
+{
+    reader_t* reader = &archive->source.reader;
+
+    size_t size = (size_t)entry->size;
+    size_t record_count = size_to_record_count(size);
+
+    uint64_t start = archive_clock(archive);
+
+    char* buffer = uring_writer_begin(
+        &archive->uring_writer, entry->name, entry->name_length, node);
+
+    archive_add_output_time(archive, start);
+
+    if (!buffer)
+        return archive_stop_workers(archive);
+
+    // The data is copied to the registered buffer of the file
+    size_t copied = 0;
+
+    while (record_count != 0)
+    {
+        size_t read;
+        const char* data = reader_next(reader, record_count * RECORD_SIZE, &read);
+        size_t useful = read < size - copied ? read : size - copied;
+
+        if (data)
+            memcpy(buffer + copied, data, useful);
+
+        copied += useful;
+
+        if (read % RECORD_SIZE != 0 || read == 0)
+        {
+            uring_writer_end(&archive->uring_writer, copied);
+            return unexpected_eof(archive);
+        }
+
+        record_count -= read / RECORD_SIZE;
+        archive->source.block_index += read / RECORD_SIZE;
+    }
+
+    start = archive_clock(archive);
+
+    uring_writer_end(&archive->uring_writer, copied);
+
+    archive_add_output_time(archive, start);
+    if (archive->stats)
+    {
+        ++archive->stats->files_created;
+        archive->stats->bytes_written += copied;
+    }
+
+    return 0;
+}
+
+/** Closes the file extracted from the member 'entry' of 'archive'.
+ * @return The exit code.
+ */
+static int close_output(archive_t* archive, const entry_t* entry)
+{
+    uint64_t start = archive_clock(archive);
+
+    if (archive->file_stdout)
+    {
+        archive->file_stdout = false;
+        archive->file_output = -1;
+
+        // The holes at the end of a sparse file
+        bool written = !entry->sparse ||
+                       write_stdout_at(archive, entry->real_size, NULL, 0);
+
+        archive_add_output_time(archive, start);
+
+        if (!written)
+        {
+            fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+
+            return 9;
+        }
+
+        return 0;
+    }
+
+    if (archive->file_direct && !direct_writer_end(&archive->direct_writer))
+    {
+        fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+
+        return 9;
+    }
+
+    bool restored =
+        tree_close_file(&archive->tree, archive->file_output, &archive->file_node);
+    archive->file_output = -1;
+
+    archive_add_output_time(archive, start);
+
+    if (!restored)
+    {
+        fprintf(stderr, "PPtar: Couldn't restore attributes of %s\n", entry->name);
+
+        return 9;
+    }
+
+    return 0;
+}
+
+/** Writes the 'size' bytes of 'data' of the sparse 'entry' of 'archive' to
+ * its segments from '*segment', of which '*done' bytes were written.
+ * @return The exit code.
+ */
+static int write_sparse(archive_t* archive,
+                        const entry_t* entry,
+                        size_t* segment,
+                        uint64_t* done,
+                        const char* data,
+                        size_t size)
+{
+    while (size != 0 && *segment != entry->segment_count)
+    {
+        const sparse_segment_t* current = entry->segments + *segment;
+        size_t chunk =
+            current->size - *done < size ? (size_t)(current->size - *done) : size;
+
+        if (archive->parallel)
+        {
+            extractor_seek(&archive->extractor, current->offset + *done);
+            extractor_write(&archive->extractor, data, chunk);
+        }
+        else if (archive->file_stdout
+                     ? !write_stdout_at(
+                           archive, current->offset + *done, data, chunk)
+                     : !pwrite_all(archive->file_output,
+                                   data,
+                                   chunk,
+                                   (off_t)(current->offset + *done)))
+        {
+            fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+
+            return 9;
+        }
+        else if (archive->stats)
+            archive->stats->bytes_written += chunk;
+
+        data += chunk;
+        size -= chunk;
+        *done += chunk;
+
+        if (*done == current->size)
+        {
+            ++*segment;
+            *done = 0;
+        }
+    }
+
+    return 0;
+}
+
+/** Extracts the sparse file 'entry' of 'node' into the file being extracted
+ * or by the workers of 'archive'. Only the segments are written, the holes
+ * are skipped.
+ * @return The exit code.
+ */
+static int extract_sparse(archive_t* archive,
+                          const entry_t* entry,
+                          const tree_node_t* node)
+{
+    reader_t* reader = &archive->source.reader;
+
+    // The map of a PAX 1.0 sparse file is read here
+    entry_t sparse = *entry;
+    size_t map_size = 0;
+    int return_code;
+    pptar_status_t status;
+
+    if (sparse.sparse_map_in_data &&
+        (status = pptar_read_sparse_map(&archive->source, &sparse, &map_size)) !=
+            PPTAR_OK)
+        return read_failed(archive, status);
+
+    size_t size = (size_t)sparse.size - map_size;
+    size_t record_count = size_to_record_count(size);
+
+    uint64_t data_size = 0;
+    for (size_t i = 0; i != sparse.segment_count; ++i)
+        data_size += sparse.segments[i].size;
+
+    if (archive->parallel &&
+        !extractor_begin(&archive->extractor,
+                         sparse.name,
+                         sparse.name_length,
+                         node,
+                         data_size < size ? (size_t)data_size : size))
+        return archive_stop_workers(archive);
+
+    size_t segment = 0;
+    uint64_t done = 0;
+
+    while (record_count != 0)
+    {
+        size_t read;
+        const char* data = reader_next(reader, record_count * RECORD_SIZE, &read);
+        uint64_t start = archive_clock(archive);
+
+        if (data &&
+            (return_code = write_sparse(archive,
+                                        &sparse,
+                                        &segment,
+                                        &done,
+                                        data,
+                                        read < size ? read : size)) != 0)
+            return return_code;
+
+        if (!archive->parallel)
+            archive_add_output_time(archive, start);
+
+        size -= read < size ? read : size;
+
+        if (read % RECORD_SIZE != 0 || read == 0)
+        {
+            if (archive->parallel)
+                extractor_end(&archive->extractor);
+
+            return unexpected_eof(archive);
+        }
+
+        record_count -= read / RECORD_SIZE;
+        archive->source.block_index += read / RECORD_SIZE;
+    }
+
+    if (archive->parallel)
+    {
+        extractor_end(&archive->extractor);
+        return 0;
+    }
+
+    return close_output(archive, &sparse);
+}
+
+/** Makes the regular file 'node' at 'name' extracted by 'archive' share the
+ * content of the file 'original', by cloning it if the filesystem can and by
+ * a hard link otherwise. Replaces a file written there already.
+ * @return false if neither worked, the file is written then.
+ */
+static bool link_duplicate(archive_t* archive,
+                           const char* name,
+                           const tree_node_t* node,
+                           const dedup_file_t* original)
+{
+    uint64_t start = archive_clock(archive);
+
+    bool linked = archive->clones && tree_clone_file(&archive->tree,
+                                                     &archive->tree_cache,
+                                                     name,
+                                                     node,
+                                                     original->path);
+
+    // A filesystem which cannot clone is not asked again
+    if (!linked && archive->clones &&
+        (errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL))
+        archive->clones = false;
+
+    if (!linked)
+    {
+        tree_node_t link = *node;
+
+        link.typeflag = LNKTYPE;
+        link.linkname = original->path;
+
+        linked = tree_create(&archive->tree, &archive->tree_cache, name, &link);
+    }
+
+    archive_add_output_time(archive, start);
+    if (linked && archive->stats)
+        ++archive->stats->files_linked;
+
+    return linked;
+}
+
+/** Writes the key of the regular file 'node' of 'size' bytes to 'key', all
+ * but the digest.
+ */
+static void node_key(const tree_node_t* node, uint64_t size, dedup_key_t* key)
+{
+    key->size = size;
+    key->mode = node->mode;
+    key->uid = node->uid;
+    key->gid = node->gid;
+    key->mtime = node->mtime;
+}
+
+/** Hashes the data of the regular file 'entry' of 'node' extracted by
+ * 'archive' if the reader has all of it, and links the file to an earlier
+ * one with the same key without writing it. Otherwise the data is hashed
+ * while it is written.
+ * @return The exit code or -1 if the file has to be written.
+ */
+static int extract_duplicate(archive_t* archive,
+                             const entry_t* entry,
+                             const tree_node_t* node)
+{
+    reader_t* reader = &archive->source.reader;
+    size_t size = (size_t)entry->size;
+
+    node_key(node, entry->size, &archive->file_key);
+
+    size_t available;
+    const char* data = reader_peek(reader, size, &available);
+
+    if (available < size)
+    {
+        archive->file_hashing = true;
+        sha256_init(&archive->file_hash);
+        return -1;
+    }
+
+    sha256(data, size, archive->file_key.digest);
+    archive->file_keyed = true;
+
+    const dedup_file_t* original =
+        dedup_find(&archive->dedup, &archive->file_key);
+
+    if (!original || !link_duplicate(archive, entry->name, node, original))
+        return -1;
+
+    archive->file_keyed = false;
+
+    size_t record_count = size_to_record_count(size);
+    size_t skipped = reader_skip(reader, record_count * RECORD_SIZE);
+
+    archive->source.block_index += skipped / RECORD_SIZE;
+
+    if (skipped != record_count * RECORD_SIZE)
+        return unexpected_eof(archive);
+
+    return 0;
+}
+
+/** Adds the file just written from the member 'entry' of 'archive' to the
+ * originals by the key found before or while writing it. A file hashed while
+ * it was written is replaced by a link if it turns out to be a duplicate,
+ * which saves its space at least.
+ */
+static void add_written(archive_t* archive, const entry_t* entry)
+{
+    if (archive->file_hashing)
+    {
+        archive->file_hashing = false;
+        sha256_final(&archive->file_hash, archive->file_key.digest);
+
+        const dedup_file_t* original =
+            dedup_find(&archive->dedup, &archive->file_key);
+
+        if (original &&
+            link_duplicate(archive, entry->name, &archive->file_node, original))
+            return;
+    }
+    else if (!archive->file_keyed)
+        return;
+
+    archive->file_keyed = false;
+
+    // Out of memory, the file is only not linked to
+    dedup_add(
+        &archive->dedup, entry->name, entry->name_length, &archive->file_key);
+}
+
+/** Reads the data of the listed file 'entry' and passes it to the verifier
+ * of 'archive' to check against its digest.
+ * @return The exit code.
+ */
+static int verify_member(archive_t* archive, const entry_t* entry)
+{
+    reader_t* reader = &archive->source.reader;
+
+    size_t size = (size_t)entry->size;
+    size_t record_count = size_to_record_count(size);
+
+    verifier_begin(
+        &archive->verifier, entry->name, entry->name_length, entry->digest, size);
+
+    while (record_count != 0)
+    {
+        size_t read;
+        const char* data = reader_next(reader, record_count * RECORD_SIZE, &read);
+
+        if (data)
+            verifier_write(&archive->verifier, data, read < size ? read : size);
+
+        size -= read < size ? read : size;
+
+        if (read % RECORD_SIZE != 0 || read == 0)
+        {
+            verifier_cancel(&archive->verifier);
+            return unexpected_eof(archive);
+        }
+
+        record_count -= read / RECORD_SIZE;
+        archive->source.block_index += read / RECORD_SIZE;
+    }
+
+    verifier_end(&archive->verifier);
+
+    return 0;
+}
+
+/** Checks if the 'length' bytes of 'path' have a '..' component. */
+static bool has_dotdot(const char* path, size_t length)
+{
+    for (size_t i = 0; i + 1 < length; ++i)
+        if (path[i] == '.' && path[i + 1] == '.' && (i == 0 || path[i - 1] == '/') &&
+            (i + 2 == length || path[i + 2] == '/'))
+            return true;
+
+    return false;
+}
+
+/** Removes the leading slashes of '*path' of '*length', an empty path is the
+ * working directory then. Prints the 'warning' unless '*stripped' is true.
+ */
+static void strip_slashes(const char** path,
+                          size_t* length,
+                          bool* stripped,
+                          const char* warning)
+{
+    if (*length == 0 || **path != '/')
+        return;
+
+    while (*length != 0 && **path == '/')
+    {
+        ++*path;
+        --*length;
+    }
+
+    if (*length == 0)
+    {
+        *path = ".";
+        *length = 1;
+    }
+
+    if (!*stripped)
+        fprintf(stderr, "PPtar: Removing leading '/' from %s\n", warning);
+    *stripped = true;
+}
+
+/** Makes the name and the link target of the member 'entry', extracted by
+ * 'archive', relative to the working directory. Members which would leave it
+ * are skipped.
+ * @return false if the member is skipped.
+ */
+static bool make_relative(archive_t* archive, entry_t* entry)
+{
+    strip_slashes(
+        &entry->name, &entry->name_length, &archive->stripped_name, "member names");
+
+    // Symlinks are never followed, only the targets of hard links matter
+    bool hard_link = entry->header->typeflag == LNKTYPE;
+
+    if (hard_link)
+        strip_slashes(&entry->linkname,
+                      &entry->linkname_length,
+                      &archive->stripped_link,
+                      "hard link targets");
+
+    const char* unsafe =
+        has_dotdot(entry->name, entry->name_length) ? "Member name"
+        : hard_link && has_dotdot(entry->linkname, entry->linkname_length)
+            ? "Hard link target"
+            : NULL;
+
+    if (!unsafe)
+        return true;
+
+    fprintf(stderr, "PPtar: %s: %s contains '..', skipped\n", entry->name, unsafe);
+    archive->error_code = 2;
+
+    return false;
+}
+
+/** Lists or extracts the member 'entry', whose header was just read.
+ * @return The exit code.
+ */
+static int process_member(archive_t* archive, const entry_t* entry)
+{
+    const options_t* options = archive->options;
+    reader_t* reader = &archive->source.reader;
+
+    bool selected = check_file_filter(options,
+                                      archive->output,
+                                      entry->name,
+                                      entry->name_length,
+                                      &archive->filter);
+
+    // Extracted members stay beneath the working directory
+    entry_t relative;
+
+    if (selected && options->x && !archive->data_output)
+    {
+        relative = *entry;
+        selected = make_relative(archive, &relative);
+        entry = &relative;
+    }
+
+    // Only the data of files goes to the standard output
+    if (selected && options->x && archive->data_output)
+    {
+        tree_node_t node = entry_node(entry);
+
+        if (node.typeflag == REGTYPE)
+        {
+            archive->file_output = STDOUT_FILENO;
+            archive->file_stdout = true;
+            archive->stdout_offset = 0;
+
+            if (entry->sparse)
+                return extract_sparse(archive, entry, &node);
+        }
+    }
+    else if (selected && options->x)
+    {
+        tree_node_t node = entry_node(entry);
+
+        if (archive->uring && node.typeflag == REGTYPE && !entry->sparse &&
+            entry->size <= URING_WRITER_MAX_SIZE)
+            return extract_uring(archive, entry, &node);
+
+        // The other members are created after the small files before them
+        if (archive->uring && !uring_writer_wait(&archive->uring_writer))
+            return archive_stop_workers(archive);
+
+        if (archive->parallel && node.typeflag == REGTYPE)
+            return entry->sparse ? extract_sparse(archive, entry, &node)
+                                 : extract_parallel(archive, entry, &node);
+
+        // A file replacing another one must not change its hard links, which
+        // this or an earlier extraction may have made
+        if (archive->deduplicating)
+        {
+            dedup_forget(&archive->dedup, entry->name, entry->name_length);
+
+            if (node.typeflag == REGTYPE &&
+                !tree_remove_file(&archive->tree_cache, entry->name))
+            {
+                fprintf(stderr, "PPtar: Couldn't create file %s\n", entry->name);
+
+                return 9;
+            }
+        }
+
+        int return_code;
+
+        if (archive->deduplicating && node.typeflag == REGTYPE &&
+            !entry->sparse && entry->size != 0 &&
+            (return_code = extract_duplicate(archive, entry, &node)) != -1)
+            return return_code;
+
+        uint64_t start = archive_clock(archive);
+
+        // Directories and links have no data, any data is skipped below
+        if (archive->parallel)
+        {
+            if (!extractor_begin(&archive->extractor,
+                                 entry->name,
+                                 entry->name_length,
+                                 &node,
+                                 0))
+                return archive_stop_workers(archive);
+
+            extractor_end(&archive->extractor);
+        }
+        else if (node.typeflag != REGTYPE)
+        {
+            if (!tree_create(
+                    &archive->tree, &archive->tree_cache, entry->name, &node))
+            {
+                fprintf(stderr, tree_create_error(node.typeflag), entry->name);
+
+                return 9;
+            }
+
+            archive_add_output_time(archive, start);
+        }
+        else
+        {
+            archive->file_output = tree_open_file(&archive->tree,
+                                                  &archive->tree_cache,
+                                                  entry->name,
+                                                  &node,
+                                                  &archive->file_direct);
+            if (archive->file_output == -1)
+            {
+                fprintf(stderr, "PPtar: Couldn't create file %s\n", entry->name);
+
+                return 9;
+            }
+
+            archive->file_node = node;
+            archive->file_node.linkname = NULL;
+
+            if (archive->file_direct)
+                direct_writer_begin(&archive->direct_writer, archive->file_output);
+
+            archive_add_output_time(archive, start);
+            if (archive->stats)
+                ++archive->stats->files_created;
+
+            if (entry->sparse)
+                return extract_sparse(archive, entry, &node);
+        }
+    }
+
+    size_t size = (size_t)entry->size;
+    size_t record_count = size_to_record_count(size);
+
+    // Listed files with a digest are read and hashed
+    if (archive->verifying && selected && entry->digest && !entry->sparse &&
+        entry_node(entry).typeflag == REGTYPE)
+        return verify_member(archive, entry);
+
+    // Listing or not selected, only the header chain is traversed
+    if (archive->file_output == -1)
+    {
+        size_t skipped = reader_skip(reader, record_count * RECORD_SIZE);
+
+        archive->source.block_index += skipped / RECORD_SIZE;
+
+        if (skipped != record_count * RECORD_SIZE)
+            return unexpected_eof(archive);
+
+        return 0;
+    }
+
+    // Whole records are copied by the kernel, the rest by the loop below.
+    // Smaller files go to the standard output through its buffer.
+    if (!reader->mapped && !archive->file_direct && !archive->file_hashing &&
+        (!archive->file_stdout || size >= OUTPUT_BUFFER_SIZE))
+    {
+        size_t whole_size = size / RECORD_SIZE * RECORD_SIZE;
+        size_t copied;
+
+        if ((archive->file_stdout && !output_flush(archive->data_output)) ||
+            !reader_copy(reader, archive->file_output, whole_size, &copied))
+        {
+            fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+
+            return 9;
+        }
+
+        size -= copied;
+        record_count -= copied / RECORD_SIZE;
+        archive->source.block_index += copied / RECORD_SIZE;
+
+        if (copied != whole_size)
+            return unexpected_eof(archive);
+    }
+
+    while (record_count != 0)
+    {
+        size_t read;
+        const char* data = reader_next(reader, record_count * RECORD_SIZE, &read);
+
+        uint64_t start = archive_clock(archive);
+
+        // Written directly from the buffer or the mapping
+        if (data && !write_output(archive, data, read < size ? read : size))
+        {
+            fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+
+            return 9;
+        }
+
+        if (data && archive->file_hashing)
+            sha256_update(&archive->file_hash, data, read < size ? read : size);
+
+        archive_add_output_time(archive, start);
+        if (archive->stats)
+            archive->stats->bytes_written += read < size ? read : size;
+
+        size -= read < size ? read : size;
+
+        if (read % RECORD_SIZE != 0 || read == 0)
+            return unexpected_eof(archive);
+
+        record_count -= read / RECORD_SIZE;
+        archive->source.block_index += read / RECORD_SIZE;
+    }
+
+    int return_code = close_output(archive, entry);
+
+    if (return_code == 0 && archive->deduplicating)
+        add_written(archive, entry);
+
+    return return_code;
+}
+
+/** Processes the member 'entry' read at 'start' and records the time it
+ * took, unless the workers of 'archive' record it.
+ * @return The exit code.
+ */
+static int process_member_timed(archive_t* archive,
+                                const entry_t* entry,
+                                uint64_t start)
+{
+    bool parallel = archive->parallel;
+
+    int return_code = process_member(archive, entry);
+
+    if (archive->stats && !parallel)
+        stats_add_member(archive->stats, stats_now() - start);
+
+    return return_code;
+}
+
+/** Lists or extracts the members of 'archive' from its start.
+ * Adds all members to 'builder' if it is not NULL.
+ * @return The exit code.
+ */
+static int process_archive(archive_t* archive,
+                           archive_index_builder_t* builder)
+{
+    const options_t* options = archive->options;
+    pptar_t* source = &archive->source;
+
+    while (true)
+    {
+        // The rest of the archive can neither match nor be validated
+        if (options->occurrence && filter_done(&archive->filter))
+            return 0;
+
+        uint64_t member_start = archive_clock(archive);
+        uint64_t input_time = archive->stats ? archive->stats->input_time : 0;
+
+        entry_t entry;
+        pptar_status_t status = pptar_read_entry(source, &entry);
+
+        if (status == PPTAR_END)
+        {
+            if (source->lone_null_block)
+                output_message(archive->output,
+                               "PPtar: A lone zero block at %zu\n",
+                               source->block_index);
+
+            return 0;
+        }
+        else if (status != PPTAR_OK)
+            return read_failed(archive, status);
+
+        if (builder)
+        {
+            archive_index_entry_t index_entry;
+
+            index_entry.name = entry.name;
+            index_entry.name_length = entry.name_length;
+            index_entry.header_offset = (uint64_t)source->entry_offset;
+            index_entry.size = entry.size;
+            index_entry.mtime = entry.mtime;
+
+            archive_index_builder_add(builder, &index_entry);
+        }
+
+        // Reading the headers is input time
+        if (archive->stats)
+        {
+            ++archive->stats->headers_parsed;
+            archive->stats->header_time += stats_now() - member_start -
+                                           (archive->stats->input_time - input_time);
+        }
+
+        int return_code = process_member_timed(archive, &entry, member_start);
+        if (return_code != 0)
+            return return_code;
+    }
+}
+
+/** Orders index entries by header offset. */
+static int compare_header_offsets(const void* a_void, const void* b_void)
+{
+    const archive_index_entry_t* a = a_void;
+    const archive_index_entry_t* b = b_void;
+
+    return a->header_offset < b->header_offset   ? -1
+           : a->header_offset > b->header_offset ? 1
+                                                 : 0;
+}
+
+/** Lists or extracts the members of 'archive' given by free arguments,
+ * seeking to them by 'index'.
+ * @return The exit code.
+ */
+static int process_indexed(archive_t* archive, const archive_index_t* index)
+{
+    const filter_t* filter = &archive->filter;
+    reader_t* reader = &archive->source.reader;
+
+    size_t entry_count = 0;
+    for (const filter_entry_t* i = filter->entries;
+         i != filter->entries + filter->entry_count;
+         ++i)
+        entry_count += i->requested;
+
+    archive_index_entry_t* entries =
+        malloc(sizeof(archive_index_entry_t) * (entry_count + 1));
+    if (!entries)
+    {
+        fprintf(stderr, "PPtar: Out of memory\n");
+        return 2;
+    }
+
+    // Each given name selects the next occurrence of it
+    entry_count = 0;
+    for (const filter_entry_t* i = filter->entries;
+         i != filter->entries + filter->entry_count;
+         ++i)
+    {
+        size_t position = archive_index_find(index, i->name, i->length);
+
+        for (size_t j = 0; j != i->requested && position != index->entry_count;
+             ++j, ++position)
+        {
+            archive_index_entry_t entry = archive_index_get(index, position);
+
+            if (entry.name_length != i->length ||
+                memcmp(entry.name, i->name, i->length) != 0)
+                break;
+
+            entries[entry_count++] = entry;
+        }
+    }
+
+    qsort(entries,
+          entry_count,
+          sizeof(archive_index_entry_t),
+          compare_header_offsets);
+
+    int return_code = 0;
+
+    for (const archive_index_entry_t* i = entries;
+         return_code == 0 && i != entries + entry_count;
+         ++i)
+    {
+        entry_t entry;
+        uint64_t member_start = archive_clock(archive);
+        pptar_status_t status = PPTAR_END;
+
+        // A member is read from its first header
+        if (reader_seek(reader, (off_t)i->header_offset))
+        {
+            archive->source.was_null_block = false;
+            status = pptar_read_entry(&archive->source, &entry);
+        }
+
+        if (status != PPTAR_OK && status != PPTAR_END)
+        {
+            return_code = read_failed(archive, status);
+            break;
+        }
+
+        if (status != PPTAR_OK || entry.name_length != i->name_length ||
+            memcmp(entry.name, i->name, i->name_length) != 0)
+        {
+            if ((return_code = archive_stop_workers(archive)) != 0)
+                break;
+
+            fprintf(stderr,
+                    "PPtar: Index %s does not match the archive\n",
+                    archive->options->index);
+
+            return_code = 2;
+            break;
+        }
+
+        archive->source.block_index = (size_t)(reader_tell(reader) / RECORD_SIZE);
+
+        if (archive->stats)
+            ++archive->stats->headers_parsed;
+
+        return_code = process_member_timed(archive, &entry, member_start);
+    }
+
+    free(entries);
+    return return_code;
+}
+
+/** Orders offsets. */
+static int compare_offsets(const void* a_void, const void* b_void)
+{
+    const uint64_t* a = a_void;
+    const uint64_t* b = b_void;
+
+    return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+/** Lists the members of the walk of 'region', which starts on the header
+ * chain of 'archive'.
+ * Adds them to 'builder' if it is not NULL. Keeps track of null blocks in
+ * '*was_null_block' and writes the offset at which the walk left the region to
+ * '*next_offset'.
+ * @return The exit code or -1 if the walk left the region.
+ */
+static int list_region(archive_t* archive,
+                       const scan_region_t* region,
+                       archive_index_builder_t* builder,
+                       bool* was_null_block,
+                       uint64_t* next_offset)
+{
+    const options_t* options = archive->options;
+
+    if (region->failed)
+    {
+        fprintf(stderr, "PPtar: Out of memory\n");
+        return 2;
+    }
+
+    for (const scan_event_t* i = region->events;
+         i != region->events + region->event_count;
+         ++i)
+    {
+        // The rest of the archive can neither match nor be validated
+        if (options->occurrence && filter_done(&archive->filter))
+            return 0;
+
+        archive->source.block_index = (size_t)(i->offset / RECORD_SIZE);
+
+        switch (i->kind)
+        {
+            case SCAN_MEMBER:
+            {
+                const char* name = region->names + i->name_offset;
+
+                if (builder)
+                {
+                    archive_index_entry_t entry;
+
+                    entry.name = name;
+                    entry.name_length = i->name_length;
+                    entry.header_offset = i->offset;
+                    entry.size = i->size;
+                    entry.mtime = i->mtime;
+
+                    archive_index_builder_add(builder, &entry);
+                }
+
+                uint64_t start = archive->stats ? stats_now() : 0;
+
+                check_file_filter(options,
+                                  archive->output,
+                                  name,
+                                  i->name_length,
+                                  &archive->filter);
+
+                // The time of the walk and of the listing
+                if (archive->stats)
+                {
+                    ++archive->stats->headers_parsed;
+                    stats_add_member(archive->stats,
+                                     i->time + stats_now() - start);
+                }
+                break;
+            }
+            case SCAN_NULL:
+                if (*was_null_block)
+                    return 0;
+
+                *was_null_block = true;
+                break;
+            case SCAN_EOF:
+                if (*was_null_block)
+                    output_message(archive->output,
+                                   "PPtar: A lone zero block at %zu\n",
+                                   archive->source.block_index);
+
+                return 0;
+            case SCAN_INVALID:
+                return pptar_check_header(header_check(&region->invalid_header),
+                                          region->invalid_header.typeflag);
+            case SCAN_MALFORMED:
+                return malformed_extended(archive);
+            case SCAN_ERROR:
+                archive->source.reader.error = region->error;
+                return unexpected_eof(archive);
+            case SCAN_PARTIAL:
+            case SCAN_TRUNCATED:
+                return unexpected_eof(archive);
+            case SCAN_EXIT:
+                *next_offset = i->offset;
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+/** Lists the members of 'archive' by walking its header chain in parallel.
+ * The walks start at the members of 'index' unless it is NULL.
+ * Adds all members to 'builder' if it is not NULL.
+ * @return The exit code.
+ */
+static int list_parallel(archive_t* archive,
+                         const archive_index_t* index,
+                         archive_index_builder_t* builder)
+{
+    const options_t* options = archive->options;
+    reader_t* reader = &archive->source.reader;
+
+    uint64_t* header_offsets = NULL;
+    size_t header_offset_count = 0;
+
+    if (index)
+    {
+        header_offsets = malloc(sizeof(uint64_t) * (index->entry_count + 1));
+        if (!header_offsets)
+        {
+            fprintf(stderr, "PPtar: Out of memory\n");
+            return 2;
+        }
+
+        for (; header_offset_count != index->entry_count; ++header_offset_count)
+            header_offsets[header_offset_count] =
+                archive_index_get(index, header_offset_count).header_offset;
+
+        qsort(header_offsets,
+              header_offset_count,
+              sizeof(uint64_t),
+              compare_offsets);
+    }
+
+    scanner_t scanner;
+    bool started = scanner_run(&scanner,
+                               reader->fd,
+                               (uint64_t)reader->file_size,
+                               header_offsets,
+                               header_offset_count,
+                               options->threads,
+                               archive->stats != NULL);
+
+    free(header_offsets);
+
+    if (!started)
+    {
+        fprintf(stderr, "PPtar: Out of memory\n");
+        return 2;
+    }
+
+    int return_code = -1;
+    bool was_null_block = false;
+    uint64_t next_offset = 0;
+
+    for (size_t i = 0; return_code == -1 && i != scanner.region_count; ++i)
+    {
+        scan_region_t* region = scanner.regions + i;
+
+        // A member spans the whole region
+        if (next_offset >= region->end)
+            continue;
+
+        // The walk did not start on the header chain
+        if (region->start != next_offset)
+        {
+            scan_region_t redone;
+            scanner_walk(&scanner, &redone, region->begin, region->end, next_offset);
+
+            return_code = list_region(
+                archive, &redone, builder, &was_null_block, &next_offset);
+
+            if (archive->stats)
+            {
+                archive->stats->bytes_read += redone.bytes_read;
+                archive->stats->input_time += redone.input_time;
+            }
+
+            scan_region_destroy(&redone);
+        }
+        else
+            return_code = list_region(
+                archive, region, builder, &was_null_block, &next_offset);
+    }
+
+    for (size_t i = 0; archive->stats && i != scanner.region_count; ++i)
+    {
+        archive->stats->bytes_read += scanner.regions[i].bytes_read;
+        archive->stats->input_time += scanner.regions[i].input_time;
+    }
+
+    scanner_destroy(&scanner);
+    return return_code == -1 ? 0 : return_code;
+}
+
+/** Lists or extracts the members of 'archive' from its start, listing in
+ * parallel if possible.
+ * The parallel walks start at the members of 'index' unless it is NULL. Adds
+ * all members to 'builder' if it is not NULL.
+ * @return The exit code.
+ */
+static int process_all(archive_t* archive,
+                       const archive_index_t* index,
+                       archive_index_builder_t* builder)
+{
+    const options_t* options = archive->options;
+    const reader_t* reader = &archive->source.reader;
+
+    // Headers are read by offset in the archive file, verifying reads all
+    if (options->t && options->threads > 1 && reader->file_size != -1 &&
+        !reader->decompressor && !options->verify)
+        return list_parallel(archive, index, builder);
+
+    return process_archive(archive, builder);
+}
+
+/** Lists or extracts the members of 'archive', using or building the index
+ * if one was given.
+ * @return The exit code.
+ */
+static int process(archive_t* archive)
+{
+    const options_t* options = archive->options;
+    reader_t* reader = &archive->source.reader;
+
+    // Verifying reads every header, never only those the index points to
+    struct stat archive_stat;
+    bool indexable = options->index && reader->file_size != -1 &&
+                     !options->verify && fstat(reader->fd, &archive_stat) == 0;
+
+    if (!indexable)
+        return process_all(archive, NULL, NULL);
+
+    archive_index_t index;
+
+    if (archive_index_open(&index, options->index, &archive_stat))
+    {
+        // Patterns are matched against all members
+        int return_code = archive->filter.entry_count != 0
+                              ? process_indexed(archive, &index)
+                              : process_all(archive, &index, NULL);
+        archive_index_close(&index);
+        return return_code;
+    }
+
+    archive_index_builder_t builder;
+    archive_index_builder_init(&builder);
+
+    int return_code = process_all(archive, NULL, &builder);
+
+    // Only a full pass over the archive indexes all of its members
+    bool full_pass = !options->occurrence || !filter_done(&archive->filter);
+
+    if (return_code == 0 && full_pass &&
+        !archive_index_builder_write(&builder, options->index, &archive_stat))
+        fprintf(stderr,
+                "PPtar: Couldn't write index %s\n",
+                options->index); // not fatal
+
+    archive_index_builder_destroy(&builder);
+    return return_code;
+}
+
+/** Closes the archive of 'archive' and frees the state of its pass, its
+ * filter only if 'filter' is true.
+ */
+static void archive_destroy(archive_t* archive, bool filter)
+{
+    pptar_close(&archive->source);
+    if (archive->file_output != -1 && !archive->file_stdout)
+        close(archive->file_output);
+    if (filter)
+        filter_destroy(&archive->filter);
+    tree_cache_destroy(&archive->tree_cache);
+    tree_destroy(&archive->tree);
+    dedup_destroy(&archive->dedup);
+
+    // A failed writer has no buffer
+    if (archive->options->direct)
+        direct_writer_destroy(&archive->direct_writer);
+}
+
+int extract_archive(const options_t* options, output_t* output, stats_t* stats)
+{
+    archive_t archive;
+
+    archive.options = options;
+    archive.output = output;
+    archive.stats = stats;
+    archive.file_output = -1;
+    archive.file_stdout = false;
+    archive.data_output = NULL;
+    archive.file_direct = false;
+    archive.parallel = false;
+    archive.uring = false;
+    archive.deduplicating = options->x && options->dedup && !options->O;
+    archive.clones = true;
+    archive.file_keyed = false;
+    archive.file_hashing = false;
+    archive.verifying = false;
+    archive.stripped_name = false;
+    archive.stripped_link = false;
+    archive.error_code = 0;
+
+    if (!try_open_tarball(options, &archive.source, archive.stats))
+        return 2;
+
+    tree_init(&archive.tree, options->sync, options->direct);
+    tree_cache_init(&archive.tree_cache);
+    dedup_init(&archive.dedup);
+
+    // A failed filter frees itself
+    if ((options->direct && !direct_writer_init(&archive.direct_writer,
+                                                DIRECT_WRITER_DEFAULT_CAPACITY)) ||
+        !filter_init(&archive.filter,
+                     options->free_arguments,
+                     options->wildcards,
+                     options->excludes))
+    {
+        fprintf(stderr, "PPtar: Out of memory\n");
+        archive_destroy(&archive, false);
+        return 2;
+    }
+
+    output_t data_output;
+
+    if (options->x && options->O)
+    {
+        if (!output_init(&data_output, STDOUT_FILENO, OUTPUT_FORMAT_TEXT))
+        {
+            fprintf(stderr, "PPtar: Out of memory\n");
+            output_destroy(&data_output);
+            archive_destroy(&archive, true);
+            return 2;
+        }
+
+        archive.data_output = &data_output;
+    }
+
+    // Files written to the standard output and duplicates are written in order
+    if (options->x && options->threads > 1 && !options->O &&
+        !archive.deduplicating)
+    {
+        if (!extractor_init(&archive.extractor,
+                            options->threads,
+                            EXTRACTOR_DEFAULT_MAX_BYTES_IN_FLIGHT,
+                            archive.stats != NULL,
+                            &archive.tree))
+        {
+            fprintf(stderr, "PPtar: Couldn't start threads\n");
+            archive_destroy(&archive, true);
+            return 2;
+        }
+
+        archive.parallel = true;
+    }
+    else if (options->x && options->uring && !options->O &&
+             !archive.deduplicating)
+    {
+        archive.uring = uring_writer_init(
+            &archive.uring_writer, &archive.tree, &archive.tree_cache);
+
+        if (!archive.uring)
+            fprintf(stderr,
+                    "PPtar: io_uring is not available, writing files directly: "
+                    "%s\n",
+                    strerror(errno));
+    }
+    else if (options->t && options->verify)
+    {
+        if (!verifier_init(&archive.verifier,
+                           options->threads ? options->threads
+                                            : VERIFIER_DEFAULT_THREADS,
+                           VERIFIER_DEFAULT_MAX_BYTES_IN_FLIGHT))
+        {
+            fprintf(stderr, "PPtar: Couldn't start threads\n");
+            archive_destroy(&archive, true);
+            return 2;
+        }
+
+        archive.verifying = true;
+    }
+
+    int return_code = process(&archive);
+
+    int workers_return_code = archive_stop_workers(&archive);
+    if (return_code == 0)
+        return_code = workers_return_code;
+
+    // Mismatches are errors, like members missing from the archive
+    int verify_return_code =
+        archive.verifying ? verifier_finish(&archive.verifier, archive.stats) : 0;
+
+    // Directories extracted before a failure are restored too
+    if (!tree_finish(&archive.tree) && return_code == 0)
+        return_code = 2;
+
+    if (options->t && options_has_free_arguments(options))
+        return_code = check_files(options, &archive.filter, output);
+
+    if (return_code == 0)
+        return_code = verify_return_code;
+
+    if (return_code == 0)
+        return_code = archive.error_code;
+
+    if (archive.data_output)
+        return_code = output_finish(archive.data_output, return_code);
+
+    archive_destroy(&archive, true);
+    return return_code;
+}
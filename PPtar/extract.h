@@ -0,0 +1,13 @@
+#pragma once
+
+#include "options.h"
+#include "output.h"
+#include "stats.h"
+
+/** Lists or extracts the members of the archive of the -f option selected by
+ * the free arguments, using or building the index if one was given. Lists
+ * the names to 'output' and collects statistics into 'stats' unless it is
+ * NULL.
+ * @return The exit code.
+ */
+int extract_archive(const options_t* options, output_t* output, stats_t* stats);
@@ -0,0 +1,584 @@
+#include "extractor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "header.h"
+#include "writer.h"
+
+/** Maximum number of data bytes in one job. */
+#define EXTRACTOR_CHUNK_SIZE ((size_t)1 << 20)
+
+/** Records a failure of the member 'member_index' with 'error_code' and the
+ * formatted 'error_message', unless an earlier member failed already.
+ * The mutex of 'extractor' has to be locked.
+ */
+static void extractor_fail(extractor_t* extractor,
+                           size_t member_index,
+                           int error_code,
+                           char* error_message)
+{
+    if (extractor->failed && extractor->error_member_index <= member_index)
+    {
+        free(error_message);
+        return;
+    }
+
+    free(extractor->error_message);
+
+    extractor->failed = true;
+    extractor->error_member_index = member_index;
+    extractor->error_code = error_code;
+    extractor->error_message = error_message;
+}
+
+/** Formats an error message about 'name'. */
+static char* format_error(const char* format, const char* name)
+{
+    int length = snprintf(NULL, 0, format, name);
+    char* message = length >= 0 ? malloc((size_t)length + 1) : NULL;
+
+    if (message)
+        snprintf(message, (size_t)length + 1, format, name);
+
+    return message;
+}
+
+/** Writes 'job' to the file of the current member of 'worker'.
+ * @return The error message or NULL on success.
+ */
+static char* extractor_worker_process(extractor_worker_t* worker,
+                                      extractor_job_t* job,
+                                      bool skip)
+{
+    bool collect_stats = worker->extractor->collect_stats;
+    uint64_t start = collect_stats ? stats_now() : 0;
+    char* error_message = NULL;
+    bool first = job->name != NULL;
+
+    if (first || skip)
+        worker->skip_member = skip;
+
+    // The worker keeps the name and the node until the member ends
+    if (first)
+    {
+        free(worker->name);
+        worker->name = job->name;
+        worker->node = job->node;
+        worker->member_start = start;
+        job->name = NULL;
+    }
+
+    if (first && !skip && worker->node.typeflag != REGTYPE)
+    {
+        if (!tree_create(worker->extractor->tree,
+                         &worker->cache,
+                         worker->name,
+                         &worker->node))
+            error_message = format_error(
+                tree_create_error(worker->node.typeflag), worker->name);
+
+        worker->skip_member = true;
+    }
+    else if (first && !skip)
+    {
+        worker->fd = tree_open_file(worker->extractor->tree,
+                                    &worker->cache,
+                                    worker->name,
+                                    &worker->node,
+                                    &worker->direct);
+
+        if (worker->fd == -1)
+        {
+            error_message =
+                format_error("PPtar: Couldn't create file %s\n", worker->name);
+            worker->skip_member = true;
+        }
+        else
+            ++worker->stats.files_created;
+    }
+
+    if (!worker->skip_member && job->size != 0)
+    {
+        if (worker->direct
+                ? pwrite_direct(worker->fd, job->data, job->size, (off_t)job->offset)
+                : pwrite_all(worker->fd, job->data, job->size, (off_t)job->offset))
+            worker->stats.bytes_written += job->size;
+        else
+        {
+            error_message =
+                format_error("PPtar: Write error: %s\n", strerror(errno));
+            worker->skip_member = true;
+        }
+    }
+
+    if (job->last && worker->fd != -1)
+    {
+        if (!tree_close_file(worker->extractor->tree, worker->fd, &worker->node) &&
+            !worker->skip_member)
+            error_message = format_error(
+                "PPtar: Couldn't restore attributes of %s\n", worker->name);
+
+        worker->fd = -1;
+    }
+
+    if (collect_stats)
+    {
+        uint64_t end = stats_now();
+
+        worker->stats.output_time += end - start;
+        if (job->last)
+            stats_add_member(&worker->stats, end - worker->member_start);
+    }
+
+    return error_message;
+}
+
+/** Main function of a worker thread. */
+static void* extractor_worker_run(void* worker_void)
+{
+    extractor_worker_t* worker = worker_void;
+    extractor_t* extractor = worker->extractor;
+
+    pthread_mutex_lock(&extractor->mutex);
+
+    while (true)
+    {
+        while (!worker->head && !extractor->stopping)
+            pthread_cond_wait(&worker->not_empty, &extractor->mutex);
+
+        extractor_job_t* job = worker->head;
+        if (!job)
+            break;
+
+        worker->head = job->next;
+        if (!worker->head)
+            worker->tail = NULL;
+
+        // Members after the earliest failure are not written anymore
+        bool skip =
+            extractor->failed && job->member_index > extractor->error_member_index;
+
+        pthread_mutex_unlock(&extractor->mutex);
+
+        char* error_message = extractor_worker_process(worker, job, skip);
+
+        pthread_mutex_lock(&extractor->mutex);
+
+        if (error_message)
+            extractor_fail(extractor, job->member_index, 9, error_message);
+
+        extractor->bytes_in_flight -= job->capacity;
+        pthread_cond_signal(&extractor->not_full);
+
+        if (--extractor->jobs_pending == 0)
+            pthread_cond_signal(&extractor->drained);
+
+        free(job->name);
+        free(job->data);
+        free(job);
+    }
+
+    pthread_mutex_unlock(&extractor->mutex);
+
+    return NULL;
+}
+
+bool extractor_init(extractor_t* extractor,
+                    size_t worker_count,
+                    size_t max_bytes_in_flight,
+                    bool collect_stats,
+                    tree_t* tree)
+{
+    extractor->workers = malloc(sizeof(extractor_worker_t) * worker_count);
+    extractor->paths = calloc(EXTRACTOR_PATH_TABLE_SIZE, sizeof(uint64_t));
+
+    if (!extractor->workers || !extractor->paths)
+    {
+        free(extractor->workers);
+        free(extractor->paths);
+        return false;
+    }
+
+    pthread_mutex_init(&extractor->mutex, NULL);
+    pthread_cond_init(&extractor->not_full, NULL);
+    pthread_cond_init(&extractor->drained, NULL);
+
+    extractor->worker_count = 0;
+    extractor->tree = tree;
+    extractor->bytes_in_flight = 0;
+    extractor->max_bytes_in_flight = max_bytes_in_flight;
+    extractor->jobs_pending = 0;
+    extractor->path_count = 0;
+    extractor->stopping = false;
+    extractor->collect_stats = collect_stats;
+    extractor->job = NULL;
+    extractor->job_worker = NULL;
+    extractor->member_remaining = 0;
+    extractor->member_offset = 0;
+    extractor->member_count = 0;
+    extractor->failed = false;
+    extractor->error_member_index = 0;
+    extractor->error_code = 0;
+    extractor->error_message = NULL;
+
+    for (; extractor->worker_count != worker_count; ++extractor->worker_count)
+    {
+        extractor_worker_t* worker = extractor->workers + extractor->worker_count;
+
+        worker->extractor = extractor;
+        worker->head = NULL;
+        worker->tail = NULL;
+        worker->fd = -1;
+        worker->direct = false;
+        worker->name = NULL;
+        tree_cache_init(&worker->cache);
+        worker->skip_member = false;
+        worker->member_start = 0;
+        stats_init(&worker->stats);
+        pthread_cond_init(&worker->not_empty, NULL);
+
+        if (pthread_create(&worker->thread, NULL, extractor_worker_run, worker) !=
+            0)
+        {
+            pthread_cond_destroy(&worker->not_empty);
+            tree_cache_destroy(&worker->cache);
+            stats_destroy(&worker->stats);
+            extractor_finish(extractor, NULL);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Queues the current job of 'extractor' to its worker. */
+static void extractor_submit(extractor_t* extractor, bool last)
+{
+    extractor_job_t* job = extractor->job;
+    extractor_worker_t* worker = extractor->job_worker;
+
+    extractor->job = NULL;
+
+    if (!job)
+        return;
+
+    job->last = last;
+    job->next = NULL;
+
+    pthread_mutex_lock(&extractor->mutex);
+
+    if (worker->tail)
+        worker->tail->next = job;
+    else
+        worker->head = job;
+    worker->tail = job;
+    ++extractor->jobs_pending;
+
+    pthread_cond_signal(&worker->not_empty);
+    pthread_mutex_unlock(&extractor->mutex);
+}
+
+/** Allocates the data of a job with room for 'capacity' bytes.
+ * @return NULL if 'capacity' is 0 or on failure.
+ */
+static char* extractor_allocate_data(const extractor_t* extractor, size_t capacity)
+{
+    if (capacity == 0)
+        return NULL;
+
+    if (!extractor->tree->direct)
+        return malloc(capacity);
+
+    // Data written past the page cache has to be aligned
+    return aligned_alloc(WRITER_DIRECT_ALIGNMENT,
+                         (capacity + WRITER_DIRECT_ALIGNMENT - 1) /
+                             WRITER_DIRECT_ALIGNMENT * WRITER_DIRECT_ALIGNMENT);
+}
+
+/** Allocates the next job of the current member with room for 'capacity'
+ * bytes, waiting until they fit in the pipeline.
+ */
+static void extractor_allocate(extractor_t* extractor, size_t capacity)
+{
+    pthread_mutex_lock(&extractor->mutex);
+
+    while (extractor->bytes_in_flight != 0 &&
+           extractor->bytes_in_flight + capacity > extractor->max_bytes_in_flight)
+        pthread_cond_wait(&extractor->not_full, &extractor->mutex);
+
+    extractor_job_t* job = malloc(sizeof(extractor_job_t));
+    char* data = extractor_allocate_data(extractor, capacity);
+
+    if (!job || (capacity != 0 && !data))
+    {
+        free(job);
+        free(data);
+        extractor_fail(extractor,
+                       extractor->member_count - 1,
+                       2,
+                       format_error("PPtar: %s\n", "Out of memory"));
+        pthread_mutex_unlock(&extractor->mutex);
+        return;
+    }
+
+    extractor->bytes_in_flight += capacity;
+
+    pthread_mutex_unlock(&extractor->mutex);
+
+    job->member_index = extractor->member_count - 1;
+    job->name = NULL;
+    job->node.linkname = NULL;
+    job->data = data;
+    job->size = 0;
+    job->capacity = capacity;
+    job->offset = extractor->member_offset;
+    job->last = false;
+
+    extractor->job = job;
+}
+
+/** Returns the hash of the 'length' bytes of 'path' in the paths of an
+ * extractor, 0 marks a free slot.
+ */
+static uint64_t extractor_path_hash(const char* path, size_t length)
+{
+    uint64_t hash = hash_name(path, length);
+
+    return hash != 0 ? hash : 1;
+}
+
+/** Returns the slot of 'hash' in the paths of 'extractor', or the free slot
+ * it would go to.
+ */
+static uint64_t* extractor_path_slot(const extractor_t* extractor, uint64_t hash)
+{
+    size_t mask = EXTRACTOR_PATH_TABLE_SIZE - 1;
+    size_t i = (size_t)hash & mask;
+
+    while (extractor->paths[i] != 0 && extractor->paths[i] != hash)
+        i = (i + 1) & mask;
+
+    return extractor->paths + i;
+}
+
+/** Checks if the member 'node' at the 'length' bytes of 'name' depends on the
+ * members sent to the workers of 'extractor' since the last drain.
+ */
+static bool extractor_depends(const extractor_t* extractor,
+                              const char* name,
+                              size_t length,
+                              const tree_node_t* node)
+{
+    // A link needs its target, or replaces what is in its place
+    if (node->typeflag == LNKTYPE || node->typeflag == SYMTYPE)
+        return true;
+
+    // A parent or the member itself is a file or a link sent before
+    for (size_t i = 1; i <= length; ++i)
+        if ((i == length || name[i] == '/') && name[i - 1] != '/')
+        {
+            uint64_t hash = extractor_path_hash(name, i);
+
+            if (*extractor_path_slot(extractor, hash) == hash)
+                return true;
+        }
+
+    return false;
+}
+
+/** Waits until the workers of 'extractor' wrote all queued jobs and forgets
+ * the paths sent before.
+ */
+static void extractor_drain(extractor_t* extractor)
+{
+    pthread_mutex_lock(&extractor->mutex);
+    while (extractor->jobs_pending != 0)
+        pthread_cond_wait(&extractor->drained, &extractor->mutex);
+    pthread_mutex_unlock(&extractor->mutex);
+
+    memset(extractor->paths, 0, sizeof(uint64_t) * EXTRACTOR_PATH_TABLE_SIZE);
+    extractor->path_count = 0;
+}
+
+bool extractor_begin(extractor_t* extractor,
+                     const char* name,
+                     size_t name_length,
+                     const tree_node_t* node,
+                     size_t size)
+{
+    pthread_mutex_lock(&extractor->mutex);
+    bool failed = extractor->failed;
+    pthread_mutex_unlock(&extractor->mutex);
+
+    if (failed)
+        return false;
+
+    size_t linkname_length = node->linkname ? strlen(node->linkname) : 0;
+
+    if (node->typeflag != REGTYPE)
+        size = 0;
+
+    // Trailing slashes of a directory do not make it another path
+    size_t length = name_length;
+    while (length > 1 && name[length - 1] == '/')
+        --length;
+
+    if (extractor->path_count == EXTRACTOR_PATH_TABLE_SIZE / 2 ||
+        extractor_depends(extractor, name, length, node))
+        extractor_drain(extractor);
+
+    if (node->typeflag != DIRTYPE)
+    {
+        uint64_t hash = extractor_path_hash(name, length);
+        uint64_t* slot = extractor_path_slot(extractor, hash);
+
+        if (*slot == 0)
+        {
+            *slot = hash;
+            ++extractor->path_count;
+        }
+    }
+
+    extractor->job_worker =
+        extractor->workers + hash_name(name, length) % extractor->worker_count;
+    extractor->member_remaining = size;
+    extractor->member_offset = 0;
+    ++extractor->member_count;
+
+    size_t capacity = size < EXTRACTOR_CHUNK_SIZE ? size : EXTRACTOR_CHUNK_SIZE;
+    extractor_allocate(extractor, capacity);
+
+    if (!extractor->job)
+        return true;
+
+    extractor->job->name = malloc(name_length + 1 + linkname_length + 1);
+
+    if (!extractor->job->name)
+    {
+        pthread_mutex_lock(&extractor->mutex);
+        extractor->bytes_in_flight -= extractor->job->capacity;
+        extractor_fail(extractor,
+                       extractor->job->member_index,
+                       2,
+                       format_error("PPtar: %s\n", "Out of memory"));
+        pthread_mutex_unlock(&extractor->mutex);
+
+        free(extractor->job->data);
+        free(extractor->job);
+        extractor->job = NULL;
+        return true;
+    }
+
+    memcpy(extractor->job->name, name, name_length);
+    extractor->job->name[name_length] = '\0';
+
+    extractor->job->node = *node;
+    extractor->job->node.linkname = extractor->job->name + name_length + 1;
+    memcpy(extractor->job->name + name_length + 1,
+           node->linkname ? node->linkname : "",
+           linkname_length + 1);
+
+    return true;
+}
+
+void extractor_write(extractor_t* extractor, const char* data, size_t size)
+{
+    while (size != 0 && extractor->job)
+    {
+        extractor_job_t* job = extractor->job;
+
+        size_t chunk_size = job->capacity - job->size;
+        if (chunk_size > size)
+            chunk_size = size;
+
+        memcpy(job->data + job->size, data, chunk_size);
+        job->size += chunk_size;
+        data += chunk_size;
+        size -= chunk_size;
+        extractor->member_remaining -= chunk_size;
+        extractor->member_offset += chunk_size;
+
+        if (job->size == job->capacity && extractor->member_remaining != 0)
+        {
+            extractor_submit(extractor, false);
+            extractor_allocate(extractor,
+                               extractor->member_remaining < EXTRACTOR_CHUNK_SIZE
+                                   ? extractor->member_remaining
+                                   : EXTRACTOR_CHUNK_SIZE);
+        }
+    }
+}
+
+void extractor_seek(extractor_t* extractor, uint64_t offset)
+{
+    extractor_job_t* job = extractor->job;
+
+    if (!job || offset == extractor->member_offset)
+        return;
+
+    extractor->member_offset = offset;
+
+    // The bytes of a job are consecutive in the file
+    if (job->size == 0)
+        job->offset = offset;
+    else
+    {
+        extractor_submit(extractor, false);
+        extractor_allocate(extractor,
+                           extractor->member_remaining < EXTRACTOR_CHUNK_SIZE
+                               ? extractor->member_remaining
+                               : EXTRACTOR_CHUNK_SIZE);
+    }
+}
+
+void extractor_end(extractor_t* extractor)
+{
+    extractor_submit(extractor, true);
+}
+
+int extractor_finish(extractor_t* extractor, stats_t* stats)
+{
+    extractor_submit(extractor, true);
+
+    pthread_mutex_lock(&extractor->mutex);
+    extractor->stopping = true;
+    for (extractor_worker_t* i = extractor->workers;
+         i != extractor->workers + extractor->worker_count;
+         ++i)
+        pthread_cond_signal(&i->not_empty);
+    pthread_mutex_unlock(&extractor->mutex);
+
+    for (extractor_worker_t* i = extractor->workers;
+         i != extractor->workers + extractor->worker_count;
+         ++i)
+    {
+        pthread_join(i->thread, NULL);
+        pthread_cond_destroy(&i->not_empty);
+        tree_cache_destroy(&i->cache);
+        free(i->name);
+
+        if (stats)
+            stats_merge(stats, &i->stats);
+        stats_destroy(&i->stats);
+    }
+
+    int error_code = extractor->failed ? extractor->error_code : 0;
+
+    if (extractor->error_message)
+        fputs(extractor->error_message, stderr);
+
+    free(extractor->error_message);
+    free(extractor->workers);
+    free(extractor->paths);
+    pthread_cond_destroy(&extractor->drained);
+    pthread_cond_destroy(&extractor->not_full);
+    pthread_mutex_destroy(&extractor->mutex);
+
+    return error_code;
+}
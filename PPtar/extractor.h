@@ -0,0 +1,157 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stats.h"
+#include "tree.h"
+
+/** Default maximum of bytes read from the archive and not yet written. */
+#define EXTRACTOR_DEFAULT_MAX_BYTES_IN_FLIGHT ((size_t)64 << 20)
+
+/** Number of slots of the table of the paths written since the last drain,
+ * a power of two. The pipeline is drained once half of them are used.
+ */
+#define EXTRACTOR_PATH_TABLE_SIZE ((size_t)1 << 16)
+
+/** Piece of work for an extractor worker: a part of one member. */
+typedef struct extractor_job
+{
+    struct extractor_job* next;
+
+    // Sequence number of the member in the archive
+    size_t member_index;
+
+    // Name of the member followed by the target of a link, set for the first
+    // job of a member only
+    char* name;
+    tree_node_t node;
+
+    // Data to be written at 'offset' of the file
+    char* data;
+    size_t size;
+    size_t capacity;
+    uint64_t offset;
+
+    bool last;
+} extractor_job_t;
+
+/** Writer thread of an extractor with its own queue of jobs. */
+typedef struct extractor_worker
+{
+    struct extractor* extractor;
+    pthread_t thread;
+
+    extractor_job_t* head;
+    extractor_job_t* tail;
+    pthread_cond_t not_empty;
+
+    // Descriptor of the member being written or -1, whether it was opened
+    // with O_DIRECT, its name and node
+    int fd;
+    bool direct;
+    char* name;
+    tree_node_t node;
+
+    // Parent directories of the members of this worker
+    tree_cache_t cache;
+
+    // The current member failed, the rest of its jobs are dropped
+    bool skip_member;
+
+    // Statistics of this worker and the start of the current member
+    stats_t stats;
+    uint64_t member_start;
+} extractor_worker_t;
+
+/** Parallel extraction pipeline.
+ * The reader thread slices members into jobs, the workers create the files
+ * and write them. All jobs of a member and of members with the same name go
+ * to the same worker, so they are written in archive order. Members which
+ * depend on others are created once the pipeline is drained: links, and
+ * members beneath or in the place of a file or a link sent since the last
+ * drain. The tree is then the same as after a serial extraction. The number
+ * of bytes in flight is bounded, a full pipeline blocks the reader.
+ * Of all failures, the one of the earliest member in the archive is reported.
+ */
+typedef struct extractor
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+
+    extractor_worker_t* workers;
+    size_t worker_count;
+
+    tree_t* tree;
+
+    size_t bytes_in_flight;
+    size_t max_bytes_in_flight;
+
+    // Jobs queued and not written yet, 'drained' is signaled when none is
+    // left
+    size_t jobs_pending;
+    pthread_cond_t drained;
+
+    // Hashes of the paths of the files and links sent since the last drain,
+    // 0 is a free slot. A collision only drains the pipeline needlessly.
+    uint64_t* paths;
+    size_t path_count;
+
+    bool stopping;
+    bool collect_stats;
+
+    // Job being filled by the reader, its worker, the unsent member size and
+    // the offset of the next byte in the file
+    extractor_job_t* job;
+    extractor_worker_t* job_worker;
+    size_t member_remaining;
+    uint64_t member_offset;
+    size_t member_count;
+
+    // The earliest failure
+    bool failed;
+    size_t error_member_index;
+    int error_code;
+    char* error_message;
+} extractor_t;
+
+/** Starts an extractor with 'worker_count' writer threads extracting into
+ * 'tree'.
+ * The workers collect output statistics if 'collect_stats' is true.
+ * @return false on failure.
+ */
+bool extractor_init(extractor_t* extractor,
+                    size_t worker_count,
+                    size_t max_bytes_in_flight,
+                    bool collect_stats,
+                    tree_t* tree);
+
+/** Starts a member called 'name' of 'name_length' of 'node' with 'size'
+ * bytes, which are written for a regular file only.
+ * @return false if the extractor failed already and reading should stop.
+ */
+bool extractor_begin(extractor_t* extractor,
+                     const char* name,
+                     size_t name_length,
+                     const tree_node_t* node,
+                     size_t size);
+
+/** Appends 'size' bytes of 'data' to the current member. */
+void extractor_write(extractor_t* extractor, const char* data, size_t size);
+
+/** Moves to 'offset' of the file of the current member, the bytes skipped are
+ * a hole.
+ */
+void extractor_seek(extractor_t* extractor, uint64_t offset);
+
+/** Ends the current member. */
+void extractor_end(extractor_t* extractor);
+
+/** Waits for all jobs and stops the workers.
+ * Prints the error of the earliest failed member. Adds the statistics of the
+ * workers to 'stats' unless it is NULL.
+ * @return The exit code of the failure or 0.
+ */
+int extractor_finish(extractor_t* extractor, stats_t* stats);
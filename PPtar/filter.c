@@ -0,0 +1,186 @@
+#include "filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t hash_name(const char* name, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    for (const char* i = name; i != name + length; ++i)
+    {
+        hash ^= (unsigned char)*i;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+/** Returns the slot of 'name' of 'length' in the table of 'filter', which is
+ * either its slot or the empty slot where it belongs.
+ */
+static size_t* filter_slot(const filter_t* filter,
+                           const char* name,
+                           size_t length)
+{
+    size_t mask = filter->table_size - 1;
+
+    for (size_t i = (size_t)hash_name(name, length) & mask;; i = (i + 1) & mask)
+    {
+        size_t* slot = filter->table + i;
+
+        if (*slot == 0)
+            return slot;
+
+        const filter_entry_t* entry = filter->entries + (*slot - 1);
+
+        if (entry->length == length && memcmp(entry->name, name, length) == 0)
+            return slot;
+    }
+}
+
+/** Counts the strings of the NULL terminated array 'strings'. */
+static size_t count_strings(const char* const* strings)
+{
+    size_t count = 0;
+    while (strings[count])
+        ++count;
+
+    return count;
+}
+
+bool filter_init(filter_t* filter,
+                 const char* const* names,
+                 bool wildcards,
+                 const char* const* excludes)
+{
+    filter->pattern_count = wildcards ? count_strings(names) : 0;
+    filter->exclude_count = count_strings(excludes);
+    filter->pattern_found = calloc(filter->pattern_count + 1, sizeof(bool));
+
+    if (!filter->pattern_found)
+        return false;
+
+    if (!glob_set_init(&filter->patterns, names, filter->pattern_count, true))
+    {
+        free(filter->pattern_found);
+        return false;
+    }
+
+    if (!glob_set_init(&filter->excludes, excludes, filter->exclude_count, false))
+    {
+        glob_set_destroy(&filter->patterns);
+        free(filter->pattern_found);
+        return false;
+    }
+
+    // The patterns take the place of the names
+    size_t count = wildcards ? 0 : count_strings(names);
+
+    // At most half full
+    filter->table_size = 1;
+    while (filter->table_size < count * 2)
+        filter->table_size *= 2;
+
+    filter->entries = malloc(sizeof(filter_entry_t) * (count + 1));
+    filter->table = calloc(filter->table_size, sizeof(size_t));
+    filter->entry_count = 0;
+    filter->remaining = count;
+
+    if (!filter->entries || !filter->table)
+    {
+        filter_destroy(filter);
+        return false;
+    }
+
+    for (const char* const* i = names; *i != NULL && count != 0; ++i)
+    {
+        size_t length = strlen(*i);
+        size_t* slot = filter_slot(filter, *i, length);
+
+        if (*slot == 0)
+        {
+            filter_entry_t* entry = filter->entries + filter->entry_count;
+
+            entry->name = *i;
+            entry->length = length;
+            entry->requested = 0;
+            entry->found = 0;
+
+            *slot = ++filter->entry_count;
+        }
+
+        ++filter->entries[*slot - 1].requested;
+    }
+
+    return true;
+}
+
+void filter_destroy(filter_t* filter)
+{
+    free(filter->entries);
+    free(filter->table);
+    glob_set_destroy(&filter->patterns);
+    glob_set_destroy(&filter->excludes);
+    free(filter->pattern_found);
+}
+
+filter_entry_t* filter_find(const filter_t* filter,
+                            const char* name,
+                            size_t length)
+{
+    size_t slot = *filter_slot(filter, name, length);
+
+    return slot != 0 ? filter->entries + (slot - 1) : NULL;
+}
+
+/** Returns the length of 'name' of 'length' matched against patterns. */
+static size_t pattern_length(const char* name, size_t length)
+{
+    // Patterns match a directory by its name
+    if (length > 1 && name[length - 1] == '/')
+        --length;
+
+    return length;
+}
+
+bool filter_excludes(filter_t* filter, const char* name, size_t length)
+{
+    return filter->exclude_count != 0 &&
+           glob_set_match(
+               &filter->excludes, name, pattern_length(name, length)) != 0;
+}
+
+bool filter_match(filter_t* filter, const char* name, size_t length)
+{
+    if (filter_excludes(filter, name, length))
+        return false;
+
+    if (filter->pattern_count != 0)
+    {
+        size_t match = glob_set_match(
+            &filter->patterns, name, pattern_length(name, length));
+
+        if (match != 0)
+            glob_set_mark(&filter->patterns, match, filter->pattern_found);
+
+        return match != 0;
+    }
+
+    if (filter->entry_count == 0)
+        return true;
+
+    filter_entry_t* entry = filter_find(filter, name, length);
+
+    if (!entry || entry->found == entry->requested)
+        return false;
+
+    ++entry->found;
+    --filter->remaining;
+    return true;
+}
+
+bool filter_done(const filter_t* filter)
+{
+    return filter->entry_count != 0 && filter->remaining == 0;
+}
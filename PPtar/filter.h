@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "glob.h"
+
+/** One distinct name of a filter. */
+typedef struct filter_entry
+{
+    const char* name;
+    size_t length;
+
+    // How many times the name was given and how many of them were matched
+    size_t requested;
+    size_t found;
+} filter_entry_t;
+
+/** Set of member names given on the command line.
+ * An open addressing hash table of the distinct names, each given name matches
+ * one member of the archive. Or the names as glob patterns, each matching any
+ * number of members and their contents. Members matching an exclude pattern
+ * are never selected. No names select all members.
+ */
+typedef struct filter
+{
+    filter_entry_t* entries;
+    size_t entry_count;
+
+    // Number of given names which were not matched yet
+    size_t remaining;
+
+    // Indices into 'entries' plus one, 0 for an empty slot
+    size_t* table;
+
+    // Power of two
+    size_t table_size;
+
+    // The names as anchored patterns and whether each matched some member
+    glob_set_t patterns;
+    size_t pattern_count;
+    bool* pattern_found;
+
+    // Unanchored patterns
+    glob_set_t excludes;
+    size_t exclude_count;
+} filter_t;
+
+/** Computes the FNV-1a hash of 'name' of 'length'. */
+uint64_t hash_name(const char* name, size_t length);
+
+/** Initializes 'filter' with the NULL terminated arrays 'names', which are
+ * glob patterns if 'wildcards' is true, and 'excludes'.
+ * The names are not copied.
+ * @return false on allocation failure.
+ */
+bool filter_init(filter_t* filter,
+                 const char* const* names,
+                 bool wildcards,
+                 const char* const* excludes);
+
+/** Frees the memory of 'filter'. */
+void filter_destroy(filter_t* filter);
+
+/** Finds the entry of 'name' of 'length' or returns NULL. */
+filter_entry_t* filter_find(const filter_t* filter,
+                            const char* name,
+                            size_t length);
+
+/** Checks if 'name' of 'length' matches an exclude pattern of 'filter'. */
+bool filter_excludes(filter_t* filter, const char* name, size_t length);
+
+/** Checks if 'name' of 'length' is selected by 'filter', which is when it
+ * matches a name which was not matched yet or a pattern, and marks them as
+ * found.
+ */
+bool filter_match(filter_t* filter, const char* name, size_t length);
+
+/** Checks if 'filter' has names which can match no more members. */
+bool filter_done(const filter_t* filter);
@@ -0,0 +1,424 @@
+#include "glob.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Words of the bit set of a byte set. */
+#define GLOB_BYTES_WORDS (sizeof(((glob_position_t*)NULL)->bytes) / sizeof(uint64_t))
+
+/** Adds 'byte' to the byte set of 'position'. */
+static void glob_add_byte(glob_position_t* position, unsigned char byte)
+{
+    position->bytes[byte / 64] |= (uint64_t)1 << (byte % 64);
+}
+
+/** Checks if the byte set of 'position' contains 'byte'. */
+static bool glob_has_byte(const glob_position_t* position, unsigned char byte)
+{
+    return (position->bytes[byte / 64] >> (byte % 64)) & 1;
+}
+
+/** Parses the bracket expression at 'pattern' before 'end' into the byte set
+ * of 'position'.
+ * @return The end of the expression or NULL if it is not closed.
+ */
+static const char* glob_parse_bracket(const char* pattern,
+                                      const char* end,
+                                      glob_position_t* position)
+{
+    const char* i = pattern + 1;
+    bool negated = *i == '!' || *i == '^';
+
+    if (negated)
+        ++i;
+
+    // A leading bracket is a member
+    for (const char* first = i; *i != ']' || i == first; ++i)
+    {
+        if (i >= end)
+            return NULL;
+
+        unsigned char low = (unsigned char)*i;
+        unsigned char high = low;
+
+        if (end - i > 2 && i[1] == '-' && i[2] != ']')
+        {
+            high = (unsigned char)i[2];
+            i += 2;
+        }
+
+        for (unsigned byte = low; byte <= high; ++byte)
+            glob_add_byte(position, (unsigned char)byte);
+    }
+
+    if (negated)
+        for (size_t j = 0; j != GLOB_BYTES_WORDS; ++j)
+            position->bytes[j] = ~position->bytes[j];
+
+    return i + 1;
+}
+
+/** Parses 'pattern' of the index 'pattern_index' into 'positions'.
+ * 'positions' has to have room for one more position than the length of the
+ * pattern.
+ * @return The number of positions written, including the end.
+ */
+static size_t glob_parse(const char* pattern,
+                         size_t pattern_index,
+                         glob_position_t* positions)
+{
+    glob_position_t* position = positions;
+    size_t length = strlen(pattern);
+
+    // A directory is matched by its name
+    while (length > 1 && pattern[length - 1] == '/')
+        --length;
+
+    const char* end = pattern + length;
+
+    for (const char* i = pattern; i != end;)
+    {
+        const char* bracket_end = NULL;
+
+        memset(position, 0, sizeof(glob_position_t));
+        position->pattern = pattern_index;
+
+        if (*i == '*')
+        {
+            // Adjacent stars match the same as one
+            while (i != end && *i == '*')
+                ++i;
+
+            position->star = true;
+        }
+        else if (*i == '?')
+        {
+            memset(position->bytes, 0xff, sizeof(position->bytes));
+            ++i;
+        }
+        else if (*i == '[' && (bracket_end = glob_parse_bracket(i, end, position)))
+            i = bracket_end;
+        else
+        {
+            if (*i == '\\' && i + 1 != end)
+                ++i;
+
+            // An unclosed bracket expression may have added bytes
+            memset(position->bytes, 0, sizeof(position->bytes));
+            glob_add_byte(position, (unsigned char)*i);
+            ++i;
+        }
+
+        ++position;
+    }
+
+    memset(position, 0, sizeof(glob_position_t));
+    position->end = true;
+    position->pattern = pattern_index;
+
+    return (size_t)(position + 1 - positions);
+}
+
+/** Starts building a new state of 'glob'. */
+static void glob_begin(glob_set_t* glob)
+{
+    glob->scratch_count = 0;
+
+    if (++glob->stamp == 0)
+    {
+        memset(glob->stamps, 0, sizeof(uint32_t) * glob->position_count);
+        glob->stamp = 1;
+    }
+}
+
+/** Adds 'position' to the state being built by 'glob', and the position
+ * after it if it is a star, which matches the empty string.
+ */
+static void glob_add_position(glob_set_t* glob, uint32_t position)
+{
+    // No star is the last position of a pattern or follows another one
+    uint32_t end = position + (glob->positions[position].star ? 2 : 1);
+
+    for (uint32_t i = position; i != end; ++i)
+        if (glob->stamps[i] != glob->stamp)
+        {
+            glob->stamps[i] = glob->stamp;
+            glob->scratch[glob->scratch_count++] = i;
+        }
+}
+
+/** Orders positions by index. */
+static int compare_positions(const void* a_void, const void* b_void)
+{
+    uint32_t a = *(const uint32_t*)a_void;
+    uint32_t b = *(const uint32_t*)b_void;
+
+    return (a > b) - (a < b);
+}
+
+/** Sorts the positions of the state being built by 'glob'. */
+static void glob_sort(glob_set_t* glob)
+{
+    // The positions are mostly added in order
+    for (size_t i = 1; i < glob->scratch_count; ++i)
+        if (glob->scratch[i - 1] > glob->scratch[i])
+        {
+            qsort(glob->scratch,
+                  glob->scratch_count,
+                  sizeof(uint32_t),
+                  compare_positions);
+            return;
+        }
+}
+
+/** Returns the hash of the 'count' 'positions'. */
+static uint64_t glob_hash(const uint32_t* positions, size_t count)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    for (const uint32_t* i = positions; i != positions + count; ++i)
+    {
+        hash ^= *i;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+/** Finds the state of the 'count' 'positions' in the table of 'glob' and
+ * writes its slot, or the empty slot where it belongs, to '*slot'.
+ * @return The index of the state plus one or 0 if there is none.
+ */
+static size_t glob_find(const glob_set_t* glob,
+                        const uint32_t* positions,
+                        size_t count,
+                        size_t* slot)
+{
+    size_t mask = glob->state_capacity * 2 - 1;
+
+    for (*slot = (size_t)glob_hash(positions, count) & mask;
+         glob->table[*slot] != 0;
+         *slot = (*slot + 1) & mask)
+    {
+        const glob_state_t* state = glob->states + (glob->table[*slot] - 1);
+
+        if (state->position_count == count &&
+            memcmp(glob->state_positions + state->positions,
+                   positions,
+                   sizeof(uint32_t) * count) == 0)
+            return glob->table[*slot];
+    }
+
+    return 0;
+}
+
+/** Adds the state of the 'count' 'positions' to 'glob' at the empty 'slot'
+ * of its table.
+ * @return The index of the state.
+ */
+static size_t glob_add(glob_set_t* glob,
+                       const uint32_t* positions,
+                       size_t count,
+                       size_t slot)
+{
+    size_t index = glob->state_count++;
+    glob_state_t* state = glob->states + index;
+
+    memset(state->next, 0, sizeof(state->next));
+    state->positions = glob->state_positions_size;
+    state->position_count = count;
+    state->accepting = false;
+
+    memcpy(glob->state_positions + state->positions,
+           positions,
+           sizeof(uint32_t) * count);
+    glob->state_positions_size += count;
+
+    for (const uint32_t* i = positions; i != positions + count; ++i)
+        if (glob->positions[*i].end)
+            state->accepting = true;
+
+    glob->table[slot] = (uint32_t)index + 1;
+    return index;
+}
+
+/** Frees all states of 'glob' but the start one, which becomes the first. */
+static void glob_clear(glob_set_t* glob)
+{
+    glob->state_count = 0;
+    glob->state_positions_size = 0;
+    memset(glob->table, 0, sizeof(uint32_t) * glob->state_capacity * 2);
+
+    size_t slot;
+    glob_find(glob, glob->start, glob->start_count, &slot);
+    glob_add(glob, glob->start, glob->start_count, slot);
+}
+
+/** Finds or adds the state being built by 'glob', clearing the states if they
+ * are full. Writes whether they were cleared to '*cleared'.
+ * @return The index of the state.
+ */
+static size_t glob_intern(glob_set_t* glob, bool* cleared)
+{
+    size_t slot;
+    size_t found = glob_find(glob, glob->scratch, glob->scratch_count, &slot);
+
+    *cleared = false;
+
+    if (found != 0)
+        return found - 1;
+
+    // The start state and any other one fit into empty states
+    if (glob->state_count == glob->state_capacity ||
+        glob->state_positions_capacity - glob->state_positions_size <
+            glob->scratch_count)
+    {
+        glob_clear(glob);
+        *cleared = true;
+
+        found = glob_find(glob, glob->scratch, glob->scratch_count, &slot);
+        if (found != 0)
+            return found - 1;
+    }
+
+    return glob_add(glob, glob->scratch, glob->scratch_count, slot);
+}
+
+/** Computes the state of 'glob' after reading 'byte' in the state 'index'.
+ * @return The index of the state, the states before may have been cleared.
+ */
+static size_t glob_step(glob_set_t* glob, size_t index, unsigned char byte)
+{
+    const glob_state_t* state = glob->states + index;
+    const uint32_t* positions = glob->state_positions + state->positions;
+
+    glob_begin(glob);
+
+    for (const uint32_t* i = positions; i != positions + state->position_count;
+         ++i)
+    {
+        const glob_position_t* position = glob->positions + *i;
+
+        if (position->star)
+            glob_add_position(glob, *i);
+        else if (!position->end && glob_has_byte(position, byte))
+            glob_add_position(glob, *i + 1);
+    }
+
+    // An unanchored pattern starts again after each slash
+    if (!glob->anchored && byte == '/')
+        for (const uint32_t* i = glob->start; i != glob->start + glob->start_count;
+             ++i)
+            glob_add_position(glob, *i);
+
+    glob_sort(glob);
+
+    bool cleared;
+    size_t next = glob_intern(glob, &cleared);
+
+    if (!cleared)
+        glob->states[index].next[byte] = (uint32_t)next + 1;
+
+    return next;
+}
+
+bool glob_set_init(glob_set_t* set,
+                   const char* const* patterns,
+                   size_t count,
+                   bool anchored)
+{
+    size_t position_count = 0;
+    for (size_t i = 0; i != count; ++i)
+        position_count += strlen(patterns[i]) + 1;
+
+    set->pattern_count = count;
+    set->anchored = anchored;
+
+    // Without patterns there is only the start state
+    set->state_capacity = count != 0 ? GLOB_MAX_STATES : 1;
+    set->state_positions_capacity = position_count * 2;
+    if (count != 0 && set->state_positions_capacity < GLOB_MIN_STATE_POSITIONS)
+        set->state_positions_capacity = GLOB_MIN_STATE_POSITIONS;
+
+    // A start position may be followed by a star
+    set->positions = malloc(sizeof(glob_position_t) * (position_count + 1));
+    set->start = malloc(sizeof(uint32_t) * (count * 2 + 1));
+    set->scratch = malloc(sizeof(uint32_t) * (position_count + 1));
+    set->stamps = calloc(position_count + 1, sizeof(uint32_t));
+    set->states = malloc(sizeof(glob_state_t) * set->state_capacity);
+    set->state_positions =
+        malloc(sizeof(uint32_t) * (set->state_positions_capacity + 1));
+    set->table = malloc(sizeof(uint32_t) * set->state_capacity * 2);
+
+    if (!set->positions || !set->start || !set->scratch || !set->stamps ||
+        !set->states || !set->state_positions || !set->table)
+    {
+        glob_set_destroy(set);
+        return false;
+    }
+
+    set->position_count = 0;
+    set->stamp = 0;
+    glob_begin(set);
+
+    for (size_t i = 0; i != count; ++i)
+    {
+        size_t first = set->position_count;
+
+        set->position_count +=
+            glob_parse(patterns[i], i, set->positions + first);
+        glob_add_position(set, (uint32_t)first);
+    }
+
+    memcpy(set->start, set->scratch, sizeof(uint32_t) * set->scratch_count);
+    set->start_count = set->scratch_count;
+
+    glob_clear(set);
+
+    return true;
+}
+
+void glob_set_destroy(glob_set_t* set)
+{
+    free(set->positions);
+    free(set->start);
+    free(set->scratch);
+    free(set->stamps);
+    free(set->states);
+    free(set->state_positions);
+    free(set->table);
+}
+
+size_t glob_set_match(glob_set_t* set, const char* name, size_t length)
+{
+    size_t state = 0;
+
+    for (const char* i = name; i != name + length; ++i)
+    {
+        unsigned char byte = (unsigned char)*i;
+
+        // A pattern matching a leading directory matches its members
+        if (byte == '/' && set->states[state].accepting)
+            return state + 1;
+
+        uint32_t next = set->states[state].next[byte];
+        state = next != 0 ? next - 1 : glob_step(set, state, byte);
+
+        // No pattern can match anymore
+        if (set->anchored && set->states[state].position_count == 0)
+            return 0;
+    }
+
+    return set->states[state].accepting ? state + 1 : 0;
+}
+
+void glob_set_mark(const glob_set_t* set, size_t match, bool* found)
+{
+    const glob_state_t* state = set->states + (match - 1);
+    const uint32_t* positions = set->state_positions + state->positions;
+
+    for (const uint32_t* i = positions; i != positions + state->position_count;
+         ++i)
+        if (set->positions[*i].end)
+            found[set->positions[*i].pattern] = true;
+}
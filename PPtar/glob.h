@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Maximum number of cached states of the automaton of a glob set. */
+#define GLOB_MAX_STATES ((size_t)4096)
+
+/** Minimum number of positions of the cached states of a glob set. */
+#define GLOB_MIN_STATE_POSITIONS ((size_t)1 << 20)
+
+/** Position of the automaton of a glob set, one per token of a pattern and
+ * one for the end of each pattern.
+ */
+typedef struct glob_position
+{
+    // The bytes matched by a token which is not a star
+    uint64_t bytes[4];
+
+    bool star;
+    bool end;
+
+    // Index of the pattern
+    size_t pattern;
+} glob_position_t;
+
+/** State of the automaton of a glob set, a sorted set of positions. */
+typedef struct glob_state
+{
+    // Indices of the next states plus one by the byte read, 0 if unknown
+    uint32_t next[256];
+
+    // The positions in the positions of the states
+    size_t positions;
+    size_t position_count;
+
+    // Some pattern ends in the state
+    bool accepting;
+} glob_state_t;
+
+/** Set of glob patterns matched at once.
+ * A star matches any string and a question mark any byte, both including a
+ * slash. A bracket expression matches a byte of a set, a backslash quotes the
+ * next byte. A pattern matches a name or any of its leading directories, an
+ * unanchored one also after any slash of the name. Trailing slashes of a
+ * pattern are ignored.
+ * The patterns are compiled into one automaton, whose deterministic states
+ * are built while matching and cached, so a name is matched in time linear
+ * to its length whatever the number of patterns. A literal prefix shared by
+ * patterns is matched once, like in a trie. The cache is cleared when full,
+ * the start state is always the first one.
+ */
+typedef struct glob_set
+{
+    glob_position_t* positions;
+    size_t position_count;
+    size_t pattern_count;
+    bool anchored;
+
+    // The positions of the start state
+    uint32_t* start;
+    size_t start_count;
+
+    // A state being built and the stamps of the positions added to it
+    uint32_t* scratch;
+    size_t scratch_count;
+    uint32_t* stamps;
+    uint32_t stamp;
+
+    glob_state_t* states;
+    size_t state_count;
+    size_t state_capacity;
+
+    uint32_t* state_positions;
+    size_t state_positions_size;
+    size_t state_positions_capacity;
+
+    // Indices of the states plus one by the hashes of their positions, twice
+    // as big as the states
+    uint32_t* table;
+} glob_set_t;
+
+/** Compiles the 'count' 'patterns' into 'set', which matches them at the
+ * start of a name only if 'anchored' is true.
+ * @return false if out of memory.
+ */
+bool glob_set_init(glob_set_t* set,
+                   const char* const* patterns,
+                   size_t count,
+                   bool anchored);
+
+/** Frees the memory of 'set'. */
+void glob_set_destroy(glob_set_t* set);
+
+/** Matches 'name' of 'length' against the patterns of 'set'.
+ * @return The state in which the name was accepted plus one or 0 if no
+ * pattern matches.
+ */
+size_t glob_set_match(glob_set_t* set, const char* name, size_t length);
+
+/** Sets 'found' of the patterns ending in the state 'match' of 'set' returned
+ * by the last glob_set_match.
+ */
+void glob_set_mark(const glob_set_t* set, size_t match, bool* found);
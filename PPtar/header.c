@@ -0,0 +1,395 @@
+#include "header.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+/** Sums of the bytes of a header block. */
+typedef struct header_sums
+{
+    uint32_t sum;
+
+    // Number of bytes with the high bit set
+    uint32_t high_count;
+
+    bool null;
+} header_sums_t;
+
+#if !defined(__SSE2__) && !(defined(__ARM_NEON) && defined(__aarch64__))
+/** Computes the sums of the bytes of 'block' one at a time. */
+static header_sums_t header_sum_scalar(const unsigned char* block)
+{
+    header_sums_t sums;
+    unsigned char any = 0;
+
+    sums.sum = 0;
+    sums.high_count = 0;
+
+    for (size_t i = 0; i != sizeof(header_t); ++i)
+    {
+        sums.sum += block[i];
+        sums.high_count += block[i] >> 7;
+        any |= block[i];
+    }
+
+    sums.null = any == 0;
+    return sums;
+}
+#endif
+
+#if defined(__SSE2__)
+/** Computes the sums of the bytes of 'block' 16 at a time. */
+static header_sums_t header_sum_sse2(const unsigned char* block)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i high_bit = _mm_set1_epi8((char)0x80);
+
+    __m128i sum = zero;
+    __m128i high_sum = zero;
+    __m128i any = zero;
+
+    for (size_t i = 0; i != sizeof(header_t); i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+
+        // Sums of 8 bytes in each half
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(bytes, zero));
+        high_sum =
+            _mm_add_epi64(high_sum, _mm_sad_epu8(_mm_and_si128(bytes, high_bit), zero));
+        any = _mm_or_si128(any, bytes);
+    }
+
+    header_sums_t sums;
+
+    sums.sum = (uint32_t)(_mm_cvtsi128_si32(sum) +
+                          _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+    sums.high_count = (uint32_t)(_mm_cvtsi128_si32(high_sum) +
+                                 _mm_cvtsi128_si32(_mm_srli_si128(high_sum, 8))) /
+                      0x80;
+    sums.null = _mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) == 0xFFFF;
+
+    return sums;
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/** Computes the sums of the bytes of 'block' 32 at a time. */
+__attribute__((target("avx2"))) static header_sums_t
+header_sum_avx2(const unsigned char* block)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i high_bit = _mm256_set1_epi8((char)0x80);
+
+    __m256i sum = zero;
+    __m256i high_sum = zero;
+    __m256i any = zero;
+
+    for (size_t i = 0; i != sizeof(header_t); i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i));
+
+        // Sums of 8 bytes in each quarter
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(bytes, zero));
+        high_sum = _mm256_add_epi64(
+            high_sum, _mm256_sad_epu8(_mm256_and_si256(bytes, high_bit), zero));
+        any = _mm256_or_si256(any, bytes);
+    }
+
+    // Sums of the quarters
+    __m128i sum_halves = _mm_add_epi64(_mm256_castsi256_si128(sum),
+                                       _mm256_extracti128_si256(sum, 1));
+    __m128i high_halves = _mm_add_epi64(_mm256_castsi256_si128(high_sum),
+                                        _mm256_extracti128_si256(high_sum, 1));
+
+    header_sums_t sums;
+
+    sums.sum = (uint32_t)(_mm_cvtsi128_si32(sum_halves) +
+                          _mm_cvtsi128_si32(_mm_srli_si128(sum_halves, 8)));
+    sums.high_count =
+        (uint32_t)(_mm_cvtsi128_si32(high_halves) +
+                   _mm_cvtsi128_si32(_mm_srli_si128(high_halves, 8))) /
+        0x80;
+    sums.null = _mm256_testz_si256(any, any) != 0;
+
+    return sums;
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+/** Computes the sums of the bytes of 'block' 16 at a time. */
+static header_sums_t header_sum_neon(const unsigned char* block)
+{
+    uint32x4_t sum = vdupq_n_u32(0);
+    uint8x16_t high_count = vdupq_n_u8(0);
+    uint8x16_t any = vdupq_n_u8(0);
+
+    for (size_t i = 0; i != sizeof(header_t); i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(block + i);
+
+        // Pairwise widening sums, which cannot overflow
+        sum = vpadalq_u16(sum, vpaddlq_u8(bytes));
+        high_count = vaddq_u8(high_count, vshrq_n_u8(bytes, 7));
+        any = vorrq_u8(any, bytes);
+    }
+
+    header_sums_t sums;
+
+    // At most 32 per lane
+    sums.sum = vaddvq_u32(sum);
+    sums.high_count = vaddlvq_u8(high_count);
+    sums.null = vmaxvq_u8(any) == 0;
+
+    return sums;
+}
+#endif
+
+typedef header_sums_t (*header_sum_t)(const unsigned char* block);
+
+/** Selects the fastest way to sum a block on this processor. */
+static header_sum_t header_select_sum(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return header_sum_avx2;
+#endif
+#if defined(__SSE2__)
+    return header_sum_sse2;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return header_sum_neon;
+#else
+    return header_sum_scalar;
+#endif
+}
+
+/** Computes the sums of the bytes of 'header' with the chksum field taken as
+ * spaces.
+ */
+static header_sums_t header_sum(const header_t* header)
+{
+    static header_sum_t sum = NULL;
+
+    header_sum_t selected = __atomic_load_n(&sum, __ATOMIC_RELAXED);
+    if (!selected)
+    {
+        selected = header_select_sum();
+        __atomic_store_n(&sum, selected, __ATOMIC_RELAXED);
+    }
+
+    header_sums_t sums = selected((const unsigned char*)header);
+
+    for (size_t i = 0; i != sizeof(header->chksum); ++i)
+    {
+        unsigned char byte = (unsigned char)header->chksum[i];
+
+        sums.sum += (uint32_t)' ' - byte;
+        sums.high_count -= byte >> 7;
+    }
+
+    return sums;
+}
+
+/** Converts 8 octal digits loaded little-endian into 'chunk' to their value.
+ * @return false if some byte is not an octal digit.
+ */
+static bool header_decode_octal_chunk(uint64_t chunk, uint64_t* value)
+{
+    const uint64_t ones = 0x0101010101010101;
+
+    // Octal digits are 0x30 to 0x37
+    if ((chunk & (0xF8 * ones)) != 0x30 * ones)
+        return false;
+
+    chunk -= 0x30 * ones;
+
+    // The first digit is the lowest byte, digits are merged pairwise
+    chunk = (chunk & 0x0007000700070007) << 3 | (chunk >> 8 & 0x0007000700070007);
+    chunk = (chunk & 0x0000003F0000003F) << 6 | (chunk >> 16 & 0x0000003F0000003F);
+    chunk = (chunk & 0x0000000000000FFF) << 12 | (chunk >> 32 & 0x0000000000000FFF);
+
+    *value = chunk;
+    return true;
+}
+
+bool header_get_number(const char* field, size_t size, uint64_t* value)
+{
+    const unsigned char* bytes = (const unsigned char*)field;
+
+    // Base-256, negative values are not supported
+    if (size != 0 && bytes[0] == 0x80)
+    {
+        uint64_t result = 0;
+
+        for (size_t i = 1; i != size; ++i)
+        {
+            if (result >> 56 != 0)
+                return false;
+
+            result = result << 8 | bytes[i];
+        }
+
+        *value = result;
+        return true;
+    }
+
+    size_t i = 0;
+    while (i != size && bytes[i] == ' ')
+        ++i;
+
+    uint64_t result = 0;
+
+    // Eight digits at a time, the fields are at most 12 bytes long
+    while (size - i >= 8)
+    {
+        uint64_t chunk;
+        uint64_t chunk_value;
+
+        memcpy(&chunk, bytes + i, sizeof(chunk));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        chunk = __builtin_bswap64(chunk);
+#endif
+
+        if (!header_decode_octal_chunk(chunk, &chunk_value))
+            break;
+
+        result = result << 24 | chunk_value;
+        i += 8;
+    }
+
+    for (; i != size; ++i)
+    {
+        unsigned digit = (unsigned)bytes[i] - '0';
+        if (digit > 7)
+            break;
+
+        result = result << 3 | digit;
+    }
+
+    *value = result;
+    return i == size || bytes[i] == ' ' || bytes[i] == '\0';
+}
+
+bool header_is_magic_valid(const header_t* header)
+{
+    // TMAGIC and TMAGICS differ only in the terminator
+    return memcmp(header->magic, TMAGIC, sizeof(TMAGIC) - 1) == 0 &&
+           (header->magic[5] == '\0' || header->magic[5] == ' ');
+}
+
+bool header_is_regular_file(const header_t* header)
+{
+    return header->typeflag == REGTYPE || header->typeflag == AREGTYPE ||
+           header->typeflag == GNUTYPE_SPARSE;
+}
+
+bool header_is_extended(const header_t* header)
+{
+    return header->typeflag == XHDTYPE || header->typeflag == XGLTYPE ||
+           header->typeflag == GNUTYPE_LONGNAME ||
+           header->typeflag == GNUTYPE_LONGLINK;
+}
+
+bool header_is_node(const header_t* header)
+{
+    return header->typeflag == DIRTYPE || header->typeflag == SYMTYPE ||
+           header->typeflag == LNKTYPE;
+}
+
+header_status_t header_check(const header_t* header)
+{
+    header_sums_t sums = header_sum(header);
+    uint64_t checksum;
+    uint64_t size;
+
+    if (sums.null)
+        return HEADER_NULL;
+
+    if (!header_is_magic_valid(header))
+        return HEADER_BAD_MAGIC;
+
+    // Some old archivers summed signed bytes
+    if (!header_get_number(header->chksum, sizeof(header->chksum), &checksum) ||
+        (checksum != sums.sum && checksum != sums.sum - 0x100 * sums.high_count))
+        return HEADER_BAD_CHECKSUM;
+
+    if (!header_get_number(header->size, sizeof(header->size), &size))
+        return HEADER_BAD_SIZE;
+
+    if (!header_is_regular_file(header) && !header_is_node(header) &&
+        !header_is_extended(header))
+        return HEADER_UNSUPPORTED_TYPE;
+
+    return HEADER_VALID;
+}
+
+bool header_is_null(const header_t* header)
+{
+    return header_sum(header).null;
+}
+
+/** Decodes the numeric field 'field' of 'size' bytes or returns 0. */
+static uint64_t header_get_number_or_zero(const char* field, size_t size)
+{
+    uint64_t value;
+    return header_get_number(field, size, &value) ? value : 0;
+}
+
+size_t header_get_size(const header_t* header)
+{
+    return (size_t)header_get_number_or_zero(header->size, sizeof(header->size));
+}
+
+uint64_t header_get_mtime(const header_t* header)
+{
+    return header_get_number_or_zero(header->mtime, sizeof(header->mtime));
+}
+
+uint32_t header_get_mode(const header_t* header)
+{
+    return (uint32_t)header_get_number_or_zero(header->mode, sizeof(header->mode));
+}
+
+uint64_t header_get_uid(const header_t* header)
+{
+    return header_get_number_or_zero(header->uid, sizeof(header->uid));
+}
+
+uint64_t header_get_gid(const header_t* header)
+{
+    return header_get_number_or_zero(header->gid, sizeof(header->gid));
+}
+
+size_t header_get_name_length(const header_t* header)
+{
+    return strnlen(header->name, sizeof(header->name));
+}
+
+uint32_t header_compute_checksum(const header_t* header)
+{
+    return header_sum(header).sum;
+}
+
+void header_set_number(char* field, size_t size, uint64_t value)
+{
+    // size - 1 octal digits hold 3 * (size - 1) bits
+    if (3 * (size - 1) >= 64 || value >> (3 * (size - 1)) == 0)
+    {
+        field[size - 1] = '\0';
+
+        for (size_t i = size - 1; i-- != 0; value >>= 3)
+            field[i] = (char)('0' + (value & 7));
+
+        return;
+    }
+
+    // Big-endian binary with the high bit of the first byte set
+    for (size_t i = size; i-- != 1; value >>= 8)
+        field[i] = (char)(value & 0xff);
+
+    field[0] = (char)0x80;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Structure representing a tar header block. */
+typedef struct header
+{
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+
+    char padding[12];
+} header_t;
+
+/** Possible magic values in header block. */
+#define TMAGIC "ustar"
+#define TMAGICS "ustar "
+
+/** Version written after TMAGIC. */
+#define TVERSION "00"
+
+/** Values used in typeflag field. */
+#define REGTYPE '0'
+#define AREGTYPE '\0'
+#define LNKTYPE '1'
+#define SYMTYPE '2'
+#define DIRTYPE '5'
+
+/** Values used in typeflag field of extended headers. */
+#define XHDTYPE 'x'
+#define XGLTYPE 'g'
+#define GNUTYPE_LONGNAME 'L'
+#define GNUTYPE_LONGLINK 'K'
+
+/** Value used in typeflag field of old GNU sparse files. */
+#define GNUTYPE_SPARSE 'S'
+
+/** Results of checking a header block. */
+typedef enum header_status
+{
+    HEADER_NULL,
+    HEADER_VALID,
+    HEADER_BAD_MAGIC,
+    HEADER_BAD_CHECKSUM,
+    HEADER_BAD_SIZE,
+    HEADER_UNSUPPORTED_TYPE
+} header_status_t;
+
+/** Checks if 'header' is a null block or a valid header of a supported
+ * member or of an extended header.
+ * The null check and the checksum take one vectorized pass over the block.
+ */
+header_status_t header_check(const header_t* header);
+
+/** Checks if 'header' contains the right magic value. */
+bool header_is_magic_valid(const header_t* header);
+
+/** Checks if 'header' corresponds to a regular file */
+bool header_is_regular_file(const header_t* header);
+
+/** Checks if 'header' corresponds to a directory, a symbolic link or a hard
+ * link.
+ */
+bool header_is_node(const header_t* header);
+
+/** Checks if 'header' is a PAX extended header or a GNU long name or long
+ * link, whose data applies to the following member.
+ */
+bool header_is_extended(const header_t* header);
+
+/** Checks if 'header' is a null block. */
+bool header_is_null(const header_t* header);
+
+/** Decodes the numeric field 'field' of 'size' bytes into '*value'.
+ * The field holds octal digits after optional spaces, terminated by a space, a
+ * NUL or its end, or a big-endian base-256 number after a 0x80 byte.
+ * @return false if the field is not a valid number.
+ */
+bool header_get_number(const char* field, size_t size, uint64_t* value);
+
+/** Gets the size field from 'header'. */
+size_t header_get_size(const header_t* header);
+
+/** Gets the mtime field from 'header'. */
+uint64_t header_get_mtime(const header_t* header);
+
+/** Gets the mode field from 'header'. */
+uint32_t header_get_mode(const header_t* header);
+
+/** Gets the uid field from 'header'. */
+uint64_t header_get_uid(const header_t* header);
+
+/** Gets the gid field from 'header'. */
+uint64_t header_get_gid(const header_t* header);
+
+/** Returns the length of the name field of 'header'. */
+size_t header_get_name_length(const header_t* header);
+
+/** Computes the checksum of 'header', the sum of its bytes with the chksum
+ * field taken as spaces.
+ */
+uint32_t header_compute_checksum(const header_t* header);
+
+/** Stores 'value' into the numeric field 'field' of 'size' bytes.
+ * Uses octal digits terminated by a NUL and the base-256 extension for values
+ * which do not fit.
+ */
+void header_set_number(char* field, size_t size, uint64_t value);
@@ -1,76 +1,160 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/** Structure containing command line options and arguments.
- * Handles:
- *  -f <arg>
- *  -t
- *  -x
- *  -v
- *  free arguments
- */
-typedef struct options
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "append.h"
+#include "extract.h"
+#include "manifest.h"
+#include "options.h"
+#include "output.h"
+#include "stats.h"
+#include "tree.h"
+
+/** Parses a long option 'arg' of the form --name or --name=value. */
+static int parse_long_option(options_t* options, const char* arg)
 {
-    bool f;
-    const char* f_argument;
-    bool t;
-    bool x;
-    bool v;
+    const char* name = arg + 2;
+    const char* value = strchr(name, '=');
+    size_t name_length = value ? (size_t)(value - name) : strlen(name);
+
+    if (value)
+        ++value;
+
+    if (options_match(name, name_length, "mmap") && !value)
+        options->mmap = true;
+    else if (options_match(name, name_length, "zstd") && !value)
+        options->compression = COMPRESSION_ZSTD;
+    else if (options_match(name, name_length, "occurrence") && !value)
+        options->occurrence = true;
+    else if (options_match(name, name_length, "index") && value && *value)
+        options->index = value;
+    else if (options_match(name, name_length, "buffer-size"))
+    {
+        size_t mebibytes;
+
+        if (!options_parse_number(value, 1024, &mebibytes))
+        {
+            fprintf(stderr, "PPtar: invalid buffer size %s\n", arg);
+            return 2;
+        }
 
-    const char** free_arguments;
-    size_t free_arguments_count;
+        options->buffer_size = mebibytes << 20;
+    }
+    else if (options_match(name, name_length, "stats") &&
+             (!value || strcmp(value, "text") == 0))
+        options->stats = STATS_FORMAT_TEXT;
+    else if (options_match(name, name_length, "stats") &&
+             strcmp(value, "json") == 0)
+        options->stats = STATS_FORMAT_JSON;
+    else if (options_match(name, name_length, "sync") && value &&
+             strcmp(value, "none") == 0)
+        options->sync = TREE_SYNC_NONE;
+    else if (options_match(name, name_length, "sync") && value &&
+             strcmp(value, "file") == 0)
+        options->sync = TREE_SYNC_FILE;
+    else if (options_match(name, name_length, "sync") && value &&
+             strcmp(value, "fs") == 0)
+        options->sync = TREE_SYNC_FS;
+    else if (options_match(name, name_length, "direct") && !value)
+        options->direct = true;
+    else if (options_match(name, name_length, "io") && value &&
+             strcmp(value, "sync") == 0)
+        options->uring = false;
+    else if (options_match(name, name_length, "io") && value &&
+             strcmp(value, "uring") == 0)
+        options->uring = true;
+    else if (options_match(name, name_length, "list-format") && value &&
+             strcmp(value, "text") == 0)
+        options->list_format = OUTPUT_FORMAT_TEXT;
+    else if (options_match(name, name_length, "list-format") && value &&
+             strcmp(value, "null") == 0)
+        options->list_format = OUTPUT_FORMAT_NULL;
+    else if (options_match(name, name_length, "list-format") && value &&
+             strcmp(value, "length") == 0)
+        options->list_format = OUTPUT_FORMAT_LENGTH;
+    else if (options_match(name, name_length, "wildcards") && !value)
+        options->wildcards = true;
+    else if (options_match(name, name_length, "exclude") && value && *value)
+        options->excludes[options->exclude_count++] = value;
+    else if (options_match(name, name_length, "null") && !value)
+        options->null = true;
+    else if (options_match(name, name_length, "dedup") && !value)
+        options->dedup = true;
+    else if (options_match(name, name_length, "verify") && !value)
+        options->verify = true;
+    else if (options_match(name, name_length, "threads"))
+    {
+        if (!options_parse_number(value, 256, &options->threads))
+        {
+            fprintf(stderr, "PPtar: invalid thread count %s\n", arg);
+            return 2;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "PPtar: invalid option '%s'\n", arg);
+        return 2;
+    }
 
-    int error_code;
-} options_t;
+    return 0;
+}
 
-/** Creates a default options_t with capacity for free arguments of
- * 'free_arguments_capacity'.
+/** Reads the names of the file of the -T option of 'options' after its free
+ * arguments.
+ * @return The exit code.
  */
-static options_t options_default(size_t free_arguments_capacity)
+static int read_manifest(options_t* options)
 {
-    options_t options;
-
-    options.error_code = 0;
+    bool standard_input = strcmp(options->T_argument, "-") == 0;
+    int fd = standard_input ? STDIN_FILENO
+                            : open(options->T_argument, O_RDONLY | O_CLOEXEC);
 
-    options.f = false;
-    options.t = false;
-    options.x = false;
-    options.v = false;
+    if (fd == -1)
+    {
+        fprintf(stderr, "PPtar: could not open file %s\n", options->T_argument);
+        return 2;
+    }
 
-    options.f_argument = NULL;
+    bool success =
+        manifest_read(&options->manifest, fd, options->null ? '\0' : '\n');
+    int error = errno;
 
-    options.free_arguments =
-        malloc(sizeof(const char*) * (free_arguments_capacity + 1));
-    options.free_arguments_count = 0;
+    if (!standard_input)
+        close(fd);
 
-    return options;
-}
+    if (!success)
+    {
+        fprintf(stderr,
+                "PPtar: Cannot read names from %s: %s\n",
+                options->T_argument,
+                strerror(error));
+        return 2;
+    }
 
-/** Checks if 'options' contains any free arguments. */
-static bool options_has_free_arguments(const options_t* options)
-{
-    return options->free_arguments_count != 0;
-}
+    size_t count = options->free_arguments_count + options->manifest.name_count;
+    const char** names =
+        realloc(options->free_arguments, sizeof(const char*) * (count + 1));
 
-/** Checks if 'options' contains a free argument equal to 'str' and marks it in
- * the 'free_arguments_found' array.
- */
-static bool options_find_free_argument(const options_t* options,
-                                       const char* str,
-                                       bool* free_arguments_found)
-{
-    for (const char** i = options->free_arguments; *i != NULL;
-         ++i, ++free_arguments_found)
+    if (!names)
     {
-        if (!*free_arguments_found && strcmp(*i, str) == 0)
-        {
-            *free_arguments_found = true;
-            return true;
-        }
+        fprintf(stderr, "PPtar: Out of memory\n");
+        return 2;
     }
-    return false;
+
+    for (size_t i = 0; i != options->manifest.name_count; ++i)
+        names[options->free_arguments_count + i] = options->manifest.names[i];
+    names[count] = NULL;
+
+    options->free_arguments = names;
+    options->free_arguments_count = count;
+
+    return 0;
 }
 
 static options_t parse_arguments_helper(size_t argc, char* const* argv)
@@ -78,6 +162,7 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
     options_t options = options_default(argc);
 
     bool was_f = false;
+    bool was_T = false;
 
     const char** free_argument_i = options.free_arguments;
 
@@ -99,6 +184,16 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
             options.f_argument = arg;
             was_f = false;
         }
+        else if (was_T)
+        {
+            options.T_argument = arg;
+            was_T = false;
+        }
+        else if (arg[0] == '-' && arg[1] == '-' && argument_length != 2)
+        {
+            if ((options.error_code = parse_long_option(&options, arg)) != 0)
+                return options;
+        }
         else if (arg[0] == '-')
         {
             was_f = false;
@@ -118,6 +213,19 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
                     options.f = true;
                     was_f = true;
                     break;
+                case 'T':
+                    options.T = true;
+                    was_T = true;
+                    break;
+                case 'c':
+                    options.c = true;
+                    break;
+                case 'r':
+                    options.r = true;
+                    break;
+                case 'u':
+                    options.u = true;
+                    break;
                 case 't':
                     options.t = true;
                     break;
@@ -127,6 +235,12 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
                 case 'v':
                     options.v = true;
                     break;
+                case 'O':
+                    options.O = true;
+                    break;
+                case 'z':
+                    options.compression = COMPRESSION_GZIP;
+                    break;
                 default:
                     fprintf(stderr, "PPtar: invalid option '%c'\n", option);
                     options.error_code = 2;
@@ -142,6 +256,7 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
     }
 
     *free_argument_i = NULL;
+    options.excludes[options.exclude_count] = NULL;
 
     if (options.f && !options.f_argument)
     {
@@ -150,6 +265,13 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
         return options;
     }
 
+    if (options.T && !options.T_argument)
+    {
+        fprintf(stderr, "PPtar: option -T requires an argument\n");
+        options.error_code = 5;
+        return options;
+    }
+
     if (!options.f)
     {
         fprintf(stderr, "PPtar: no -f option\n");
@@ -164,218 +286,57 @@ static options_t parse_arguments_helper(size_t argc, char* const* argv)
         return options;
     }
 
-    if (!options.x && !options.t)
+    if (options.c && (options.x || options.t))
     {
-        fprintf(stderr, "PPtar: must specify at least on of -tx\n");
-        options.error_code = 8;
+        fprintf(stderr, "PPtar: cannot specify -c with -t or -x\n");
+        options.error_code = 7;
         return options;
     }
 
-    return options;
-}
-
-/** Parses the command line for options. */
-static options_t parse_arguments(size_t argc, char* const* argv)
-{
-    options_t options = parse_arguments_helper(argc, argv);
-
-    if (options.error_code != 0)
-        free(options.free_arguments);
-
-    return options;
-}
-
-/** Structure representing a tar header block. */
-typedef struct header
-{
-    char name[100];
-    char mode[8];
-    char uid[8];
-    char gid[8];
-    char size[12];
-    char mtime[12];
-    char chksum[8];
-    char typeflag;
-    char linkname[100];
-    char magic[6];
-    char version[2];
-    char uname[32];
-    char gname[32];
-    char devmajor[8];
-    char devminor[8];
-    char prefix[155];
-
-    char padding[12];
-} header_t;
-
-/** Size of one record in a tarball. */
-#define RECORD_SIZE ((size_t)512)
-
-/** Possible magic values in header block. */
-#define TMAGIC "ustar"
-#define TMAGICS "ustar "
-
-/** Values used in typeflag field. */
-#define REGTYPE '0'
-#define AREGTYPE '\0'
-
-typedef enum read_header_status
-{
-	READ_HEADER_EOF,
-	READ_HEADER_PARTIAL,
-	READ_HEADER_FULL
-} read_header_status_t;
-
-/** Attempts to read one header block from 'file'.
- * @return Success code.
- * @retval READ_HEADER_EOF - EOF (0 bytes left to read)
- * @retval READ_HEADER_PARTIAL - partial read (truncated file)
- * @retval READ_HEADER_FULL - read the full size of a header block
- */
-static read_header_status_t read_header(FILE* file, header_t* header)
-{
-    size_t read_count = fread(header, sizeof(char), sizeof(header_t), file);
-
-    return read_count == sizeof(header_t) ? READ_HEADER_FULL
-           : read_count == 0              ? READ_HEADER_EOF
-                                          : READ_HEADER_PARTIAL;
-}
-
-/** Checks if 'header' contains the right magic value. */
-static bool header_is_magic_valid(const header_t* header)
-{
-    const size_t magic_size = sizeof(header->magic);
-
-    return strncmp(header->magic, TMAGIC, magic_size) == 0 ||
-           strncmp(header->magic, TMAGICS, magic_size) == 0;
-}
-
-/** Checks if 'header' corresponds to a regular file */
-static bool header_is_regular_file(const header_t* header)
-{
-    return header->typeflag == REGTYPE || header->typeflag == AREGTYPE;
-}
-
-/** Checks validity of 'header' and prints an error message. */
-static int header_check_valid(const header_t* header)
-{
-    if (!header_is_magic_valid(header))
+    if ((options.r || options.u) && (options.c || options.x || options.t))
     {
-        fprintf(stderr,
-                "PPtar: This does not look like a tar archive\n"
-                "PPtar: Exiting with failure status due to previous errors\n");
-
-        return 2;
-    }
-    else if (!header_is_regular_file(header))
-    {
-        fprintf(stderr,
-                "PPtar: Unsupported header type: %d\n",
-                (int)header->typeflag);
-
-        return 2;
+        fprintf(stderr, "PPtar: cannot specify -r or -u with -c, -t or -x\n");
+        options.error_code = 7;
+        return options;
     }
 
-    return 0;
-}
-
-/** Checks if 'header' is a null block. */
-static bool header_is_null(const header_t* header)
-{
-    for (const char* i = (char*)header; i != (char*)(header + 1); ++i)
-        if (*i != 0)
-            return false;
-
-    return true;
-}
-
-/** Gets the size field from 'header'. */
-static size_t header_get_size(const header_t* header)
-{
-    return (size_t)strtoull(header->size, NULL, 8);
-}
-
-/** Returns the number of records a file of size 'x' occupies. */
-static size_t size_to_record_count(size_t x)
-{
-    return (x + RECORD_SIZE - 1) / RECORD_SIZE;
-}
-
-/** Prints errors about files from free arguments. */
-static int check_files(const options_t* options,
-                       const bool* free_arguments_found)
-{
-    bool some_was_not_found = false;
-
-    const char** free_argument_i = options->free_arguments;
-
-    for (const bool* i = free_arguments_found; *free_argument_i != NULL;
-         ++i, ++free_argument_i)
+    if (options.x && options.verify)
     {
-        if (!*i)
-        {
-            printf("PPtar: %s: Not found in archive\n",
-                   *free_argument_i); // should print to stderr
-            some_was_not_found = true;
-        }
+        fprintf(stderr, "PPtar: cannot specify --verify with -x\n");
+        options.error_code = 7;
+        return options;
     }
 
-    if (some_was_not_found)
+    if (!options.c && !options.r && !options.u && !options.x && !options.t)
     {
-        printf("PPtar: Exiting with failure status due to previous "
-               "errors\n"); // should print to stderr
-
-        return 2;
+        fprintf(stderr, "PPtar: must specify at least on of -crtux\n");
+        options.error_code = 8;
+        return options;
     }
 
-    return 0;
-}
-
-/** Allocates and initializes an array of bools indicating whether a file from
- * free arguments was found
- */
-static bool* make_files_found(const options_t* options)
-{
-    bool* files_found = malloc(sizeof(bool) * options->free_arguments_count);
-
-    for (bool* i = files_found;
-         i != files_found + options->free_arguments_count;
-         ++i)
-        *i = false;
-
-    return files_found;
-}
+    if (options.T && (options.error_code = read_manifest(&options)) != 0)
+        return options;
 
-/** Checks if the file corresponding to 'header' is to be considered.
- * Writes to 'files_found' the result of this search.
- */
-static bool check_file_filter(const options_t* options,
-                              const header_t* header,
-                              bool* files_found)
-{
-    if (!options_has_free_arguments(options) ||
-        options_find_free_argument(options, header->name, files_found))
+    if (options.c && options.free_arguments_count == 0)
     {
-        if (options->t || (options->x && options->v))
-            printf("%.*s\n", (int)sizeof(header->name), header->name);
-        return true;
+        fprintf(stderr,
+                "PPtar: Cowardly refusing to create an empty archive\n");
+        options.error_code = 2;
+        return options;
     }
 
-    return false;
+    return options;
 }
 
-/** Tries to open the file from the argument of the -f option. */
-static FILE* try_open_tarball(const options_t* options)
+/** Parses the command line for options. */
+static options_t parse_arguments(size_t argc, char* const* argv)
 {
-    FILE* file = fopen(options->f_argument, "rb");
+    options_t options = parse_arguments_helper(argc, argv);
 
-    if (!file)
-    {
-        fprintf(stderr, "PPtar: could not open file %s\n", options->f_argument);
-        free(options->free_arguments);
-    }
+    if (options.error_code != 0)
+        options_destroy(&options);
 
-    return file;
+    return options;
 }
 
 int main(int argc, char* argv[])
@@ -391,134 +352,39 @@ int main(int argc, char* argv[])
     if (options.error_code != 0)
         return options.error_code;
 
-    FILE* file = try_open_tarball(&options);
-    if (!file)
-        return 2;
-
-    int return_code = 0;
-
-    // Keeps track of blocks read.
-    size_t block_index = 0;
-
-    // If the last read block was a null block
-    bool was_null_block = false;
-
-    // Pointer to the current file being extracted or NULL
-    FILE* file_output = NULL;
+    uint64_t start = stats_now();
 
-    bool* files_found = make_files_found(&options);
+    output_t output;
 
-    while (true)
+    // The standard output is the data of extracted files with -O
+    if (!output_init(&output,
+                     options.x && options.O ? STDERR_FILENO : STDOUT_FILENO,
+                     options.list_format))
     {
-        header_t header;
-
-        read_header_status_t read_header_status = read_header(file, &header);
-
-        if (read_header_status == READ_HEADER_EOF)
-        {
-            if (was_null_block)
-                printf("PPtar: A lone zero block at %zu\n", block_index);
-
-            return_code = 0;
-            break;
-        }
-        else if (read_header_status == READ_HEADER_PARTIAL)
-        {
-            printf("PPtar: Unexpected EOF in archive\n"
-                   "PPtar: Error is not recoverable: exiting now\n");
-
-            return_code = 2;
-            break;
-        }
-
-        ++block_index;
-
-        if (header_is_null(&header))
-        {
-            if (was_null_block)
-            {
-                return_code = 0;
-                break;
-            }
-            else
-            {
-                was_null_block = true;
-                continue;
-            }
-        }
-
-        if ((return_code = header_check_valid(&header)) != 0)
-            break;
-
-        if (check_file_filter(&options, &header, files_found) && options.x)
-        {
-            file_output = fopen(header.name, "wb");
-            if (!file_output)
-            {
-                fprintf(stderr,
-                        "PPtar: Couldn't create file %s\n",
-                        header.name);
-
-                return_code = 9;
-                break;
-            }
-        }
-
-        size_t size = header_get_size(&header);
-        size_t record_count = size_to_record_count(size);
-
-        char buffer[RECORD_SIZE];
-
-        for (size_t i = 0; i != record_count; ++i)
-        {
-            size_t read = fread(buffer, 1, RECORD_SIZE, file);
-
-            if (file_output != NULL)
-            {
-                fwrite(buffer,
-                       1,
-                       read < RECORD_SIZE    ? read
-                       : size >= RECORD_SIZE ? RECORD_SIZE
-                                             : size,
-                       file_output);
-            }
-
-            size -= read;
-
-            if (read != RECORD_SIZE)
-            {
-                printf(
-                    "PPtar: Unexpected EOF in archive\n"
-                    "PPtar: Error is not recoverable: exiting now\n"); // should
-                                                                       // print
-                                                                       // to
-                                                                       // stderr
-
-                return_code = 2;
-                break;
-            }
+        fprintf(stderr, "PPtar: Out of memory\n");
+        options_destroy(&options);
+        return 2;
+    }
 
-            ++block_index;
-        }
+    stats_t stats;
+    stats_init(&stats);
 
-        if (return_code != 0)
-            break;
+    stats_t* used_stats = options.stats != STATS_FORMAT_NONE ? &stats : NULL;
+    int return_code;
 
-        if (file_output != NULL)
-        {
-            fclose(file_output);
-            file_output = NULL;
-        }
-    }
+    if (options.c)
+        return_code = append_create(&options, &output, used_stats);
+    else if (options.r || options.u)
+        return_code = append_archive(&options, &output, used_stats);
+    else
+        return_code = extract_archive(&options, &output, used_stats);
 
-    if (options.t && options_has_free_arguments(&options))
-        return_code = check_files(&options, files_found);
+    return_code = output_finish(&output, return_code);
+    options_destroy(&options);
 
-    fclose(file);
-    if (file_output)
-        fclose(file_output);
-    free(files_found);
-    free(options.free_arguments);
+    if (used_stats)
+        stats_print(used_stats, stats_now() - start, options.stats, stderr);
+    stats_destroy(&stats);
 
     return return_code;
 }
@@ -0,0 +1,193 @@
+#include "manifest.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "filter.h"
+
+void manifest_init(manifest_t* manifest)
+{
+    arena_init(&manifest->strings);
+
+    manifest->names = NULL;
+    manifest->name_count = 0;
+    manifest->name_capacity = 0;
+    manifest->table = NULL;
+    manifest->table_size = 0;
+}
+
+void manifest_destroy(manifest_t* manifest)
+{
+    arena_destroy(&manifest->strings);
+    free(manifest->names);
+    free(manifest->table);
+}
+
+/** Returns the slot of 'name' of 'length' in the table of 'manifest', which
+ * is either its slot or the empty slot where it belongs.
+ */
+static size_t* manifest_slot(const manifest_t* manifest,
+                             const char* name,
+                             size_t length)
+{
+    size_t mask = manifest->table_size - 1;
+
+    for (size_t i = (size_t)hash_name(name, length) & mask;; i = (i + 1) & mask)
+    {
+        size_t* slot = manifest->table + i;
+
+        if (*slot == 0)
+            return slot;
+
+        const char* other = manifest->names[*slot - 1];
+
+        if (strncmp(other, name, length) == 0 && other[length] == '\0')
+            return slot;
+    }
+}
+
+/** Doubles the table of 'manifest' and the room for its names.
+ * @return false if out of memory.
+ */
+static bool manifest_grow(manifest_t* manifest)
+{
+    size_t capacity = manifest->name_capacity ? manifest->name_capacity * 2 : 1024;
+
+    const char** names = realloc(manifest->names, sizeof(const char*) * capacity);
+    if (!names)
+        return false;
+
+    manifest->names = names;
+    manifest->name_capacity = capacity;
+
+    // At most half full
+    size_t* table = calloc(capacity * 2, sizeof(size_t));
+    if (!table)
+        return false;
+
+    free(manifest->table);
+    manifest->table = table;
+    manifest->table_size = capacity * 2;
+
+    for (size_t i = 0; i != manifest->name_count; ++i)
+    {
+        const char* name = manifest->names[i];
+        *manifest_slot(manifest, name, strlen(name)) = i + 1;
+    }
+
+    return true;
+}
+
+/** Adds 'name' of 'length' to 'manifest' unless it is there already.
+ * @return false if out of memory.
+ */
+static bool manifest_add(manifest_t* manifest, const char* name, size_t length)
+{
+    // A name ends at a NUL like in a header
+    length = strnlen(name, length);
+
+    if (manifest->name_count == manifest->name_capacity && !manifest_grow(manifest))
+        return false;
+
+    size_t* slot = manifest_slot(manifest, name, length);
+
+    if (*slot != 0)
+        return true;
+
+    char* copy = arena_strndup(&manifest->strings, name, length);
+    if (!copy)
+        return false;
+
+    manifest->names[manifest->name_count] = copy;
+    *slot = ++manifest->name_count;
+
+    return true;
+}
+
+bool manifest_read(manifest_t* manifest, int fd, char delimiter)
+{
+    size_t capacity = MANIFEST_READ_SIZE;
+    char* buffer = malloc(capacity);
+
+    // Start of the name being read and end of the data read
+    size_t begin = 0;
+    size_t end = 0;
+
+    bool success = buffer != NULL;
+    if (!success)
+        errno = ENOMEM;
+
+    while (success)
+    {
+        // A name longer than the buffer grows it
+        if (begin == 0 && end == capacity)
+        {
+            char* grown = realloc(buffer, capacity * 2);
+            if (!grown)
+            {
+                errno = ENOMEM;
+                success = false;
+                break;
+            }
+
+            buffer = grown;
+            capacity *= 2;
+        }
+        else if (capacity - end < MANIFEST_READ_SIZE / 2)
+        {
+            memmove(buffer, buffer + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+
+        ssize_t result = read(fd, buffer + end, capacity - end);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0)
+        {
+            success = false;
+            break;
+        }
+
+        // The last name needs no delimiter
+        if (result == 0)
+        {
+            if (end != begin &&
+                !manifest_add(manifest, buffer + begin, end - begin))
+            {
+                errno = ENOMEM;
+                success = false;
+            }
+            break;
+        }
+
+        const char* scan = buffer + end;
+        end += (size_t)result;
+
+        const char* delimiter_i;
+        while ((delimiter_i =
+                    memchr(scan, delimiter, (size_t)(buffer + end - scan))))
+        {
+            size_t length = (size_t)(delimiter_i - (buffer + begin));
+
+            if (length != 0 && !manifest_add(manifest, buffer + begin, length))
+            {
+                success = false;
+                break;
+            }
+
+            begin += length + 1;
+            scan = delimiter_i + 1;
+        }
+
+        if (!success)
+            errno = ENOMEM;
+    }
+
+    free(buffer);
+    return success;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/** Size of a read of a manifest. */
+#define MANIFEST_READ_SIZE ((size_t)64 << 10)
+
+/** Distinct member names read from a file, in the order of their first
+ * occurrences.
+ * The names are copied to an arena and found in an open addressing hash table
+ * of their indices, so each is kept once.
+ */
+typedef struct manifest
+{
+    arena_t strings;
+
+    const char** names;
+    size_t name_count;
+    size_t name_capacity;
+
+    // Indices into 'names' plus one, 0 for an empty slot
+    size_t* table;
+
+    // Power of two
+    size_t table_size;
+} manifest_t;
+
+/** Initializes empty 'manifest'. */
+void manifest_init(manifest_t* manifest);
+
+/** Frees the memory of 'manifest' and its names. */
+void manifest_destroy(manifest_t* manifest);
+
+/** Reads the names of 'fd' separated by 'delimiter' into 'manifest', skipping
+ * empty ones.
+ * @return false on failure, errno is set.
+ */
+bool manifest_read(manifest_t* manifest, int fd, char delimiter);
@@ -0,0 +1,84 @@
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "reader.h"
+
+options_t options_default(size_t free_arguments_capacity)
+{
+    options_t options;
+
+    options.error_code = 0;
+
+    options.f = false;
+    options.c = false;
+    options.r = false;
+    options.u = false;
+    options.t = false;
+    options.x = false;
+    options.v = false;
+    options.O = false;
+    options.compression = COMPRESSION_NONE;
+
+    options.f_argument = NULL;
+    options.T = false;
+    options.T_argument = NULL;
+    options.null = false;
+
+    options.buffer_size = READER_DEFAULT_BUFFER_SIZE;
+    options.mmap = false;
+    options.occurrence = false;
+    options.index = NULL;
+    options.threads = 0;
+    options.stats = STATS_FORMAT_NONE;
+    options.sync = TREE_SYNC_NONE;
+    options.direct = false;
+    options.uring = false;
+    options.list_format = OUTPUT_FORMAT_TEXT;
+    options.wildcards = false;
+    options.dedup = false;
+    options.verify = false;
+
+    options.free_arguments =
+        malloc(sizeof(const char*) * (free_arguments_capacity + 1));
+    options.free_arguments_count = 0;
+    manifest_init(&options.manifest);
+    options.excludes = malloc(sizeof(const char*) * (free_arguments_capacity + 1));
+    options.exclude_count = 0;
+
+    return options;
+}
+
+void options_destroy(options_t* options)
+{
+    free(options->free_arguments);
+    manifest_destroy(&options->manifest);
+    free(options->excludes);
+}
+
+bool options_has_free_arguments(const options_t* options)
+{
+    return options->free_arguments_count != 0;
+}
+
+bool options_parse_number(const char* value, size_t max, size_t* number)
+{
+    if (!value || *value < '0' || *value > '9')
+        return false;
+
+    char* end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+
+    if (*end != '\0' || parsed == 0 || parsed > max)
+        return false;
+
+    *number = (size_t)parsed;
+    return true;
+}
+
+bool options_match(const char* name, size_t name_length, const char* option)
+{
+    return name_length == strlen(option) &&
+           strncmp(name, option, name_length) == 0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "decompressor.h"
+#include "manifest.h"
+#include "output.h"
+#include "stats.h"
+#include "tree.h"
+
+/** Structure containing command line options and arguments.
+ * Handles:
+ *  -f <arg>
+ *  -T <file>
+ *  -c
+ *  -t
+ *  -x
+ *  -v
+ *  -z
+ *  --zstd
+ *  --buffer-size=<MiB>
+ *  --mmap
+ *  --occurrence
+ *  --index=<file>
+ *  --threads=<count>
+ *  --stats[=text|json]
+ *  --sync=none|file|fs
+ *  --direct
+ *  --io=sync|uring
+ *  --list-format=text|null|length
+ *  --wildcards
+ *  --exclude=<pattern>
+ *  --null
+ *  --dedup
+ *  --verify
+ *  free arguments
+ */
+typedef struct options
+{
+    bool f;
+    const char* f_argument;
+
+    // Names of members are read from the file, '-' for the standard input
+    bool T;
+    const char* T_argument;
+
+    // The names of the file are separated by NULs instead of newlines
+    bool null;
+    bool c;
+
+    // Files are appended, with -u only those newer than their members
+    bool r;
+    bool u;
+    bool t;
+    bool x;
+    bool v;
+
+    // Extracted files are written to the standard output
+    bool O;
+
+    // Compression of a created archive
+    compression_t compression;
+
+    size_t buffer_size;
+    bool mmap;
+    bool occurrence;
+    const char* index;
+
+    // 0 if not given
+    size_t threads;
+    stats_format_t stats;
+
+    // Flushing and page cache use of extracted files
+    tree_sync_t sync;
+    bool direct;
+
+    // Small files are written through io_uring
+    bool uring;
+
+    output_format_t list_format;
+
+    // Free arguments are glob patterns
+    bool wildcards;
+
+    // Followed by the names from the file of -T
+    const char** free_arguments;
+    size_t free_arguments_count;
+
+    // Storage of the names from the file of -T
+    manifest_t manifest;
+
+    // Patterns of members never selected
+    const char** excludes;
+    size_t exclude_count;
+
+    // Files with the content and the attributes of an earlier one are links
+    // to it
+    bool dedup;
+
+    // Digests of files are recorded when writing and checked with -t
+    bool verify;
+
+    int error_code;
+} options_t;
+
+/** Creates a default options_t with capacity for free arguments of
+ * 'free_arguments_capacity'.
+ */
+options_t options_default(size_t free_arguments_capacity);
+
+/** Frees the memory of 'options'. */
+void options_destroy(options_t* options);
+
+/** Checks if 'options' contains any free arguments. */
+bool options_has_free_arguments(const options_t* options);
+
+/** Parses 'value' as a decimal number in [1, 'max'] into '*number'.
+ * @return false if it is NULL or not such a number.
+ */
+bool options_parse_number(const char* value, size_t max, size_t* number);
+
+/** Checks if the long option 'name' of 'name_length' is 'option'. */
+bool options_match(const char* name, size_t name_length, const char* option);
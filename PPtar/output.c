@@ -0,0 +1,168 @@
+#include "output.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "writer.h"
+
+bool output_init(output_t* output, int fd, output_format_t format)
+{
+    output->fd = fd;
+    output->format = format;
+    output->line_buffered = isatty(fd) == 1;
+    output->buffer = malloc(OUTPUT_BUFFER_SIZE);
+    output->fill = 0;
+    output->error = 0;
+
+    return output->buffer != NULL;
+}
+
+void output_destroy(output_t* output)
+{
+    free(output->buffer);
+}
+
+/** Writes 'size' bytes of 'data' to 'output' past its buffer. */
+static void output_write(output_t* output, const char* data, size_t size)
+{
+    if (output->error == 0 && !write_all(output->fd, data, size))
+        output->error = errno;
+}
+
+bool output_flush(output_t* output)
+{
+    output_write(output, output->buffer, output->fill);
+    output->fill = 0;
+
+    errno = output->error;
+    return output->error == 0;
+}
+
+/** Makes room for 'size' bytes in the buffer of 'output'.
+ * @return false if they do not fit even into an empty buffer.
+ */
+static bool output_reserve(output_t* output, size_t size)
+{
+    if (OUTPUT_BUFFER_SIZE - output->fill < size)
+        output_flush(output);
+
+    return size <= OUTPUT_BUFFER_SIZE;
+}
+
+void output_name(output_t* output, const char* name, size_t length)
+{
+    char prefix[4];
+    size_t prefix_size = 0;
+
+    if (output->format == OUTPUT_FORMAT_LENGTH)
+    {
+        for (; prefix_size != sizeof(prefix); ++prefix_size)
+            prefix[prefix_size] = (char)((uint32_t)length >> (8 * prefix_size));
+    }
+
+    char terminator = output->format == OUTPUT_FORMAT_TEXT ? '\n' : '\0';
+    size_t terminator_size = output->format == OUTPUT_FORMAT_LENGTH ? 0 : 1;
+
+    if (output_reserve(output, prefix_size + length + terminator_size))
+    {
+        char* end = output->buffer + output->fill;
+
+        memcpy(end, prefix, prefix_size);
+        memcpy(end + prefix_size, name, length);
+        memcpy(end + prefix_size + length, &terminator, terminator_size);
+
+        output->fill += prefix_size + length + terminator_size;
+    }
+    else
+    {
+        output_write(output, prefix, prefix_size);
+        output_write(output, name, length);
+        output_write(output, &terminator, terminator_size);
+    }
+
+    if (output->line_buffered)
+        output_flush(output);
+}
+
+bool output_data(output_t* output, const char* data, size_t size)
+{
+    if (output_reserve(output, size))
+    {
+        memcpy(output->buffer + output->fill, data, size);
+        output->fill += size;
+    }
+    else
+        output_write(output, data, size);
+
+    if (output->line_buffered)
+        output_flush(output);
+
+    errno = output->error;
+    return output->error == 0;
+}
+
+void output_message(output_t* output, const char* format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+
+    if (output->format != OUTPUT_FORMAT_TEXT)
+    {
+        vfprintf(stderr, format, arguments);
+        va_end(arguments);
+        return;
+    }
+
+    va_list copy;
+    va_copy(copy, arguments);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+
+    // The terminating NUL is overwritten by the next write
+    if (length >= 0 && output_reserve(output, (size_t)length + 1))
+    {
+        vsnprintf(output->buffer + output->fill,
+                  (size_t)length + 1,
+                  format,
+                  arguments);
+        output->fill += (size_t)length;
+    }
+    else if (length >= 0)
+    {
+        char* message = malloc((size_t)length + 1);
+
+        if (message)
+        {
+            vsnprintf(message, (size_t)length + 1, format, arguments);
+            output_write(output, message, (size_t)length);
+        }
+        else if (output->error == 0)
+            output->error = ENOMEM;
+
+        free(message);
+    }
+
+    va_end(arguments);
+
+    if (output->line_buffered)
+        output_flush(output);
+}
+
+int output_finish(output_t* output, int return_code)
+{
+    if (!output_flush(output))
+    {
+        fprintf(stderr, "PPtar: Write error: %s\n", strerror(errno));
+
+        if (return_code == 0)
+            return_code = 2;
+    }
+
+    output_destroy(output);
+    return return_code;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Size of the buffer of an output. */
+#define OUTPUT_BUFFER_SIZE ((size_t)1 << 20)
+
+/** Formats of the names of listed members. */
+typedef enum output_format
+{
+    // Each name is followed by a newline
+    OUTPUT_FORMAT_TEXT,
+
+    // Each name is followed by a NUL
+    OUTPUT_FORMAT_NULL,
+
+    // Each name is preceded by its length as 4 bytes in little endian
+    OUTPUT_FORMAT_LENGTH
+} output_format_t;
+
+/** Buffered standard output of member names and messages, or of the data of
+ * extracted members.
+ * The names are copied to a large buffer, which is written whole when full,
+ * or after each line to a terminal. Messages of a machine format go to the
+ * standard error output instead, so only names are written.
+ * A write error is kept and reported by the next flush.
+ */
+typedef struct output
+{
+    int fd;
+    output_format_t format;
+    bool line_buffered;
+
+    char* buffer;
+    size_t fill;
+
+    // errno of the first failed write or 0
+    int error;
+} output_t;
+
+/** Initializes 'output' writing to 'fd' in 'format'.
+ * @return false if out of memory.
+ */
+bool output_init(output_t* output, int fd, output_format_t format);
+
+/** Frees the memory of 'output', the buffer has to be flushed. */
+void output_destroy(output_t* output);
+
+/** Writes the member name 'name' of 'length'. */
+void output_name(output_t* output, const char* name, size_t length);
+
+/** Writes the message formatted from 'format' and the rest of the
+ * arguments.
+ */
+void output_message(output_t* output, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/** Writes 'size' bytes of 'data' as they are. Data larger than the buffer is
+ * written past it.
+ * @return false if this or an earlier write failed, errno is set.
+ */
+bool output_data(output_t* output, const char* data, size_t size);
+
+/** Writes the buffer of 'output'.
+ * @return false if this or an earlier write failed, errno is set.
+ */
+bool output_flush(output_t* output);
+
+/** Flushes and frees 'output' of a run which ended with 'return_code'.
+ * @return The exit code.
+ */
+int output_finish(output_t* output, int return_code);
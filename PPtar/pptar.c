@@ -0,0 +1,455 @@
+#include "pptar.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Returns the number of records 'size' bytes occupy. */
+static size_t record_count(uint64_t size)
+{
+    return (size_t)((size + RECORD_SIZE - 1) / RECORD_SIZE);
+}
+
+pptar_options_t pptar_options_default(void)
+{
+    pptar_options_t options;
+
+    options.buffer_size = READER_DEFAULT_BUFFER_SIZE;
+    options.map = false;
+    options.allocator = NULL;
+    options.stats = NULL;
+
+    return options;
+}
+
+/** Initializes the state of 'archive' whose reader was just opened. */
+static void pptar_init(pptar_t* archive)
+{
+    extended_init(&archive->extended);
+
+    archive->block_index = 0;
+    archive->entry_offset = 0;
+    archive->end_offset = -1;
+    archive->was_null_block = false;
+    archive->lone_null_block = false;
+    archive->header_status = HEADER_VALID;
+    archive->typeflag = '\0';
+    archive->data_remaining = 0;
+    archive->padding = 0;
+}
+
+/** Opens the archive 'fd' with 'options' into 'archive', which closes it even
+ * on failure.
+ * @return false on failure, errno is set.
+ */
+static bool pptar_open_owned(pptar_t* archive,
+                             int fd,
+                             const pptar_options_t* options)
+{
+    if (!reader_open_fd(&archive->reader,
+                        fd,
+                        options->buffer_size,
+                        options->map,
+                        options->allocator,
+                        options->stats))
+        return false;
+
+    pptar_init(archive);
+    return true;
+}
+
+bool pptar_open(pptar_t* archive, const char* path, const pptar_options_t* options)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    return fd != -1 && pptar_open_owned(archive, fd, options);
+}
+
+bool pptar_open_fd(pptar_t* archive, int fd, const pptar_options_t* options)
+{
+    int duplicate = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+    return duplicate != -1 && pptar_open_owned(archive, duplicate, options);
+}
+
+bool pptar_open_memory(pptar_t* archive,
+                       const void* data,
+                       size_t size,
+                       const pptar_options_t* options)
+{
+    if (!reader_open_memory(&archive->reader, data, size, options->stats))
+        return false;
+
+    pptar_init(archive);
+    return true;
+}
+
+void pptar_close(pptar_t* archive)
+{
+    reader_close(&archive->reader);
+    extended_destroy(&archive->extended);
+}
+
+/** Reads one header block of 'archive' into '*header', which points into the
+ * buffer of the reader.
+ * @return PPTAR_OK, PPTAR_END if the archive ended before it, PPTAR_TRUNCATED
+ * if it ended inside of it.
+ */
+static pptar_status_t pptar_read_header(pptar_t* archive, const header_t** header)
+{
+    size_t read_count;
+    *header = (const header_t*)reader_next(
+        &archive->reader, sizeof(header_t), &read_count);
+
+    if (read_count == sizeof(header_t))
+    {
+        ++archive->block_index;
+        return PPTAR_OK;
+    }
+
+    return read_count == 0 ? PPTAR_END : PPTAR_TRUNCATED;
+}
+
+/** Returns the status of a failed making of an entry, by errno. */
+static pptar_status_t entry_failed(void)
+{
+    return errno == ENOMEM ? PPTAR_NO_MEMORY : PPTAR_MALFORMED;
+}
+
+/** Reads the data of the extended header 'header', which was just read, into
+ * the attributes of 'archive'.
+ * @return PPTAR_OK or the error.
+ */
+static pptar_status_t pptar_read_extended(pptar_t* archive, const header_t* header)
+{
+    // The header is not valid after the next read
+    char typeflag = header->typeflag;
+    size_t size = header_get_size(header);
+    size_t records = record_count(size);
+
+    if (size > EXTENDED_MAX_SIZE)
+        return PPTAR_MALFORMED;
+
+    char* data = extended_begin(&archive->extended, typeflag, size);
+    if (!data)
+        return PPTAR_NO_MEMORY;
+
+    for (size_t copied = 0; records != 0;)
+    {
+        size_t read;
+        const char* block =
+            reader_next(&archive->reader, records * RECORD_SIZE, &read);
+        size_t useful = read < size - copied ? read : size - copied;
+
+        if (block)
+            memcpy(data + copied, block, useful);
+
+        copied += useful;
+
+        if (read % RECORD_SIZE != 0 || read == 0)
+            return PPTAR_TRUNCATED;
+
+        records -= read / RECORD_SIZE;
+        archive->block_index += read / RECORD_SIZE;
+    }
+
+    if (!extended_parse(&archive->extended, typeflag, data, size))
+        return PPTAR_MALFORMED;
+
+    return PPTAR_OK;
+}
+
+/** Makes '*entry' of 'header', which was just read from 'archive'. The
+ * header is copied to the archive first, as the next read invalidates it, be
+ * it the extension records of an old GNU sparse file or the data.
+ * @return PPTAR_OK or the error.
+ */
+static pptar_status_t pptar_make_entry(pptar_t* archive,
+                                       const header_t* header,
+                                       entry_t* entry)
+{
+    // An archive in memory stays in place
+    if (!archive->reader.memory)
+    {
+        archive->header = *header;
+        header = &archive->header;
+    }
+
+    if (!extended_make_entry(&archive->extended, header, entry))
+        return entry_failed();
+
+    while (entry->sparse_extended)
+    {
+        const header_t* record;
+
+        if (pptar_read_header(archive, &record) != PPTAR_OK)
+            return PPTAR_TRUNCATED;
+
+        if (!extended_add_sparse_record(
+                &archive->extended, entry, (const char*)record))
+            return entry_failed();
+    }
+
+    return PPTAR_OK;
+}
+
+pptar_status_t pptar_read_entry(pptar_t* archive, entry_t* entry)
+{
+    reader_t* reader = &archive->reader;
+
+    // The attributes of the last entry
+    extended_reset(&archive->extended);
+
+    while (true)
+    {
+        off_t header_offset = reader_tell(reader);
+        const header_t* header;
+
+        pptar_status_t status = pptar_read_header(archive, &header);
+
+        if (!archive->extended.pending)
+            archive->entry_offset = header_offset;
+
+        if (status == PPTAR_END)
+        {
+            if (reader->error != 0)
+                return PPTAR_TRUNCATED;
+
+            if (archive->end_offset == -1)
+                archive->end_offset = archive->entry_offset;
+
+            archive->lone_null_block = archive->was_null_block;
+            return PPTAR_END;
+        }
+        else if (status != PPTAR_OK)
+            return status;
+
+        header_status_t header_status = header_check(header);
+
+        if (header_status == HEADER_NULL)
+        {
+            if (archive->end_offset == -1)
+                archive->end_offset = archive->entry_offset;
+
+            // Extended headers apply to members only
+            extended_reset(&archive->extended);
+
+            if (archive->was_null_block)
+                return PPTAR_END;
+
+            archive->was_null_block = true;
+            continue;
+        }
+
+        archive->end_offset = -1;
+
+        if (header_status != HEADER_VALID)
+        {
+            archive->header_status = header_status;
+            archive->typeflag = header->typeflag;
+            return PPTAR_BAD_HEADER;
+        }
+
+        if (!header_is_extended(header))
+            return pptar_make_entry(archive, header, entry);
+
+        if ((status = pptar_read_extended(archive, header)) != PPTAR_OK)
+            return status;
+    }
+}
+
+pptar_status_t pptar_read_sparse_map(pptar_t* archive,
+                                     entry_t* entry,
+                                     size_t* map_size)
+{
+    char* map = NULL;
+    size_t size = 0;
+    pptar_status_t status = PPTAR_OK;
+
+    // The map is parsed again after each record, it mostly fits the first
+    do
+    {
+        if (size + RECORD_SIZE > EXTENDED_MAX_SIZE ||
+            size + RECORD_SIZE > entry->size)
+        {
+            status = PPTAR_MALFORMED;
+            break;
+        }
+
+        char* grown = realloc(map, size + RECORD_SIZE);
+        if (!grown)
+        {
+            status = PPTAR_NO_MEMORY;
+            break;
+        }
+
+        map = grown;
+
+        const header_t* record;
+        if (pptar_read_header(archive, &record) != PPTAR_OK)
+        {
+            status = PPTAR_TRUNCATED;
+            break;
+        }
+
+        memcpy(map + size, record, RECORD_SIZE);
+        size += RECORD_SIZE;
+
+        if (!extended_parse_sparse_map(
+                &archive->extended, entry, map, size, map_size))
+        {
+            status = entry_failed();
+            break;
+        }
+    } while (*map_size == 0);
+
+    free(map);
+    return status;
+}
+
+pptar_status_t pptar_next_entry(pptar_t* archive, entry_t* entry)
+{
+    uint64_t rest = archive->data_remaining + archive->padding;
+
+    archive->data_remaining = 0;
+    archive->padding = 0;
+
+    if (rest != 0)
+    {
+        size_t skipped = reader_skip(&archive->reader, (size_t)rest);
+
+        archive->block_index = (size_t)(reader_tell(&archive->reader) / RECORD_SIZE);
+
+        if (skipped != rest)
+            return PPTAR_TRUNCATED;
+    }
+
+    pptar_status_t status = pptar_read_entry(archive, entry);
+    if (status != PPTAR_OK)
+        return status;
+
+    size_t map_size = 0;
+
+    if (entry->sparse_map_in_data &&
+        (status = pptar_read_sparse_map(archive, entry, &map_size)) != PPTAR_OK)
+        return status;
+
+    archive->data_remaining = entry->size - map_size;
+    archive->padding = record_count(entry->size) * RECORD_SIZE - (size_t)entry->size;
+
+    return PPTAR_OK;
+}
+
+pptar_status_t pptar_read_view(pptar_t* archive,
+                               size_t max_size,
+                               const char** data,
+                               size_t* size)
+{
+    *data = NULL;
+    *size = 0;
+
+    if (archive->data_remaining == 0)
+        return PPTAR_END;
+
+    size_t request = archive->data_remaining < max_size
+                         ? (size_t)archive->data_remaining
+                         : max_size;
+
+    *data = reader_next(&archive->reader, request, size);
+    archive->data_remaining -= *size;
+
+    return *size != 0 ? PPTAR_OK : PPTAR_TRUNCATED;
+}
+
+pptar_status_t pptar_read(pptar_t* archive, void* data, size_t size, size_t* read)
+{
+    *read = 0;
+
+    while (*read != size)
+    {
+        const char* view;
+        size_t view_size;
+
+        pptar_status_t status =
+            pptar_read_view(archive, size - *read, &view, &view_size);
+
+        if (status == PPTAR_END)
+            break;
+        if (status != PPTAR_OK)
+            return status;
+
+        memcpy((char*)data + *read, view, view_size);
+        *read += view_size;
+    }
+
+    return *read != 0 || size == 0 ? PPTAR_OK : PPTAR_END;
+}
+
+pptar_status_t pptar_read_to(pptar_t* archive,
+                             const entry_t* entry,
+                             const pptar_sink_t* sink)
+{
+    while (true)
+    {
+        const char* data;
+        size_t size;
+
+        // As much as the reader has at once
+        pptar_status_t status = pptar_read_view(archive, SIZE_MAX, &data, &size);
+
+        if (status == PPTAR_END)
+            return PPTAR_OK;
+        if (status != PPTAR_OK)
+            return status;
+
+        if (!sink->write(sink->context, entry, data, size))
+            return PPTAR_STOPPED;
+    }
+}
+
+int pptar_check_header(header_status_t status, char typeflag)
+{
+    if (status == HEADER_BAD_MAGIC)
+    {
+        fprintf(stderr,
+                "PPtar: This does not look like a tar archive\n"
+                "PPtar: Exiting with failure status due to previous errors\n");
+
+        return 2;
+    }
+    else if (status == HEADER_BAD_CHECKSUM)
+    {
+        fprintf(stderr,
+                "PPtar: Checksum error in header\n"
+                "PPtar: Exiting with failure status due to previous errors\n");
+
+        return 2;
+    }
+    else if (status == HEADER_BAD_SIZE)
+    {
+        fprintf(stderr,
+                "PPtar: Invalid size field in header\n"
+                "PPtar: Exiting with failure status due to previous errors\n");
+
+        return 2;
+    }
+    else if (status == HEADER_UNSUPPORTED_TYPE)
+    {
+        fprintf(stderr,
+                "PPtar: Unsupported header type: %d\n",
+                (int)typeflag);
+
+        return 2;
+    }
+
+    return 0;
+}
+
+void pptar_check_read_error(const reader_t* reader)
+{
+    if (reader->error != 0)
+        fprintf(stderr, "PPtar: Read error: %s\n", strerror(reader->error));
+}
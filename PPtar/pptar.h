@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "allocator.h"
+#include "extended.h"
+#include "header.h"
+#include "reader.h"
+
+/** Results of reading from an archive. */
+typedef enum pptar_status
+{
+    // An entry or data was read
+    PPTAR_OK,
+
+    // The archive or the data of the entry ended
+    PPTAR_END,
+
+    // The archive ended in the middle of a member or reading failed, the
+    // error of the reader is set then
+    PPTAR_TRUNCATED,
+
+    // A header is not valid, the header status and the typeflag of the
+    // archive tell why
+    PPTAR_BAD_HEADER,
+
+    // An extended header or a sparse map is malformed
+    PPTAR_MALFORMED,
+
+    PPTAR_NO_MEMORY,
+
+    // A sink stopped reading
+    PPTAR_STOPPED
+} pptar_status_t;
+
+/** Options of opening an archive. */
+typedef struct pptar_options
+{
+    // Size of the buffer, a non-zero multiple of RECORD_SIZE, or the
+    // readahead distance of a mapped archive
+    size_t buffer_size;
+
+    // An uncompressed regular file is mapped instead of read
+    bool map;
+
+    // Allocator of the buffer or NULL
+    const allocator_t* allocator;
+
+    // Statistics to collect or NULL
+    struct stats* stats;
+} pptar_options_t;
+
+/** Receiver of the data of entries. */
+typedef struct pptar_sink
+{
+    // Receives the next 'size' bytes of the data of 'entry' at 'data', which
+    // point into the buffer or the mapping of the reader and are valid during
+    // the call only. Returns false to stop.
+    bool (*write)(void* context,
+                  const entry_t* entry,
+                  const char* data,
+                  size_t size);
+
+    void* context;
+} pptar_sink_t;
+
+/** Archive read entry by entry, each followed by its data.
+ * An entry is a member with its preceding extended headers applied. Its data
+ * is handed out by pointers into the buffer or the mapping of the reader,
+ * without copying, or copied out. The data of a sparse member are its
+ * segments one after another. Data left unread is skipped by the next entry,
+ * by seeking if possible.
+ * Compressed archives are decompressed on the fly. An archive in memory is
+ * read in place, its headers are not copied and all of the data of an entry
+ * comes in one view.
+ */
+typedef struct pptar
+{
+    reader_t reader;
+    extended_t extended;
+
+    // Copy of the header of the last entry unless the archive is in memory
+    header_t header;
+
+    // Number of records consumed
+    size_t block_index;
+
+    // Offset of the first extended header of the last entry
+    off_t entry_offset;
+
+    // Offset of the end of the archive, the first null block after the last
+    // member or the end of the file, before any extended headers of neither,
+    // -1 until the end is read
+    off_t end_offset;
+
+    // The last header was a null block
+    bool was_null_block;
+
+    // The archive ended after a single null block
+    bool lone_null_block;
+
+    // Why the last header was not valid
+    header_status_t header_status;
+    char typeflag;
+
+    // Data of the last entry left to read and the padding after it
+    uint64_t data_remaining;
+    size_t padding;
+} pptar_t;
+
+/** Returns the default options of opening an archive. */
+pptar_options_t pptar_options_default(void);
+
+/** Opens the archive at 'path' with 'options' into 'archive'.
+ * @return false on failure, errno is set, ENOTSUP for a compression which is
+ * not supported by this build.
+ */
+bool pptar_open(pptar_t* archive, const char* path, const pptar_options_t* options);
+
+/** Opens the archive 'fd' from its start like pptar_open. 'fd' stays open, a
+ * duplicate of it is read.
+ */
+bool pptar_open_fd(pptar_t* archive, int fd, const pptar_options_t* options);
+
+/** Opens the uncompressed archive of 'size' bytes at 'data' in memory like
+ * pptar_open, only the statistics of 'options' apply. 'data' is not copied
+ * and has to stay valid until the archive is closed.
+ * @return false with errno ENOTSUP for a compressed archive.
+ */
+bool pptar_open_memory(pptar_t* archive,
+                       const void* data,
+                       size_t size,
+                       const pptar_options_t* options);
+
+/** Closes 'archive' and frees its memory. */
+void pptar_close(pptar_t* archive);
+
+/** Skips the rest of the data of the last entry of 'archive' and reads the
+ * next one into '*entry'. The entry is valid until the next entry is read.
+ * @return PPTAR_OK, PPTAR_END at the end of the archive or the error.
+ */
+pptar_status_t pptar_next_entry(pptar_t* archive, entry_t* entry);
+
+/** Returns a pointer to at most 'max_size', which is not 0, next bytes of the
+ * data of the last entry of 'archive' in '*data' and consumes them. Writes
+ * their number to '*size'. The pointer is valid until the next read.
+ * @return PPTAR_OK, PPTAR_END at the end of the data or the error.
+ */
+pptar_status_t pptar_read_view(pptar_t* archive,
+                               size_t max_size,
+                               const char** data,
+                               size_t* size);
+
+/** Copies at most 'size' next bytes of the data of the last entry of
+ * 'archive' to 'data'. Writes their number to '*read', less than 'size' only
+ * at the end of the data.
+ * @return PPTAR_OK, PPTAR_END if no bytes are left or the error.
+ */
+pptar_status_t pptar_read(pptar_t* archive, void* data, size_t size, size_t* read);
+
+/** Passes the rest of the data of the last entry 'entry' of 'archive' to
+ * 'sink' chunk by chunk as it is read, without copying.
+ * @return PPTAR_OK, PPTAR_STOPPED if the sink returned false or the error.
+ */
+pptar_status_t pptar_read_to(pptar_t* archive,
+                             const entry_t* entry,
+                             const pptar_sink_t* sink);
+
+/** Reads the headers of the next member of 'archive' into '*entry', the
+ * reader is at its data then. The data is left to the caller, which has to
+ * consume all of its records before reading the next entry.
+ * The entry is valid until the next entry is read.
+ * @return PPTAR_OK, PPTAR_END at the end of the archive or the error.
+ */
+pptar_status_t pptar_read_entry(pptar_t* archive, entry_t* entry);
+
+/** Reads the map at the start of the data of the PAX 1.0 sparse 'entry' of
+ * 'archive' into it. Writes the size of the map in the data to '*map_size'.
+ * @return PPTAR_OK or the error.
+ */
+pptar_status_t pptar_read_sparse_map(pptar_t* archive,
+                                     entry_t* entry,
+                                     size_t* map_size);
+
+/** Prints an error message if a header of 'typeflag' with 'status' is not
+ * valid.
+ * @return The exit code.
+ */
+int pptar_check_header(header_status_t status, char typeflag);
+
+/** Prints an error message if reading from 'reader' failed. */
+void pptar_check_read_error(const reader_t* reader);
@@ -0,0 +1,644 @@
+#define _GNU_SOURCE
+
+#include "reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "decompressor.h"
+#include "stats.h"
+#include "writer.h"
+
+/** Alignment of the reader buffer. */
+#define READER_ALIGNMENT ((size_t)4096)
+
+/** Size of the first read after opening or seeking. */
+#define READER_INITIAL_READ_SIZE ((size_t)64 << 10)
+
+/** Returns the size of 'fd' if it is a seekable regular file, -1 otherwise. */
+static off_t fd_get_seekable_size(int fd)
+{
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+        return -1;
+
+    return file_stat.st_size;
+}
+
+/** Returns the smaller of 'a' and 'b'. */
+static size_t min_size(size_t a, size_t b)
+{
+    return a < b ? a : b;
+}
+
+/** Detects the compression of the archive and sets up the decompressor.
+ * @return false on failure, errno is set.
+ */
+static bool reader_detect_compression(reader_t* reader);
+
+bool reader_open(reader_t* reader,
+                 const char* path,
+                 size_t buffer_size,
+                 bool map,
+                 stats_t* stats)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    return reader_open_fd(reader, fd, buffer_size, map, NULL, stats);
+}
+
+bool reader_open_fd(reader_t* reader,
+                    int fd,
+                    size_t buffer_size,
+                    bool map,
+                    const allocator_t* allocator,
+                    stats_t* stats)
+{
+    size_t capacity =
+        (buffer_size + READER_ALIGNMENT - 1) / READER_ALIGNMENT * READER_ALIGNMENT;
+
+    reader->fd = fd;
+    reader->allocator = allocator;
+    reader->memory = false;
+    reader->file_size = fd_get_seekable_size(reader->fd);
+    reader->decompressor = NULL;
+    reader->stats = stats;
+
+    // Only an uncompressed archive can be mapped
+    unsigned char magic[COMPRESSION_MAGIC_SIZE];
+    reader->mapped =
+        map && reader->file_size != -1 &&
+        (pread(reader->fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+         compression_detect(magic, sizeof(magic)) == COMPRESSION_NONE);
+
+    if (reader->mapped)
+        reader->buffer = NULL;
+    else if (!(reader->buffer =
+                   allocator_allocate(allocator, READER_ALIGNMENT, capacity)))
+    {
+        close(reader->fd);
+        errno = ENOMEM;
+        return false;
+    }
+
+    reader->fd_offset = 0;
+    reader->advised = 0;
+    reader->capacity = capacity;
+    reader->begin = 0;
+    reader->end = 0;
+    reader->read_size = min_size(READER_INITIAL_READ_SIZE, capacity);
+    reader->eof = false;
+    reader->error = 0;
+
+    if (!reader->mapped && !reader_detect_compression(reader))
+    {
+        int error = errno;
+        reader_close(reader);
+        errno = error;
+        return false;
+    }
+
+    return true;
+}
+
+bool reader_open_memory(reader_t* reader,
+                        const void* data,
+                        size_t size,
+                        stats_t* stats)
+{
+    if (compression_detect(data, size) != COMPRESSION_NONE)
+    {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    reader->fd = -1;
+    reader->allocator = NULL;
+    reader->file_size = (off_t)size;
+    reader->decompressor = NULL;
+    reader->stats = stats;
+
+    // All of the archive is the window, it is never moved
+    reader->mapped = true;
+    reader->memory = true;
+    reader->buffer = (char*)data;
+    reader->fd_offset = (off_t)size;
+    reader->advised = size;
+    reader->capacity = size;
+    reader->begin = 0;
+    reader->end = size;
+    reader->read_size = size;
+    reader->eof = false;
+    reader->error = 0;
+
+    return true;
+}
+
+/** Returns the current time if 'reader' collects statistics. */
+static uint64_t reader_clock(const reader_t* reader)
+{
+    return reader->stats ? stats_now() : 0;
+}
+
+/** Adds the time since 'start' to the input time of 'reader'. */
+static void reader_add_input_time(reader_t* reader, uint64_t start)
+{
+    if (reader->stats)
+        reader->stats->input_time += stats_now() - start;
+}
+
+/** Unmaps the window of a mapped 'reader'. */
+static void reader_unmap(reader_t* reader)
+{
+    if (reader->memory)
+        return;
+
+    if (reader->buffer)
+        munmap(reader->buffer, reader->end);
+
+    reader->buffer = NULL;
+}
+
+void reader_close(reader_t* reader)
+{
+    if (reader->mapped)
+        reader_unmap(reader);
+    else
+        allocator_free(reader->allocator, reader->buffer, reader->capacity);
+
+    if (reader->decompressor)
+    {
+        decompressor_destroy(reader->decompressor);
+        free(reader->decompressor);
+    }
+
+    if (!reader->memory)
+        close(reader->fd);
+}
+
+/** Requests readahead of the mapping up to a distance of 'capacity'. */
+static void reader_advise(reader_t* reader)
+{
+    if (reader->begin + reader->capacity / 2 <= reader->advised ||
+        reader->advised == reader->end)
+        return;
+
+    size_t advised = reader->begin + reader->capacity < reader->end
+                         ? reader->begin + reader->capacity
+                         : reader->end;
+
+    // madvise needs a page aligned address
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t from =
+        (reader->advised > reader->begin ? reader->advised : reader->begin) /
+        page_size * page_size;
+
+    madvise(reader->buffer + from, advised - from, MADV_WILLNEED);
+    reader->advised = advised;
+}
+
+/** Maps the window of a mapped 'reader' starting at the current position. */
+static void reader_map(reader_t* reader)
+{
+    off_t position = reader_tell(reader);
+    off_t page_size = (off_t)sysconf(_SC_PAGESIZE);
+    off_t window_offset = position / page_size * page_size;
+
+    reader_unmap(reader);
+
+    reader->begin = 0;
+    reader->end = 0;
+    reader->advised = 0;
+    reader->fd_offset = window_offset;
+
+    if (window_offset >= reader->file_size)
+    {
+        reader->eof = true;
+        return;
+    }
+
+    size_t window_size =
+        (size_t)(reader->file_size - window_offset) < READER_MAP_WINDOW_SIZE
+            ? (size_t)(reader->file_size - window_offset)
+            : READER_MAP_WINDOW_SIZE;
+
+    uint64_t start = reader_clock(reader);
+
+    void* window = mmap(NULL,
+                        window_size,
+                        PROT_READ,
+                        MAP_PRIVATE,
+                        reader->fd,
+                        window_offset);
+
+    if (window == MAP_FAILED)
+    {
+        reader->eof = true;
+        reader->error = errno;
+        return;
+    }
+
+    madvise(window, window_size, MADV_SEQUENTIAL);
+
+    reader_add_input_time(reader, start);
+
+    reader->buffer = window;
+    reader->begin = (size_t)(position - window_offset);
+    reader->end = window_size;
+    reader->fd_offset = window_offset + (off_t)window_size;
+}
+
+/** Reads at most 'size' bytes of the archive into 'data'. */
+static ssize_t reader_read(reader_t* reader, char* data, size_t size)
+{
+    uint64_t start = reader_clock(reader);
+
+    ssize_t read_count =
+        reader->decompressor
+            ? decompressor_read(reader->decompressor, data, size)
+            : read(reader->fd, data, size);
+
+    if (reader->stats && read_count > 0)
+        reader->stats->bytes_read += (uint64_t)read_count;
+    reader_add_input_time(reader, start);
+
+    return read_count;
+}
+
+/** Moves the source of 'reader' to 'offset'. */
+static bool reader_seek_source(reader_t* reader, off_t offset)
+{
+    uint64_t start = reader_clock(reader);
+
+    bool success = reader->decompressor
+                       ? decompressor_seek(reader->decompressor, offset)
+                       : lseek(reader->fd, offset, SEEK_SET) != -1;
+
+    reader_add_input_time(reader, start);
+
+    return success;
+}
+
+/** Makes at least 'size' bytes available unless the archive ends. */
+static void reader_fill(reader_t* reader, size_t size)
+{
+    if (reader->memory)
+    {
+        reader->eof = reader->end - reader->begin < size;
+        return;
+    }
+
+    if (reader->mapped)
+    {
+        if (!reader->eof &&
+            (!reader->buffer || reader->end - reader->begin < size))
+        {
+            if (!reader->buffer || reader->fd_offset < reader->file_size)
+                reader_map(reader);
+            else
+                reader->eof = true;
+        }
+
+        if (reader->buffer)
+            reader_advise(reader);
+
+        return;
+    }
+
+    if (reader->end - reader->begin >= size || reader->eof)
+        return;
+
+    size_t available = reader->end - reader->begin;
+
+    if (available == 0 || reader->begin + size > reader->capacity)
+    {
+        memmove(reader->buffer, reader->buffer + reader->begin, available);
+        reader->begin = 0;
+        reader->end = available;
+    }
+
+    while (reader->end - reader->begin < size)
+    {
+        size_t request =
+            min_size(reader->read_size, reader->capacity - reader->end);
+        if (request < size - (reader->end - reader->begin))
+            request = reader->capacity - reader->end;
+
+        ssize_t read_count =
+            reader_read(reader, reader->buffer + reader->end, request);
+
+        if (read_count == -1 && errno == EINTR)
+            continue;
+
+        if (read_count <= 0)
+        {
+            reader->eof = true;
+            if (read_count == -1)
+                reader->error = errno;
+            return;
+        }
+
+        reader->end += (size_t)read_count;
+        reader->fd_offset += read_count;
+        reader->read_size = min_size(reader->read_size * 2, reader->capacity);
+    }
+}
+
+const char* reader_next(reader_t* reader, size_t max_size, size_t* size)
+{
+    reader_fill(reader, RECORD_SIZE);
+
+    size_t available = reader->end - reader->begin;
+
+    if (available >= RECORD_SIZE)
+        available -= available % RECORD_SIZE;
+
+    *size = min_size(available, max_size);
+
+    if (*size == 0)
+        return NULL;
+
+    const char* data = reader->buffer + reader->begin;
+    reader->begin += *size;
+
+    if (reader->mapped && reader->stats)
+        reader->stats->bytes_read += *size;
+
+    return data;
+}
+
+const char* reader_peek(reader_t* reader, size_t size, size_t* available)
+{
+    // A buffer holds its capacity at most
+    reader_fill(reader,
+                reader->mapped || reader->memory || size <= reader->capacity
+                    ? size
+                    : reader->capacity);
+
+    *available = reader->end - reader->begin;
+
+    return *available != 0 ? reader->buffer + reader->begin : NULL;
+}
+
+size_t reader_skip(reader_t* reader, size_t size)
+{
+    size_t skipped = min_size(size, reader->end - reader->begin);
+    reader->begin += skipped;
+
+    if (skipped == size || reader->memory)
+        return skipped;
+
+    if (reader->mapped)
+    {
+        off_t available = reader->file_size > reader_tell(reader)
+                              ? reader->file_size - reader_tell(reader)
+                              : 0;
+        size_t seek = (size_t)available < size - skipped ? (size_t)available
+                                                          : size - skipped;
+
+        // The window is moved lazily by the next read
+        reader_unmap(reader);
+        reader->fd_offset += (off_t)seek;
+        reader->begin = 0;
+        reader->end = 0;
+
+        return skipped + seek;
+    }
+
+    if (reader->file_size != -1 && !reader->eof)
+    {
+        off_t available = reader->file_size > reader->fd_offset
+                              ? reader->file_size - reader->fd_offset
+                              : 0;
+        size_t seek = (size_t)available < size - skipped ? (size_t)available
+                                                          : size - skipped;
+
+        if (reader_seek_source(reader, reader->fd_offset + (off_t)seek))
+        {
+            reader->fd_offset += (off_t)seek;
+            reader->begin = 0;
+            reader->end = 0;
+            reader->read_size =
+                min_size(READER_INITIAL_READ_SIZE, reader->capacity);
+
+            return skipped + seek;
+        }
+    }
+
+    while (skipped != size)
+    {
+        size_t chunk_size;
+        size_t request = min_size(size - skipped, reader->capacity);
+
+        if (request % RECORD_SIZE != 0)
+            request = request / RECORD_SIZE * RECORD_SIZE + RECORD_SIZE;
+
+        if (!reader_next(reader, request, &chunk_size))
+            break;
+
+        if (chunk_size > size - skipped)
+        {
+            reader->begin -= chunk_size - (size - skipped);
+            chunk_size = size - skipped;
+        }
+
+        skipped += chunk_size;
+    }
+
+    return skipped;
+}
+
+bool reader_seek(reader_t* reader, off_t offset)
+{
+    if (reader->file_size == -1)
+        return false;
+
+    if (reader->memory)
+    {
+        if (offset < 0 || offset > reader->file_size)
+            return false;
+
+        reader->begin = (size_t)offset;
+        reader->eof = false;
+        return true;
+    }
+
+    off_t buffer_offset = reader->fd_offset - (off_t)reader->end;
+
+    // Already in the buffer or the window
+    if (reader->buffer && offset >= buffer_offset &&
+        offset < reader->fd_offset)
+    {
+        reader->begin = (size_t)(offset - buffer_offset);
+        reader->eof = false;
+        return true;
+    }
+
+    if (reader->mapped)
+        reader_unmap(reader);
+    else if (!reader_seek_source(reader, offset))
+        return false;
+
+    reader->fd_offset = offset;
+    reader->begin = 0;
+    reader->end = 0;
+    reader->read_size = min_size(READER_INITIAL_READ_SIZE, reader->capacity);
+    reader->eof = false;
+
+    return true;
+}
+
+/** Copies up to 'size' bytes from the descriptor of a non-mapped 'reader' to
+ * 'fd' in the kernel.
+ * @return The number of bytes copied.
+ */
+static size_t reader_copy_kernel(reader_t* reader, int fd, size_t size)
+{
+    size_t copied = 0;
+
+    // A pipe on either side is spliced
+    bool file_copy = reader->file_size != -1;
+
+    while (copied != size)
+    {
+        ssize_t count =
+            file_copy
+                ? copy_file_range(reader->fd, NULL, fd, NULL, size - copied, 0)
+                : splice(reader->fd,
+                         NULL,
+                         fd,
+                         NULL,
+                         size - copied,
+                         SPLICE_F_MOVE | SPLICE_F_MORE);
+
+        if (count == -1 && errno == EINTR)
+            continue;
+
+        if (count == -1 && errno == EINVAL && file_copy)
+        {
+            file_copy = false;
+            continue;
+        }
+
+        // Unsupported or the end of the archive, both handled by the fallback
+        if (count <= 0)
+            break;
+
+        copied += (size_t)count;
+        reader->fd_offset += count;
+    }
+
+    return copied;
+}
+
+/** Writes 'size' bytes of 'data' to 'fd' as output of 'reader'. */
+static bool reader_write(reader_t* reader, int fd, const char* data, size_t size)
+{
+    uint64_t start = reader_clock(reader);
+
+    bool success = write_all(fd, data, size);
+
+    if (reader->stats)
+    {
+        reader->stats->bytes_written += size;
+        reader->stats->output_time += stats_now() - start;
+    }
+
+    return success;
+}
+
+bool reader_copy(reader_t* reader, int fd, size_t size, size_t* copied)
+{
+    *copied = min_size(size, reader->end - reader->begin);
+
+    if (*copied != 0 &&
+        !reader_write(reader, fd, reader->buffer + reader->begin, *copied))
+        return false;
+
+    reader->begin += *copied;
+
+    if (!reader->mapped && !reader->decompressor && !reader->eof)
+    {
+        uint64_t start = reader_clock(reader);
+
+        size_t kernel_copied = reader_copy_kernel(reader, fd, size - *copied);
+        *copied += kernel_copied;
+
+        if (reader->stats)
+        {
+            reader->stats->bytes_read += kernel_copied;
+            reader->stats->bytes_written += kernel_copied;
+            reader->stats->output_time += stats_now() - start;
+        }
+    }
+
+    while (*copied != size)
+    {
+        size_t chunk_size;
+        const char* chunk = reader_next(reader, size - *copied, &chunk_size);
+
+        if (!chunk)
+            break;
+
+        if (!reader_write(reader, fd, chunk, chunk_size))
+            return false;
+
+        *copied += chunk_size;
+    }
+
+    return true;
+}
+
+static bool reader_detect_compression(reader_t* reader)
+{
+    // The first bytes stay in the buffer for an uncompressed archive
+    reader_fill(reader, COMPRESSION_MAGIC_SIZE);
+
+    compression_t compression =
+        compression_detect((const unsigned char*)reader->buffer + reader->begin,
+                           reader->end - reader->begin);
+
+    if (compression == COMPRESSION_NONE)
+        return true;
+
+    if (!(reader->decompressor = malloc(sizeof(decompressor_t))))
+        return false;
+
+    bool regular_file = reader->file_size != -1;
+
+    if (regular_file && lseek(reader->fd, 0, SEEK_SET) == -1)
+        regular_file = false;
+
+    if (!decompressor_init(reader->decompressor,
+                           compression,
+                           reader->fd,
+                           regular_file ? NULL : reader->buffer + reader->begin,
+                           regular_file ? 0 : reader->end - reader->begin))
+    {
+        free(reader->decompressor);
+        reader->decompressor = NULL;
+        return false;
+    }
+
+    reader->file_size = decompressor_get_seekable_size(reader->decompressor);
+    reader->fd_offset = 0;
+    reader->begin = 0;
+    reader->end = 0;
+    reader->eof = false;
+    reader->error = 0;
+
+    return true;
+}
+
+off_t reader_tell(const reader_t* reader)
+{
+    return reader->fd_offset - (off_t)(reader->end - reader->begin);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "allocator.h"
+
+/** Size of one record in a tarball. */
+#define RECORD_SIZE ((size_t)512)
+
+/** Default size of the reader buffer in bytes. */
+#define READER_DEFAULT_BUFFER_SIZE ((size_t)1 << 20)
+
+/** Size of the mapped window of a mapped archive. */
+#define READER_MAP_WINDOW_SIZE \
+    (sizeof(size_t) > 4 ? (size_t)1 << 30 : (size_t)64 << 20)
+
+/** Block reader of a tarball.
+ * Reads the archive in large chunks into an aligned buffer and hands out
+ * pointers to whole records inside of it.
+ * A mapped reader instead maps a window of the archive and hands out pointers
+ * into the mapping. The window is moved when the reader leaves it.
+ * An archive in memory is handed out in place like a mapping of all of it.
+ * A compressed archive is decompressed into the buffer, offsets are in the
+ * decompressed archive then.
+ */
+typedef struct reader
+{
+    int fd;
+
+    // Size of the archive if it can be seeked over, -1 otherwise
+    off_t file_size;
+
+    // Position of 'fd' in the archive
+    off_t fd_offset;
+
+    // The buffer or the window of the mapping
+    char* buffer;
+
+    // Allocator of the buffer or NULL
+    const allocator_t* allocator;
+
+    // Size of the buffer or the readahead distance of the mapping
+    size_t capacity;
+
+    bool mapped;
+
+    // The archive is in memory, 'buffer' is all of it and 'fd' is -1
+    bool memory;
+
+    // Offset in the window until which readahead was requested
+    size_t advised;
+
+    // Unconsumed bytes are in [begin, end)
+    size_t begin;
+    size_t end;
+
+    // Number of bytes requested by the next read, grows up to 'capacity'
+    size_t read_size;
+
+    bool eof;
+
+    // errno of a failed read or 0
+    int error;
+
+    // Stage decompressing a compressed archive or NULL
+    struct decompressor* decompressor;
+
+    // Statistics to collect or NULL
+    struct stats* stats;
+} reader_t;
+
+/** Opens the archive at 'path' for reading with a buffer of 'buffer_size'
+ * bytes, which has to be a non-zero multiple of RECORD_SIZE.
+ * If 'map' is true and the archive is an uncompressed regular file, it is
+ * memory mapped instead and 'buffer_size' is the readahead distance.
+ * The compression of the archive is detected from its first bytes.
+ * Collects statistics into 'stats' unless it is NULL.
+ * @return false on failure, errno is set, ENOTSUP for a compression which is
+ * not supported by this build.
+ */
+bool reader_open(reader_t* reader,
+                 const char* path,
+                 size_t buffer_size,
+                 bool map,
+                 struct stats* stats);
+
+/** Opens the archive 'fd' at its start like reader_open, the reader closes it
+ * even on failure. Allocates the buffer by 'allocator' unless it is NULL.
+ */
+bool reader_open_fd(reader_t* reader,
+                    int fd,
+                    size_t buffer_size,
+                    bool map,
+                    const allocator_t* allocator,
+                    struct stats* stats);
+
+/** Opens the uncompressed archive of 'size' bytes at 'data' in memory like
+ * reader_open. 'data' is not copied and has to stay valid until the reader is
+ * closed.
+ * @return false with errno ENOTSUP for a compressed archive.
+ */
+bool reader_open_memory(reader_t* reader,
+                        const void* data,
+                        size_t size,
+                        struct stats* stats);
+
+/** Closes the archive and frees the buffer. */
+void reader_close(reader_t* reader);
+
+/** Returns a pointer to at most 'max_size' consecutive bytes of the archive
+ * and consumes them.
+ * Writes the number of bytes to '*size'. This is 'max_size' or a multiple of
+ * RECORD_SIZE unless the archive ends. Returns NULL with '*size' 0 at the end
+ * of the archive.
+ * The pointer is valid until the next call on 'reader'.
+ */
+const char* reader_next(reader_t* reader, size_t max_size, size_t* size);
+
+/** Returns a pointer to the next bytes of the archive without consuming
+ * them. Writes their number to '*available', which is at least 'size' unless
+ * the archive ends or 'size' exceeds the buffer of a reader which is not
+ * mapped.
+ * The pointer is valid until the next call on 'reader'.
+ */
+const char* reader_peek(reader_t* reader, size_t size, size_t* available);
+
+/** Skips 'size' bytes of the archive, seeking over them if possible.
+ * @return The number of bytes skipped, less than 'size' only at the end of the
+ * archive.
+ */
+size_t reader_skip(reader_t* reader, size_t size);
+
+/** Moves to 'offset' of a seekable archive.
+ * @return false if the archive is not seekable or seeking failed.
+ */
+bool reader_seek(reader_t* reader, off_t offset);
+
+/** Copies 'size' bytes of the archive to 'fd' and consumes them.
+ * The copy counts as output in the statistics.
+ * Uses copy_file_range for regular files and splice for pipes if possible and
+ * falls back to writing from the buffer. Writes the number of bytes copied to
+ * '*copied', less than 'size' only at the end of the archive.
+ * @return false if writing failed, errno is set.
+ */
+bool reader_copy(reader_t* reader, int fd, size_t size, size_t* copied);
+
+/** Returns the offset of the next unconsumed byte in the archive. */
+off_t reader_tell(const reader_t* reader);
@@ -0,0 +1,656 @@
+#include "scanner.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extended.h"
+#include "reader.h"
+#include "stats.h"
+
+/** Number of bytes read at once by a walk. */
+#define SCANNER_WINDOW_SIZE ((size_t)64 << 10)
+
+/** Bytes of the archive last read by a walk. */
+typedef struct scan_window
+{
+    char* data;
+    uint64_t offset;
+    size_t size;
+} scan_window_t;
+
+/** Returns the record at 'offset' of the archive of 'scanner', which has to be
+ * before its end, reading it into 'window' if needed.
+ * Writes the number of bytes available to '*size', less than RECORD_SIZE only
+ * at the end of the archive.
+ * @return NULL on failure, errno is set.
+ */
+static const char* scan_window_get(const scanner_t* scanner,
+                                   scan_region_t* region,
+                                   scan_window_t* window,
+                                   uint64_t offset,
+                                   size_t* size)
+{
+    if (offset < window->offset || offset - window->offset >= window->size ||
+        window->size - (offset - window->offset) < RECORD_SIZE)
+    {
+        uint64_t start = scanner->collect_stats ? stats_now() : 0;
+        size_t wanted = scanner->size - offset < SCANNER_WINDOW_SIZE
+                            ? (size_t)(scanner->size - offset)
+                            : SCANNER_WINDOW_SIZE;
+
+        window->offset = offset;
+        window->size = 0;
+
+        while (window->size != wanted)
+        {
+            ssize_t read_size = pread(scanner->fd,
+                                      window->data + window->size,
+                                      wanted - window->size,
+                                      (off_t)(offset + window->size));
+
+            if (read_size == -1 && errno == EINTR)
+                continue;
+
+            if (read_size == -1)
+                return NULL;
+
+            // The archive shrank
+            if (read_size == 0)
+                break;
+
+            window->size += (size_t)read_size;
+        }
+
+        region->bytes_read += window->size;
+        if (scanner->collect_stats)
+            region->input_time += stats_now() - start;
+    }
+
+    size_t available = window->size - (size_t)(offset - window->offset);
+    *size = available < RECORD_SIZE ? available : RECORD_SIZE;
+
+    return window->data + (offset - window->offset);
+}
+
+/** Reads 'size' bytes at 'offset' of the archive of 'scanner' into 'data'
+ * for 'region'.
+ * @return The number of bytes read, less than 'size' only at the end of the
+ * archive, or -1 on failure, errno is set.
+ */
+static ssize_t scan_read(const scanner_t* scanner,
+                         scan_region_t* region,
+                         char* data,
+                         uint64_t offset,
+                         size_t size)
+{
+    uint64_t start = scanner->collect_stats ? stats_now() : 0;
+    size_t done = 0;
+
+    while (done != size)
+    {
+        ssize_t read_size =
+            pread(scanner->fd, data + done, size - done, (off_t)(offset + done));
+
+        if (read_size == -1 && errno == EINTR)
+            continue;
+
+        if (read_size == -1)
+            return -1;
+
+        if (read_size == 0)
+            break;
+
+        done += (size_t)read_size;
+    }
+
+    region->bytes_read += done;
+    if (scanner->collect_stats)
+        region->input_time += stats_now() - start;
+
+    return (ssize_t)done;
+}
+
+/** Appends an event of 'kind' at 'offset' to 'region'.
+ * @return The event or NULL if out of memory.
+ */
+static scan_event_t* scan_region_add(scan_region_t* region,
+                                     scan_event_kind_t kind,
+                                     uint64_t offset)
+{
+    if (region->event_count == region->event_capacity)
+    {
+        size_t capacity = region->event_capacity ? 2 * region->event_capacity : 64;
+        scan_event_t* events =
+            realloc(region->events, sizeof(scan_event_t) * capacity);
+        if (!events)
+        {
+            region->failed = true;
+            return NULL;
+        }
+
+        region->events = events;
+        region->event_capacity = capacity;
+    }
+
+    scan_event_t* event = region->events + region->event_count++;
+
+    event->kind = kind;
+    event->offset = offset;
+    event->size = 0;
+    event->mtime = 0;
+    event->name_offset = 0;
+    event->name_length = 0;
+    event->time = 0;
+
+    return event;
+}
+
+/** Appends a member event of 'entry' at 'offset' to 'region', whose headers
+ * took 'time'.
+ * @return false if out of memory.
+ */
+static bool scan_region_add_member(scan_region_t* region,
+                                   const entry_t* entry,
+                                   uint64_t offset,
+                                   uint64_t time)
+{
+    size_t name_length = entry->name_length;
+
+    if (region->names_capacity - region->names_size < name_length)
+    {
+        size_t capacity = region->names_capacity ? region->names_capacity : 4096;
+        while (capacity - region->names_size < name_length)
+            capacity *= 2;
+
+        char* names = realloc(region->names, capacity);
+        if (!names)
+        {
+            region->failed = true;
+            return false;
+        }
+
+        region->names = names;
+        region->names_capacity = capacity;
+    }
+
+    scan_event_t* event = scan_region_add(region, SCAN_MEMBER, offset);
+    if (!event)
+        return false;
+
+    event->size = entry->size;
+    event->mtime = entry->mtime;
+    event->name_offset = region->names_size;
+    event->name_length = name_length;
+    event->time = time;
+
+    memcpy(region->names + region->names_size, entry->name, name_length);
+    region->names_size += name_length;
+
+    return true;
+}
+
+/** Reads the data of the extended header 'header' at 'offset' of the archive
+ * of 'scanner' into 'extended'.
+ * Appends an event to 'region' if reading it fails.
+ * @return false on failure.
+ */
+static bool scan_region_read_extended(const scanner_t* scanner,
+                                      scan_region_t* region,
+                                      extended_t* extended,
+                                      const header_t* header,
+                                      uint64_t offset)
+{
+    size_t size = header_get_size(header);
+
+    if (size > EXTENDED_MAX_SIZE)
+    {
+        scan_region_add(region, SCAN_MALFORMED, offset);
+        return false;
+    }
+
+    char* data = extended_begin(extended, header->typeflag, size);
+    if (!data)
+    {
+        region->failed = true;
+        return false;
+    }
+
+    ssize_t read_size =
+        scan_read(scanner, region, data, offset + RECORD_SIZE, size);
+
+    if (read_size == -1)
+    {
+        region->error = errno;
+        scan_region_add(region, SCAN_ERROR, offset);
+        return false;
+    }
+    else if ((size_t)read_size != size)
+    {
+        scan_region_add(region, SCAN_TRUNCATED, offset + RECORD_SIZE);
+        return false;
+    }
+
+    if (!extended_parse(extended, header->typeflag, data, size))
+    {
+        scan_region_add(region, SCAN_MALFORMED, offset);
+        return false;
+    }
+
+    return true;
+}
+
+/** Makes '*entry' of the member 'header' at '*offset' of the archive of
+ * 'scanner' with the attributes of 'extended'. Reads the extension records of
+ * an old GNU sparse file and moves '*offset' past them, which invalidates
+ * the header, so it is copied to '*copy' first.
+ * Appends an event to 'region' if making the entry fails.
+ * @return false on failure.
+ */
+static bool scan_region_make_entry(const scanner_t* scanner,
+                                   scan_region_t* region,
+                                   scan_window_t* window,
+                                   extended_t* extended,
+                                   const header_t* header,
+                                   header_t* copy,
+                                   uint64_t* offset,
+                                   entry_t* entry)
+{
+    if (header->typeflag == GNUTYPE_SPARSE)
+    {
+        *copy = *header;
+        header = copy;
+    }
+
+    if (!extended_make_entry(extended, header, entry))
+    {
+        if (errno == ENOMEM)
+            region->failed = true;
+        else
+            scan_region_add(region, SCAN_MALFORMED, *offset);
+
+        return false;
+    }
+
+    while (entry->sparse_extended)
+    {
+        uint64_t record_offset = *offset + RECORD_SIZE;
+
+        if (record_offset == scanner->size)
+        {
+            scan_region_add(region, SCAN_TRUNCATED, record_offset);
+            return false;
+        }
+
+        size_t size;
+        const char* record =
+            scan_window_get(scanner, region, window, record_offset, &size);
+
+        if (!record)
+        {
+            region->error = errno;
+            scan_region_add(region, SCAN_ERROR, record_offset);
+            return false;
+        }
+        else if (size != RECORD_SIZE)
+        {
+            scan_region_add(region, SCAN_PARTIAL, record_offset);
+            return false;
+        }
+
+        if (!extended_add_sparse_record(extended, entry, record))
+        {
+            if (errno == ENOMEM)
+                region->failed = true;
+            else
+                scan_region_add(region, SCAN_MALFORMED, *offset);
+
+            return false;
+        }
+
+        *offset = record_offset;
+    }
+
+    return true;
+}
+
+/** Walks the header chain of 'region' from its start. */
+static void scan_region_walk(const scanner_t* scanner, scan_region_t* region)
+{
+    scan_window_t window;
+    extended_t extended;
+
+    window.data = malloc(SCANNER_WINDOW_SIZE);
+    window.offset = 0;
+    window.size = 0;
+
+    if (!window.data)
+    {
+        region->failed = true;
+        return;
+    }
+
+    extended_init(&extended);
+
+    uint64_t offset = region->start;
+    uint64_t entry_offset = offset;
+    uint64_t entry_start = 0;
+    size_t null_count = 0;
+
+    while (true)
+    {
+        if (offset == scanner->size)
+        {
+            scan_region_add(region, SCAN_EOF, offset);
+            break;
+        }
+        else if (offset >= region->end && !extended.pending)
+        {
+            scan_region_add(region, SCAN_EXIT, offset);
+            break;
+        }
+
+        if (scanner->collect_stats && !extended.pending)
+            entry_start = stats_now();
+
+        size_t size;
+        const header_t* header = (const header_t*)scan_window_get(
+            scanner, region, &window, offset, &size);
+
+        if (!header)
+        {
+            region->error = errno;
+            scan_region_add(region, SCAN_ERROR, offset);
+            break;
+        }
+        else if (size != RECORD_SIZE)
+        {
+            scan_region_add(region, SCAN_PARTIAL, offset);
+            break;
+        }
+
+        header_status_t status = header_check(header);
+
+        if (!extended.pending)
+            entry_offset = offset;
+
+        // Two null blocks end the archive, consecutive or not
+        if (status == HEADER_NULL)
+        {
+            extended_reset(&extended);
+
+            if (!scan_region_add(region, SCAN_NULL, offset) || ++null_count == 2)
+                break;
+
+            offset += RECORD_SIZE;
+            continue;
+        }
+
+        if (status != HEADER_VALID)
+        {
+            region->invalid_header = *header;
+            scan_region_add(region, SCAN_INVALID, offset);
+            break;
+        }
+
+        uint64_t member_size = header_get_size(header);
+
+        if (header_is_extended(header))
+        {
+            if (!scan_region_read_extended(
+                    scanner, region, &extended, header, offset))
+                break;
+        }
+        else
+        {
+            entry_t entry;
+            header_t copy;
+
+            if (!scan_region_make_entry(scanner,
+                                        region,
+                                        &window,
+                                        &extended,
+                                        header,
+                                        &copy,
+                                        &offset,
+                                        &entry))
+                break;
+
+            member_size = entry.size;
+
+            uint64_t time = scanner->collect_stats ? stats_now() - entry_start : 0;
+
+            if (!scan_region_add_member(region, &entry, entry_offset, time))
+                break;
+
+            extended_reset(&extended);
+        }
+
+        uint64_t data_size =
+            (member_size + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+
+        offset += RECORD_SIZE;
+
+        if (data_size > scanner->size - offset)
+        {
+            scan_region_add(region, SCAN_TRUNCATED, offset);
+            break;
+        }
+
+        offset += data_size;
+    }
+
+    extended_destroy(&extended);
+    free(window.data);
+}
+
+/** Checks if 'header' at 'offset' could start a header chain of an archive
+ * of 'size' bytes. Its checksum makes data looking like a header unlikely.
+ */
+static bool scanner_is_candidate(const header_t* header,
+                                 uint64_t offset,
+                                 uint64_t size)
+{
+    if (header_check(header) != HEADER_VALID)
+        return false;
+
+    uint64_t data_size = (header_get_size(header) + RECORD_SIZE - 1) /
+                         RECORD_SIZE * RECORD_SIZE;
+
+    return data_size <= size - offset - RECORD_SIZE;
+}
+
+/** Finds the first header of 'region' by probing the records at its start.
+ * A region which starts inside of a large member is left to the walk of the
+ * previous one.
+ */
+static void scanner_probe(const scanner_t* scanner, scan_region_t* region)
+{
+    scan_window_t window;
+
+    window.data = malloc(SCANNER_WINDOW_SIZE);
+    window.offset = 0;
+    window.size = 0;
+
+    region->start = region->end;
+
+    if (!window.data)
+        return;
+
+    uint64_t end = region->end - region->begin > SCANNER_MAX_PROBE_SIZE
+                       ? region->begin + SCANNER_MAX_PROBE_SIZE
+                       : region->end;
+
+    for (uint64_t offset = region->begin; offset < end; offset += RECORD_SIZE)
+    {
+        size_t size;
+        const header_t* header = (const header_t*)scan_window_get(
+            scanner, region, &window, offset, &size);
+
+        if (!header || size != RECORD_SIZE)
+            break;
+
+        if (scanner_is_candidate(header, offset, scanner->size))
+        {
+            region->start = offset;
+            break;
+        }
+    }
+
+    free(window.data);
+}
+
+/** Initializes empty 'region' as [begin, end). */
+static void scan_region_init(scan_region_t* region, uint64_t begin, uint64_t end)
+{
+    region->begin = begin;
+    region->end = end;
+    region->start = begin;
+    region->events = NULL;
+    region->event_count = 0;
+    region->event_capacity = 0;
+    region->names = NULL;
+    region->names_size = 0;
+    region->names_capacity = 0;
+    region->error = 0;
+    region->failed = false;
+    region->bytes_read = 0;
+    region->input_time = 0;
+}
+
+void scan_region_destroy(scan_region_t* region)
+{
+    free(region->events);
+    free(region->names);
+}
+
+void scanner_walk(const scanner_t* scanner,
+                  scan_region_t* region,
+                  uint64_t begin,
+                  uint64_t end,
+                  uint64_t start)
+{
+    scan_region_init(region, begin, end);
+    region->start = start;
+
+    scan_region_walk(scanner, region);
+}
+
+/** Main function of a scanning thread. */
+static void* scanner_run_thread(void* scanner_void)
+{
+    scanner_t* scanner = scanner_void;
+
+    while (true)
+    {
+        pthread_mutex_lock(&scanner->mutex);
+        size_t index = scanner->next_region++;
+        pthread_mutex_unlock(&scanner->mutex);
+
+        if (index >= scanner->region_count)
+            break;
+
+        scan_region_t* region = scanner->regions + index;
+
+        // The start of a region is unknown when there is no index
+        if (region->start == UINT64_MAX)
+            scanner_probe(scanner, region);
+
+        scan_region_walk(scanner, region);
+    }
+
+    return NULL;
+}
+
+bool scanner_run(scanner_t* scanner,
+                 int fd,
+                 uint64_t size,
+                 const uint64_t* header_offsets,
+                 size_t header_offset_count,
+                 size_t thread_count,
+                 bool collect_stats)
+{
+    uint64_t region_count =
+        (size + SCANNER_MIN_REGION_SIZE - 1) / SCANNER_MIN_REGION_SIZE;
+    if (region_count > thread_count * SCANNER_REGIONS_PER_THREAD)
+        region_count = thread_count * SCANNER_REGIONS_PER_THREAD;
+    if (region_count == 0)
+        region_count = 1;
+
+    scanner->fd = fd;
+    scanner->size = size;
+    scanner->region_count = (size_t)region_count;
+    scanner->next_region = 0;
+    scanner->collect_stats = collect_stats;
+
+    scanner->regions = malloc(sizeof(scan_region_t) * scanner->region_count);
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+
+    if (!scanner->regions || !threads)
+    {
+        free(scanner->regions);
+        free(threads);
+        return false;
+    }
+
+    // Regions of whole records
+    uint64_t record_count = size / RECORD_SIZE;
+    const uint64_t* header_offset = header_offsets;
+
+    for (size_t i = 0; i != scanner->region_count; ++i)
+    {
+        uint64_t begin = record_count * i / region_count * RECORD_SIZE;
+        uint64_t end = i + 1 == scanner->region_count
+                           ? size
+                           : record_count * (i + 1) / region_count * RECORD_SIZE;
+
+        scan_region_t* region = scanner->regions + i;
+        scan_region_init(region, begin, end);
+
+        if (i == 0)
+            region->start = 0;
+        else if (!header_offsets)
+            region->start = UINT64_MAX;
+        else
+        {
+            while (header_offset != header_offsets + header_offset_count &&
+                   *header_offset < begin)
+                ++header_offset;
+
+            region->start =
+                header_offset != header_offsets + header_offset_count &&
+                        *header_offset < end
+                    ? *header_offset
+                    : end;
+        }
+    }
+
+    pthread_mutex_init(&scanner->mutex, NULL);
+
+    size_t started = 0;
+    for (; started != thread_count; ++started)
+        if (pthread_create(threads + started, NULL, scanner_run_thread, scanner) !=
+            0)
+            break;
+
+    // Without threads, the regions are walked here
+    if (started == 0)
+        scanner_run_thread(scanner);
+
+    for (size_t i = 0; i != started; ++i)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&scanner->mutex);
+    free(threads);
+
+    return true;
+}
+
+void scanner_destroy(scanner_t* scanner)
+{
+    for (size_t i = 0; i != scanner->region_count; ++i)
+        scan_region_destroy(scanner->regions + i);
+
+    free(scanner->regions);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "header.h"
+
+/** Minimum size of a region of a scanned archive. */
+#define SCANNER_MIN_REGION_SIZE ((uint64_t)4 << 20)
+
+/** Maximum number of bytes probed for the first header of a region. */
+#define SCANNER_MAX_PROBE_SIZE ((uint64_t)1 << 20)
+
+/** Number of regions per scanning thread. */
+#define SCANNER_REGIONS_PER_THREAD ((size_t)4)
+
+/** Kinds of records met on a walk of the header chain. */
+typedef enum scan_event_kind
+{
+    // A valid header of a member which fits into the archive
+    SCAN_MEMBER,
+
+    SCAN_NULL,
+
+    // The walk ends with the event
+    SCAN_EOF,
+    SCAN_PARTIAL,
+    SCAN_TRUNCATED,
+    SCAN_INVALID,
+    SCAN_MALFORMED,
+    SCAN_ERROR,
+
+    // The next member lies at or after the end of the region
+    SCAN_EXIT
+} scan_event_kind_t;
+
+/** Record met on a walk, at 'offset' of the archive.
+ * The offset of a member is that of its first extended header.
+ */
+typedef struct scan_event
+{
+    scan_event_kind_t kind;
+    uint64_t offset;
+
+    // Fields of a member
+    uint64_t size;
+    uint64_t mtime;
+    size_t name_offset;
+    size_t name_length;
+
+    // Time the walk spent on the headers of a member if it collects statistics
+    uint64_t time;
+} scan_event_t;
+
+/** Part of the archive walked by one thread. */
+typedef struct scan_region
+{
+    // The region is [begin, end), the walk starts at the first header at or
+    // after 'begin' or at 'end' if none was found
+    uint64_t begin;
+    uint64_t end;
+    uint64_t start;
+
+    scan_event_t* events;
+    size_t event_count;
+    size_t event_capacity;
+
+    char* names;
+    size_t names_size;
+    size_t names_capacity;
+
+    // Header of a SCAN_INVALID event, errno of a SCAN_ERROR event
+    header_t invalid_header;
+    int error;
+
+    // An allocation failed, the events are incomplete
+    bool failed;
+
+    uint64_t bytes_read;
+    uint64_t input_time;
+} scan_region_t;
+
+/** Parallel walker of the header chain of an uncompressed seekable archive.
+ * The archive is cut into regions. Each region is walked from its first
+ * header, which is taken from the index or found by probing the records at
+ * its start for the magic value and a valid checksum. A walk reads headers
+ * only and leaves its region at the first header past its end. A walk which
+ * does not start where the previous one left is not on the header chain and
+ * has to be redone.
+ */
+typedef struct scanner
+{
+    int fd;
+    uint64_t size;
+
+    scan_region_t* regions;
+    size_t region_count;
+
+    pthread_mutex_t mutex;
+    size_t next_region;
+
+    bool collect_stats;
+} scanner_t;
+
+/** Walks the archive at 'fd' of 'size' bytes with 'thread_count' threads.
+ * The 'header_offset_count' sorted 'header_offsets' of an index are the
+ * region starts unless they are NULL.
+ * The walks collect input statistics if 'collect_stats' is true.
+ * @return false on failure.
+ */
+bool scanner_run(scanner_t* scanner,
+                 int fd,
+                 uint64_t size,
+                 const uint64_t* header_offsets,
+                 size_t header_offset_count,
+                 size_t thread_count,
+                 bool collect_stats);
+
+/** Frees the memory of 'scanner'. */
+void scanner_destroy(scanner_t* scanner);
+
+/** Initializes 'region' of 'scanner' as [begin, end) starting at 'start'
+ * and walks it.
+ */
+void scanner_walk(const scanner_t* scanner,
+                  scan_region_t* region,
+                  uint64_t begin,
+                  uint64_t end,
+                  uint64_t start);
+
+/** Frees the memory of 'region'. */
+void scan_region_destroy(scan_region_t* region);
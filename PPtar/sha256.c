@@ -0,0 +1,259 @@
+#include "sha256.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+
+/** Round constants. */
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+    0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+    0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+    0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+    0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+    0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+/** Rotates 'x' right by 'count' bits. */
+static uint32_t rotate_right(uint32_t x, unsigned count)
+{
+    return x >> count | x << (32 - count);
+}
+
+/** Loads a big-endian word from 'bytes'. */
+static uint32_t load_big_endian(const unsigned char* bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+/** Hashes 'count' blocks of 'data' into 'state' one word at a time. */
+static void sha256_blocks_scalar(uint32_t* state,
+                                 const unsigned char* data,
+                                 size_t count)
+{
+    for (; count != 0; --count, data += SHA256_BLOCK_SIZE)
+    {
+        uint32_t w[64];
+
+        for (size_t i = 0; i != 16; ++i)
+            w[i] = load_big_endian(data + 4 * i);
+
+        for (size_t i = 16; i != 64; ++i)
+        {
+            uint32_t s0 = rotate_right(w[i - 15], 7) ^
+                          rotate_right(w[i - 15], 18) ^ w[i - 15] >> 3;
+            uint32_t s1 = rotate_right(w[i - 2], 17) ^
+                          rotate_right(w[i - 2], 19) ^ w[i - 2] >> 10;
+
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (size_t i = 0; i != 64; ++i)
+        {
+            uint32_t s1 =
+                rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choice + sha256_k[i] + w[i];
+            uint32_t s0 =
+                rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/** Hashes 'count' blocks of 'data' into 'state' with the SHA extensions, four
+ * rounds at a time.
+ */
+__attribute__((target("sha,sse4.1"))) static void
+sha256_blocks_shani(uint32_t* state, const unsigned char* data, size_t count)
+{
+    // Swaps the bytes of each word
+    const __m128i byte_swap =
+        _mm_set_epi64x(0x0C0D0E0F08090A0BLL, 0x0405060700010203LL);
+
+    // The instructions take the state as ABEF and CDGH
+    __m128i dcba =
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xB1);
+    __m128i cdgh =
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 0x1B);
+    __m128i abef = _mm_alignr_epi8(dcba, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, dcba, 0xF0);
+
+    for (; count != 0; --count, data += SHA256_BLOCK_SIZE)
+    {
+        __m128i abef_start = abef;
+        __m128i cdgh_start = cdgh;
+
+        // The last four groups of four words of the schedule
+        __m128i w[4];
+
+        for (size_t i = 0; i != 16; ++i)
+        {
+            if (i < 4)
+                w[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)(data + 16 * i)), byte_swap);
+            else
+            {
+                // Each group from the four before it
+                __m128i sum = _mm_add_epi32(
+                    _mm_sha256msg1_epu32(w[i % 4], w[(i + 1) % 4]),
+                    _mm_alignr_epi8(w[(i + 3) % 4], w[(i + 2) % 4], 4));
+
+                w[i % 4] = _mm_sha256msg2_epu32(sum, w[(i + 3) % 4]);
+            }
+
+            __m128i message = _mm_add_epi32(
+                w[i % 4], _mm_loadu_si128((const __m128i*)(sha256_k + 4 * i)));
+
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+            abef = _mm_sha256rnds2_epu32(
+                abef, cdgh, _mm_shuffle_epi32(message, 0x0E));
+        }
+
+        abef = _mm_add_epi32(abef, abef_start);
+        cdgh = _mm_add_epi32(cdgh, cdgh_start);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+
+    _mm_storeu_si128((__m128i*)state, _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i*)(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+typedef void (*sha256_blocks_t)(uint32_t* state,
+                                const unsigned char* data,
+                                size_t count);
+
+/** Selects the fastest way to hash blocks on this processor. */
+static sha256_blocks_t sha256_select_blocks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+        return sha256_blocks_shani;
+#endif
+    return sha256_blocks_scalar;
+}
+
+/** Hashes 'count' blocks of 'data' into 'state'. */
+static void sha256_blocks(uint32_t* state, const unsigned char* data, size_t count)
+{
+    static sha256_blocks_t blocks = NULL;
+
+    sha256_blocks_t selected = __atomic_load_n(&blocks, __ATOMIC_RELAXED);
+    if (!selected)
+    {
+        selected = sha256_select_blocks();
+        __atomic_store_n(&blocks, selected, __ATOMIC_RELAXED);
+    }
+
+    selected(state, data, count);
+}
+
+void sha256_init(sha256_t* hash)
+{
+    static const uint32_t initial[8] = {0x6A09E667,
+                                        0xBB67AE85,
+                                        0x3C6EF372,
+                                        0xA54FF53A,
+                                        0x510E527F,
+                                        0x9B05688C,
+                                        0x1F83D9AB,
+                                        0x5BE0CD19};
+
+    memcpy(hash->state, initial, sizeof(initial));
+    hash->length = 0;
+}
+
+void sha256_update(sha256_t* hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    size_t fill = (size_t)(hash->length % SHA256_BLOCK_SIZE);
+
+    hash->length += size;
+
+    if (fill != 0)
+    {
+        size_t chunk = SHA256_BLOCK_SIZE - fill < size ? SHA256_BLOCK_SIZE - fill
+                                                        : size;
+
+        memcpy(hash->block + fill, bytes, chunk);
+        bytes += chunk;
+        size -= chunk;
+
+        if (fill + chunk != SHA256_BLOCK_SIZE)
+            return;
+
+        sha256_blocks(hash->state, hash->block, 1);
+    }
+
+    sha256_blocks(hash->state, bytes, size / SHA256_BLOCK_SIZE);
+
+    memcpy(hash->block, bytes + size / SHA256_BLOCK_SIZE * SHA256_BLOCK_SIZE,
+           size % SHA256_BLOCK_SIZE);
+}
+
+void sha256_final(sha256_t* hash, unsigned char* digest)
+{
+    uint64_t bit_length = hash->length * 8;
+    size_t fill = (size_t)(hash->length % SHA256_BLOCK_SIZE);
+
+    // A one bit, zeros and the length in bits fill one or two blocks
+    unsigned char padding[2 * SHA256_BLOCK_SIZE] = {0x80};
+    size_t padding_size = (fill < SHA256_BLOCK_SIZE - 8 ? SHA256_BLOCK_SIZE
+                                                        : 2 * SHA256_BLOCK_SIZE) -
+                          fill;
+
+    for (size_t i = 0; i != 8; ++i)
+        padding[padding_size - 1 - i] = (unsigned char)(bit_length >> (8 * i));
+
+    sha256_update(hash, padding, padding_size);
+
+    for (size_t i = 0; i != 8; ++i)
+    {
+        digest[4 * i] = (unsigned char)(hash->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char)(hash->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(hash->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char)hash->state[i];
+    }
+}
+
+void sha256(const void* data, size_t size, unsigned char* digest)
+{
+    sha256_t hash;
+
+    sha256_init(&hash);
+    sha256_update(&hash, data, size);
+    sha256_final(&hash, digest);
+}
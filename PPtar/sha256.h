@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of a SHA-256 digest. */
+#define SHA256_DIGEST_SIZE ((size_t)32)
+
+/** Size of a block of SHA-256. */
+#define SHA256_BLOCK_SIZE ((size_t)64)
+
+/** SHA-256 hash of data given piece by piece.
+ * Whole blocks are hashed straight from the data, with the SHA extensions of
+ * the processor if it has them.
+ */
+typedef struct sha256
+{
+    uint32_t state[8];
+
+    // Number of bytes hashed
+    uint64_t length;
+
+    // Start of a block which is not whole yet
+    unsigned char block[SHA256_BLOCK_SIZE];
+} sha256_t;
+
+/** Initializes 'hash' of no data. */
+void sha256_init(sha256_t* hash);
+
+/** Appends 'size' bytes of 'data' to the data of 'hash'. */
+void sha256_update(sha256_t* hash, const void* data, size_t size);
+
+/** Writes the digest of 'hash' to 'digest'. 'hash' has to be initialized
+ * again before it is reused.
+ */
+void sha256_final(sha256_t* hash, unsigned char* digest);
+
+/** Writes the digest of 'size' bytes of 'data' to 'digest'. */
+void sha256(const void* data, size_t size, unsigned char* digest);
@@ -0,0 +1,181 @@
+#include "sparse.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "header.h"
+#include "reader.h"
+
+/** Maximum number of segments of a map. */
+#define SPARSE_MAX_COUNT ((uint64_t)1 << 32)
+
+void sparse_map_init(sparse_map_t* map)
+{
+    map->segments = NULL;
+    map->count = 0;
+    map->capacity = 0;
+}
+
+bool sparse_map_add(sparse_map_t* map,
+                    arena_t* arena,
+                    uint64_t offset,
+                    uint64_t size)
+{
+    // The old segments stay in the arena until it is reset
+    if (map->count == map->capacity)
+    {
+        size_t capacity = map->capacity ? 2 * map->capacity : 16;
+        sparse_segment_t* segments =
+            arena_alloc(arena, sizeof(sparse_segment_t) * capacity);
+        if (!segments)
+            return false;
+
+        if (map->count != 0)
+            memcpy(segments, map->segments, sizeof(sparse_segment_t) * map->count);
+
+        map->segments = segments;
+        map->capacity = capacity;
+    }
+
+    if (offset + size < offset)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    map->segments[map->count].offset = offset;
+    map->segments[map->count].size = size;
+    ++map->count;
+
+    return true;
+}
+
+bool sparse_parse_gnu(sparse_map_t* map,
+                      arena_t* arena,
+                      const char* fields,
+                      size_t count)
+{
+    for (size_t i = 0; i != count && fields[24 * i] != '\0'; ++i)
+    {
+        uint64_t offset;
+        uint64_t size;
+
+        if (!header_get_number(fields + 24 * i, 12, &offset) ||
+            !header_get_number(fields + 24 * i + 12, 12, &size))
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        if (!sparse_map_add(map, arena, offset, size))
+            return false;
+    }
+
+    return true;
+}
+
+/** Parses the decimal number at '*position' of 'size' bytes of 'data' into
+ * '*number' and moves the position past its terminator 'terminator', which
+ * may be the end of the data if 'final' is true.
+ * @return 1 on success, 0 if the data ends before the terminator or -1 if the
+ * number is malformed.
+ */
+static int sparse_get_number(const char* data,
+                             size_t size,
+                             size_t* position,
+                             char terminator,
+                             bool final,
+                             uint64_t* number)
+{
+    uint64_t result = 0;
+    size_t i = *position;
+
+    for (; i != size && data[i] != terminator; ++i)
+    {
+        if (data[i] < '0' || data[i] > '9')
+            return -1;
+
+        uint64_t digit = (uint64_t)(data[i] - '0');
+        if (result > (UINT64_MAX - digit) / 10)
+            return -1;
+
+        result = result * 10 + digit;
+    }
+
+    if (i == size && !final)
+        return 0;
+
+    if (i == *position)
+        return -1;
+
+    *number = result;
+    *position = i == size ? i : i + 1;
+    return 1;
+}
+
+bool sparse_parse_list(sparse_map_t* map,
+                       arena_t* arena,
+                       const char* list,
+                       size_t length)
+{
+    size_t position = 0;
+
+    while (position != length)
+    {
+        uint64_t offset;
+        uint64_t size;
+
+        if (sparse_get_number(list, length, &position, ',', false, &offset) != 1 ||
+            sparse_get_number(list, length, &position, ',', true, &size) != 1)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        if (!sparse_map_add(map, arena, offset, size))
+            return false;
+    }
+
+    return true;
+}
+
+bool sparse_parse_data(sparse_map_t* map,
+                       arena_t* arena,
+                       const char* data,
+                       size_t size,
+                       size_t* map_size)
+{
+    size_t position = 0;
+    uint64_t count;
+
+    *map_size = 0;
+    map->count = 0;
+
+    int status = sparse_get_number(data, size, &position, '\n', false, &count);
+
+    if (status == 1 && count > SPARSE_MAX_COUNT)
+        status = -1;
+
+    for (uint64_t i = 0; status == 1 && i != count; ++i)
+    {
+        uint64_t offset;
+        uint64_t segment_size;
+
+        status = sparse_get_number(data, size, &position, '\n', false, &offset);
+
+        if (status == 1)
+            status = sparse_get_number(
+                data, size, &position, '\n', false, &segment_size);
+
+        if (status == 1 && !sparse_map_add(map, arena, offset, segment_size))
+            return false;
+    }
+
+    if (status == 1)
+        *map_size = (position + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+
+    if (status == -1)
+        errno = EINVAL;
+
+    return status != -1;
+}
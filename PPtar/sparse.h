@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/** Offset of the map in the header of an old GNU sparse file. */
+#define SPARSE_GNU_MAP_OFFSET ((size_t)386)
+
+/** Number of map entries in the header of an old GNU sparse file. */
+#define SPARSE_GNU_MAP_COUNT ((size_t)4)
+
+/** Offset of the flag of following extension records in the header. */
+#define SPARSE_GNU_EXTENDED_OFFSET ((size_t)482)
+
+/** Offset of the size field of the whole file in the header. */
+#define SPARSE_GNU_REAL_SIZE_OFFSET ((size_t)483)
+
+/** Number of map entries in an extension record. */
+#define SPARSE_GNU_EXTENSION_COUNT ((size_t)21)
+
+/** Offset of the flag of following extension records in a record. */
+#define SPARSE_GNU_EXTENSION_EXTENDED_OFFSET ((size_t)504)
+
+/** Part of a sparse file which holds data, the rest are holes. */
+typedef struct sparse_segment
+{
+    uint64_t offset;
+    uint64_t size;
+} sparse_segment_t;
+
+/** Segments of a sparse file in the order of their data in the archive,
+ * allocated from an arena.
+ */
+typedef struct sparse_map
+{
+    sparse_segment_t* segments;
+    size_t count;
+    size_t capacity;
+} sparse_map_t;
+
+/** Initializes empty 'map'. */
+void sparse_map_init(sparse_map_t* map);
+
+/** Appends the segment of 'size' bytes at 'offset' to 'map'.
+ * @return false if the segment overflows or out of memory, errno is set.
+ */
+bool sparse_map_add(sparse_map_t* map,
+                    arena_t* arena,
+                    uint64_t offset,
+                    uint64_t size);
+
+/** Appends the at most 'count' old GNU map entries at 'fields', pairs of
+ * numeric fields of 12 bytes, to 'map'. An empty entry ends them.
+ * @return false if an entry is malformed or out of memory, errno is set.
+ */
+bool sparse_parse_gnu(sparse_map_t* map,
+                      arena_t* arena,
+                      const char* fields,
+                      size_t count);
+
+/** Appends the PAX 0.1 map 'list', decimal offsets and sizes separated by
+ * commas, of 'length' to 'map'.
+ * @return false if the list is malformed or out of memory, errno is set.
+ */
+bool sparse_parse_list(sparse_map_t* map,
+                       arena_t* arena,
+                       const char* list,
+                       size_t length);
+
+/** Parses the PAX 1.0 map at the start of 'size' bytes of the data of a
+ * member into the empty 'map'. The map consists of decimal numbers, each
+ * followed by a newline: the number of segments and their offsets and sizes.
+ * Writes the size of the map padded to whole records to '*map_size', 0 if the
+ * data ends before the map.
+ * @return false if the map is malformed or out of memory, errno is set.
+ */
+bool sparse_parse_data(sparse_map_t* map,
+                       arena_t* arena,
+                       const char* data,
+                       size_t size,
+                       size_t* map_size);
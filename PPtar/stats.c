@@ -0,0 +1,157 @@
+#include "stats.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void stats_init(stats_t* stats)
+{
+    memset(stats, 0, sizeof(stats_t));
+}
+
+void stats_destroy(stats_t* stats)
+{
+    free(stats->member_times);
+}
+
+uint64_t stats_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+void stats_add_member(stats_t* stats, uint64_t time)
+{
+    if (stats->member_count == stats->member_capacity)
+    {
+        size_t capacity =
+            stats->member_capacity != 0 ? stats->member_capacity * 2 : 1024;
+        uint64_t* member_times =
+            realloc(stats->member_times, sizeof(uint64_t) * capacity);
+
+        // Latencies are best effort
+        if (!member_times)
+            return;
+
+        stats->member_times = member_times;
+        stats->member_capacity = capacity;
+    }
+
+    stats->member_times[stats->member_count++] = time;
+}
+
+void stats_merge(stats_t* stats, const stats_t* from)
+{
+    stats->bytes_read += from->bytes_read;
+    stats->bytes_written += from->bytes_written;
+    stats->headers_parsed += from->headers_parsed;
+    stats->files_created += from->files_created;
+    stats->files_linked += from->files_linked;
+    stats->files_verified += from->files_verified;
+    stats->header_time += from->header_time;
+    stats->input_time += from->input_time;
+    stats->output_time += from->output_time;
+
+    for (size_t i = 0; i != from->member_count; ++i)
+        stats_add_member(stats, from->member_times[i]);
+}
+
+/** Orders member times. */
+static int compare_times(const void* a_void, const void* b_void)
+{
+    uint64_t a = *(const uint64_t*)a_void;
+    uint64_t b = *(const uint64_t*)b_void;
+
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/** Returns the 'percent' percentile of sorted member times of 'stats'. */
+static uint64_t stats_percentile(const stats_t* stats, size_t percent)
+{
+    if (stats->member_count == 0)
+        return 0;
+
+    // Nearest rank
+    size_t rank = (stats->member_count * percent + 99) / 100;
+
+    return stats->member_times[rank != 0 ? rank - 1 : 0];
+}
+
+void stats_print(stats_t* stats,
+                 uint64_t total_time,
+                 stats_format_t format,
+                 FILE* file)
+{
+    // The times are NULL until one is recorded
+    if (stats->member_count > 1)
+        qsort(stats->member_times,
+              stats->member_count,
+              sizeof(uint64_t),
+              compare_times);
+
+    uint64_t p50 = stats_percentile(stats, 50);
+    uint64_t p90 = stats_percentile(stats, 90);
+    uint64_t p99 = stats_percentile(stats, 99);
+    uint64_t max = stats_percentile(stats, 100);
+
+    if (format == STATS_FORMAT_JSON)
+    {
+        fprintf(file,
+                "{\"bytes_read\":%" PRIu64 ",\"bytes_written\":%" PRIu64
+                ",\"headers_parsed\":%" PRIu64 ",\"files_created\":%" PRIu64
+                ",\"files_linked\":%" PRIu64 ",\"files_verified\":%" PRIu64
+                ",\"time_ns\":{\"total\":%" PRIu64 ",\"header_parsing\":%" PRIu64
+                ",\"input\":%" PRIu64 ",\"output\":%" PRIu64
+                "},\"member_latency_ns\":{\"count\":%zu,\"p50\":%" PRIu64
+                ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64 ",\"max\":%" PRIu64
+                "}}\n",
+                stats->bytes_read,
+                stats->bytes_written,
+                stats->headers_parsed,
+                stats->files_created,
+                stats->files_linked,
+                stats->files_verified,
+                total_time,
+                stats->header_time,
+                stats->input_time,
+                stats->output_time,
+                stats->member_count,
+                p50,
+                p90,
+                p99,
+                max);
+        return;
+    }
+
+    fprintf(file,
+            "PPtar: bytes read:       %" PRIu64 "\n"
+            "PPtar: bytes written:    %" PRIu64 "\n"
+            "PPtar: headers parsed:   %" PRIu64 "\n"
+            "PPtar: files created:    %" PRIu64 "\n"
+            "PPtar: files linked:     %" PRIu64 "\n"
+            "PPtar: files verified:   %" PRIu64 "\n"
+            "PPtar: total time:       %.3f ms\n"
+            "PPtar: header parsing:   %.3f ms\n"
+            "PPtar: input:            %.3f ms\n"
+            "PPtar: output:           %.3f ms\n"
+            "PPtar: member latency:   p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, "
+            "max %.3f ms over %zu members\n",
+            stats->bytes_read,
+            stats->bytes_written,
+            stats->headers_parsed,
+            stats->files_created,
+            stats->files_linked,
+            stats->files_verified,
+            (double)total_time / 1e6,
+            (double)stats->header_time / 1e6,
+            (double)stats->input_time / 1e6,
+            (double)stats->output_time / 1e6,
+            (double)p50 / 1e6,
+            (double)p90 / 1e6,
+            (double)p99 / 1e6,
+            (double)max / 1e6,
+            stats->member_count);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Formats of the statistics report. */
+typedef enum stats_format
+{
+    STATS_FORMAT_NONE,
+    STATS_FORMAT_TEXT,
+    STATS_FORMAT_JSON
+} stats_format_t;
+
+/** Throughput and latency statistics of a run, times are in nanoseconds. */
+typedef struct stats
+{
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t headers_parsed;
+    uint64_t files_created;
+
+    // Duplicates made links to the files with the same content
+    uint64_t files_linked;
+
+    // Members whose data was checked against their digests
+    uint64_t files_verified;
+
+    uint64_t header_time;
+    uint64_t input_time;
+
+    // Opening, writing and closing of extracted files
+    uint64_t output_time;
+
+    // Time spent on each member, by the writer threads when extracting in
+    // parallel
+    uint64_t* member_times;
+    size_t member_count;
+    size_t member_capacity;
+} stats_t;
+
+/** Initializes empty 'stats'. */
+void stats_init(stats_t* stats);
+
+/** Frees the memory of 'stats'. */
+void stats_destroy(stats_t* stats);
+
+/** Returns the current time of a monotonic clock. */
+uint64_t stats_now(void);
+
+/** Records that a member took 'time'. */
+void stats_add_member(stats_t* stats, uint64_t time);
+
+/** Adds the statistics of 'from' to 'stats'. */
+void stats_merge(stats_t* stats, const stats_t* from);
+
+/** Prints 'stats' of a run which took 'total_time' to 'file' in 'format'. */
+void stats_print(stats_t* stats,
+                 uint64_t total_time,
+                 stats_format_t format,
+                 FILE* file);
@@ -0,0 +1,616 @@
+#define _GNU_SOURCE
+#include "tree.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/fs.h>
+
+#include "header.h"
+
+void tree_init(tree_t* tree, tree_sync_t sync, bool direct)
+{
+    pthread_mutex_init(&tree->mutex, NULL);
+    arena_init(&tree->paths);
+
+    tree->directories = NULL;
+    tree->directory_count = 0;
+    tree->directory_capacity = 0;
+
+    // The mask can only be read by replacing it
+    tree->umask = umask(0);
+    umask(tree->umask);
+
+    tree->same_owner = geteuid() == 0;
+    tree->sync = sync;
+    tree->direct = direct;
+}
+
+void tree_destroy(tree_t* tree)
+{
+    free(tree->directories);
+    arena_destroy(&tree->paths);
+    pthread_mutex_destroy(&tree->mutex);
+}
+
+void tree_cache_init(tree_cache_t* cache)
+{
+    for (size_t i = 0; i != TREE_CACHE_SIZE; ++i)
+    {
+        cache->entries[i].path = NULL;
+        cache->entries[i].length = 0;
+        cache->entries[i].fd = -1;
+    }
+
+    cache->next = 0;
+}
+
+void tree_cache_destroy(tree_cache_t* cache)
+{
+    for (size_t i = 0; i != TREE_CACHE_SIZE; ++i)
+        if (cache->entries[i].path)
+        {
+            free(cache->entries[i].path);
+            close(cache->entries[i].fd);
+        }
+}
+
+/** Opens the directory at 'path', which is writable, walking its components
+ * from the directory 'fd' at the component 'position' and creating them if
+ * 'create' is true. A symlink is never walked through, so a link extracted
+ * before cannot lead outside of the tree.
+ * @return The descriptor or -1 on failure, errno is set.
+ */
+static int tree_walk(int fd, char* path, size_t position, bool create)
+{
+    static const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+    int base = fd;
+
+    while (true)
+    {
+        while (path[position] == '/')
+            ++position;
+
+        if (path[position] == '\0')
+            return fd;
+
+        char* component = path + position;
+        char* end = strchr(component, '/');
+        size_t length = end ? (size_t)(end - component) : strlen(component);
+
+        if (end)
+            *end = '\0';
+
+        int next = openat(fd, component, flags);
+
+        if (next == -1 && errno == ENOENT && create &&
+            (mkdirat(fd, component, 0777) == 0 || errno == EEXIST))
+            next = openat(fd, component, flags);
+
+        if (end)
+            *end = '/';
+
+        int error = errno;
+        if (fd != base)
+            close(fd);
+
+        if (next == -1)
+        {
+            errno = error;
+            return -1;
+        }
+
+        fd = next;
+        position += length;
+    }
+}
+
+/** Returns the length of 'path' without its trailing slashes, which would
+ * make a symlink at it be followed.
+ */
+static size_t tree_trimmed_length(const char* path)
+{
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/')
+        --length;
+
+    return length;
+}
+
+/** Writes the last component of 'path' to '*name'.
+ * @return The length of the directory containing it, 0 for the working
+ * directory.
+ */
+static size_t tree_split(const char* path, const char** name)
+{
+    // Trailing slashes of a directory stay in its name
+    size_t parent_length = tree_trimmed_length(path);
+    while (parent_length != 0 && path[parent_length - 1] != '/')
+        --parent_length;
+
+    *name = path + parent_length;
+
+    while (parent_length != 0 && path[parent_length - 1] == '/')
+        --parent_length;
+
+    return parent_length;
+}
+
+/** Returns the directory containing 'path' relative to the working directory
+ * and writes its last component to '*name', creating the missing
+ * directories. The directory belongs to 'cache' and is valid until its next
+ * use.
+ * @return The descriptor or -1 on failure, errno is set.
+ */
+static int tree_open_parent(tree_cache_t* cache, const char* path, const char** name)
+{
+    size_t parent_length = tree_split(path, name);
+
+    if (parent_length == 0)
+        return AT_FDCWD;
+
+    // The longest cached ancestor is the start of the walk
+    tree_cache_entry_t* ancestor = NULL;
+
+    for (tree_cache_entry_t* i = cache->entries;
+         i != cache->entries + TREE_CACHE_SIZE;
+         ++i)
+    {
+        if (!i->path || i->length > parent_length ||
+            memcmp(i->path, path, i->length) != 0)
+            continue;
+
+        if (i->length == parent_length)
+            return i->fd;
+
+        if (path[i->length] == '/' && (!ancestor || i->length > ancestor->length))
+            ancestor = i;
+    }
+
+    char* parent = malloc(parent_length + 1);
+    if (!parent)
+        return -1;
+
+    memcpy(parent, path, parent_length);
+    parent[parent_length] = '\0';
+
+    // Leading slashes are skipped, the walk never leaves the working directory
+    int fd = ancestor ? tree_walk(ancestor->fd, parent, ancestor->length + 1, true)
+                      : tree_walk(AT_FDCWD, parent, 0, true);
+
+    // A parent of only slashes or equal to its ancestor is not cached
+    if (fd == -1 || fd == AT_FDCWD || (ancestor && fd == ancestor->fd))
+    {
+        free(parent);
+        return fd;
+    }
+
+    tree_cache_entry_t* entry = cache->entries + cache->next;
+    cache->next = (cache->next + 1) % TREE_CACHE_SIZE;
+
+    if (entry->path)
+    {
+        free(entry->path);
+        close(entry->fd);
+    }
+
+    entry->path = parent;
+    entry->length = parent_length;
+    entry->fd = fd;
+
+    return fd;
+}
+
+/** Creates the regular file 'name' in the directory 'parent' and opens it
+ * with 'flags'. A file in its place is replaced, not written through, so
+ * neither a symlink nor the other names of a hard link are changed.
+ * @return The descriptor or -1 on failure, errno is set.
+ */
+static int tree_open_regular(int parent, const char* name, int flags)
+{
+    while (true)
+    {
+        int fd =
+            openat(parent, name, flags | O_CREAT | O_EXCL | O_NOFOLLOW, 0666);
+
+        if (fd != -1 || errno != EEXIST || unlinkat(parent, name, 0) != 0)
+            return fd;
+    }
+}
+
+int tree_open_file(const tree_t* tree,
+                   tree_cache_t* cache,
+                   const char* path,
+                   const tree_node_t* node,
+                   bool* direct)
+{
+    const char* name;
+    int parent = tree_open_parent(cache, path, &name);
+
+    if (parent == -1)
+        return -1;
+
+    int fd = -1;
+    *direct = tree->direct && !node->sparse && node->size >= TREE_DIRECT_MIN_SIZE;
+
+    if (*direct)
+    {
+        fd = tree_open_regular(parent, name, O_WRONLY | O_DIRECT);
+
+        // Some filesystems cannot write past the page cache
+        if (fd == -1 && errno != EINVAL)
+            return -1;
+    }
+
+    if (fd == -1)
+    {
+        *direct = false;
+        fd = tree_open_regular(parent, name, O_WRONLY);
+    }
+
+    // Only a hint, the size is kept so a failed extraction shows
+    if (fd != -1 && !node->sparse && node->size >= TREE_PREALLOCATE_MIN_SIZE)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)node->size);
+
+    return fd;
+}
+
+/** Returns the mode of 'node' to be restored in 'tree'. */
+static mode_t tree_mode(const tree_t* tree, const tree_node_t* node)
+{
+    mode_t mode = (mode_t)node->mode & 07777;
+
+    return tree->same_owner ? mode : mode & ~tree->umask;
+}
+
+/** Writes the times of 'node' to 'times', the access time is kept. */
+static void tree_times(const tree_node_t* node, struct timespec times[2])
+{
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = (time_t)node->mtime;
+    times[1].tv_nsec = 0;
+}
+
+bool tree_make_parent(tree_cache_t* cache, const char* path)
+{
+    const char* name;
+
+    return tree_open_parent(cache, path, &name) != -1;
+}
+
+bool tree_restore_file(const tree_t* tree,
+                       tree_cache_t* cache,
+                       const char* path,
+                       const tree_node_t* node)
+{
+    const char* name;
+    int parent = tree_open_parent(cache, path, &name);
+
+    if (parent == -1)
+        return false;
+
+    struct timespec times[2];
+    tree_times(node, times);
+
+    // The file was just created in place, so the mode goes to it
+    return (!tree->same_owner ||
+            fchownat(parent,
+                     name,
+                     (uid_t)node->uid,
+                     (gid_t)node->gid,
+                     AT_SYMLINK_NOFOLLOW) == 0) &&
+           fchmodat(parent, name, tree_mode(tree, node), 0) == 0 &&
+           utimensat(parent, name, times, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+bool tree_close_file(const tree_t* tree, int fd, const tree_node_t* node)
+{
+    struct timespec times[2];
+    tree_times(node, times);
+
+    // Changing the owner clears the set-user-ID bits, so the mode goes after it
+    bool restored =
+        (!node->sparse || ftruncate(fd, (off_t)node->size) == 0) &&
+        (!tree->same_owner ||
+         fchown(fd, (uid_t)node->uid, (gid_t)node->gid) == 0) &&
+        fchmod(fd, tree_mode(tree, node)) == 0 && futimens(fd, times) == 0 &&
+        (tree->sync != TREE_SYNC_FILE || fsync(fd) == 0);
+
+    int error = errno;
+    bool closed = close(fd) == 0;
+
+    if (!restored)
+        errno = error;
+
+    return restored && closed;
+}
+
+bool tree_clone_file(const tree_t* tree,
+                     tree_cache_t* cache,
+                     const char* path,
+                     const tree_node_t* node,
+                     const char* source)
+{
+    const char* name;
+    int parent = tree_open_parent(cache, path, &name);
+
+    if (parent == -1)
+        return false;
+
+    int source_fd = open(source, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (source_fd == -1)
+        return false;
+
+    // Not replaced, a written file stays whole if cloning fails. Only a file
+    // this extraction created can be there
+    int fd =
+        openat(parent, name, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0666);
+
+    bool cloned = fd != -1 && ioctl(fd, FICLONE, source_fd) == 0 &&
+                  ftruncate(fd, (off_t)node->size) == 0;
+
+    int error = errno;
+    close(source_fd);
+
+    if (!cloned)
+    {
+        if (fd != -1)
+            close(fd);
+
+        errno = error;
+        return false;
+    }
+
+    return tree_close_file(tree, fd, node);
+}
+
+bool tree_remove_file(tree_cache_t* cache, const char* path)
+{
+    const char* name;
+    int parent = tree_open_parent(cache, path, &name);
+
+    return parent != -1 && (unlinkat(parent, name, 0) == 0 || errno == ENOENT);
+}
+
+/** Records the directory 'node' at 'path' of 'tree' to restore its
+ * attributes at the end.
+ * @return false if out of memory.
+ */
+static bool tree_defer(tree_t* tree, const char* path, const tree_node_t* node)
+{
+    pthread_mutex_lock(&tree->mutex);
+
+    if (tree->directory_count == tree->directory_capacity)
+    {
+        size_t capacity =
+            tree->directory_capacity ? 2 * tree->directory_capacity : 64;
+        tree_directory_t* directories =
+            realloc(tree->directories, sizeof(tree_directory_t) * capacity);
+
+        if (!directories)
+        {
+            pthread_mutex_unlock(&tree->mutex);
+            errno = ENOMEM;
+            return false;
+        }
+
+        tree->directories = directories;
+        tree->directory_capacity = capacity;
+    }
+
+    tree_directory_t* directory = tree->directories + tree->directory_count;
+
+    directory->path = arena_strndup(&tree->paths, path, tree_trimmed_length(path));
+    directory->index = tree->directory_count;
+    directory->node = *node;
+    directory->node.linkname = NULL;
+
+    if (directory->path)
+        ++tree->directory_count;
+
+    pthread_mutex_unlock(&tree->mutex);
+
+    if (!directory->path)
+        errno = ENOMEM;
+
+    return directory->path != NULL;
+}
+
+bool tree_create(tree_t* tree,
+                 tree_cache_t* cache,
+                 const char* path,
+                 const tree_node_t* node)
+{
+    const char* name;
+    int parent = tree_open_parent(cache, path, &name);
+
+    if (parent == -1)
+        return false;
+
+    if (node->typeflag == DIRTYPE)
+    {
+        char* own_name = strndup(name, tree_trimmed_length(name));
+        if (!own_name)
+            return false;
+
+        // The directory has to stay writable until its attributes are
+        // restored, a symlink in its place is replaced
+        mode_t mode = 0700 | ((mode_t)node->mode & 0777);
+        struct stat existing;
+
+        bool created =
+            mkdirat(parent, own_name, mode) == 0 ||
+            (errno == EEXIST &&
+             fstatat(parent, own_name, &existing, AT_SYMLINK_NOFOLLOW) == 0 &&
+             (!S_ISLNK(existing.st_mode) ||
+              (unlinkat(parent, own_name, 0) == 0 &&
+               mkdirat(parent, own_name, mode) == 0)));
+
+        int error = errno;
+        free(own_name);
+        errno = error;
+
+        return created && tree_defer(tree, path, node);
+    }
+
+    // The target of a hard link is found beneath the working directory too
+    const char* target = node->linkname;
+    int target_parent = AT_FDCWD;
+
+    if (node->typeflag == LNKTYPE)
+    {
+        size_t parent_length = tree_split(node->linkname, &target);
+
+        if (parent_length != 0)
+        {
+            char* target_path = strndup(node->linkname, parent_length);
+
+            target_parent =
+                target_path ? tree_walk(AT_FDCWD, target_path, 0, false) : -1;
+            free(target_path);
+
+            if (target_parent == -1)
+                return false;
+        }
+    }
+
+    bool created;
+
+    while (true)
+    {
+        int result = node->typeflag == SYMTYPE
+                         ? symlinkat(node->linkname, parent, name)
+                         : linkat(target_parent, target, parent, name, 0);
+
+        created = result == 0;
+
+        if (created || errno != EEXIST || unlinkat(parent, name, 0) != 0)
+            break;
+    }
+
+    if (target_parent != AT_FDCWD)
+    {
+        int error = errno;
+        close(target_parent);
+        errno = error;
+    }
+
+    if (!created)
+        return false;
+
+    // The attributes of a hard link are those of its target
+    if (node->typeflag != SYMTYPE)
+        return true;
+
+    struct timespec times[2];
+    tree_times(node, times);
+
+    return (!tree->same_owner ||
+            fchownat(parent,
+                     name,
+                     (uid_t)node->uid,
+                     (gid_t)node->gid,
+                     AT_SYMLINK_NOFOLLOW) == 0) &&
+           utimensat(parent, name, times, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+const char* tree_create_error(char typeflag)
+{
+    return typeflag == DIRTYPE   ? "PPtar: Couldn't create directory %s\n"
+           : typeflag == SYMTYPE ? "PPtar: Couldn't create symlink %s\n"
+                                 : "PPtar: Couldn't create link %s\n";
+}
+
+/** Orders directories by path descending, so children go before their
+ * parents, and by order of creation.
+ */
+static int compare_directories(const void* a_void, const void* b_void)
+{
+    const tree_directory_t* a = a_void;
+    const tree_directory_t* b = b_void;
+
+    int order = strcmp(b->path, a->path);
+    if (order != 0)
+        return order;
+
+    return a->index < b->index ? -1 : a->index > b->index ? 1 : 0;
+}
+
+bool tree_finish(tree_t* tree)
+{
+    bool success = true;
+
+    if (tree->directory_count != 0)
+        qsort(tree->directories,
+              tree->directory_count,
+              sizeof(tree_directory_t),
+              compare_directories);
+
+    for (size_t i = 0; i != tree->directory_count; ++i)
+    {
+        const tree_directory_t* directory = tree->directories + i;
+
+        // The last member of a directory wins
+        if (i + 1 != tree->directory_count &&
+            strcmp(directory->path, directory[1].path) == 0)
+            continue;
+
+        struct timespec times[2];
+        tree_times(&directory->node, times);
+
+        // Its parents were walked without following symlinks when it was
+        // created, only the directory itself could have been replaced
+        int fd = open(
+            directory->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+        bool restored = fd != -1 &&
+                        (!tree->same_owner ||
+                         fchown(fd,
+                                (uid_t)directory->node.uid,
+                                (gid_t)directory->node.gid) == 0) &&
+                        fchmod(fd, tree_mode(tree, &directory->node)) == 0 &&
+                        futimens(fd, times) == 0;
+
+        int error = errno;
+        if (fd != -1)
+            close(fd);
+        errno = error;
+
+        if (!restored)
+        {
+            fprintf(stderr,
+                    "PPtar: %s: Cannot restore attributes: %s\n",
+                    directory->path,
+                    strerror(errno));
+            success = false;
+        }
+    }
+
+    tree->directory_count = 0;
+
+    if (tree->sync == TREE_SYNC_FS)
+    {
+        int fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (fd == -1 || syncfs(fd) != 0)
+        {
+            fprintf(stderr,
+                    "PPtar: Cannot sync the extracted files: %s\n",
+                    strerror(errno));
+            success = false;
+        }
+
+        if (fd != -1)
+            close(fd);
+    }
+
+    return success;
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "arena.h"
+
+/** Number of parent directories kept open by a cache. */
+#define TREE_CACHE_SIZE ((size_t)8)
+
+/** Minimum size of a file whose blocks are allocated before it is written. */
+#define TREE_PREALLOCATE_MIN_SIZE ((uint64_t)64 << 10)
+
+/** Minimum size of a file written past the page cache if asked to. */
+#define TREE_DIRECT_MIN_SIZE ((uint64_t)4 << 20)
+
+/** When the extracted data is flushed to the disk. */
+typedef enum tree_sync
+{
+    // Left to the kernel
+    TREE_SYNC_NONE,
+
+    // Each file before it is closed
+    TREE_SYNC_FILE,
+
+    // The whole filesystem once all members are extracted
+    TREE_SYNC_FS
+} tree_sync_t;
+
+/** Kind and attributes of an extracted member. */
+typedef struct tree_node
+{
+    // REGTYPE, DIRTYPE, SYMTYPE or LNKTYPE
+    char typeflag;
+
+    // Target of a link terminated by a NUL
+    const char* linkname;
+
+    uint32_t mode;
+    uint64_t uid;
+    uint64_t gid;
+    uint64_t mtime;
+
+    // A sparse file is extended to 'size' bytes, its end may be a hole
+    bool sparse;
+    uint64_t size;
+} tree_node_t;
+
+/** Open parent directory of extracted members. */
+typedef struct tree_cache_entry
+{
+    // NULL for an empty entry
+    char* path;
+    size_t length;
+    int fd;
+} tree_cache_entry_t;
+
+/** Parent directories last used by one thread, members are created relative
+ * to them instead of resolving their whole paths.
+ */
+typedef struct tree_cache
+{
+    tree_cache_entry_t entries[TREE_CACHE_SIZE];
+
+    // Entry to be replaced next
+    size_t next;
+} tree_cache_t;
+
+/** Directory whose attributes are restored after the extraction. */
+typedef struct tree_directory
+{
+    const char* path;
+    size_t index;
+    tree_node_t node;
+} tree_directory_t;
+
+/** Extracted tree of files, directories and links.
+ * The attributes of files and links are restored when they are created. The
+ * attributes of directories are restored in one pass at the end, as creating
+ * their entries would change their times and their modes could forbid it.
+ * Paths are relative to the working directory and symlinks are never
+ * followed on the way to a member, a symlink in the place of a member is
+ * replaced by it.
+ */
+typedef struct tree
+{
+    pthread_mutex_t mutex;
+
+    // Paths of the directories
+    arena_t paths;
+
+    tree_directory_t* directories;
+    size_t directory_count;
+    size_t directory_capacity;
+
+    mode_t umask;
+
+    // Owners and exact modes are restored by the superuser only
+    bool same_owner;
+
+    tree_sync_t sync;
+
+    // Large files are written with O_DIRECT
+    bool direct;
+} tree_t;
+
+/** Initializes empty 'tree' flushed by 'sync', writing large files past the
+ * page cache if 'direct' is true.
+ */
+void tree_init(tree_t* tree, tree_sync_t sync, bool direct);
+
+/** Frees the memory of 'tree'. */
+void tree_destroy(tree_t* tree);
+
+/** Initializes empty 'cache'. */
+void tree_cache_init(tree_cache_t* cache);
+
+/** Closes the directories of 'cache'. */
+void tree_cache_destroy(tree_cache_t* cache);
+
+/** Opens the regular file 'node' at 'path' of 'tree' for writing, creating
+ * its missing parent directories with the help of 'cache'. A file at 'path'
+ * is replaced, so its other hard links keep their data. Allocates the
+ * blocks of a large file which is not sparse. Writes whether the file was
+ * opened with O_DIRECT to '*direct'.
+ * @return The descriptor or -1 on failure, errno is set.
+ */
+int tree_open_file(const tree_t* tree,
+                   tree_cache_t* cache,
+                   const char* path,
+                   const tree_node_t* node,
+                   bool* direct);
+
+/** Creates the missing parent directories of 'path' with the help of 'cache'.
+ * @return false on failure, errno is set.
+ */
+bool tree_make_parent(tree_cache_t* cache, const char* path);
+
+/** Restores the attributes of 'node' to the closed file at 'path' of 'tree'
+ * with the help of 'cache'.
+ * @return false on failure, errno is set.
+ */
+bool tree_restore_file(const tree_t* tree,
+                       tree_cache_t* cache,
+                       const char* path,
+                       const tree_node_t* node);
+
+/** Restores the attributes of 'node' to the file 'fd' of 'tree' and closes
+ * it. Extends a sparse file to its size. Flushes the file if 'tree' syncs
+ * each file.
+ * @return false on failure, errno is set.
+ */
+bool tree_close_file(const tree_t* tree, int fd, const tree_node_t* node);
+
+/** Makes the regular file 'node' at 'path' of 'tree' share the data of the
+ * file at 'source' by cloning it, creating its missing parent directories
+ * with the help of 'cache'. Restores the attributes of 'node' to it. An
+ * existing file keeps its data if cloning fails.
+ * @return false on failure, errno is set, EOPNOTSUPP or EXDEV if the
+ * filesystem cannot clone between the files.
+ */
+bool tree_clone_file(const tree_t* tree,
+                     tree_cache_t* cache,
+                     const char* path,
+                     const tree_node_t* node,
+                     const char* source);
+
+/** Removes the file at 'path', which may not exist, with the help of
+ * 'cache'. A file written there next does not change its other hard links.
+ * @return false on failure, errno is set.
+ */
+bool tree_remove_file(tree_cache_t* cache, const char* path);
+
+/** Creates the directory or link 'node' at 'path' of 'tree', creating its
+ * missing parent directories with the help of 'cache'. Replaces an existing
+ * link.
+ * @return false on failure, errno is set.
+ */
+bool tree_create(tree_t* tree,
+                 tree_cache_t* cache,
+                 const char* path,
+                 const tree_node_t* node);
+
+/** Returns the format of the error message of a failed tree_create of a
+ * member with 'typeflag' about its path.
+ */
+const char* tree_create_error(char typeflag);
+
+/** Restores the attributes of the directories of 'tree', each only once.
+ * Flushes the filesystem of the working directory if 'tree' syncs it.
+ * Prints errors of the directories which failed.
+ * @return false if some failed.
+ */
+bool tree_finish(tree_t* tree);
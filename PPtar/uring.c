@@ -0,0 +1,200 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/** Returns 'offset' bytes past 'base' as a pointer to unsigned. */
+static unsigned* uring_field(void* base, uint32_t offset)
+{
+    return (unsigned*)((char*)base + offset);
+}
+
+bool uring_init(uring_t* ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd == -1)
+        return false;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size)
+        ring->sq_ring_size = ring->cq_ring_size;
+
+    ring->sq_ring = mmap(NULL,
+                         ring->sq_ring_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+
+    if (ring->sq_ring != MAP_FAILED && !single_mmap)
+        ring->cq_ring = mmap(NULL,
+                             ring->cq_ring_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             ring->fd,
+                             IORING_OFF_CQ_RING);
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = ring->cq_ring == MAP_FAILED ? MAP_FAILED
+                                             : mmap(NULL,
+                                                    ring->sqes_size,
+                                                    PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_POPULATE,
+                                                    ring->fd,
+                                                    IORING_OFF_SQES);
+
+    if (ring->sqes == MAP_FAILED)
+    {
+        int error = errno;
+
+        if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        if (ring->sq_ring != MAP_FAILED)
+            munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+
+        errno = error;
+        return false;
+    }
+
+    ring->sq_head = uring_field(ring->sq_ring, params.sq_off.head);
+    ring->sq_tail = uring_field(ring->sq_ring, params.sq_off.tail);
+    ring->sq_array = uring_field(ring->sq_ring, params.sq_off.array);
+    ring->sq_mask = *uring_field(ring->sq_ring, params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+
+    ring->cq_head = uring_field(ring->cq_ring, params.cq_off.head);
+    ring->cq_tail = uring_field(ring->cq_ring, params.cq_off.tail);
+    ring->cq_mask = *uring_field(ring->cq_ring, params.cq_off.ring_mask);
+    ring->cqes =
+        (struct io_uring_cqe*)((char*)ring->cq_ring + params.cq_off.cqes);
+
+    // The array maps the queue slots to entries one to one
+    for (unsigned i = 0; i != ring->sq_entries; ++i)
+        ring->sq_array[i] = i;
+
+    ring->unsubmitted = 0;
+
+    return true;
+}
+
+void uring_destroy(uring_t* ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+bool uring_register_buffers(uring_t* ring,
+                            const struct iovec* buffers,
+                            unsigned count)
+{
+    return syscall(__NR_io_uring_register,
+                   ring->fd,
+                   IORING_REGISTER_BUFFERS,
+                   buffers,
+                   count) == 0;
+}
+
+bool uring_register_files(uring_t* ring, unsigned count)
+{
+    int* fds = malloc(sizeof(int) * count);
+    if (!fds)
+        return false;
+
+    for (unsigned i = 0; i != count; ++i)
+        fds[i] = -1;
+
+    bool registered =
+        syscall(
+            __NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, fds, count) ==
+        0;
+
+    int error = errno;
+    free(fds);
+    errno = error;
+
+    return registered;
+}
+
+struct io_uring_sqe* uring_get_sqe(uring_t* ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->unsubmitted;
+
+    if (tail - head == ring->sq_entries)
+        return NULL;
+
+    struct io_uring_sqe* sqe = ring->sqes + (tail & ring->sq_mask);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ++ring->unsubmitted;
+
+    return sqe;
+}
+
+unsigned uring_unsubmitted(const uring_t* ring)
+{
+    return ring->unsubmitted;
+}
+
+bool uring_submit(uring_t* ring, unsigned wait_count)
+{
+    // The kernel sees the entries once the tail moves past them
+    unsigned to_submit = ring->unsubmitted;
+    __atomic_store_n(
+        ring->sq_tail, *ring->sq_tail + to_submit, __ATOMIC_RELEASE);
+    ring->unsubmitted = 0;
+
+    while (to_submit != 0 || wait_count != 0)
+    {
+        long result = syscall(__NR_io_uring_enter,
+                              ring->fd,
+                              to_submit,
+                              wait_count,
+                              wait_count != 0 ? IORING_ENTER_GETEVENTS : 0,
+                              NULL,
+                              0);
+
+        if (result == -1 && errno == EINTR)
+            continue;
+
+        if (result == -1)
+            return false;
+
+        to_submit -= (unsigned)result;
+
+        // The completions waited for are there once all entries were taken
+        if (to_submit == 0)
+            break;
+    }
+
+    return true;
+}
+
+bool uring_next_cqe(uring_t* ring, struct io_uring_cqe* cqe)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    *cqe = ring->cqes[head & ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/** io_uring instance driven by raw system calls.
+ * Submission entries are filled in place and submitted in batches, which
+ * also waits for completions.
+ */
+typedef struct uring
+{
+    int fd;
+
+    // Mapped submission queue
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    // Mapped completion queue, shared with the submission queue if the
+    // kernel maps both at once
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    struct io_uring_cqe* cqes;
+    unsigned cq_mask;
+
+    // Entries filled and not submitted yet
+    unsigned unsubmitted;
+} uring_t;
+
+/** Creates 'ring' with room for 'entries' submissions.
+ * @return false on failure, errno is set.
+ */
+bool uring_init(uring_t* ring, unsigned entries);
+
+/** Closes 'ring' and frees its memory. */
+void uring_destroy(uring_t* ring);
+
+/** Registers the 'count' 'buffers' of 'ring' for fixed reads and writes.
+ * @return false on failure, errno is set.
+ */
+bool uring_register_buffers(uring_t* ring,
+                            const struct iovec* buffers,
+                            unsigned count);
+
+/** Registers 'count' empty slots of direct descriptors of 'ring'.
+ * @return false on failure, errno is set.
+ */
+bool uring_register_files(uring_t* ring, unsigned count);
+
+/** Returns the next cleared submission entry of 'ring' or NULL if the queue
+ * is full. The entry is submitted by the next uring_submit.
+ */
+struct io_uring_sqe* uring_get_sqe(uring_t* ring);
+
+/** Returns the number of entries of 'ring' filled and not submitted. */
+unsigned uring_unsubmitted(const uring_t* ring);
+
+/** Submits the filled entries of 'ring' and waits for 'wait_count'
+ * completions.
+ * @return false on failure, errno is set.
+ */
+bool uring_submit(uring_t* ring, unsigned wait_count);
+
+/** Moves the next completion of 'ring' to '*cqe'.
+ * @return false if there is none.
+ */
+bool uring_next_cqe(uring_t* ring, struct io_uring_cqe* cqe);
@@ -0,0 +1,468 @@
+#include "uring_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "filter.h"
+
+/** Operations of the chain of a file, the low bits of its user data. */
+enum
+{
+    URING_OPEN,
+    URING_WRITE,
+    URING_FSYNC,
+    URING_CLOSE,
+    URING_OPERATION_COUNT,
+
+    // Restoring the attributes after the chain
+    URING_RESTORE = URING_OPERATION_COUNT
+};
+
+/** Alignment of the registered buffers. */
+#define URING_WRITER_ALIGNMENT ((size_t)4096)
+
+/** Records a failure of the member 'member_index' with 'error_code' and the
+ * formatted 'error_message', unless an earlier member failed already.
+ */
+static void uring_writer_fail(uring_writer_t* writer,
+                              size_t member_index,
+                              int error_code,
+                              char* error_message)
+{
+    if (writer->failed && writer->error_member_index <= member_index)
+    {
+        free(error_message);
+        return;
+    }
+
+    free(writer->error_message);
+
+    writer->failed = true;
+    writer->error_member_index = member_index;
+    writer->error_code = error_code;
+    writer->error_message = error_message;
+}
+
+/** Formats an error message about 'name'. */
+static char* format_error(const char* format, const char* name)
+{
+    int length = snprintf(NULL, 0, format, name);
+    char* message = length >= 0 ? malloc((size_t)length + 1) : NULL;
+
+    if (message)
+        snprintf(message, (size_t)length + 1, format, name);
+
+    return message;
+}
+
+/** Writes the file of 'slot' of 'writer' directly, replacing the existing
+ * file the chain refused to open. Records the failed operation and its errno in the
+ * slot.
+ */
+static void uring_writer_write_directly(uring_writer_t* writer, uring_slot_t* slot)
+{
+    const char* data = writer->buffers +
+                       (size_t)(slot - writer->slots) * URING_WRITER_MAX_SIZE;
+    bool direct;
+
+    int fd = tree_open_file(
+        writer->tree, writer->cache, slot->path, &slot->node, &direct);
+    slot->error = fd == -1 ? errno : 0;
+    if (fd == -1)
+        return;
+
+    slot->failed_operation = URING_WRITE;
+
+    for (size_t written = 0; written != slot->size;)
+    {
+        ssize_t result = write(fd, data + written, slot->size - written);
+
+        if (result == -1 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+        {
+            slot->error = result == 0 ? EIO : errno;
+            close(fd);
+            return;
+        }
+
+        written += (size_t)result;
+    }
+
+    if (!tree_close_file(writer->tree, fd, &slot->node))
+    {
+        slot->error = errno;
+        slot->failed_operation = URING_RESTORE;
+    }
+}
+
+/** Ends the chain of 'slot' of 'writer', whose operations all completed, and
+ * frees the slot.
+ */
+static void uring_writer_end_slot(uring_writer_t* writer, uring_slot_t* slot)
+{
+    // The attributes were restored when the file was closed
+    if (slot->error == EEXIST && slot->failed_operation == URING_OPEN)
+        uring_writer_write_directly(writer, slot);
+    else if (slot->error == 0 &&
+        !tree_restore_file(writer->tree, writer->cache, slot->path, &slot->node))
+    {
+        slot->error = errno;
+        slot->failed_operation = URING_RESTORE;
+    }
+
+    if (slot->error != 0)
+    {
+        char* error_message;
+
+        if (slot->failed_operation == URING_OPEN)
+            error_message =
+                format_error("PPtar: Couldn't create file %s\n", slot->path);
+        else if (slot->failed_operation == URING_RESTORE)
+            error_message = format_error(
+                "PPtar: Couldn't restore attributes of %s\n", slot->path);
+        else
+            error_message =
+                format_error("PPtar: Write error: %s\n", strerror(slot->error));
+
+        uring_writer_fail(writer, slot->member_index, 9, error_message);
+    }
+
+    slot->busy = false;
+    writer->free_slots[writer->free_count++] = (size_t)(slot - writer->slots);
+}
+
+/** Processes the completions of 'writer' which arrived. */
+static void uring_writer_reap(uring_writer_t* writer)
+{
+    struct io_uring_cqe cqe;
+
+    while (uring_next_cqe(&writer->ring, &cqe))
+    {
+        uring_slot_t* slot = writer->slots + cqe.user_data / URING_OPERATION_COUNT;
+        unsigned operation = (unsigned)(cqe.user_data % URING_OPERATION_COUNT);
+        int result = cqe.res;
+
+        // A short write breaks the chain too
+        if (operation == URING_WRITE && result >= 0 && (size_t)result != slot->size)
+            result = -EIO;
+
+        // The operations after a failed one are canceled
+        if (result < 0 && slot->error == 0 && result != -ECANCELED)
+        {
+            slot->error = -result;
+            slot->failed_operation = operation;
+        }
+
+        if (--slot->pending == 0)
+            uring_writer_end_slot(writer, slot);
+    }
+}
+
+/** Submits the chains of 'writer' and waits for 'wait_count' completions.
+ * @return false on failure.
+ */
+static bool uring_writer_submit(uring_writer_t* writer, unsigned wait_count)
+{
+    writer->unsubmitted = 0;
+
+    if (!uring_submit(&writer->ring, wait_count))
+    {
+        // The chains in flight are lost, nothing is written anymore
+        uring_writer_fail(writer,
+                          0,
+                          9,
+                          format_error("PPtar: Write error: %s\n", strerror(errno)));
+        writer->free_count = URING_WRITER_SLOT_COUNT;
+        return false;
+    }
+
+    uring_writer_reap(writer);
+    return true;
+}
+
+/** Checks if a file called 'path' of 'path_length' with 'hash' is being
+ * written by 'writer'.
+ */
+static bool uring_writer_writing(const uring_writer_t* writer,
+                                 const char* path,
+                                 size_t path_length,
+                                 uint64_t hash)
+{
+    for (const uring_slot_t* i = writer->slots;
+         i != writer->slots + URING_WRITER_SLOT_COUNT;
+         ++i)
+        if (i->busy && i->hash == hash && strncmp(i->path, path, path_length) == 0 &&
+            i->path[path_length] == '\0')
+            return true;
+
+    return false;
+}
+
+/** Opens the working directory into the first direct descriptor of 'ring'
+ * and closes it, kernels before 5.15 ignore the descriptor index or refuse
+ * it.
+ * @return false if the kernel cannot open into direct descriptors, errno is
+ * set.
+ */
+static bool uring_writer_probe(uring_t* ring)
+{
+    struct io_uring_sqe* open = uring_get_sqe(ring);
+    open->opcode = IORING_OP_OPENAT;
+    open->fd = AT_FDCWD;
+    open->addr = (uintptr_t)".";
+    open->open_flags = O_RDONLY | O_DIRECTORY;
+    open->file_index = 1;
+
+    struct io_uring_cqe cqe;
+
+    if (!uring_submit(ring, 1) || !uring_next_cqe(ring, &cqe))
+        return false;
+
+    // A regular descriptor is installed if the index is ignored
+    if (cqe.res > 0)
+        close(cqe.res);
+
+    if (cqe.res != 0)
+    {
+        errno = cqe.res < 0 ? -cqe.res : EOPNOTSUPP;
+        return false;
+    }
+
+    struct io_uring_sqe* close = uring_get_sqe(ring);
+    close->opcode = IORING_OP_CLOSE;
+    close->file_index = 1;
+
+    if (!uring_submit(ring, 1) || !uring_next_cqe(ring, &cqe))
+        return false;
+
+    errno = -cqe.res;
+    return cqe.res == 0;
+}
+
+bool uring_writer_init(uring_writer_t* writer, tree_t* tree, tree_cache_t* cache)
+{
+    writer->buffers = aligned_alloc(URING_WRITER_ALIGNMENT,
+                                    URING_WRITER_SLOT_COUNT * URING_WRITER_MAX_SIZE);
+    if (!writer->buffers)
+        return false;
+
+    struct iovec buffers[URING_WRITER_SLOT_COUNT];
+
+    for (size_t i = 0; i != URING_WRITER_SLOT_COUNT; ++i)
+    {
+        buffers[i].iov_base = writer->buffers + i * URING_WRITER_MAX_SIZE;
+        buffers[i].iov_len = URING_WRITER_MAX_SIZE;
+    }
+
+    // Each chain takes up to one entry per operation
+    if (!uring_init(&writer->ring,
+                    (unsigned)(URING_WRITER_SLOT_COUNT * URING_OPERATION_COUNT)))
+    {
+        int error = errno;
+        free(writer->buffers);
+        errno = error;
+        return false;
+    }
+
+    if (!uring_register_buffers(
+            &writer->ring, buffers, (unsigned)URING_WRITER_SLOT_COUNT) ||
+        !uring_register_files(&writer->ring, (unsigned)URING_WRITER_SLOT_COUNT) ||
+        !uring_writer_probe(&writer->ring))
+    {
+        int error = errno;
+        uring_destroy(&writer->ring);
+        free(writer->buffers);
+        errno = error;
+        return false;
+    }
+
+    writer->tree = tree;
+    writer->cache = cache;
+
+    for (size_t i = 0; i != URING_WRITER_SLOT_COUNT; ++i)
+    {
+        writer->slots[i].path = NULL;
+        writer->slots[i].path_capacity = 0;
+        writer->slots[i].busy = false;
+        writer->free_slots[i] = URING_WRITER_SLOT_COUNT - 1 - i;
+    }
+
+    writer->free_count = URING_WRITER_SLOT_COUNT;
+    writer->current = 0;
+    writer->unsubmitted = 0;
+    writer->member_count = 0;
+    writer->failed = false;
+    writer->error_member_index = 0;
+    writer->error_code = 0;
+    writer->error_message = NULL;
+
+    return true;
+}
+
+char* uring_writer_begin(uring_writer_t* writer,
+                         const char* path,
+                         size_t path_length,
+                         const tree_node_t* node)
+{
+    uint64_t hash = hash_name(path, path_length);
+    size_t member_index = writer->member_count++;
+
+    // A file of the same name waits for the previous one
+    while (!writer->failed &&
+           (writer->free_count == 0 ||
+            uring_writer_writing(writer, path, path_length, hash)))
+        if (!uring_writer_submit(writer, 1))
+            break;
+
+    if (writer->failed)
+        return NULL;
+
+    size_t index = writer->free_slots[writer->free_count - 1];
+    uring_slot_t* slot = writer->slots + index;
+
+    if (slot->path_capacity < path_length + 1)
+    {
+        char* grown = realloc(slot->path, path_length + 1);
+        if (!grown)
+        {
+            uring_writer_fail(writer,
+                              member_index,
+                              2,
+                              format_error("PPtar: %s\n", "Out of memory"));
+            return NULL;
+        }
+
+        slot->path = grown;
+        slot->path_capacity = path_length + 1;
+    }
+
+    memcpy(slot->path, path, path_length);
+    slot->path[path_length] = '\0';
+
+    if (!tree_make_parent(writer->cache, slot->path))
+    {
+        uring_writer_fail(
+            writer,
+            member_index,
+            9,
+            format_error("PPtar: Couldn't create file %s\n", slot->path));
+        return NULL;
+    }
+
+    --writer->free_count;
+
+    slot->busy = true;
+    slot->hash = hash;
+    slot->node = *node;
+    slot->node.linkname = NULL;
+    slot->member_index = member_index;
+    slot->size = 0;
+    slot->pending = 0;
+    slot->failed_operation = URING_OPEN;
+    slot->error = 0;
+
+    writer->current = index;
+
+    return writer->buffers + index * URING_WRITER_MAX_SIZE;
+}
+
+/** Adds the operation 'opcode' of 'operation' on the direct descriptor of
+ * the slot 'index' of 'writer' to its chain.
+ * @return The submission entry.
+ */
+static struct io_uring_sqe* uring_writer_add(uring_writer_t* writer,
+                                             size_t index,
+                                             unsigned operation,
+                                             unsigned char opcode)
+{
+    // The ring has room for the chains of all slots
+    struct io_uring_sqe* sqe = uring_get_sqe(&writer->ring);
+
+    sqe->opcode = opcode;
+    sqe->user_data = index * URING_OPERATION_COUNT + operation;
+
+    if (operation != URING_CLOSE)
+        sqe->flags = IOSQE_IO_LINK;
+    if (operation != URING_OPEN && operation != URING_CLOSE)
+    {
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->fd = (int)index;
+    }
+
+    ++writer->slots[index].pending;
+
+    return sqe;
+}
+
+void uring_writer_end(uring_writer_t* writer, size_t size)
+{
+    size_t index = writer->current;
+    uring_slot_t* slot = writer->slots + index;
+    char* buffer = writer->buffers + index * URING_WRITER_MAX_SIZE;
+
+    slot->size = size;
+
+    struct io_uring_sqe* open =
+        uring_writer_add(writer, index, URING_OPEN, IORING_OP_OPENAT);
+    open->fd = AT_FDCWD;
+    open->addr = (uintptr_t)slot->path;
+    open->len = 0666;
+    // A direct descriptor is never inherited, O_CLOEXEC is refused. An
+    // existing file is replaced when the slot ends.
+    open->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW;
+    open->file_index = (uint32_t)index + 1;
+
+    if (size != 0)
+    {
+        struct io_uring_sqe* write =
+            uring_writer_add(writer, index, URING_WRITE, IORING_OP_WRITE_FIXED);
+        write->addr = (uintptr_t)buffer;
+        write->len = (uint32_t)size;
+        write->buf_index = (uint16_t)index;
+    }
+
+    if (writer->tree->sync == TREE_SYNC_FILE)
+        uring_writer_add(writer, index, URING_FSYNC, IORING_OP_FSYNC);
+
+    struct io_uring_sqe* close =
+        uring_writer_add(writer, index, URING_CLOSE, IORING_OP_CLOSE);
+    close->file_index = (uint32_t)index + 1;
+
+    if (++writer->unsubmitted == URING_WRITER_BATCH_SIZE)
+        uring_writer_submit(writer, 0);
+}
+
+bool uring_writer_wait(uring_writer_t* writer)
+{
+    while (writer->free_count != URING_WRITER_SLOT_COUNT)
+        if (!uring_writer_submit(writer, 1))
+            break;
+
+    return !writer->failed;
+}
+
+int uring_writer_finish(uring_writer_t* writer)
+{
+    uring_writer_wait(writer);
+
+    int error_code = writer->failed ? writer->error_code : 0;
+
+    if (writer->error_message)
+        fputs(writer->error_message, stderr);
+
+    for (size_t i = 0; i != URING_WRITER_SLOT_COUNT; ++i)
+        free(writer->slots[i].path);
+
+    free(writer->error_message);
+    uring_destroy(&writer->ring);
+    free(writer->buffers);
+
+    return error_code;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stats.h"
+#include "tree.h"
+#include "uring.h"
+
+/** Number of files written by an io_uring writer at once. */
+#define URING_WRITER_SLOT_COUNT ((size_t)64)
+
+/** Maximum size of a file written by an io_uring writer. */
+#define URING_WRITER_MAX_SIZE ((size_t)64 << 10)
+
+/** Number of files whose submissions are gathered before they are made. */
+#define URING_WRITER_BATCH_SIZE ((size_t)8)
+
+/** Small file being written by an io_uring writer. */
+typedef struct uring_slot
+{
+    bool busy;
+
+    // Kept for the next file of the slot
+    char* path;
+    size_t path_capacity;
+    uint64_t hash;
+    tree_node_t node;
+
+    // Sequence number of the member in the archive
+    size_t member_index;
+
+    size_t size;
+
+    // Operations not completed yet, the first failed one and its errno
+    unsigned pending;
+    unsigned failed_operation;
+    int error;
+} uring_slot_t;
+
+/** Writer of small extracted files through io_uring.
+ * Each file is opened, written, flushed if asked to and closed by one chain
+ * of linked operations using a direct descriptor and a registered buffer of
+ * its slot, so many files are written by one system call. Their attributes
+ * are restored once the chain completes.
+ * Files of the same name are written in archive order. Of all failures, the
+ * one of the earliest member in the archive is reported.
+ */
+typedef struct uring_writer
+{
+    uring_t ring;
+    tree_t* tree;
+    tree_cache_t* cache;
+
+    // Registered buffers of the slots, each of URING_WRITER_MAX_SIZE bytes
+    char* buffers;
+    uring_slot_t slots[URING_WRITER_SLOT_COUNT];
+
+    // Indices of the free slots
+    size_t free_slots[URING_WRITER_SLOT_COUNT];
+    size_t free_count;
+
+    // Slot of the file being filled and the chains not submitted yet
+    size_t current;
+    size_t unsubmitted;
+
+    size_t member_count;
+
+    // The earliest failure
+    bool failed;
+    size_t error_member_index;
+    int error_code;
+    char* error_message;
+} uring_writer_t;
+
+/** Creates 'writer' extracting into 'tree', creating the parent directories
+ * of the files with the help of 'cache'. Checks that the kernel opens files
+ * into direct descriptors, which it does since Linux 5.15.
+ * @return false if io_uring is not available or on failure, errno is set.
+ */
+bool uring_writer_init(uring_writer_t* writer, tree_t* tree, tree_cache_t* cache);
+
+/** Starts the file 'node' at 'path' of 'path_length'.
+ * @return The buffer of URING_WRITER_MAX_SIZE bytes to write the data of the
+ * file to or NULL if the writer failed already and reading should stop.
+ */
+char* uring_writer_begin(uring_writer_t* writer,
+                         const char* path,
+                         size_t path_length,
+                         const tree_node_t* node);
+
+/** Writes the 'size' bytes of the buffer of the file started last. */
+void uring_writer_end(uring_writer_t* writer, size_t size);
+
+/** Waits until all files are written.
+ * @return false if the writer failed.
+ */
+bool uring_writer_wait(uring_writer_t* writer);
+
+/** Waits until all files are written and frees the memory of 'writer'.
+ * Prints the error of the earliest failed member.
+ * @return The exit code of the failure or 0.
+ */
+int uring_writer_finish(uring_writer_t* writer);
@@ -0,0 +1,395 @@
+#include "verifier.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Maximum number of data bytes in one job. */
+#define VERIFIER_CHUNK_SIZE ((size_t)1 << 20)
+
+/** Records that the member 'member_index' called 'name' does not match,
+ * taking the ownership of the name.
+ * The mutex of 'verifier' has to be locked.
+ */
+static void verifier_mismatch(verifier_t* verifier, size_t member_index, char* name)
+{
+    if (verifier->mismatch_count == verifier->mismatch_capacity)
+    {
+        size_t capacity =
+            verifier->mismatch_capacity ? verifier->mismatch_capacity * 2 : 16;
+        verifier_mismatch_t* mismatches = realloc(
+            verifier->mismatches, sizeof(verifier_mismatch_t) * capacity);
+
+        if (!mismatches)
+        {
+            // Reported right away then
+            fprintf(stderr, "PPtar: %s: Contents differ\n", name);
+            free(name);
+            verifier->out_of_memory = true;
+            return;
+        }
+
+        verifier->mismatches = mismatches;
+        verifier->mismatch_capacity = capacity;
+    }
+
+    verifier_mismatch_t* mismatch =
+        verifier->mismatches + verifier->mismatch_count++;
+
+    mismatch->member_index = member_index;
+    mismatch->name = name;
+}
+
+/** Hashes 'job' into the current member of 'worker'.
+ * @return The name of the member if it ended and does not match, else NULL.
+ */
+static char* verifier_worker_process(verifier_worker_t* worker, verifier_job_t* job)
+{
+    // The worker keeps the name and the digest until the member ends
+    if (job->name)
+    {
+        free(worker->name);
+        worker->name = job->name;
+        worker->member_index = job->member_index;
+        memcpy(worker->digest, job->digest, sizeof(worker->digest));
+        sha256_init(&worker->hash);
+        job->name = NULL;
+    }
+
+    if (job->size != 0)
+        sha256_update(&worker->hash, job->data, job->size);
+
+    if (!job->last)
+        return NULL;
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_final(&worker->hash, digest);
+    ++worker->stats.files_verified;
+
+    if (memcmp(digest, worker->digest, sizeof(digest)) == 0)
+        return NULL;
+
+    char* name = worker->name;
+    worker->name = NULL;
+    return name;
+}
+
+/** Main function of a worker thread. */
+static void* verifier_worker_run(void* worker_void)
+{
+    verifier_worker_t* worker = worker_void;
+    verifier_t* verifier = worker->verifier;
+
+    pthread_mutex_lock(&verifier->mutex);
+
+    while (true)
+    {
+        while (!worker->head && !verifier->stopping)
+            pthread_cond_wait(&worker->not_empty, &verifier->mutex);
+
+        verifier_job_t* job = worker->head;
+        if (!job)
+            break;
+
+        worker->head = job->next;
+        if (!worker->head)
+            worker->tail = NULL;
+
+        pthread_mutex_unlock(&verifier->mutex);
+
+        char* mismatch = verifier_worker_process(worker, job);
+
+        pthread_mutex_lock(&verifier->mutex);
+
+        if (mismatch)
+            verifier_mismatch(verifier, worker->member_index, mismatch);
+
+        worker->queued -= job->capacity;
+        verifier->bytes_in_flight -= job->capacity;
+        pthread_cond_signal(&verifier->not_full);
+
+        free(job->name);
+        free(job->data);
+        free(job);
+    }
+
+    pthread_mutex_unlock(&verifier->mutex);
+
+    return NULL;
+}
+
+bool verifier_init(verifier_t* verifier,
+                   size_t worker_count,
+                   size_t max_bytes_in_flight)
+{
+    verifier->workers = malloc(sizeof(verifier_worker_t) * worker_count);
+    if (!verifier->workers)
+        return false;
+
+    pthread_mutex_init(&verifier->mutex, NULL);
+    pthread_cond_init(&verifier->not_full, NULL);
+
+    verifier->worker_count = 0;
+    verifier->bytes_in_flight = 0;
+    verifier->max_bytes_in_flight = max_bytes_in_flight;
+    verifier->stopping = false;
+    verifier->job = NULL;
+    verifier->job_worker = NULL;
+    verifier->member_remaining = 0;
+    verifier->member_count = 0;
+    verifier->mismatches = NULL;
+    verifier->mismatch_count = 0;
+    verifier->mismatch_capacity = 0;
+    verifier->out_of_memory = false;
+
+    for (; verifier->worker_count != worker_count; ++verifier->worker_count)
+    {
+        verifier_worker_t* worker = verifier->workers + verifier->worker_count;
+
+        worker->verifier = verifier;
+        worker->head = NULL;
+        worker->tail = NULL;
+        worker->queued = 0;
+        worker->member_index = 0;
+        worker->name = NULL;
+        stats_init(&worker->stats);
+        pthread_cond_init(&worker->not_empty, NULL);
+
+        if (pthread_create(&worker->thread, NULL, verifier_worker_run, worker) != 0)
+        {
+            pthread_cond_destroy(&worker->not_empty);
+            stats_destroy(&worker->stats);
+            verifier_finish(verifier, NULL);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Queues the current job of 'verifier' to its worker. */
+static void verifier_submit(verifier_t* verifier, bool last)
+{
+    verifier_job_t* job = verifier->job;
+    verifier_worker_t* worker = verifier->job_worker;
+
+    verifier->job = NULL;
+
+    if (!job)
+        return;
+
+    job->last = last;
+    job->next = NULL;
+
+    pthread_mutex_lock(&verifier->mutex);
+
+    if (worker->tail)
+        worker->tail->next = job;
+    else
+        worker->head = job;
+    worker->tail = job;
+
+    pthread_cond_signal(&worker->not_empty);
+    pthread_mutex_unlock(&verifier->mutex);
+}
+
+/** Allocates the next job of the current member with room for 'capacity'
+ * bytes, waiting until they fit in the pipeline.
+ */
+static void verifier_allocate(verifier_t* verifier, size_t capacity)
+{
+    pthread_mutex_lock(&verifier->mutex);
+
+    while (verifier->bytes_in_flight != 0 &&
+           verifier->bytes_in_flight + capacity > verifier->max_bytes_in_flight)
+        pthread_cond_wait(&verifier->not_full, &verifier->mutex);
+
+    verifier_job_t* job = malloc(sizeof(verifier_job_t));
+    char* data = capacity != 0 ? malloc(capacity) : NULL;
+
+    if (!job || (capacity != 0 && !data))
+    {
+        free(job);
+        free(data);
+        verifier->out_of_memory = true;
+        pthread_mutex_unlock(&verifier->mutex);
+        return;
+    }
+
+    verifier->bytes_in_flight += capacity;
+    verifier->job_worker->queued += capacity;
+
+    pthread_mutex_unlock(&verifier->mutex);
+
+    job->member_index = verifier->member_count - 1;
+    job->name = NULL;
+    job->data = data;
+    job->size = 0;
+    job->capacity = capacity;
+    job->last = false;
+
+    verifier->job = job;
+}
+
+void verifier_begin(verifier_t* verifier,
+                    const char* name,
+                    size_t name_length,
+                    const unsigned char* digest,
+                    uint64_t size)
+{
+    // The other workers are busy with the members before
+    pthread_mutex_lock(&verifier->mutex);
+
+    verifier->job_worker = verifier->workers;
+    for (verifier_worker_t* i = verifier->workers;
+         i != verifier->workers + verifier->worker_count;
+         ++i)
+        if (i->queued < verifier->job_worker->queued)
+            verifier->job_worker = i;
+
+    pthread_mutex_unlock(&verifier->mutex);
+
+    verifier->member_remaining = size;
+    ++verifier->member_count;
+
+    verifier_allocate(
+        verifier, size < VERIFIER_CHUNK_SIZE ? (size_t)size : VERIFIER_CHUNK_SIZE);
+
+    if (!verifier->job)
+        return;
+
+    verifier->job->name = malloc(name_length + 1);
+
+    if (!verifier->job->name)
+    {
+        pthread_mutex_lock(&verifier->mutex);
+        verifier->bytes_in_flight -= verifier->job->capacity;
+        verifier->job_worker->queued -= verifier->job->capacity;
+        verifier->out_of_memory = true;
+        pthread_mutex_unlock(&verifier->mutex);
+
+        free(verifier->job->data);
+        free(verifier->job);
+        verifier->job = NULL;
+        return;
+    }
+
+    memcpy(verifier->job->name, name, name_length);
+    verifier->job->name[name_length] = '\0';
+    memcpy(verifier->job->digest, digest, sizeof(verifier->job->digest));
+}
+
+void verifier_write(verifier_t* verifier, const char* data, size_t size)
+{
+    while (size != 0 && verifier->job)
+    {
+        verifier_job_t* job = verifier->job;
+
+        size_t chunk_size = job->capacity - job->size;
+        if (chunk_size > size)
+            chunk_size = size;
+
+        memcpy(job->data + job->size, data, chunk_size);
+        job->size += chunk_size;
+        data += chunk_size;
+        size -= chunk_size;
+        verifier->member_remaining -= chunk_size;
+
+        if (job->size == job->capacity && verifier->member_remaining != 0)
+        {
+            verifier_submit(verifier, false);
+            verifier_allocate(verifier,
+                              verifier->member_remaining < VERIFIER_CHUNK_SIZE
+                                  ? (size_t)verifier->member_remaining
+                                  : VERIFIER_CHUNK_SIZE);
+        }
+    }
+}
+
+void verifier_end(verifier_t* verifier)
+{
+    verifier_submit(verifier, true);
+}
+
+void verifier_cancel(verifier_t* verifier)
+{
+    verifier_job_t* job = verifier->job;
+    verifier->job = NULL;
+
+    if (!job)
+        return;
+
+    // The jobs queued before never complete the member
+    pthread_mutex_lock(&verifier->mutex);
+    verifier->bytes_in_flight -= job->capacity;
+    verifier->job_worker->queued -= job->capacity;
+    pthread_cond_signal(&verifier->not_full);
+    pthread_mutex_unlock(&verifier->mutex);
+
+    free(job->name);
+    free(job->data);
+    free(job);
+}
+
+/** Orders mismatches by their position in the archive. */
+static int compare_mismatches(const void* a_void, const void* b_void)
+{
+    const verifier_mismatch_t* a = a_void;
+    const verifier_mismatch_t* b = b_void;
+
+    return a->member_index < b->member_index   ? -1
+           : a->member_index > b->member_index ? 1
+                                               : 0;
+}
+
+int verifier_finish(verifier_t* verifier, stats_t* stats)
+{
+    verifier_submit(verifier, true);
+
+    pthread_mutex_lock(&verifier->mutex);
+    verifier->stopping = true;
+    for (verifier_worker_t* i = verifier->workers;
+         i != verifier->workers + verifier->worker_count;
+         ++i)
+        pthread_cond_signal(&i->not_empty);
+    pthread_mutex_unlock(&verifier->mutex);
+
+    for (verifier_worker_t* i = verifier->workers;
+         i != verifier->workers + verifier->worker_count;
+         ++i)
+    {
+        pthread_join(i->thread, NULL);
+        pthread_cond_destroy(&i->not_empty);
+        free(i->name);
+
+        if (stats)
+            stats_merge(stats, &i->stats);
+        stats_destroy(&i->stats);
+    }
+
+    if (verifier->mismatch_count != 0)
+        qsort(verifier->mismatches,
+              verifier->mismatch_count,
+              sizeof(verifier_mismatch_t),
+              compare_mismatches);
+
+    for (size_t i = 0; i != verifier->mismatch_count; ++i)
+    {
+        fprintf(
+            stderr, "PPtar: %s: Contents differ\n", verifier->mismatches[i].name);
+        free(verifier->mismatches[i].name);
+    }
+
+    if (verifier->out_of_memory)
+        fprintf(stderr, "PPtar: Out of memory, not all members were verified\n");
+
+    int error_code =
+        verifier->mismatch_count != 0 || verifier->out_of_memory ? 2 : 0;
+
+    free(verifier->mismatches);
+    free(verifier->workers);
+    pthread_cond_destroy(&verifier->not_full);
+    pthread_mutex_destroy(&verifier->mutex);
+
+    return error_code;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+#include "stats.h"
+
+/** Default number of hashing threads. */
+#define VERIFIER_DEFAULT_THREADS ((size_t)4)
+
+/** Default maximum of bytes read from the archive and not yet hashed. */
+#define VERIFIER_DEFAULT_MAX_BYTES_IN_FLIGHT ((size_t)64 << 20)
+
+/** Piece of work for a verifier worker: a part of one member. */
+typedef struct verifier_job
+{
+    struct verifier_job* next;
+
+    // Sequence number of the member in the archive
+    size_t member_index;
+
+    // Name of the member and its recorded digest, set for the first job of a
+    // member only
+    char* name;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+
+    char* data;
+    size_t size;
+    size_t capacity;
+
+    bool last;
+} verifier_job_t;
+
+/** Member whose data does not match its recorded digest. */
+typedef struct verifier_mismatch
+{
+    size_t member_index;
+    char* name;
+} verifier_mismatch_t;
+
+/** Hashing thread of a verifier with its own queue of jobs. */
+typedef struct verifier_worker
+{
+    struct verifier* verifier;
+    pthread_t thread;
+
+    verifier_job_t* head;
+    verifier_job_t* tail;
+    pthread_cond_t not_empty;
+
+    // Bytes of the queued jobs
+    size_t queued;
+
+    // Current member, its hash so far and its recorded digest
+    size_t member_index;
+    char* name;
+    sha256_t hash;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+
+    stats_t stats;
+} verifier_worker_t;
+
+/** Parallel verification of the digests of members.
+ * The reader thread slices the data of members into jobs, the workers hash
+ * them. All jobs of a member go to one worker, the one with the fewest bytes
+ * queued when the member starts. The number of bytes in flight is bounded, a
+ * full pipeline blocks the reader.
+ * The mismatches are reported in archive order at the end.
+ */
+typedef struct verifier
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+
+    verifier_worker_t* workers;
+    size_t worker_count;
+
+    size_t bytes_in_flight;
+    size_t max_bytes_in_flight;
+
+    bool stopping;
+
+    // Job being filled by the reader, its worker and the unsent member size
+    verifier_job_t* job;
+    verifier_worker_t* job_worker;
+    uint64_t member_remaining;
+    size_t member_count;
+
+    verifier_mismatch_t* mismatches;
+    size_t mismatch_count;
+    size_t mismatch_capacity;
+
+    // A job or a mismatch could not be allocated
+    bool out_of_memory;
+} verifier_t;
+
+/** Starts a verifier with 'worker_count' hashing threads.
+ * @return false on failure.
+ */
+bool verifier_init(verifier_t* verifier,
+                   size_t worker_count,
+                   size_t max_bytes_in_flight);
+
+/** Starts a member called 'name' of 'name_length' of 'size' bytes whose
+ * SHA-256 is recorded as 'digest'.
+ */
+void verifier_begin(verifier_t* verifier,
+                    const char* name,
+                    size_t name_length,
+                    const unsigned char* digest,
+                    uint64_t size);
+
+/** Appends 'size' bytes of 'data' to the current member. */
+void verifier_write(verifier_t* verifier, const char* data, size_t size);
+
+/** Ends the current member. */
+void verifier_end(verifier_t* verifier);
+
+/** Drops the current member, whose data ended early, without checking it. */
+void verifier_cancel(verifier_t* verifier);
+
+/** Waits for all jobs and stops the workers.
+ * Prints the members which do not match. Adds the statistics of the workers
+ * to 'stats' unless it is NULL.
+ * @return The exit code, 2 if a member does not match.
+ */
+int verifier_finish(verifier_t* verifier, stats_t* stats);
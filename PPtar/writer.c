@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include "writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+bool write_all(int fd, const char* data, size_t size)
+{
+    while (size != 0)
+    {
+        ssize_t written = write(fd, data, size);
+
+        if (written == -1 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        data += written;
+        size -= (size_t)written;
+    }
+
+    return true;
+}
+
+bool pwrite_all(int fd, const char* data, size_t size, off_t offset)
+{
+    while (size != 0)
+    {
+        ssize_t written = pwrite(fd, data, size, offset);
+
+        if (written == -1 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        data += written;
+        size -= (size_t)written;
+        offset += written;
+    }
+
+    return true;
+}
+
+bool pwrite_direct(int fd, const char* data, size_t size, off_t offset)
+{
+    size_t direct_size = 0;
+
+    if ((uintptr_t)data % WRITER_DIRECT_ALIGNMENT == 0 &&
+        (uint64_t)offset % WRITER_DIRECT_ALIGNMENT == 0)
+        direct_size = size / WRITER_DIRECT_ALIGNMENT * WRITER_DIRECT_ALIGNMENT;
+
+    if (!pwrite_all(fd, data, direct_size, offset))
+        return false;
+
+    if (direct_size == size)
+        return true;
+
+    // The flag is cleared for the unaligned rest only
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_DIRECT) == -1)
+        return false;
+
+    bool written = pwrite_all(fd,
+                              data + direct_size,
+                              size - direct_size,
+                              offset + (off_t)direct_size);
+
+    int error = errno;
+    bool restored = fcntl(fd, F_SETFL, flags) == 0;
+
+    if (!written)
+        errno = error;
+
+    return written && restored;
+}
+
+bool direct_writer_init(direct_writer_t* writer, size_t capacity)
+{
+    writer->fd = -1;
+    writer->offset = 0;
+    writer->buffer = aligned_alloc(WRITER_DIRECT_ALIGNMENT, capacity);
+    writer->capacity = capacity;
+    writer->fill = 0;
+
+    return writer->buffer != NULL;
+}
+
+void direct_writer_destroy(direct_writer_t* writer)
+{
+    free(writer->buffer);
+}
+
+void direct_writer_begin(direct_writer_t* writer, int fd)
+{
+    writer->fd = fd;
+    writer->offset = 0;
+    writer->fill = 0;
+}
+
+bool direct_writer_write(direct_writer_t* writer, const char* data, size_t size)
+{
+    while (size != 0)
+    {
+        size_t chunk = writer->capacity - writer->fill;
+        if (chunk > size)
+            chunk = size;
+
+        memcpy(writer->buffer + writer->fill, data, chunk);
+        writer->fill += chunk;
+        data += chunk;
+        size -= chunk;
+
+        if (writer->fill == writer->capacity)
+        {
+            if (!pwrite_all(
+                    writer->fd, writer->buffer, writer->fill, writer->offset))
+                return false;
+
+            writer->offset += (off_t)writer->fill;
+            writer->fill = 0;
+        }
+    }
+
+    return true;
+}
+
+bool direct_writer_end(direct_writer_t* writer)
+{
+    bool written =
+        pwrite_direct(writer->fd, writer->buffer, writer->fill, writer->offset);
+
+    writer->offset += (off_t)writer->fill;
+    writer->fill = 0;
+
+    return written;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/** Alignment of the data, offsets and sizes of writes bypassing the page
+ * cache.
+ */
+#define WRITER_DIRECT_ALIGNMENT ((size_t)4096)
+
+/** Default size of the buffer of a direct writer. */
+#define DIRECT_WRITER_DEFAULT_CAPACITY ((size_t)1 << 20)
+
+/** Writer of a file opened with O_DIRECT. The data is gathered in an aligned
+ * buffer and written in whole blocks.
+ */
+typedef struct direct_writer
+{
+    int fd;
+    off_t offset;
+
+    char* buffer;
+    size_t capacity;
+    size_t fill;
+} direct_writer_t;
+
+/** Writes all 'size' bytes of 'data' to 'fd'.
+ * @return false on failure, errno is set.
+ */
+bool write_all(int fd, const char* data, size_t size);
+
+/** Writes all 'size' bytes of 'data' to 'fd' at 'offset'.
+ * @return false on failure, errno is set.
+ */
+bool pwrite_all(int fd, const char* data, size_t size, off_t offset);
+
+/** Writes all 'size' bytes of 'data' to 'fd' opened with O_DIRECT at
+ * 'offset'. The whole blocks are written directly if 'data' and 'offset' are
+ * aligned, the rest through the page cache.
+ * @return false on failure, errno is set.
+ */
+bool pwrite_direct(int fd, const char* data, size_t size, off_t offset);
+
+/** Initializes 'writer' with a buffer of 'capacity' bytes, which has to be a
+ * multiple of WRITER_DIRECT_ALIGNMENT.
+ * @return false if out of memory.
+ */
+bool direct_writer_init(direct_writer_t* writer, size_t capacity);
+
+/** Frees the memory of 'writer'. */
+void direct_writer_destroy(direct_writer_t* writer);
+
+/** Starts writing the file 'fd' from its beginning. */
+void direct_writer_begin(direct_writer_t* writer, int fd);
+
+/** Appends 'size' bytes of 'data' to the file.
+ * @return false on failure, errno is set.
+ */
+bool direct_writer_write(direct_writer_t* writer, const char* data, size_t size);
+
+/** Writes the rest of the file.
+ * @return false on failure, errno is set.
+ */
+bool direct_writer_end(direct_writer_t* writer);
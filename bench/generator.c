@@ -0,0 +1,550 @@
+#include "generator.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compressor.h"
+#include "header.h"
+#include "reader.h"
+
+/** Size of the buffer of a generator and of its compressed chunks. */
+#define GENERATOR_BUFFER_SIZE ((size_t)1 << 20)
+
+/** Size of the text the data of the files is cut from. */
+#define GENERATOR_POOL_SIZE ((size_t)1 << 20)
+
+/** Number of files in a directory. */
+#define GENERATOR_DIRECTORY_SIZE ((size_t)1000)
+
+/** Modification time of all members. */
+#define GENERATOR_MTIME ((uint64_t)1700000000)
+
+/** Length of the names of the files of extended profiles. */
+#define GENERATOR_LONG_NAME_LENGTH ((size_t)200)
+
+const generator_profile_t generator_profiles[] = {
+    {"tiny", "1M files of up to 1 KiB", 1000000, 1024, false, 1, false, false},
+    {"huge", "3 files of 10 GiB", 3, (uint64_t)10 << 30, true, 0, false, true},
+    {"deep", "100k files 32 directories deep", 100000, 4096, false, 32, false,
+     false},
+    {"pax", "200k files with PAX headers", 200000, 4096, false, 1, true, false},
+};
+
+const size_t generator_profile_count =
+    sizeof(generator_profiles) / sizeof(generator_profiles[0]);
+
+/** Writer of a synthetic archive. */
+typedef struct generator
+{
+    int fd;
+
+    bool compressed;
+    compressor_t compressor;
+
+    // A chunk of the compressor if compressed
+    char* buffer;
+    size_t fill;
+
+    // State of the random numbers
+    uint64_t random;
+
+    // Text the data is cut from
+    char* pool;
+
+    // Names of the selected files or NULL
+    FILE* names;
+
+    generator_result_t* result;
+} generator_t;
+
+const generator_profile_t* generator_find_profile(const char* name)
+{
+    for (size_t i = 0; i != generator_profile_count; ++i)
+        if (strcmp(generator_profiles[i].name, name) == 0)
+            return generator_profiles + i;
+
+    return NULL;
+}
+
+/** Returns the next random number of 'generator', a splitmix64 sequence. */
+static uint64_t generator_random(generator_t* generator)
+{
+    uint64_t x = (generator->random += 0x9E3779B97F4A7C15);
+
+    x = (x ^ x >> 30) * 0xBF58476D1CE4E5B9;
+    x = (x ^ x >> 27) * 0x94D049BB133111EB;
+
+    return x ^ x >> 31;
+}
+
+/** Fills the pool of 'generator' with words, which compress about like text.
+ */
+static void generator_fill_pool(generator_t* generator)
+{
+    static const char* const words[] = {
+        "archive", "member", "header", "record", "block", "file", "data",
+        "the", "of", "a", "to", "and", "is", "in", "for", "with"};
+
+    size_t word_count = sizeof(words) / sizeof(words[0]);
+    size_t fill = 0;
+
+    while (fill != GENERATOR_POOL_SIZE)
+    {
+        uint64_t random = generator_random(generator);
+        const char* word = words[random % word_count];
+        size_t length = strlen(word);
+
+        if (length > GENERATOR_POOL_SIZE - fill - 1)
+            length = GENERATOR_POOL_SIZE - fill - 1;
+
+        memcpy(generator->pool + fill, word, length);
+        fill += length;
+        generator->pool[fill++] = random >> 32 & 0xF ? ' ' : '\n';
+    }
+}
+
+/** Writes the buffer of 'generator' out.
+ * @return false on failure, errno is set.
+ */
+static bool generator_flush(generator_t* generator)
+{
+    if (generator->compressed)
+    {
+        char* buffer = generator->buffer;
+        generator->buffer = NULL;
+
+        if (!compressor_submit(&generator->compressor, buffer, generator->fill))
+            return false;
+
+        if (!(generator->buffer = compressor_get_chunk(&generator->compressor)))
+        {
+            errno = ENOMEM;
+            return false;
+        }
+    }
+    else
+    {
+        for (size_t written = 0; written != generator->fill;)
+        {
+            ssize_t size = write(generator->fd,
+                                 generator->buffer + written,
+                                 generator->fill - written);
+
+            if (size == -1 && errno == EINTR)
+                continue;
+
+            if (size == -1)
+                return false;
+
+            written += (size_t)size;
+        }
+    }
+
+    generator->fill = 0;
+    return true;
+}
+
+/** Appends 'size' bytes of 'data', or zeros if it is NULL, to the archive of
+ * 'generator'. Takes the bytes from the pool at 'pool_offset' instead if
+ * 'data' is NULL and 'from_pool' is true.
+ * @return false on failure, errno is set.
+ */
+static bool generator_append(generator_t* generator,
+                             const void* data,
+                             uint64_t size,
+                             bool from_pool,
+                             size_t pool_offset)
+{
+    generator->result->archive_size += size;
+
+    while (size != 0)
+    {
+        if (generator->fill == GENERATOR_BUFFER_SIZE && !generator_flush(generator))
+            return false;
+
+        size_t chunk = GENERATOR_BUFFER_SIZE - generator->fill;
+        if (chunk > size)
+            chunk = (size_t)size;
+
+        if (from_pool && chunk > GENERATOR_POOL_SIZE - pool_offset)
+            chunk = GENERATOR_POOL_SIZE - pool_offset;
+
+        char* target = generator->buffer + generator->fill;
+
+        if (data)
+        {
+            memcpy(target, data, chunk);
+            data = (const char*)data + chunk;
+        }
+        else if (from_pool)
+        {
+            memcpy(target, generator->pool + pool_offset, chunk);
+            pool_offset = (pool_offset + chunk) % GENERATOR_POOL_SIZE;
+        }
+        else
+            memset(target, 0, chunk);
+
+        generator->fill += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+/** Appends the zeros after 'size' bytes of data up to the end of its last
+ * record.
+ * @return false on failure, errno is set.
+ */
+static bool generator_pad(generator_t* generator, uint64_t size)
+{
+    return generator_append(
+        generator, NULL, (RECORD_SIZE - size % RECORD_SIZE) % RECORD_SIZE, false, 0);
+}
+
+/** Splits 'name' of 'length' for a ustar header into a prefix of
+ * '*prefix_length' bytes, 0 for none, a slash and the rest.
+ * @return false if the name does not fit a header.
+ */
+static bool generator_split_name(const char* name,
+                                 size_t length,
+                                 size_t* prefix_length)
+{
+    *prefix_length = 0;
+
+    if (length <= sizeof(((header_t*)NULL)->name))
+        return true;
+
+    size_t slash = length > sizeof(((header_t*)NULL)->prefix) + 1
+                       ? sizeof(((header_t*)NULL)->prefix) + 1
+                       : length - 1;
+
+    while (slash != 0 && name[slash] != '/')
+        --slash;
+
+    if (slash == 0 || slash > sizeof(((header_t*)NULL)->prefix) ||
+        length - slash - 1 > sizeof(((header_t*)NULL)->name) ||
+        length - slash - 1 == 0)
+        return false;
+
+    *prefix_length = slash;
+    return true;
+}
+
+/** Appends the PAX record "<length> <key>=<value>\n" to 'records' of
+ * '*size' bytes, which have room for it.
+ */
+static void generator_add_record(char* records,
+                                 size_t* size,
+                                 const char* key,
+                                 const char* value,
+                                 size_t value_length)
+{
+    // The length counts its own digits
+    size_t base = strlen(key) + value_length + 3;
+    size_t record_length = base + 1;
+
+    for (size_t bound = 10; record_length >= bound; bound *= 10)
+        ++record_length;
+
+    *size += (size_t)sprintf(records + *size, "%zu %s=", record_length, key);
+    memcpy(records + *size, value, value_length);
+    *size += value_length;
+    records[(*size)++] = '\n';
+}
+
+/** Fills 'header' of a member 'name' of 'size' bytes and 'typeflag'. The
+ * first 'prefix_length' bytes of the name go to the prefix field.
+ */
+static void generator_fill_header(header_t* header,
+                                  const char* name,
+                                  size_t length,
+                                  size_t prefix_length,
+                                  char typeflag,
+                                  uint64_t size)
+{
+    memset(header, 0, sizeof(header_t));
+
+    if (prefix_length != 0)
+    {
+        memcpy(header->prefix, name, prefix_length);
+        name += prefix_length + 1;
+        length -= prefix_length + 1;
+    }
+
+    memcpy(header->name,
+           name,
+           length < sizeof(header->name) ? length : sizeof(header->name));
+    header_set_number(header->mode,
+                      sizeof(header->mode),
+                      typeflag == DIRTYPE ? 0755 : 0644);
+    header_set_number(header->uid, sizeof(header->uid), 1000);
+    header_set_number(header->gid, sizeof(header->gid), 1000);
+    header_set_number(header->size, sizeof(header->size), size);
+    header_set_number(header->mtime, sizeof(header->mtime), GENERATOR_MTIME);
+    header->typeflag = typeflag;
+    memcpy(header->magic, TMAGIC, sizeof(header->magic));
+    memcpy(header->version, TVERSION, sizeof(header->version));
+    memcpy(header->uname, "bench", sizeof("bench") - 1);
+    memcpy(header->gname, "bench", sizeof("bench") - 1);
+    header_set_number(header->devmajor, sizeof(header->devmajor), 0);
+    header_set_number(header->devminor, sizeof(header->devminor), 0);
+
+    // Six octal digits, a NUL and a space
+    header_set_number(header->chksum,
+                      sizeof(header->chksum) - 1,
+                      header_compute_checksum(header));
+    header->chksum[sizeof(header->chksum) - 1] = ' ';
+}
+
+/** Appends the member 'name' of 'length' with 'typeflag' and 'size' bytes of
+ * data from the pool to the archive of 'generator'. The member gets an
+ * extended header with its path and attributes if 'extended' is true or if
+ * its name does not fit a header.
+ * @return false on failure, errno is set.
+ */
+static bool generator_add_member(generator_t* generator,
+                                 const char* name,
+                                 size_t length,
+                                 char typeflag,
+                                 uint64_t size,
+                                 bool extended)
+{
+    size_t prefix_length;
+    bool fits = generator_split_name(name, length, &prefix_length);
+
+    header_t header;
+
+    if (!fits || extended)
+    {
+        char records[1024 + 2 * GENERATOR_LONG_NAME_LENGTH];
+        size_t records_size = 0;
+
+        char value[64];
+        int value_length;
+
+        generator_add_record(records, &records_size, "path", name, length);
+
+        if (extended)
+        {
+            value_length = snprintf(value,
+                                    sizeof(value),
+                                    "%llu.123456789",
+                                    (unsigned long long)GENERATOR_MTIME);
+            generator_add_record(
+                records, &records_size, "mtime", value, (size_t)value_length);
+            generator_add_record(
+                records, &records_size, "atime", value, (size_t)value_length);
+            generator_add_record(
+                records, &records_size, "ctime", value, (size_t)value_length);
+            generator_add_record(records, &records_size, "uname", "bench", 5);
+            generator_add_record(records, &records_size, "gname", "bench", 5);
+
+            value_length = snprintf(value,
+                                    sizeof(value),
+                                    "%016llx",
+                                    (unsigned long long)generator_random(generator));
+            generator_add_record(records,
+                                 &records_size,
+                                 "SCHILY.xattr.user.bench",
+                                 value,
+                                 (size_t)value_length);
+        }
+
+        generator_fill_header(&header,
+                              "././@PaxHeader",
+                              sizeof("././@PaxHeader") - 1,
+                              0,
+                              XHDTYPE,
+                              records_size);
+
+        if (!generator_append(generator, &header, sizeof(header), false, 0) ||
+            !generator_append(generator, records, records_size, false, 0) ||
+            !generator_pad(generator, records_size))
+            return false;
+
+        ++generator->result->member_count;
+
+        prefix_length = 0;
+        if (!fits)
+            length = sizeof(header.name);
+    }
+
+    generator_fill_header(&header, name, length, prefix_length, typeflag, size);
+
+    size_t pool_offset = (size_t)(generator_random(generator) % GENERATOR_POOL_SIZE);
+
+    if (!generator_append(generator, &header, sizeof(header), false, 0) ||
+        !generator_append(generator, NULL, size, true, pool_offset) ||
+        !generator_pad(generator, size))
+        return false;
+
+    ++generator->result->member_count;
+
+    return true;
+}
+
+/** Writes the directory of the file 'index' of 'profile' followed by a slash
+ * to 'path' and returns its length.
+ */
+static size_t generator_directory(const generator_profile_t* profile,
+                                  size_t index,
+                                  char* path)
+{
+    int length = sprintf(path, "%s/", profile->name);
+
+    for (size_t level = 0; level != profile->depth; ++level)
+        length += level == 0 ? sprintf(path + length,
+                                       "d%04zu/",
+                                       index / GENERATOR_DIRECTORY_SIZE)
+                             : sprintf(path + length, "l%02zu/", level);
+
+    return (size_t)length;
+}
+
+/** Appends the files of 'profile' scaled down 'scale' times and their
+ * directories to the archive of 'generator'. Writes every 'name_step'th name
+ * to the name list.
+ * @return false on failure, errno is set.
+ */
+static bool generator_add_files(generator_t* generator,
+                                const generator_profile_t* profile,
+                                size_t scale,
+                                size_t name_step)
+{
+    size_t file_count = profile->file_count;
+    uint64_t file_size = profile->file_size;
+
+    if (profile->scale_size)
+        file_size = file_size / scale ? file_size / scale : 1;
+    else
+        file_count = file_count / scale ? file_count / scale : 1;
+
+    // Room for the deepest directory and a long name
+    char path[64 * 8 + GENERATOR_LONG_NAME_LENGTH + 64];
+
+    for (size_t i = 0; i != file_count; ++i)
+    {
+        size_t directory_length = generator_directory(profile, i, path);
+
+        // Each directory comes before its first file, all of its parents with
+        // it
+        if (i % GENERATOR_DIRECTORY_SIZE == 0)
+        {
+            size_t start = i == 0 ? 0 : strlen(profile->name) + 1;
+
+            for (size_t end = start; end != directory_length; ++end)
+                if (path[end] == '/' &&
+                    !generator_add_member(
+                        generator, path, end + 1, DIRTYPE, 0, false))
+                    return false;
+        }
+
+        size_t length =
+            directory_length +
+            (size_t)sprintf(path + directory_length, "f%07zu", i);
+
+        // Long names are padded with a pattern
+        if (profile->extended)
+            for (; length - directory_length != GENERATOR_LONG_NAME_LENGTH; ++length)
+                path[length] = (char)('a' + length % 26);
+
+        uint64_t size =
+            profile->fixed_size ? file_size
+                                : generator_random(generator) % (file_size + 1);
+
+        if (!generator_add_member(
+                generator, path, length, REGTYPE, size, profile->extended))
+            return false;
+
+        ++generator->result->file_count;
+        generator->result->data_size += size;
+
+        if (generator->names && i % name_step == 0)
+        {
+            fwrite(path, 1, length, generator->names);
+            fputc('\n', generator->names);
+            ++generator->result->name_count;
+        }
+    }
+
+    // The end of the archive is two null blocks
+    return generator_append(generator, NULL, 2 * RECORD_SIZE, false, 0) &&
+           generator_flush(generator);
+}
+
+bool generator_write(const generator_profile_t* profile,
+                     size_t scale,
+                     int fd,
+                     compression_t compression,
+                     int names_fd,
+                     size_t name_step,
+                     generator_result_t* result)
+{
+    generator_t generator;
+
+    memset(result, 0, sizeof(*result));
+
+    generator.fd = fd;
+    generator.compressed = compression != COMPRESSION_NONE;
+    generator.fill = 0;
+    generator.random = 0x5EED;
+    generator.result = result;
+    generator.names = NULL;
+
+    long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (generator.compressed &&
+        !compressor_init(&generator.compressor,
+                         fd,
+                         compression,
+                         GENERATOR_BUFFER_SIZE,
+                         processor_count > 0 ? (size_t)processor_count : 1,
+                         NULL))
+        return false;
+
+    generator.buffer = generator.compressed
+                           ? compressor_get_chunk(&generator.compressor)
+                           : malloc(GENERATOR_BUFFER_SIZE);
+    generator.pool = malloc(GENERATOR_POOL_SIZE);
+
+    int names_copy = names_fd == -1 ? -1 : dup(names_fd);
+    if (names_copy != -1)
+        generator.names = fdopen(names_copy, "w");
+
+    bool success = generator.buffer && generator.pool &&
+                   (names_fd == -1 || generator.names);
+    if (!success)
+        errno = ENOMEM;
+
+    if (success)
+    {
+        generator_fill_pool(&generator);
+
+        success = generator_add_files(&generator, profile, scale, name_step) &&
+                  (!generator.compressed ||
+                   compressor_finish(&generator.compressor));
+    }
+
+    int error = errno;
+
+    if (generator.names && fclose(generator.names) != 0 && success)
+    {
+        error = errno;
+        success = false;
+    }
+    else if (!generator.names && names_copy != -1)
+        close(names_copy);
+
+    free(generator.buffer);
+
+    if (generator.compressed)
+        compressor_destroy(&generator.compressor);
+
+    free(generator.pool);
+
+    errno = error;
+    return success;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decompressor.h"
+
+/** Shape of a synthetic archive. */
+typedef struct generator_profile
+{
+    const char* name;
+    const char* description;
+
+    size_t file_count;
+
+    // Sizes of the files are uniform up to it unless they are all of it
+    uint64_t file_size;
+    bool fixed_size;
+
+    // Directories above each file
+    size_t depth;
+
+    // Every member has a PAX extended header with a long path and attributes
+    bool extended;
+
+    // The scale divides the size of the files instead of their number
+    bool scale_size;
+} generator_profile_t;
+
+/** Profiles of the benchmark archives. */
+extern const generator_profile_t generator_profiles[];
+extern const size_t generator_profile_count;
+
+/** Numbers of a written archive. */
+typedef struct generator_result
+{
+    // Members including directories and extended headers
+    uint64_t member_count;
+    uint64_t file_count;
+    uint64_t data_size;
+    uint64_t archive_size;
+
+    // Names written to the name list
+    uint64_t name_count;
+} generator_result_t;
+
+/** Returns the profile called 'name' or NULL. */
+const generator_profile_t* generator_find_profile(const char* name);
+
+/** Writes the archive of 'profile' scaled down 'scale' times to 'fd',
+ * compressed with 'compression'. The archive depends only on the profile and
+ * the scale. Writes the name of every 'name_step'th file and a newline to
+ * 'names_fd' unless it is -1. Fills '*result'.
+ * @return false on failure, errno is set.
+ */
+bool generator_write(const generator_profile_t* profile,
+                     size_t scale,
+                     int fd,
+                     compression_t compression,
+                     int names_fd,
+                     size_t name_step,
+                     generator_result_t* result);
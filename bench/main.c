@@ -0,0 +1,723 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compressor.h"
+#include "generator.h"
+#include "options.h"
+#include "runner.h"
+#include "stats.h"
+
+// PPtar of this build
+#ifndef PPTAR_BENCH_PPTAR
+    #define PPTAR_BENCH_PPTAR "PPtar"
+#endif
+
+/** Timed runs of PPtar on an archive. */
+typedef enum scenario
+{
+    // -t
+    SCENARIO_LIST,
+
+    // -x of all members
+    SCENARIO_EXTRACT,
+
+    // -x of the members of a name list
+    SCENARIO_SELECT,
+
+    // -t of the archive compressed
+    SCENARIO_COMPRESSED,
+
+    SCENARIO_COUNT
+} scenario_t;
+
+/** Names of the scenarios. */
+static const char* const scenario_names[SCENARIO_COUNT] = {
+    "list", "extract", "select", "compressed"};
+
+/** Structure containing command line options and arguments.
+ * Handles:
+ *  --pptar=<path>
+ *  --dir=<path>
+ *  --scale=<divisor>
+ *  --profile=<name>
+ *  --scenario=<name>
+ *  --repeat=<count>
+ *  --select-step=<count>
+ *  --format=text|json
+ *  --cold
+ *  --keep
+ *  free arguments, passed to PPtar
+ */
+typedef struct bench_options
+{
+    const char* pptar;
+
+    // Directory of the archives and of the extracted files, a new one in the
+    // working directory if NULL
+    const char* directory;
+
+    // The profiles are scaled down by it
+    size_t scale;
+
+    // Bits of the selected profiles and scenarios, all if 0
+    uint32_t profiles;
+    uint32_t scenarios;
+
+    size_t repeat;
+
+    // Every one of these files is in the name list of the select scenario
+    size_t select_step;
+
+    stats_format_t format;
+
+    // The archive is evicted from the page cache before each run
+    bool cold;
+
+    // The archives and the extracted files are left in the directory, which
+    // is removed otherwise if the benchmark created it
+    bool keep;
+
+    char* const* pptar_options;
+    size_t pptar_option_count;
+
+    int error_code;
+} bench_options_t;
+
+/** Parses a long option 'arg' of the form --name or --name=value. */
+static int parse_long_option(bench_options_t* options, const char* arg)
+{
+    const char* name = arg + 2;
+    const char* value = strchr(name, '=');
+    size_t name_length = value ? (size_t)(value - name) : strlen(name);
+
+    if (value)
+        ++value;
+
+    if (options_match(name, name_length, "pptar") && value && *value)
+        options->pptar = value;
+    else if (options_match(name, name_length, "dir") && value && *value)
+        options->directory = value;
+    else if (options_match(name, name_length, "profile") && value)
+    {
+        const generator_profile_t* profile = generator_find_profile(value);
+
+        if (!profile)
+        {
+            fprintf(stderr, "pptar_bench: unknown profile %s\n", arg);
+            return 2;
+        }
+
+        options->profiles |= (uint32_t)1 << (profile - generator_profiles);
+    }
+    else if (options_match(name, name_length, "scenario") && value)
+    {
+        size_t scenario = 0;
+
+        while (scenario != SCENARIO_COUNT &&
+               strcmp(scenario_names[scenario], value) != 0)
+            ++scenario;
+
+        if (scenario == SCENARIO_COUNT)
+        {
+            fprintf(stderr, "pptar_bench: unknown scenario %s\n", arg);
+            return 2;
+        }
+
+        options->scenarios |= (uint32_t)1 << scenario;
+    }
+    else if (options_match(name, name_length, "format") && value &&
+             strcmp(value, "text") == 0)
+        options->format = STATS_FORMAT_TEXT;
+    else if (options_match(name, name_length, "format") && value &&
+             strcmp(value, "json") == 0)
+        options->format = STATS_FORMAT_JSON;
+    else if (options_match(name, name_length, "cold") && !value)
+        options->cold = true;
+    else if (options_match(name, name_length, "keep") && !value)
+        options->keep = true;
+    else if (options_match(name, name_length, "scale") ||
+             options_match(name, name_length, "repeat") ||
+             options_match(name, name_length, "select-step"))
+    {
+        size_t* number = options_match(name, name_length, "scale")
+                             ? &options->scale
+                         : options_match(name, name_length, "repeat")
+                             ? &options->repeat
+                             : &options->select_step;
+
+        if (!options_parse_number(value, 1000000000, number))
+        {
+            fprintf(stderr, "pptar_bench: invalid number %s\n", arg);
+            return 2;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "pptar_bench: invalid option '%s'\n", arg);
+        return 2;
+    }
+
+    return 0;
+}
+
+/** Parses the command line arguments 'argv' of 'argc'. Arguments after "--"
+ * or not starting with "--" go to PPtar.
+ */
+static bench_options_t parse_arguments(int argc, char* const* argv)
+{
+    bench_options_t options;
+
+    options.pptar = PPTAR_BENCH_PPTAR;
+    options.directory = NULL;
+    options.scale = 1;
+    options.profiles = 0;
+    options.scenarios = 0;
+    options.repeat = 1;
+    options.select_step = 10;
+    options.format = STATS_FORMAT_JSON;
+    options.cold = false;
+    options.keep = false;
+    options.pptar_options = argv + argc;
+    options.pptar_option_count = 0;
+    options.error_code = 0;
+
+    int i = 1;
+
+    for (; i != argc && strncmp(argv[i], "--", 2) == 0; ++i)
+    {
+        if (argv[i][2] == '\0')
+        {
+            ++i;
+            break;
+        }
+
+        if ((options.error_code = parse_long_option(&options, argv[i])) != 0)
+            return options;
+    }
+
+    options.pptar_options = argv + i;
+    options.pptar_option_count = (size_t)(argc - i);
+
+    if (options.profiles == 0)
+        options.profiles = ((uint32_t)1 << generator_profile_count) - 1;
+
+    if (options.scenarios == 0)
+        options.scenarios = ((uint32_t)1 << SCENARIO_COUNT) - 1;
+
+    return options;
+}
+
+/** Removes the file at 'path' for nftw. */
+static int remove_entry(const char* path,
+                        const struct stat* stat,
+                        int type,
+                        struct FTW* ftw)
+{
+    (void)stat;
+    (void)type;
+    (void)ftw;
+
+    return remove(path);
+}
+
+/** Removes the tree at 'path' if there is one.
+ * @return false on failure, errno is set.
+ */
+static bool remove_tree(const char* path)
+{
+    struct stat path_stat;
+
+    if (lstat(path, &path_stat) != 0)
+        return errno == ENOENT;
+
+    return nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+/** Writes the archive of 'profile' to 'path', compressed with
+ * 'compression', and its name list to 'names_path' unless it is NULL.
+ * @return false on failure.
+ */
+static bool generate(const bench_options_t* options,
+                     const generator_profile_t* profile,
+                     const char* path,
+                     compression_t compression,
+                     const char* names_path,
+                     generator_result_t* result)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int names_fd =
+        names_path
+            ? open(names_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+            : -1;
+
+    uint64_t start = stats_now();
+    bool success = fd != -1 && (!names_path || names_fd != -1) &&
+                   generator_write(profile,
+                                   options->scale,
+                                   fd,
+                                   compression,
+                                   names_fd,
+                                   options->select_step,
+                                   result);
+    int error = errno;
+
+    if (names_fd != -1)
+        close(names_fd);
+    if (fd != -1 && close(fd) != 0 && success)
+    {
+        error = errno;
+        success = false;
+    }
+
+    if (!success)
+    {
+        fprintf(
+            stderr, "pptar_bench: %s: Cannot write: %s\n", path, strerror(error));
+        return false;
+    }
+
+    fprintf(stderr,
+            "pptar_bench: %s: %" PRIu64 " files, %" PRIu64
+            " bytes of data in %.3f s\n",
+            path,
+            result->file_count,
+            result->data_size,
+            (double)(stats_now() - start) / 1e9);
+
+    return true;
+}
+
+/** Evicts the file at 'path' from the page cache. */
+static void evict(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/** Returns the time of 'time' in nanoseconds. */
+static uint64_t timeval_ns(const struct timeval* time)
+{
+    return (uint64_t)time->tv_sec * 1000000000 + (uint64_t)time->tv_usec * 1000;
+}
+
+/** Reads the last line of the file 'path' which is a JSON object into
+ * 'line' of 'size', an empty string if there is none. Copies the other lines
+ * to the error output if 'echo' is true.
+ */
+static void read_errors(const char* path, bool echo, char* line, size_t size)
+{
+    line[0] = '\0';
+
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return;
+
+    char* read_line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+
+    while ((length = getline(&read_line, &capacity, file)) != -1)
+    {
+        if (read_line[0] == '{' && (size_t)length < size)
+        {
+            memcpy(line, read_line, (size_t)length);
+            line[length && read_line[length - 1] == '\n' ? length - 1 : length] =
+                '\0';
+        }
+        else if (echo)
+            fputs(read_line, stderr);
+    }
+
+    free(read_line);
+    fclose(file);
+}
+
+/** Prints the 'run'th measurement of 'scenario' on the archive of 'profile'
+ * in the format of 'options'. 'input_size' bytes, the archive of 'result',
+ * were read. 'stats' are the statistics of PPtar, an empty string if there
+ * are none.
+ */
+static void report(const bench_options_t* options,
+                   const generator_profile_t* profile,
+                   scenario_t scenario,
+                   size_t run,
+                   const generator_result_t* result,
+                   uint64_t input_size,
+                   const measurement_t* measurement,
+                   const char* stats)
+{
+    const struct rusage* usage = &measurement->usage;
+    double seconds = (double)measurement->wall_time / 1e9;
+    double throughput =
+        seconds > 0 ? (double)result->archive_size / seconds / (1 << 20) : 0;
+
+    if (options->format == STATS_FORMAT_JSON)
+    {
+        printf("{\"profile\":\"%s\",\"scenario\":\"%s\",\"run\":%zu"
+               ",\"scale\":%zu,\"status\":%d,\"members\":%" PRIu64
+               ",\"files\":%" PRIu64 ",\"data_bytes\":%" PRIu64
+               ",\"archive_bytes\":%" PRIu64 ",\"input_bytes\":%" PRIu64
+               ",\"wall_ns\":%" PRIu64 ",\"user_ns\":%" PRIu64
+               ",\"system_ns\":%" PRIu64 ",\"throughput_mib_s\":%.1f"
+               ",\"max_rss_kib\":%ld,\"minor_faults\":%ld,\"major_faults\":%ld"
+               ",\"voluntary_switches\":%ld,\"involuntary_switches\":%ld",
+               profile->name,
+               scenario_names[scenario],
+               run,
+               options->scale,
+               measurement->status,
+               result->member_count,
+               result->file_count,
+               result->data_size,
+               result->archive_size,
+               input_size,
+               measurement->wall_time,
+               timeval_ns(&usage->ru_utime),
+               timeval_ns(&usage->ru_stime),
+               throughput,
+               usage->ru_maxrss,
+               usage->ru_minflt,
+               usage->ru_majflt,
+               usage->ru_nvcsw,
+               usage->ru_nivcsw);
+
+        if (measurement->has_io)
+            printf(",\"io\":{\"read_calls\":%" PRIu64 ",\"write_calls\":%" PRIu64
+                   ",\"read_chars\":%" PRIu64 ",\"written_chars\":%" PRIu64
+                   ",\"storage_read\":%" PRIu64 ",\"storage_written\":%" PRIu64
+                   "}",
+                   measurement->read_calls,
+                   measurement->write_calls,
+                   measurement->read_chars,
+                   measurement->written_chars,
+                   measurement->storage_read,
+                   measurement->storage_written);
+        else
+            printf(",\"io\":null");
+
+        printf(",\"stats\":%s}\n", stats[0] ? stats : "null");
+    }
+    else
+    {
+        printf("%-6s %-10s #%zu: %8.3f s %9.1f MiB/s, user %.3f s, sys %.3f s, "
+               "rss %ld KiB",
+               profile->name,
+               scenario_names[scenario],
+               run,
+               seconds,
+               throughput,
+               (double)timeval_ns(&usage->ru_utime) / 1e9,
+               (double)timeval_ns(&usage->ru_stime) / 1e9,
+               usage->ru_maxrss);
+
+        if (measurement->has_io)
+            printf(", %" PRIu64 " reads, %" PRIu64 " writes",
+                   measurement->read_calls,
+                   measurement->write_calls);
+
+        if (measurement->status != 0)
+            printf(", exit code %d", measurement->status);
+
+        printf("\n");
+    }
+
+    fflush(stdout);
+}
+
+/** Paths of the files of a profile. */
+typedef struct profile_paths
+{
+    char archive[PATH_MAX];
+    char compressed[PATH_MAX];
+    char names[PATH_MAX];
+    char output[PATH_MAX];
+    char errors[PATH_MAX];
+} profile_paths_t;
+
+/** Writes the path of the file of 'profile' with 'suffix' in 'directory' to
+ * 'path' of PATH_MAX bytes.
+ * @return false if it does not fit.
+ */
+static bool profile_path(char* path,
+                         const char* directory,
+                         const generator_profile_t* profile,
+                         const char* suffix)
+{
+    int length =
+        snprintf(path, PATH_MAX, "%s/%s%s", directory, profile->name, suffix);
+
+    return length >= 0 && length < PATH_MAX;
+}
+
+/** Runs 'scenario' 'options->repeat' times on the archive 'paths' of
+ * 'profile' and 'result'. 'compressed_size' is the size of the compressed
+ * archive.
+ * @return The exit code.
+ */
+static int run_scenario(const bench_options_t* options,
+                        const generator_profile_t* profile,
+                        scenario_t scenario,
+                        const profile_paths_t* paths,
+                        const generator_result_t* result,
+                        uint64_t compressed_size)
+{
+    const char* archive =
+        scenario == SCENARIO_COMPRESSED ? paths->compressed : paths->archive;
+
+    // The program, the mode, the archive, a name list, the statistics, the
+    // options and the end
+    size_t argument_count = 0;
+    char** argv = malloc(sizeof(char*) * (options->pptar_option_count + 8));
+    if (!argv)
+    {
+        fprintf(stderr, "pptar_bench: Out of memory\n");
+        return 2;
+    }
+
+    argv[argument_count++] = (char*)options->pptar;
+    argv[argument_count++] =
+        scenario == SCENARIO_EXTRACT || scenario == SCENARIO_SELECT ? "-x" : "-t";
+    argv[argument_count++] = "-f";
+    argv[argument_count++] = (char*)archive;
+
+    if (scenario == SCENARIO_SELECT)
+    {
+        argv[argument_count++] = "-T";
+        argv[argument_count++] = (char*)paths->names;
+    }
+
+    argv[argument_count++] = "--stats=json";
+
+    for (size_t i = 0; i != options->pptar_option_count; ++i)
+        argv[argument_count++] = options->pptar_options[i];
+
+    argv[argument_count] = NULL;
+
+    int return_code = 0;
+
+    for (size_t run = 0; run != options->repeat; ++run)
+    {
+        // Every run starts from an empty directory
+        if (!remove_tree(paths->output) || mkdir(paths->output, 0755) != 0)
+        {
+            fprintf(stderr,
+                    "pptar_bench: %s: Cannot create: %s\n",
+                    paths->output,
+                    strerror(errno));
+            return_code = 2;
+            break;
+        }
+
+        if (options->cold)
+            evict(archive);
+
+        measurement_t measurement;
+
+        if (!runner_run(argv, paths->output, paths->errors, &measurement))
+        {
+            fprintf(stderr,
+                    "pptar_bench: %s: Cannot run: %s\n",
+                    options->pptar,
+                    strerror(errno));
+            return_code = 2;
+            break;
+        }
+
+        char stats[4096];
+        read_errors(paths->errors, measurement.status != 0, stats, sizeof(stats));
+
+        report(options,
+               profile,
+               scenario,
+               run,
+               result,
+               scenario == SCENARIO_COMPRESSED ? compressed_size
+                                               : result->archive_size,
+               &measurement,
+               stats);
+
+        if (measurement.status != 0)
+            return_code = 1;
+    }
+
+    free(argv);
+    return return_code;
+}
+
+/** Generates the archives of 'profile' in 'directory' and runs the
+ * scenarios of 'options' on them, compressing with 'compression'.
+ * @return The exit code.
+ */
+static int run_profile(const bench_options_t* options,
+                       const generator_profile_t* profile,
+                       const char* directory,
+                       compression_t compression)
+{
+    profile_paths_t paths;
+
+    const char* suffix = compression == COMPRESSION_GZIP ? ".tar.gz" : ".tar.zst";
+
+    if (!profile_path(paths.archive, directory, profile, ".tar") ||
+        !profile_path(paths.compressed, directory, profile, suffix) ||
+        !profile_path(paths.names, directory, profile, ".names") ||
+        !profile_path(paths.output, directory, profile, ".out") ||
+        !profile_path(paths.errors, directory, profile, ".err"))
+    {
+        fprintf(stderr, "pptar_bench: %s: File name too long\n", directory);
+        return 2;
+    }
+
+    bool compressing = options->scenarios & 1 << SCENARIO_COMPRESSED &&
+                       compression != COMPRESSION_NONE;
+
+    generator_result_t result;
+    generator_result_t compressed_result;
+    struct stat compressed_stat;
+
+    if (!generate(options,
+                  profile,
+                  paths.archive,
+                  COMPRESSION_NONE,
+                  paths.names,
+                  &result) ||
+        (compressing && (!generate(options,
+                                   profile,
+                                   paths.compressed,
+                                   compression,
+                                   NULL,
+                                   &compressed_result) ||
+                         stat(paths.compressed, &compressed_stat) != 0)))
+        return 2;
+
+    int return_code = 0;
+
+    for (size_t scenario = 0; scenario != SCENARIO_COUNT; ++scenario)
+    {
+        if (!(options->scenarios & 1 << scenario) ||
+            (scenario == SCENARIO_COMPRESSED && !compressing))
+            continue;
+
+        int scenario_code =
+            run_scenario(options,
+                         profile,
+                         (scenario_t)scenario,
+                         &paths,
+                         &result,
+                         compressing ? (uint64_t)compressed_stat.st_size : 0);
+
+        if (scenario_code > return_code)
+            return_code = scenario_code;
+    }
+
+    if (!options->keep)
+    {
+        remove_tree(paths.output);
+        unlink(paths.archive);
+        unlink(paths.names);
+        unlink(paths.errors);
+
+        if (compressing)
+            unlink(paths.compressed);
+    }
+
+    return return_code;
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options_t options = parse_arguments(argc, argv);
+
+    if (options.error_code != 0)
+        return options.error_code;
+
+    // The runs change directories
+    char directory[PATH_MAX];
+    char template[] = "pptar_bench.XXXXXX";
+    const char* path = options.directory;
+
+    // Only a directory created here is removed, a given one may be in use
+    bool created;
+
+    if (path)
+        created = mkdir(path, 0755) == 0;
+    else
+    {
+        path = template;
+        created = mkdtemp(template) != NULL;
+    }
+
+    if ((!created && (path == template || errno != EEXIST)) ||
+        !realpath(path, directory))
+    {
+        fprintf(stderr,
+                "pptar_bench: %s: Cannot create: %s\n",
+                path,
+                strerror(errno));
+        return 2;
+    }
+
+    char pptar[PATH_MAX];
+
+    if (!realpath(options.pptar, pptar))
+    {
+        fprintf(stderr,
+                "pptar_bench: %s: Cannot find: %s\n",
+                options.pptar,
+                strerror(errno));
+        return 2;
+    }
+
+    options.pptar = pptar;
+
+    compression_t compression = COMPRESSION_NONE;
+
+    if (compressor_is_supported(COMPRESSION_GZIP) &&
+        compression_is_supported(COMPRESSION_GZIP))
+        compression = COMPRESSION_GZIP;
+    else if (compressor_is_supported(COMPRESSION_ZSTD) &&
+             compression_is_supported(COMPRESSION_ZSTD))
+        compression = COMPRESSION_ZSTD;
+    else if (options.scenarios & 1 << SCENARIO_COMPRESSED)
+        fprintf(stderr,
+                "pptar_bench: Compression is not supported by this build, "
+                "skipping the compressed scenario\n");
+
+    int return_code = 0;
+
+    for (size_t i = 0; i != generator_profile_count; ++i)
+    {
+        if (!(options.profiles & (uint32_t)1 << i))
+            continue;
+
+        int profile_code =
+            run_profile(&options, generator_profiles + i, directory, compression);
+
+        if (profile_code > return_code)
+            return_code = profile_code;
+    }
+
+    if (!options.keep && created)
+        rmdir(directory);
+    else if (!options.directory)
+        fprintf(stderr, "pptar_bench: The files are kept in %s\n", directory);
+
+    return return_code;
+}
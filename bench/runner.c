@@ -0,0 +1,113 @@
+#include "runner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+/** Points the descriptor 'target' of the child at 'path' opened with 'flags'.
+ * @return false on failure.
+ */
+static bool runner_redirect(int target, const char* path, int flags)
+{
+    int fd = open(path, flags | O_CLOEXEC, 0644);
+
+    return fd != -1 && dup2(fd, target) != -1;
+}
+
+/** Reads the I/O counters of the process 'pid', which exited and was not
+ * reaped yet, into 'measurement'.
+ */
+static void runner_read_io(pid_t pid, measurement_t* measurement)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return;
+
+    char line[128];
+    size_t found = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char key[32];
+        uint64_t value;
+
+        if (sscanf(line, "%31[^:]: %" SCNu64, key, &value) != 2)
+            continue;
+
+        if (strcmp(key, "syscr") == 0)
+            measurement->read_calls = value;
+        else if (strcmp(key, "syscw") == 0)
+            measurement->write_calls = value;
+        else if (strcmp(key, "rchar") == 0)
+            measurement->read_chars = value;
+        else if (strcmp(key, "wchar") == 0)
+            measurement->written_chars = value;
+        else if (strcmp(key, "read_bytes") == 0)
+            measurement->storage_read = value;
+        else if (strcmp(key, "write_bytes") == 0)
+            measurement->storage_written = value;
+        else
+            continue;
+
+        ++found;
+    }
+
+    fclose(file);
+
+    measurement->has_io = found == 6;
+}
+
+bool runner_run(char* const* argv,
+                const char* directory,
+                const char* error_path,
+                measurement_t* measurement)
+{
+    memset(measurement, 0, sizeof(*measurement));
+
+    uint64_t start = stats_now();
+    pid_t pid = fork();
+
+    if (pid == -1)
+        return false;
+
+    if (pid == 0)
+    {
+        if (chdir(directory) != 0 ||
+            !runner_redirect(STDIN_FILENO, "/dev/null", O_RDONLY) ||
+            !runner_redirect(STDOUT_FILENO, "/dev/null", O_WRONLY) ||
+            !runner_redirect(
+                STDERR_FILENO, error_path, O_WRONLY | O_CREAT | O_TRUNC))
+            _exit(126);
+
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    // The counters go away with the process, it is left a zombie to read them
+    siginfo_t info;
+    while (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) != 0)
+        if (errno != EINTR)
+            return false;
+
+    measurement->wall_time = stats_now() - start;
+    runner_read_io(pid, measurement);
+
+    int status;
+    while (wait4(pid, &status, 0, &measurement->usage) == -1)
+        if (errno != EINTR)
+            return false;
+
+    measurement->status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                            : 128 + WTERMSIG(status);
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/** Resources used by a finished process. */
+typedef struct measurement
+{
+    // Exit code, 128 plus the signal if it was killed
+    int status;
+
+    uint64_t wall_time;
+
+    // The peak resident set includes the runner's from before the exec
+    struct rusage usage;
+
+    // Counters of /proc/<pid>/io, of all threads
+    bool has_io;
+    uint64_t read_calls;
+    uint64_t write_calls;
+    uint64_t read_chars;
+    uint64_t written_chars;
+    uint64_t storage_read;
+    uint64_t storage_written;
+} measurement_t;
+
+/** Runs 'argv' in 'directory' with the standard input and output at
+ * /dev/null and the error output in the file 'error_path' and measures it
+ * into '*measurement'.
+ * @return false if the process could not be started, errno is set.
+ */
+bool runner_run(char* const* argv,
+                const char* directory,
+                const char* error_path,
+                measurement_t* measurement);
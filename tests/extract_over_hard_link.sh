@@ -0,0 +1,33 @@
+#!/bin/sh
+# A member extracted over a hard link replaces it, the other names of the
+# link keep their data.
+# Usage: extract_over_hard_link.sh PPTAR
+
+set -e
+
+pptar=$(realpath "$1")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+# Identical files are archived as a hard link, the updated one is appended
+mkdir hd
+echo same > hd/a
+echo same > hd/b
+touch -t 202001010000 hd/a hd/b
+"$pptar" -c --dedup -f dedup.tar hd
+echo changed > hd/b
+"$pptar" -u -f dedup.tar hd
+
+for mode in "" --direct --io=uring --dedup --threads=4
+do
+    rm -rf out
+    mkdir out
+    (cd out && "$pptar" -x $mode -f ../dedup.tar)
+
+    if [ "$(cat out/hd/a)" != same ] || [ "$(cat out/hd/b)" != changed ]
+    then
+        echo "-x $mode: a=$(cat out/hd/a) b=$(cat out/hd/b)" >&2
+        exit 1
+    fi
+done
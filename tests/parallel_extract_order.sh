@@ -0,0 +1,82 @@
+#!/bin/sh
+# Extracting with threads gives the same tree, errors and exit code as a
+# serial extraction for members which depend on each other's paths.
+# Usage: parallel_extract_order.sh PPTAR
+
+set -e
+
+pptar=$(realpath "$1")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+# A large first member keeps its worker busy while the others go on
+python3 - <<'PYTHON'
+import io
+import tarfile
+
+def add(archive, name, kind=tarfile.REGTYPE, data=b"", linkname=""):
+    info = tarfile.TarInfo(name)
+    info.type = kind
+    info.linkname = linkname
+    info.size = len(data) if kind == tarfile.REGTYPE else 0
+    info.mode = 0o755 if kind == tarfile.DIRTYPE else 0o644
+    info.mtime = 1700000000
+    archive.addfile(info, io.BytesIO(data) if info.size else None)
+
+archives = {
+    # A member beneath a symlink extracted before is not written through it
+    "symlink": [("target/", tarfile.DIRTYPE, b"", ""),
+                ("link", tarfile.SYMTYPE, b"", "target"),
+                ("link/payload", tarfile.REGTYPE, b"payload\n", "")],
+    # Each link needs the one before it
+    "chain": [("a", tarfile.REGTYPE, b"a\n" * (4 << 20), ""),
+              ("b", tarfile.LNKTYPE, b"", "a"),
+              ("c", tarfile.LNKTYPE, b"", "b"),
+              ("d", tarfile.LNKTYPE, b"", "c")],
+    # A file replaces the link extracted before it in its place
+    "replaced": [("a", tarfile.REGTYPE, b"a\n" * (4 << 20), ""),
+                 ("b", tarfile.LNKTYPE, b"", "a"),
+                 ("b", tarfile.REGTYPE, b"b\n", "")],
+}
+
+for name, members in archives.items():
+    with tarfile.open(name + ".tar", "w", format=tarfile.GNU_FORMAT) as archive:
+        for member in members:
+            add(archive, member[0], member[1], member[2], member[3])
+PYTHON
+
+# Writes the types, link counts, symlink targets and contents of the tree
+describe() {
+    (cd "$1" && find . -printf '%p %y %n %l\n' | sort &&
+        find . -type f -exec cksum {} + | sort)
+}
+
+for archive in symlink chain replaced
+do
+    rm -rf serial
+    mkdir serial
+    status=0
+    (cd serial && "$pptar" -x -f "../$archive.tar") 2>serial.err || status=$?
+    describe serial >serial.tree
+
+    for run in 1 2 3 4 5 6 7 8 9 10
+    do
+        rm -rf parallel
+        mkdir parallel
+        parallel_status=0
+        (cd parallel && "$pptar" -x --threads=4 -f "../$archive.tar") \
+            2>parallel.err || parallel_status=$?
+        describe parallel >parallel.tree
+
+        if [ $status != $parallel_status ] ||
+            ! cmp -s serial.err parallel.err ||
+            ! cmp -s serial.tree parallel.tree
+        then
+            echo "$archive: exit $parallel_status instead of $status" >&2
+            diff serial.err parallel.err >&2 || true
+            diff serial.tree parallel.tree >&2 || true
+            exit 1
+        fi
+    done
+done